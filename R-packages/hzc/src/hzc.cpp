@@ -21,6 +21,8 @@ using zmq::context_t;
 using proto::common::Value;
 using proto::historian::IndexedValue;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
+using proto::historian::SessionLog;
 using proto::historian::Record;
 
 using historian::DbReactorClient;
@@ -182,3 +184,76 @@ RcppExport SEXP hzc_query(SEXP connectionHandle,
   }
 }
 
+
+
+/**
+ * Visitor collecting the sessions of a catalog query.
+ */
+class CatalogVisitor : public historian::Visitor {
+
+ public:
+  virtual bool operator()(const Record& data)
+  {
+    using namespace proto::historian;
+    optional<SessionLog> log = as<SessionLog>(data);
+    if (log) {
+      symbols.push_back(log->symbol());
+      starts.push_back(static_cast<double>(log->start_timestamp()) / 1000000.);
+      stops.push_back(static_cast<double>(log->stop_timestamp()) / 1000000.);
+      records.push_back(log->has_records() ?
+                        static_cast<double>(log->records()) : NA_REAL);
+      sources.push_back(log->source());
+    }
+    return true;
+  }
+
+  std::vector<string> symbols;
+  NumericVector starts;
+  NumericVector stops;
+  NumericVector records;
+  std::vector<string> sources;
+};
+
+RcppExport SEXP hzc_catalog(SEXP connectionHandle,
+                            SEXP symbol, SEXP rStart, SEXP rStop,
+                            SEXP est)
+{
+  List handleList(connectionHandle);
+  XPtr<DbReactorClient> clientPtr(handleList["clientPtr"],
+                                  R_NilValue, R_NilValue);
+  bool ok = as<bool>(handleList["connected"]);
+  if (!ok) {
+    return R_NilValue;
+  }
+
+  bool asEastern = as<bool>(est);
+  QueryCatalog q;
+  string qSymbol = as<string>(symbol);
+  if (qSymbol.length() > 0) {
+    q.set_symbol(qSymbol);
+  }
+  string qStart = as<string>(rStart);
+  string qStop = as<string>(rStop);
+  ptime utcStart, utcStop;
+  if (qStart.length() > 0 && historian::parse(qStart, &utcStart, asEastern)) {
+    q.set_utc_first_micros(historian::as_micros(utcStart));
+  }
+  if (qStop.length() > 0 && historian::parse(qStop, &utcStop, asEastern)) {
+    q.set_utc_last_micros(historian::as_micros(utcStop));
+  }
+
+  CatalogVisitor visitor;
+  int count = clientPtr->Query(q, &visitor);
+  Rprintf("%d sessions.\n", count);
+
+  if (count > 0) {
+    return List::create(Named("symbol", wrap(visitor.symbols)),
+                        Named("utc_start", visitor.starts),
+                        Named("utc_stop", visitor.stops),
+                        Named("records", visitor.records),
+                        Named("source", wrap(visitor.sources))
+                        );
+  } else {
+    return R_NilValue;
+  }
+}
@@ -13,5 +13,9 @@ RcppExport SEXP hzc_query(SEXP connectionHandle,
                           SEXP rStart, SEXP rStop,
                           SEXP callback, SEXP est);
 
+RcppExport SEXP hzc_catalog(SEXP connectionHandle,
+                            SEXP symbol, SEXP rStart, SEXP rStop,
+                            SEXP est);
+
 
 #endif // RHZC_H
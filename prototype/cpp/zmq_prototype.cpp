@@ -0,0 +1,168 @@
+
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include <zmq.hpp>
+
+#include "utils.hpp"
+#include "varz/varz.hpp"
+#include "zmq/Forwarder.hpp"
+#include "zmq/ZmqUtils.hpp"
+
+
+DEFINE_int32(forward_messages, 1000000, "Messages to forward in benchmark.");
+DEFINE_int32(forward_payload_size, 100, "Bytes per message payload.");
+DEFINE_int32(forward_max_batch, 1024, "Max batch size of batched forwarder.");
+
+// Updated per frame by the baseline loop, as the Publisher did.
+DECLARE_VARZ_int64(publisher_bytes_sent);
+DECLARE_VARZ_int64(publisher_messages_sent);
+
+
+using namespace atp::zmq;
+
+static void set_unlimited_hwm(::zmq::socket_t& socket)
+{
+#ifdef ZMQ_3X
+  int hwm = 0;
+  socket.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+  socket.setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
+#else
+  boost::uint64_t hwm = 0;
+  socket.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+#endif
+}
+
+/// Pushes topic + payload messages, like the firehose, then "stop".
+static void produce(::zmq::context_t* context, const std::string& addr,
+                    int messages)
+{
+  ::zmq::socket_t push(*context, ZMQ_PUSH);
+  set_unlimited_hwm(push);
+  push.connect(addr.c_str());
+  std::string topic("AAPL.STK");
+  std::string payload(FLAGS_forward_payload_size, 'x');
+  for (int i = 0; i < messages; ++i) {
+    send_copy(push, topic, true);
+    send_copy(push, payload, false);
+  }
+  send_copy(push, std::string("stop"), true);
+  send_copy(push, std::string("stop"), false);
+}
+
+/// The loop of Publisher::process before forward_batch, as it was but for
+/// the signal handling: a blocking recv, getsockopt and blocking send per
+/// frame, with the varz updated per frame.  Returns the number of messages
+/// forwarded.
+static size_t baseline_forward(::zmq::socket_t& inbound,
+                               ::zmq::socket_t& publish)
+{
+  while (true) {
+    ::zmq::message_t message;
+#ifdef ZMQ_3X
+    int more(0);
+#else
+    int64_t more(0);
+#endif
+    size_t more_size = sizeof(more);
+    //  Process all parts of the message
+    inbound.recv(&message);
+    inbound.getsockopt( ZMQ_RCVMORE, &more, &more_size);
+
+    VARZ_publisher_bytes_sent += publish.send(message,
+                                              more? ZMQ_SNDMORE: 0);
+
+    VARZ_publisher_messages_sent++;
+
+    if (!more) {
+      break;      //  Last message part
+    }
+  }
+  return 1;
+}
+
+/// Forwards messages + 1 messages from inbound to publish.  Stats are only
+/// kept by the batched forwarder.
+static void run_forwarder(::zmq::socket_t* inbound, ::zmq::socket_t* publish,
+                          size_t messages, bool batched, forward_stats_t* stats)
+{
+  size_t count = 0;
+  while (count < messages + 1) {
+    if (batched) {
+      count += forward_batch(*inbound, *publish, FLAGS_forward_max_batch,
+                             stats);
+    } else {
+      count += baseline_forward(*inbound, *publish);
+      stats->messages++;
+      stats->batches++;
+    }
+  }
+}
+
+static double run(bool batched, forward_stats_t* stats)
+{
+  ::zmq::context_t context(1);
+  const std::string inboundAddr = EndPoint::inproc("forwarder-in");
+  const std::string publishAddr = EndPoint::inproc("forwarder-pub");
+
+  ::zmq::socket_t inbound(context, ZMQ_PULL);
+  set_unlimited_hwm(inbound);
+  inbound.bind(inboundAddr.c_str());
+  ::zmq::socket_t publish(context, ZMQ_PUB);
+  set_unlimited_hwm(publish);
+  publish.bind(publishAddr.c_str());
+
+  ::zmq::socket_t subscriber(context, ZMQ_SUB);
+  set_unlimited_hwm(subscriber);
+  subscriber.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+  subscriber.connect(publishAddr.c_str());
+  boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+  boost::uint64_t start = now_micros();
+  boost::thread forwarder(boost::bind(&run_forwarder, &inbound, &publish,
+                                      FLAGS_forward_messages, batched, stats));
+  boost::thread producer(boost::bind(&produce, &context, inboundAddr,
+                                     FLAGS_forward_messages));
+
+  int received = 0;
+  while (true) {
+    std::string topic, payload;
+    receive(subscriber, &topic);
+    receive(subscriber, &payload);
+    if (topic == "stop") break;
+    ++received;
+  }
+  boost::uint64_t elapsed = now_micros() - start;
+
+  producer.join();
+  forwarder.join();
+
+  EXPECT_EQ(FLAGS_forward_messages, received);
+  return static_cast<double>(received) /
+      (static_cast<double>(elapsed) / 1000000.);
+}
+
+
+TEST(ZmqPrototype, ForwarderBenchmark)
+{
+  forward_stats_t baseline;
+  double qpsBaseline = run(false, &baseline);
+  LOG(INFO) << "Baseline publisher loop: " << qpsBaseline << " messages/sec, "
+            << baseline.batches << " wakeups.";
+
+  forward_stats_t batch;
+  double qpsBatch = run(true, &batch);
+  LOG(INFO) << "Forward batches: " << qpsBatch << " messages/sec, "
+            << batch.batches << " wakeups, avg batch "
+            << static_cast<double>(batch.messages) / batch.batches
+            << ", " << batch.dropped << " dropped.";
+
+  LOG(INFO) << "Speedup = " << qpsBatch / qpsBaseline;
+  EXPECT_EQ(baseline.messages, batch.messages);
+}
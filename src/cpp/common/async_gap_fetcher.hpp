@@ -0,0 +1,232 @@
+#ifndef ATP_COMMON_ASYNC_GAP_FETCHER_H_
+#define ATP_COMMON_ASYNC_GAP_FETCHER_H_
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "common.hpp"
+#include "utils.hpp"
+#include "common/sequence_tracker.hpp"
+
+
+namespace atp {
+namespace common {
+
+
+/// Messages of a gap fetched by an async_gap_fetcher.
+struct fetched_gap_t
+{
+  std::string topic;
+  sequence_gap_t gap;
+  std::vector<std::string> messages;
+};
+
+
+/// Gaps fetched for one thread, waiting for it to take them.  Checking an
+/// empty inbox is a load of a flag.
+class fetched_gaps : NoCopyAndAssign
+{
+ public:
+
+  fetched_gaps() : ready_(false) {}
+
+  /// Moves the gaps fetched since the last take to out.  Returns false if
+  /// there are none.
+  bool take(std::vector<fetched_gap_t>* out)
+  {
+    if (!ready_.load(boost::memory_order_acquire)) {
+      return false;
+    }
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    out->clear();
+    out->swap(gaps_);
+    ready_.store(false, boost::memory_order_relaxed);
+    return true;
+  }
+
+  /// The messages of the gap are swapped out.
+  void put(fetched_gap_t* gap)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    gaps_.push_back(fetched_gap_t());
+    gaps_.back().topic.swap(gap->topic);
+    gaps_.back().gap = gap->gap;
+    gaps_.back().messages.swap(gap->messages);
+    ready_.store(true, boost::memory_order_release);
+  }
+
+ private:
+  boost::mutex mutex_;
+  std::vector<fetched_gap_t> gaps_;
+  boost::atomic<bool> ready_;
+};
+
+
+/// Fetches the messages of sequence gaps (e.g. from the historian, see
+/// historian::GapFetcher) on a thread of its own, so that a subscriber
+/// never waits on a round trip -- gaps come when it is already behind.
+/// Requests are dropped, and counted, past maxPerSecond (in bursts of up
+/// to a second's worth; 0 for no limit) or while maxPending are waiting: a
+/// storm of gaps means the source of the fetches is loaded as well.
+///
+/// The fetched messages go to the inbox given with each request, for the
+/// thread that owns the topic to process them when it next looks.
+class async_gap_fetcher : NoCopyAndAssign
+{
+ public:
+
+  /// Fetches the serialized messages of the gap, in order.  Returns false
+  /// if the range cannot be fetched.
+  typedef boost::function<
+    bool(const std::string& topic, const sequence_gap_t& gap,
+         std::vector<std::string>* messages)> fetch_function;
+
+  async_gap_fetcher(fetch_function fetch, double maxPerSecond,
+                    size_t maxPending = 64) :
+      fetch_(fetch),
+      maxPerSecond_(std::max(0., maxPerSecond)),
+      maxPending_(std::max<size_t>(1, maxPending)),
+      tokens_(std::max(1., maxPerSecond_)),
+      lastRefill_(now_micros()),
+      stopping_(false),
+      requested_(0), fetched_(0), failed_(0), dropped_(0)
+  {
+    thread_.reset(new boost::thread(
+        boost::bind(&async_gap_fetcher::run, this)));
+  }
+
+  ~async_gap_fetcher()
+  {
+    stop();
+  }
+
+  /// Queues the gap to be fetched into inbox, which must outlive the
+  /// fetcher or its stop.  Returns false if the request is dropped.
+  bool request(const std::string& topic, const sequence_gap_t& gap,
+               fetched_gaps* inbox)
+  {
+    requested_++;
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      boost::int64_t now = now_micros();
+      tokens_ = std::min(std::max(1., maxPerSecond_),
+                         tokens_ + (now - lastRefill_) * maxPerSecond_ / 1e6);
+      lastRefill_ = now;
+      bool limited = maxPerSecond_ > 0;
+      if (!stopping_ && (!limited || tokens_ >= 1.) &&
+          pending_.size() < maxPending_) {
+        if (limited) {
+          tokens_ -= 1.;
+        }
+        pending_.push_back(request_t());
+        pending_.back().gap.topic = topic;
+        pending_.back().gap.gap = gap;
+        pending_.back().inbox = inbox;
+        changed_.notify_one();
+        return true;
+      }
+    }
+    dropped_++;
+    return false;
+  }
+
+  /// Finishes the fetch in progress and drops the rest.  Later requests
+  /// are dropped.
+  void stop()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stopping_ = true;
+      dropped_ += pending_.size();
+      pending_.clear();
+      changed_.notify_one();
+    }
+    if (thread_->joinable()) {
+      thread_->join();
+    }
+  }
+
+  boost::uint64_t requested() const { return requested_; }
+
+  /// Gaps with messages found, put in their inbox.
+  boost::uint64_t fetched() const { return fetched_; }
+
+  /// Gaps with no messages found.
+  boost::uint64_t failed() const { return failed_; }
+
+  boost::uint64_t dropped() const { return dropped_; }
+
+ private:
+
+  struct request_t
+  {
+    fetched_gap_t gap;
+    fetched_gaps* inbox;
+  };
+
+  void run()
+  {
+    request_t request;
+    while (true) {
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (pending_.empty() && !stopping_) {
+          changed_.wait(lock);
+        }
+        if (stopping_) {
+          return;
+        }
+        request.gap.topic.swap(pending_.front().gap.topic);
+        request.gap.gap = pending_.front().gap.gap;
+        request.inbox = pending_.front().inbox;
+        pending_.pop_front();
+      }
+      request.gap.messages.clear();
+      bool found = false;
+      try {
+        found = fetch_(request.gap.topic, request.gap.gap,
+                       &request.gap.messages);
+      } catch (...) {
+        found = false;
+      }
+      if (found && !request.gap.messages.empty()) {
+        request.inbox->put(&request.gap);
+        fetched_++;
+      } else {
+        failed_++;
+      }
+    }
+  }
+
+  fetch_function fetch_;
+  const double maxPerSecond_;
+  const size_t maxPending_;
+
+  boost::mutex mutex_;
+  boost::condition_variable changed_;
+  std::deque<request_t> pending_;
+  double tokens_;
+  boost::int64_t lastRefill_;
+  bool stopping_;
+  boost::scoped_ptr<boost::thread> thread_;
+
+  boost::atomic<boost::uint64_t> requested_;
+  boost::atomic<boost::uint64_t> fetched_;
+  boost::atomic<boost::uint64_t> failed_;
+  boost::atomic<boost::uint64_t> dropped_;
+};
+
+
+} // common
+} // atp
+
+#endif //ATP_COMMON_ASYNC_GAP_FETCHER_H_
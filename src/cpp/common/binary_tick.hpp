@@ -0,0 +1,206 @@
+#ifndef ATP_COMMON_BINARY_TICK_H_
+#define ATP_COMMON_BINARY_TICK_H_
+
+#include <string>
+#include <string.h>
+
+#include <boost/cstdint.hpp>
+
+#include "common/intern_table.hpp"
+
+
+/// Compact fixed-layout encoding of a market data tick, an alternative to
+/// the MarketData proto on the wire.  The symbol and the event are sent as
+/// interned ids, so both ends must share the intern tables (see
+/// open_intern_tables); the stamp of the tables tells the receiver whether
+/// they do.  Laid out as:
+///
+///   offset  size
+///        0     1  magic 0xA7
+///        1     1  version
+///        2     1  value type, numbered as proto::common::Value::Type
+///        3     1  reserved, 0
+///        4     4  symbol id
+///        8     4  event id
+///       12     4  contract id
+///       16     8  timestamp (micros)
+///       24     8  publisher id
+///       32     8  seq
+///       40     4  intern stamp (see intern_stamp)
+///       44     8  value: double, int64 or timestamp
+///                 or, for strings: uint32 length, then the bytes
+///
+/// Integers are in host (little endian) byte order, as in the tick capture
+/// files.  A serialized MarketData or MarketDepth starts with the tag of a
+/// field (0x08, 0x0a, ...), never with the magic, so a receiver can tell
+/// the encodings apart by the first byte and take either on any topic.
+namespace atp {
+namespace common {
+
+
+static const unsigned char BINARY_TICK_MAGIC = 0xA7;
+static const unsigned char BINARY_TICK_VERSION = 2;
+
+static const size_t BINARY_TICK_HEADER_SIZE = 44;
+static const size_t BINARY_TICK_SIZE = BINARY_TICK_HEADER_SIZE + 8;
+
+
+struct binary_tick_t
+{
+  enum value_type_t {
+    DOUBLE = 0,
+    INT = 1,
+    STRING = 2,
+    TIMESTAMP = 3
+  };
+
+  binary_tick_t() :
+      type(DOUBLE), symbol_id(NO_INTERN_ID), event_id(NO_INTERN_ID),
+      contract_id(0), timestamp(0), publisher_id(0), seq(0),
+      intern_stamp(0), string_value(NULL), string_size(0)
+  {
+    value.int_value = 0;
+  }
+
+  value_type_t type;
+  intern_id_t symbol_id;
+  intern_id_t event_id;
+  boost::uint32_t contract_id;
+  boost::uint64_t timestamp;
+  boost::uint64_t publisher_id;
+  boost::uint64_t seq;
+  boost::uint32_t intern_stamp;
+
+  union {
+    double double_value;
+    boost::int64_t int_value;
+    boost::int64_t timestamp_value;
+  } value;
+
+  // Not owned; when decoding, points into the encoded bytes.
+  const char* string_value;
+  size_t string_size;
+
+  void set(double v)
+  {
+    type = DOUBLE;
+    value.double_value = v;
+  }
+
+  void set(int v)
+  {
+    type = INT;
+    value.int_value = v;
+  }
+
+  void set(const std::string& v)
+  {
+    type = STRING;
+    string_value = v.data();
+    string_size = v.size();
+  }
+
+  std::string string() const
+  {
+    return std::string(string_value, string_size);
+  }
+};
+
+
+/// Bytes needed to encode the tick.
+inline size_t binary_tick_size(const binary_tick_t& tick)
+{
+  return tick.type == binary_tick_t::STRING ?
+      BINARY_TICK_HEADER_SIZE + 4 + tick.string_size : BINARY_TICK_SIZE;
+}
+
+/// Encodes the tick into out, which must hold binary_tick_size(tick)
+/// bytes.  Returns the bytes written.
+inline size_t encode_binary_tick(const binary_tick_t& tick, char* out)
+{
+  out[0] = static_cast<char>(BINARY_TICK_MAGIC);
+  out[1] = static_cast<char>(BINARY_TICK_VERSION);
+  out[2] = static_cast<char>(tick.type);
+  out[3] = 0;
+  memcpy(out + 4, &tick.symbol_id, 4);
+  memcpy(out + 8, &tick.event_id, 4);
+  memcpy(out + 12, &tick.contract_id, 4);
+  memcpy(out + 16, &tick.timestamp, 8);
+  memcpy(out + 24, &tick.publisher_id, 8);
+  memcpy(out + 32, &tick.seq, 8);
+  memcpy(out + 40, &tick.intern_stamp, 4);
+  if (tick.type != binary_tick_t::STRING) {
+    memcpy(out + BINARY_TICK_HEADER_SIZE, &tick.value, 8);
+    return BINARY_TICK_SIZE;
+  }
+  boost::uint32_t length = static_cast<boost::uint32_t>(tick.string_size);
+  memcpy(out + BINARY_TICK_HEADER_SIZE, &length, 4);
+  memcpy(out + BINARY_TICK_HEADER_SIZE + 4, tick.string_value, length);
+  return BINARY_TICK_HEADER_SIZE + 4 + length;
+}
+
+inline bool encode_binary_tick(const binary_tick_t& tick, std::string* out)
+{
+  out->resize(binary_tick_size(tick));
+  encode_binary_tick(tick, &(*out)[0]);
+  return true;
+}
+
+/// True if the bytes are a binary tick rather than a proto.
+inline bool is_binary_tick(const char* data, size_t size)
+{
+  return size > 0 && static_cast<unsigned char>(data[0]) == BINARY_TICK_MAGIC;
+}
+
+inline bool is_binary_tick(const std::string& data)
+{
+  return is_binary_tick(data.data(), data.size());
+}
+
+/// Decodes without copying: a string value points into data.  Returns
+/// false if data is not a complete binary tick of a known version.
+inline bool decode_binary_tick(const char* data, size_t size,
+                               binary_tick_t* tick)
+{
+  if (size < BINARY_TICK_HEADER_SIZE + 4 || !is_binary_tick(data, size) ||
+      static_cast<unsigned char>(data[1]) != BINARY_TICK_VERSION) {
+    return false;
+  }
+  unsigned char type = static_cast<unsigned char>(data[2]);
+  if (type > binary_tick_t::TIMESTAMP) {
+    return false;
+  }
+  tick->type = static_cast<binary_tick_t::value_type_t>(type);
+  memcpy(&tick->symbol_id, data + 4, 4);
+  memcpy(&tick->event_id, data + 8, 4);
+  memcpy(&tick->contract_id, data + 12, 4);
+  memcpy(&tick->timestamp, data + 16, 8);
+  memcpy(&tick->publisher_id, data + 24, 8);
+  memcpy(&tick->seq, data + 32, 8);
+  memcpy(&tick->intern_stamp, data + 40, 4);
+  if (tick->type != binary_tick_t::STRING) {
+    memcpy(&tick->value, data + BINARY_TICK_HEADER_SIZE, 8);
+    tick->string_value = NULL;
+    tick->string_size = 0;
+    return size == BINARY_TICK_SIZE;
+  }
+  boost::uint32_t length;
+  memcpy(&length, data + BINARY_TICK_HEADER_SIZE, 4);
+  if (size != BINARY_TICK_HEADER_SIZE + 4 + length) {
+    return false;
+  }
+  tick->string_value = data + BINARY_TICK_HEADER_SIZE + 4;
+  tick->string_size = length;
+  return true;
+}
+
+inline bool decode_binary_tick(const std::string& data, binary_tick_t* tick)
+{
+  return decode_binary_tick(data.data(), data.size(), tick);
+}
+
+
+} // common
+} // atp
+
+#endif //ATP_COMMON_BINARY_TICK_H_
@@ -0,0 +1,252 @@
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "log_levels.h"
+#include "common/intern_table.hpp"
+
+
+namespace atp {
+namespace common {
+
+
+static const std::string UNKNOWN;
+
+static const char STAMP_HEADER[] = "#intern ";
+
+
+/// A stamp unlikely to be picked by another table or process.
+static boost::uint32_t new_stamp()
+{
+  static boost::atomic<boost::uint32_t> count(0);
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  boost::uint64_t seed = (static_cast<boost::uint64_t>(tv.tv_sec) << 20) ^
+      tv.tv_usec ^ (static_cast<boost::uint64_t>(getpid()) << 40) ^
+      (static_cast<boost::uint64_t>(count++) << 52);
+  seed *= 0x9E3779B97F4A7C15ULL;
+  boost::uint32_t stamp = static_cast<boost::uint32_t>(seed >> 32);
+  return stamp != 0 ? stamp : 1;
+}
+
+
+intern_table::intern_table(const std::string& name) :
+    name_(name), stamp_(new_stamp()), shared_stamp_(false),
+    size_(0), fd_(-1), synced_(0)
+{
+  for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+    chunks_[i] = NULL;
+  }
+}
+
+intern_table::~intern_table()
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+    delete[] chunks_[i];
+  }
+}
+
+bool intern_table::open(const std::string& path)
+{
+  boost::unique_lock<boost::shared_mutex> lock(mutex_);
+
+  if (fd_ >= 0) {
+    LOG(ERROR) << "Intern table " << name_ << " already open: " << path_;
+    return false;
+  }
+  if (size_.load() > 0) {
+    // Ids already handed out may not match the ones in the file.
+    LOG(ERROR) << "Intern table " << name_ << " in use; cannot open "
+               << path;
+    return false;
+  }
+
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Cannot open intern table file " << path;
+    return false;
+  }
+  path_ = path;
+
+  flock(fd_, LOCK_EX);
+  struct stat st;
+  if (fstat(fd_, &st) == 0 && st.st_size == 0) {
+    char header[32];
+    int size = snprintf(header, sizeof(header), "%s%08x\n", STAMP_HEADER,
+                        new_stamp());
+    if (write(fd_, header, size) != size) {
+      LOG(ERROR) << "Cannot write the header of " << path_;
+    }
+  }
+  sync_locked();
+  flock(fd_, LOCK_UN);
+
+  if (!shared_stamp_) {
+    LOG(WARNING) << "Intern table file " << path_ << " has no stamp; its "
+                 << "ids are not shared with other processes.";
+  }
+  LOG(INFO) << "Intern table " << name_ << " loaded " << size_.load()
+            << " entries from " << path_ << ", stamp " << std::hex << stamp_;
+  return true;
+}
+
+intern_id_t intern_table::insert_locked(const std::string& s)
+{
+  size_t n = size_.load(boost::memory_order_relaxed);
+  size_t chunk = n / CHUNK_SIZE;
+  if (chunk >= MAX_CHUNKS) {
+    LOG(FATAL) << "Intern table " << name_ << " is full.";
+    return NO_INTERN_ID;
+  }
+  if (chunks_[chunk] == NULL) {
+    chunks_[chunk] = new std::string[CHUNK_SIZE];
+  }
+  chunks_[chunk][n % CHUNK_SIZE] = s;
+
+  intern_id_t id = static_cast<intern_id_t>(n + 1);
+  index_[s] = id;
+
+  // Publish only after the slot is written.
+  size_.store(n + 1, boost::memory_order_release);
+  return id;
+}
+
+void intern_table::sync_locked()
+{
+  struct stat st;
+  if (fd_ < 0 || fstat(fd_, &st) != 0 || st.st_size <= synced_) {
+    return;
+  }
+
+  std::string buffer(st.st_size - synced_, '\0');
+  ssize_t got = pread(fd_, &buffer[0], buffer.size(), synced_);
+  if (got <= 0) {
+    return;
+  }
+
+  size_t start = 0;
+  for (size_t i = 0; i < static_cast<size_t>(got); ++i) {
+    if (buffer[i] != '\n') {
+      continue;
+    }
+    std::string line(buffer, start, i - start);
+    if (synced_ == 0 && start == 0 &&
+        line.compare(0, sizeof(STAMP_HEADER) - 1, STAMP_HEADER) == 0) {
+      stamp_ = static_cast<boost::uint32_t>(
+          strtoul(line.c_str() + sizeof(STAMP_HEADER) - 1, NULL, 16));
+      shared_stamp_ = stamp_ != 0;
+      if (!shared_stamp_) {
+        stamp_ = new_stamp();
+      }
+    } else {
+      insert_locked(line);
+    }
+    start = i + 1;
+  }
+  // Partial lines are left for the next sync.
+  synced_ += start;
+}
+
+intern_id_t intern_table::intern(const std::string& s)
+{
+  intern_id_t id;
+  if (find(s, &id)) {
+    return id;
+  }
+
+  boost::unique_lock<boost::shared_mutex> lock(mutex_);
+
+  if (fd_ < 0) {
+    boost::unordered_map<std::string, intern_id_t>::const_iterator found =
+        index_.find(s);
+    return found != index_.end() ? found->second : insert_locked(s);
+  }
+
+  flock(fd_, LOCK_EX);
+
+  // Another process may have added it.
+  sync_locked();
+  boost::unordered_map<std::string, intern_id_t>::const_iterator found =
+      index_.find(s);
+  if (found != index_.end()) {
+    flock(fd_, LOCK_UN);
+    return found->second;
+  }
+
+  std::string line(s + '\n');
+  if (write(fd_, line.data(), line.size()) !=
+      static_cast<ssize_t>(line.size())) {
+    // An id the file does not have would mean another name elsewhere.
+    LOG(FATAL) << "Failed to append " << s << " to " << path_;
+    flock(fd_, LOCK_UN);
+    return NO_INTERN_ID;
+  }
+  synced_ += line.size();
+  id = insert_locked(s);
+
+  flock(fd_, LOCK_UN);
+  return id;
+}
+
+bool intern_table::find(const std::string& s, intern_id_t* id)
+{
+  boost::shared_lock<boost::shared_mutex> lock(mutex_);
+  boost::unordered_map<std::string, intern_id_t>::const_iterator found =
+      index_.find(s);
+  if (found == index_.end()) {
+    return false;
+  }
+  *id = found->second;
+  return true;
+}
+
+const std::string& intern_table::slow_name(intern_id_t id)
+{
+  if (id == NO_INTERN_ID || fd_ < 0) {
+    return UNKNOWN;
+  }
+  {
+    // Pick up ids appended by other processes.
+    boost::unique_lock<boost::shared_mutex> lock(mutex_);
+    flock(fd_, LOCK_SH);
+    sync_locked();
+    flock(fd_, LOCK_UN);
+  }
+  if (id > size_.load(boost::memory_order_acquire)) {
+    return UNKNOWN;
+  }
+  return chunks_[(id - 1) / CHUNK_SIZE][(id - 1) % CHUNK_SIZE];
+}
+
+
+intern_table& symbols()
+{
+  static intern_table table("symbols");
+  return table;
+}
+
+intern_table& events()
+{
+  static intern_table table("events");
+  return table;
+}
+
+bool open_intern_tables(const std::string& dir)
+{
+  return symbols().open(dir + "/symbols.intern") &&
+      events().open(dir + "/events.intern");
+}
+
+
+} // common
+} // atp
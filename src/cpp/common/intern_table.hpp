@@ -0,0 +1,145 @@
+#ifndef ATP_COMMON_INTERN_TABLE_H_
+#define ATP_COMMON_INTERN_TABLE_H_
+
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+
+
+namespace atp {
+namespace common {
+
+
+typedef boost::uint32_t intern_id_t;
+
+/// Ids start at 1, so that 0 (e.g. an unset proto field) is never valid.
+static const intern_id_t NO_INTERN_ID = 0;
+
+
+/// Process-wide table of interned strings (symbols, event names) with
+/// dense integer ids, so that hot-path lookups can be array indexing
+/// instead of string hashing.
+///
+/// Ids are only assigned, never changed or reused.  Lookups of the name of
+/// an id are lock free.  Interning takes a lock.
+///
+/// The table can be backed by a file of one name per line, shared by
+/// processes on the same host.  The first line is a header with the stamp
+/// of the file, a random number picked when it was created; ids are the
+/// numbers of the lines after it.  New entries are appended under an
+/// exclusive file lock after catching up with entries appended by other
+/// processes, so all processes sharing the file agree on the ids.
+///
+/// Ids sent to other processes go with the stamp (see intern_stamp), and
+/// are only used by a receiver with the same stamp.  A table not backed by
+/// a file has a stamp of its own, so its ids are never taken elsewhere.
+class intern_table : boost::noncopyable
+{
+ public:
+
+  explicit intern_table(const std::string& name);
+  ~intern_table();
+
+  /// Loads the file and appends new entries to it from now on.
+  bool open(const std::string& path);
+
+  /// True if the ids are shared with other processes via a file.
+  bool is_shared() const
+  {
+    return fd_ >= 0 && shared_stamp_;
+  }
+
+  /// Identity of the ids: the stamp of the file, or of this table if not
+  /// shared.  Never 0.
+  boost::uint32_t stamp() const
+  {
+    return stamp_;
+  }
+
+  /// Returns the id of s, assigning one if s is new.  Dies if the id
+  /// cannot be appended to the file, rather than hand out an id the other
+  /// processes do not know.
+  intern_id_t intern(const std::string& s);
+
+  /// Returns false if s has not been interned.
+  bool find(const std::string& s, intern_id_t* id);
+
+  /// Returns the name of the id, or the empty string if unknown.
+  /// Ids appended to the file by other processes are picked up.
+  inline const std::string& name(intern_id_t id)
+  {
+    if (id == NO_INTERN_ID || id > size_.load(boost::memory_order_acquire)) {
+      return slow_name(id);
+    }
+    return chunks_[(id - 1) / CHUNK_SIZE][(id - 1) % CHUNK_SIZE];
+  }
+
+  /// Number of ids assigned; ids are 1..size().
+  size_t size() const
+  {
+    return size_.load(boost::memory_order_acquire);
+  }
+
+  const std::string& table_name() const
+  {
+    return name_;
+  }
+
+  static const size_t CHUNK_SIZE = 4096;
+  static const size_t MAX_CHUNKS = 1024;
+
+ private:
+
+  const std::string& slow_name(intern_id_t id);
+
+  // Must hold the write lock
+  intern_id_t insert_locked(const std::string& s);
+  void sync_locked();
+
+  std::string name_;
+  boost::uint32_t stamp_;
+  bool shared_stamp_;
+  std::string* chunks_[MAX_CHUNKS];
+  boost::atomic<size_t> size_;
+
+  boost::shared_mutex mutex_;
+  boost::unordered_map<std::string, intern_id_t> index_;
+
+  int fd_;
+  off_t synced_;
+  std::string path_;
+};
+
+
+/// Table of symbols, e.g. AAPL.STK
+intern_table& symbols();
+
+/// Table of market data event names, e.g. BID
+intern_table& events();
+
+/// Backs the symbols and events tables with the files symbols.intern and
+/// events.intern in dir.  Processes opening the same dir share ids.
+bool open_intern_tables(const std::string& dir);
+
+/// Stamp of the symbols and events tables together, sent with their ids.
+inline boost::uint32_t intern_stamp()
+{
+  boost::uint32_t stamp = symbols().stamp() * 2654435761u ^ events().stamp();
+  return stamp != 0 ? stamp : 1;
+}
+
+/// True if ids sent with the stamp are ids of this process' tables.
+inline bool is_local_intern_stamp(boost::uint32_t stamp)
+{
+  return stamp == intern_stamp();
+}
+
+
+} // common
+} // atp
+
+#endif //ATP_COMMON_INTERN_TABLE_H_
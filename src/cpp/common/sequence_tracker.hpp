@@ -0,0 +1,144 @@
+#ifndef ATP_COMMON_SEQUENCE_TRACKER_H_
+#define ATP_COMMON_SEQUENCE_TRACKER_H_
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+
+namespace atp {
+namespace common {
+
+
+/// Sequence numbers missing on a channel, first to last inclusive.
+struct sequence_gap_t
+{
+  boost::uint64_t publisher;
+  boost::uint64_t first;
+  boost::uint64_t last;
+  boost::uint64_t after_ts;   // timestamp of the message before the gap
+  boost::uint64_t before_ts;  // and of the one after
+
+  boost::uint64_t size() const
+  {
+    return last - first + 1;
+  }
+};
+
+
+/// Follows the sequence numbers of the messages of each channel (e.g. a
+/// topic) to detect messages lost on the way, such as those dropped by a
+/// PUB socket at its high water mark.  A publisher numbers the messages of
+/// each channel from 1; a new publisher id on a channel (the publisher
+/// restarted) starts the channel over.
+///
+/// Not thread safe.  With several threads, each needs its own tracker and
+/// the channels of the threads must not overlap.
+template <typename channel_t = std::string>
+class sequence_tracker
+{
+ public:
+
+  enum result_t {
+    FIRST,     // first message of the channel or of its publisher
+    IN_ORDER,
+    GAP,       // messages before this one are missing
+    STALE      // at or before the last seen; duplicate or out of order
+  };
+
+  sequence_tracker() : gaps_(0), missed_(0), stale_(0), resets_(0) {}
+
+  /// If there is a gap and gap is not NULL, it is set to the missing range.
+  result_t check(const channel_t& channel, boost::uint64_t publisher,
+                 boost::uint64_t seq, boost::uint64_t ts,
+                 sequence_gap_t* gap = NULL)
+  {
+    state_t& state = channels_[channel];
+    if (state.last == 0 || state.publisher != publisher) {
+      if (state.last != 0) {
+        resets_++;
+      }
+      state.publisher = publisher;
+      state.last = seq;
+      state.ts = ts;
+      return FIRST;
+    }
+    if (seq <= state.last) {
+      stale_++;
+      return STALE;
+    }
+
+    result_t result = IN_ORDER;
+    if (seq > state.last + 1) {
+      gaps_++;
+      missed_ += seq - state.last - 1;
+      if (gap != NULL) {
+        gap->publisher = publisher;
+        gap->first = state.last + 1;
+        gap->last = seq - 1;
+        gap->after_ts = state.ts;
+        gap->before_ts = ts;
+      }
+      result = GAP;
+    }
+    state.last = seq;
+    state.ts = ts;
+    return result;
+  }
+
+  void reset()
+  {
+    channels_.clear();
+  }
+
+  size_t channels() const
+  {
+    return channels_.size();
+  }
+
+  boost::uint64_t gaps() const
+  {
+    return gaps_;
+  }
+
+  /// Messages in all the gaps.
+  boost::uint64_t missed() const
+  {
+    return missed_;
+  }
+
+  boost::uint64_t stale() const
+  {
+    return stale_;
+  }
+
+  /// Times a channel changed publisher.
+  boost::uint64_t resets() const
+  {
+    return resets_;
+  }
+
+ private:
+
+  struct state_t
+  {
+    state_t() : publisher(0), last(0), ts(0) {}
+
+    boost::uint64_t publisher;
+    boost::uint64_t last;
+    boost::uint64_t ts;
+  };
+
+  boost::unordered_map<channel_t, state_t> channels_;
+  boost::uint64_t gaps_;
+  boost::uint64_t missed_;
+  boost::uint64_t stale_;
+  boost::uint64_t resets_;
+};
+
+
+} // common
+} // atp
+
+#endif //ATP_COMMON_SEQUENCE_TRACKER_H_
@@ -0,0 +1,185 @@
+#ifndef ATP_COMMON_TICK_BATCH_H_
+#define ATP_COMMON_TICK_BATCH_H_
+
+#include <string>
+#include <string.h>
+
+#include <boost/cstdint.hpp>
+
+
+/// Several messages of one topic sent as one frame, to save the per
+/// message costs of zmq and the kernel when ticks are many and small.
+/// Laid out as:
+///
+///   header  : uint8 magic 0xB7, uint8 version, uint16 reserved,
+///             uint32 record count
+///   record* : uint32 length, message bytes (proto or binary tick)
+///
+/// Integers are in host (little endian) byte order.  Like the binary tick
+/// magic, 0xB7 is never the first byte of a serialized proto, so readers
+/// tell batches from single messages by the first byte.
+namespace atp {
+namespace common {
+
+
+static const unsigned char TICK_BATCH_MAGIC = 0xB7;
+static const unsigned char TICK_BATCH_VERSION = 1;
+
+static const size_t TICK_BATCH_HEADER_SIZE = 8;
+
+
+/// Batch being filled.  Clearing keeps the capacity of the buffer.
+class tick_batch
+{
+ public:
+
+  tick_batch() : count_(0), start_(0) {}
+
+  /// Reserves room for a record of size bytes, to be written at the
+  /// returned address before the next append.  now is the time of the
+  /// first record, see start().
+  char* append(size_t size, boost::uint64_t now)
+  {
+    if (count_ == 0) {
+      data_.resize(TICK_BATCH_HEADER_SIZE);
+      data_[0] = static_cast<char>(TICK_BATCH_MAGIC);
+      data_[1] = static_cast<char>(TICK_BATCH_VERSION);
+      data_[2] = data_[3] = 0;
+      start_ = now;
+    }
+    size_t offset = data_.size();
+    data_.resize(offset + 4 + size);
+    boost::uint32_t length = static_cast<boost::uint32_t>(size);
+    memcpy(&data_[offset], &length, 4);
+    ++count_;
+    memcpy(&data_[4], &count_, 4);
+    return &data_[offset + 4];
+  }
+
+  bool empty() const
+  {
+    return count_ == 0;
+  }
+
+  boost::uint32_t count() const
+  {
+    return count_;
+  }
+
+  size_t bytes() const
+  {
+    return count_ == 0 ? 0 : data_.size();
+  }
+
+  /// Micros of the first record.
+  boost::uint64_t start() const
+  {
+    return start_;
+  }
+
+  const std::string& data() const
+  {
+    return data_;
+  }
+
+  void clear()
+  {
+    data_.clear();
+    count_ = 0;
+  }
+
+ private:
+  std::string data_;
+  boost::uint32_t count_;
+  boost::uint64_t start_;
+};
+
+
+inline bool is_tick_batch(const char* data, size_t size)
+{
+  return size >= TICK_BATCH_HEADER_SIZE &&
+      static_cast<unsigned char>(data[0]) == TICK_BATCH_MAGIC;
+}
+
+inline bool is_tick_batch(const std::string& data)
+{
+  return is_tick_batch(data.data(), data.size());
+}
+
+
+/// Reads the records of a batch in order, without copying.
+class tick_batch_reader
+{
+ public:
+
+  tick_batch_reader(const char* data, size_t size) :
+      data_(data), size_(size), offset_(TICK_BATCH_HEADER_SIZE), count_(0)
+  {
+    read_header();
+  }
+
+  explicit tick_batch_reader(const std::string& data) :
+      data_(data.data()), size_(data.size()),
+      offset_(TICK_BATCH_HEADER_SIZE), count_(0)
+  {
+    read_header();
+  }
+
+  /// Records in the batch, as told by its header.
+  boost::uint32_t count() const
+  {
+    return count_;
+  }
+
+  /// Returns false at the end, or at a truncated record.
+  bool next(const char** record, size_t* size)
+  {
+    if (offset_ + 4 > size_) {
+      return false;
+    }
+    boost::uint32_t length;
+    memcpy(&length, data_ + offset_, 4);
+    if (offset_ + 4 + length > size_) {
+      offset_ = size_;
+      return false;
+    }
+    *record = data_ + offset_ + 4;
+    *size = length;
+    offset_ += 4 + length;
+    return true;
+  }
+
+  bool next(std::string* record)
+  {
+    const char* data;
+    size_t size;
+    if (!next(&data, &size)) {
+      return false;
+    }
+    record->assign(data, size);
+    return true;
+  }
+
+ private:
+
+  void read_header()
+  {
+    if (!is_tick_batch(data_, size_) ||
+        static_cast<unsigned char>(data_[1]) != TICK_BATCH_VERSION) {
+      offset_ = size_;  // no records
+    } else {
+      memcpy(&count_, data_ + 4, 4);
+    }
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t offset_;
+  boost::uint32_t count_;
+};
+
+
+} // common
+} // atp
+
+#endif //ATP_COMMON_TICK_BATCH_H_
@@ -0,0 +1,385 @@
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <glog/logging.h>
+
+#include "log_levels.h"
+#include "common/time_utils.hpp"
+#include "common/tick_capture.hpp"
+
+
+namespace atp {
+namespace capture {
+
+using boost::uint32_t;
+using boost::uint64_t;
+
+
+template <typename T>
+inline void put(char* buff, size_t* at, const T& v)
+{
+  memcpy(buff + *at, &v, sizeof(T));
+  *at += sizeof(T);
+}
+
+template <typename T>
+inline T get(const char* buff, size_t at)
+{
+  T v;
+  memcpy(&v, buff + at, sizeof(T));
+  return v;
+}
+
+
+uint64_t session_end(uint64_t ts)
+{
+  using namespace atp::time;
+  ptime est = us_eastern::utc_to_local(as_ptime(ts));
+  ptime next(est.date() + boost::gregorian::days(1));
+  return as_micros(us_eastern::local_to_utc(next));
+}
+
+
+Writer::Writer(const std::string& dir, const std::string& prefix,
+               uint32_t index_interval, size_t buffer_size,
+               size_t max_pending) :
+    dir_(dir), prefix_(prefix),
+    index_interval_(index_interval > 0 ? index_interval : 1),
+    buffer_size_(buffer_size),
+    max_pending_(max_pending),
+    flush_requests_(0), flushes_done_(0), closed_(false),
+    records_(0), dropped_(0),
+    file_(NULL), offset_(0), session_end_(0), file_records_(0)
+{
+  thread_.reset(new boost::thread(&Writer::run, this));
+}
+
+Writer::~Writer()
+{
+  close();
+}
+
+bool Writer::open(uint64_t ts)
+{
+  using namespace atp::time;
+
+  std::ostringstream name;
+  name.imbue(std::locale(std::cout.getloc(),
+                         new boost::posix_time::time_facet("%Y%m%d-%H%M%S")));
+  name << dir_ << '/' << prefix_ << '-'
+       << us_eastern::utc_to_local(as_ptime(ts)) << ".tcap";
+
+  std::string path = name.str();
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == NULL) {
+    LOG(ERROR) << "Cannot open capture file " << path;
+    return false;
+  }
+  if (buffer_size_ > 0) {
+    buffer_.resize(buffer_size_);
+    setvbuf(file_, &buffer_[0], _IOFBF, buffer_.size());
+  }
+
+  char header[FILE_HEADER_SIZE];
+  size_t at = 0;
+  memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+  at += sizeof(FILE_MAGIC);
+  put(header, &at, VERSION);
+  put(header, &at, index_interval_);
+  fwrite(header, 1, at, file_);
+
+  offset_ = at;
+  file_records_ = 0;
+  index_.clear();
+  session_end_ = session_end(ts);
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    path_ = path;
+    records_ = 0;
+  }
+
+  LOG(INFO) << "Opened capture file " << path;
+  return true;
+}
+
+bool Writer::append(RecordType type, uint64_t ts, const std::string& payload)
+{
+  return append(type, ts, payload.data(), payload.size());
+}
+
+bool Writer::append(RecordType type, uint64_t ts,
+                    const char* payload, size_t size)
+{
+  char header[RECORD_HEADER_SIZE];
+  size_t at = 0;
+  put(header, &at, static_cast<uint32_t>(size));
+  put(header, &at, static_cast<boost::uint8_t>(type));
+  put(header, &at, ts);
+
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  if (closed_) {
+    return false;
+  }
+  if (pending_.size() + at + size > max_pending_) {
+    if (dropped_++ % 10000 == 0) {
+      LOG(WARNING) << "Capture writer is behind; " << dropped_
+                   << " records dropped.";
+    }
+    return false;
+  }
+  bool wake = pending_.empty();
+  pending_.append(header, at);
+  pending_.append(payload, size);
+  if (wake) {
+    pending_cond_.notify_one();
+  }
+  return true;
+}
+
+void Writer::write(const std::string& batch)
+{
+  size_t pos = 0;
+  size_t written = 0;
+  while (pos + RECORD_HEADER_SIZE <= batch.size()) {
+    uint32_t len = get<uint32_t>(batch.data(), pos);
+    uint64_t ts = get<uint64_t>(batch.data(), pos + 5);
+    size_t record = RECORD_HEADER_SIZE + len;
+
+    if (file_ != NULL && ts >= session_end_) {
+      close_file();
+    }
+    if (file_ == NULL && !open(ts)) {
+      pos += record;
+      continue;
+    }
+    if (file_records_ % index_interval_ == 0) {
+      index_entry_t entry = { ts, offset_ };
+      index_.push_back(entry);
+    }
+    if (fwrite(batch.data() + pos, 1, record, file_) != record) {
+      LOG(ERROR) << "Failed to write to capture file " << path_;
+    } else {
+      offset_ += record;
+      file_records_++;
+      written++;
+    }
+    pos += record;
+  }
+  if (written > 0) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    records_ = file_records_;
+  }
+}
+
+void Writer::run()
+{
+  std::string batch;
+  for (;;) {
+    uint64_t flush_request;
+    bool closing;
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (pending_.empty() && !closed_ &&
+             flushes_done_ == flush_requests_) {
+        pending_cond_.wait(lock);
+      }
+      batch.swap(pending_);
+      flush_request = flush_requests_;
+      closing = closed_;
+    }
+
+    write(batch);
+    batch.clear();
+
+    if (closing) {
+      close_file();
+    } else if (file_ != NULL && flush_request != flushes_done_) {
+      fflush(file_);
+    }
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      flushes_done_ = flush_request;
+      flushed_cond_.notify_all();
+      if (closing && pending_.empty()) {
+        return;
+      }
+    }
+  }
+}
+
+void Writer::flush()
+{
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  if (closed_) {
+    return;
+  }
+  uint64_t request = ++flush_requests_;
+  pending_cond_.notify_one();
+  while (flushes_done_ < request) {
+    flushed_cond_.wait(lock);
+  }
+}
+
+void Writer::close()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    pending_cond_.notify_one();
+  }
+  if (thread_.get() != NULL) {
+    thread_->join();
+    thread_.reset();
+  }
+}
+
+void Writer::close_file()
+{
+  if (file_ == NULL) {
+    return;
+  }
+
+  uint64_t index_offset = offset_;
+  std::vector<index_entry_t>::const_iterator itr = index_.begin();
+  for (; itr != index_.end(); ++itr) {
+    char entry[INDEX_ENTRY_SIZE];
+    size_t at = 0;
+    put(entry, &at, itr->timestamp);
+    put(entry, &at, itr->offset);
+    fwrite(entry, 1, at, file_);
+  }
+
+  char trailer[TRAILER_SIZE];
+  size_t at = 0;
+  put(trailer, &at, index_offset);
+  put(trailer, &at, static_cast<uint64_t>(file_records_));
+  put(trailer, &at, static_cast<uint32_t>(index_.size()));
+  memcpy(trailer + at, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  fwrite(trailer, 1, sizeof(trailer), file_);
+
+  fclose(file_);
+  file_ = NULL;
+
+  LOG(INFO) << "Closed capture file " << current_file() << " with "
+            << file_records_ << " records.";
+}
+
+
+
+File::File(const std::string& path) :
+    data_(NULL), size_(0), end_(0), pos_(0)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Cannot open capture file " << path;
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= FILE_HEADER_SIZE) {
+    void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      data_ = static_cast<const char*>(mapped);
+      size_ = st.st_size;
+    }
+  }
+  ::close(fd);
+
+  if (data_ == NULL) {
+    LOG(ERROR) << "Cannot map capture file " << path;
+    return;
+  }
+  if (memcmp(data_, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+    LOG(ERROR) << "Not a capture file: " << path;
+    munmap(const_cast<char*>(data_), size_);
+    data_ = NULL;
+    return;
+  }
+  pos_ = FILE_HEADER_SIZE;
+  end_ = size_;
+  load_index();
+}
+
+File::~File()
+{
+  if (data_ != NULL) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+void File::load_index()
+{
+  if (size_ < FILE_HEADER_SIZE + TRAILER_SIZE) {
+    return;
+  }
+  size_t trailer = size_ - TRAILER_SIZE;
+  if (memcmp(data_ + trailer + TRAILER_MAGIC_OFFSET,
+             INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+    LOG(WARNING) << "Capture file has no index; was it closed?";
+    return;
+  }
+  uint64_t index_offset = get<uint64_t>(data_, trailer);
+  uint32_t entries = get<uint32_t>(data_, trailer + TRAILER_ENTRIES_OFFSET);
+  if (index_offset + entries * INDEX_ENTRY_SIZE != trailer) {
+    LOG(WARNING) << "Capture file index is corrupted.";
+    return;
+  }
+  end_ = index_offset;
+  index_.resize(entries);
+  for (uint32_t i = 0; i < entries; ++i) {
+    size_t at = index_offset + i * INDEX_ENTRY_SIZE;
+    index_[i].timestamp = get<uint64_t>(data_, at);
+    index_[i].offset = get<uint64_t>(data_, at + 8);
+  }
+}
+
+static bool before(const index_entry_t& entry, uint64_t ts)
+{
+  return entry.timestamp < ts;
+}
+
+void File::seek(uint64_t ts)
+{
+  if (index_.empty()) {
+    return;
+  }
+  std::vector<index_entry_t>::const_iterator found =
+      std::lower_bound(index_.begin(), index_.end(), ts, before);
+  if (found != index_.begin()) {
+    --found;
+  }
+  pos_ = found->offset;
+}
+
+bool File::next(record_t* record)
+{
+  if (data_ == NULL || pos_ + RECORD_HEADER_SIZE > end_) {
+    return false;
+  }
+  uint32_t len = get<uint32_t>(data_, pos_);
+  if (pos_ + RECORD_HEADER_SIZE + len > end_) {
+    LOG(WARNING) << "Truncated record at offset " << pos_;
+    return false;
+  }
+  record->type = static_cast<RecordType>(
+      get<boost::uint8_t>(data_, pos_ + 4));
+  record->timestamp = get<uint64_t>(data_, pos_ + 5);
+  record->payload = data_ + pos_ + RECORD_HEADER_SIZE;
+  record->size = len;
+  pos_ += RECORD_HEADER_SIZE + len;
+  return true;
+}
+
+
+} // capture
+} // atp
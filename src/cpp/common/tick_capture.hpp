@@ -0,0 +1,211 @@
+#ifndef ATP_COMMON_TICK_CAPTURE_H_
+#define ATP_COMMON_TICK_CAPTURE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "common.hpp"
+
+
+/// Binary tick capture files.
+///
+/// Every message the firehose publishes is appended, as the already
+/// serialized proto bytes (or binary tick, see common/binary_tick.hpp), to
+/// a capture file.  Files are rotated per trading session (US/Eastern
+/// calendar day) and are laid out as:
+///
+///   header   : magic[8] "ATPTCAP1", uint32 version, uint32 index interval
+///   record*  : uint32 payload length, uint8 type, uint64 timestamp (micros),
+///              payload bytes
+///   index    : (uint64 timestamp, uint64 file offset) for every Nth record
+///   trailer  : uint64 index offset, uint64 record count, uint32 index
+///              entries, magic[8] "ATPTIDX1"
+///
+/// Integers are written in host (little endian) byte order.  The index and
+/// trailer are written when the file is closed; a file without a trailer
+/// (e.g. the process crashed) is still readable by sequential scan.
+namespace atp {
+namespace capture {
+
+
+enum RecordType {
+  MARKET_DATA = 1,
+  MARKET_DEPTH = 2
+};
+
+static const char FILE_MAGIC[8] = { 'A','T','P','T','C','A','P','1' };
+static const char INDEX_MAGIC[8] = { 'A','T','P','T','I','D','X','1' };
+static const boost::uint32_t VERSION = 1;
+
+static const size_t FILE_HEADER_SIZE = 8 + 4 + 4;
+static const size_t RECORD_HEADER_SIZE = 4 + 1 + 8;
+static const size_t INDEX_ENTRY_SIZE = 8 + 8;
+static const size_t TRAILER_SIZE = 8 + 8 + 4 + 8;
+static const size_t TRAILER_ENTRIES_OFFSET = 8 + 8;
+static const size_t TRAILER_MAGIC_OFFSET = 8 + 8 + 4;
+
+static const boost::uint32_t DEFAULT_INDEX_INTERVAL = 1024;
+
+
+struct index_entry_t
+{
+  boost::uint64_t timestamp;
+  boost::uint64_t offset;
+};
+
+
+/// Appends records to the capture file of the current session.
+/// Thread safe; all connections of a firehose may share one writer.
+///
+/// append only copies the record into a pending buffer; a thread of the
+/// writer's own writes the buffer to the file, rotating and indexing as
+/// it goes.  Records are dropped, and counted, while the buffer holds
+/// max_pending bytes.
+class Writer : NoCopyAndAssign
+{
+ public:
+
+  /// Files are created in dir, named <prefix>-YYYYMMDD-HHMMSS.tcap
+  Writer(const std::string& dir, const std::string& prefix,
+         boost::uint32_t index_interval = DEFAULT_INDEX_INTERVAL,
+         size_t buffer_size = 1 << 20, size_t max_pending = 64 << 20);
+
+  ~Writer();
+
+  /// Queues a record.  The file is rotated if ts is in a new session.
+  bool append(RecordType type, boost::uint64_t ts,
+              const std::string& payload);
+
+  bool append(RecordType type, boost::uint64_t ts,
+              const char* payload, size_t size);
+
+  /// Waits until the records appended so far are written to the file.
+  void flush();
+
+  /// Writes the records appended so far, the index and trailer, and closes
+  /// the current file.  Records appended after close are dropped.
+  void close();
+
+  std::string current_file() const
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return path_;
+  }
+
+  /// Records written to the current file.
+  size_t records_written() const
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return records_;
+  }
+
+  /// Records dropped while the pending buffer was full.
+  size_t records_dropped() const
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return dropped_;
+  }
+
+ private:
+
+  void run();
+  void write(const std::string& batch);
+  bool open(boost::uint64_t ts);
+  void close_file();
+
+  std::string dir_;
+  std::string prefix_;
+  boost::uint32_t index_interval_;
+  size_t buffer_size_;
+  size_t max_pending_;
+
+  // Shared with the callers of append.
+  mutable boost::mutex mutex_;
+  boost::condition_variable pending_cond_;
+  boost::condition_variable flushed_cond_;
+  std::string pending_;
+  boost::uint64_t flush_requests_;
+  boost::uint64_t flushes_done_;
+  bool closed_;
+  std::string path_;
+  size_t records_;
+  size_t dropped_;
+
+  // Used by the writer thread only.
+  FILE* file_;
+  std::vector<char> buffer_;
+  boost::uint64_t offset_;
+  boost::uint64_t session_end_;
+  size_t file_records_;
+  std::vector<index_entry_t> index_;
+
+  boost::scoped_ptr<boost::thread> thread_;
+};
+
+
+/// A record view into a file read in memory.  The payload is not copied.
+struct record_t
+{
+  RecordType type;
+  boost::uint64_t timestamp;
+  const char* payload;
+  size_t size;
+};
+
+
+/// Sequential access to the records of a capture file.
+class File : NoCopyAndAssign
+{
+ public:
+
+  explicit File(const std::string& path);
+  ~File();
+
+  bool is_open() const
+  {
+    return data_ != NULL;
+  }
+
+  /// True if the index and trailer were found.
+  bool has_index() const
+  {
+    return !index_.empty();
+  }
+
+  const std::vector<index_entry_t>& index() const
+  {
+    return index_;
+  }
+
+  /// Positions the cursor at the first record at or after ts, or earlier
+  /// than that by at most one index interval.
+  void seek(boost::uint64_t ts);
+
+  /// Reads the next record.  Returns false at the end of the records.
+  bool next(record_t* record);
+
+ private:
+
+  void load_index();
+
+  const char* data_;
+  size_t size_;
+  size_t end_;  // end of records, i.e. start of the index block
+  size_t pos_;
+  std::vector<index_entry_t> index_;
+};
+
+
+/// Returns the boundary (micros, UTC) of the session containing ts.
+boost::uint64_t session_end(boost::uint64_t ts);
+
+
+} // capture
+} // atp
+
+#endif //ATP_COMMON_TICK_CAPTURE_H_
@@ -0,0 +1,82 @@
+#ifndef ATP_COMMON_TRACE_HEADER_H_
+#define ATP_COMMON_TRACE_HEADER_H_
+
+#include <string>
+#include <string.h>
+
+#include <boost/cstdint.hpp>
+
+
+/// Header in front of a traced message (see varz/trace.hpp), so every stage
+/// can tell a sampled tick and its trace key from the first bytes, without
+/// parsing the message:
+///
+///   offset  size
+///        0     1  magic 0xC7
+///        1     1  version
+///        2     2  reserved, 0
+///        4     8  publisher id
+///       12     8  seq
+///       20        the message: proto or binary tick
+///
+/// Integers are in host (little endian) byte order.  Like the magic of
+/// binary ticks and tick batches, 0xC7 is never the first byte of a
+/// serialized proto.  Traced messages are never batched.
+namespace atp {
+namespace common {
+
+
+static const unsigned char TRACE_HEADER_MAGIC = 0xC7;
+static const unsigned char TRACE_HEADER_VERSION = 1;
+
+static const size_t TRACE_HEADER_SIZE = 20;
+
+
+inline void encode_trace_header(boost::uint64_t publisher, boost::uint64_t seq,
+                                char* out)
+{
+  out[0] = static_cast<char>(TRACE_HEADER_MAGIC);
+  out[1] = static_cast<char>(TRACE_HEADER_VERSION);
+  out[2] = out[3] = 0;
+  memcpy(out + 4, &publisher, 8);
+  memcpy(out + 12, &seq, 8);
+}
+
+inline bool is_traced(const char* data, size_t size)
+{
+  return size >= TRACE_HEADER_SIZE &&
+      static_cast<unsigned char>(data[0]) == TRACE_HEADER_MAGIC;
+}
+
+inline bool is_traced(const std::string& data)
+{
+  return is_traced(data.data(), data.size());
+}
+
+/// Reads the trace key of a traced message.  Returns false if not traced.
+inline bool read_trace_header(const char* data, size_t size,
+                              boost::uint64_t* publisher, boost::uint64_t* seq)
+{
+  if (!is_traced(data, size) ||
+      static_cast<unsigned char>(data[1]) != TRACE_HEADER_VERSION) {
+    return false;
+  }
+  memcpy(publisher, data + 4, 8);
+  memcpy(seq, data + 12, 8);
+  return true;
+}
+
+/// Moves data and size past the header, if any.
+inline void skip_trace_header(const char** data, size_t* size)
+{
+  if (is_traced(*data, *size)) {
+    *data += TRACE_HEADER_SIZE;
+    *size -= TRACE_HEADER_SIZE;
+  }
+}
+
+
+} // common
+} // atp
+
+#endif //ATP_COMMON_TRACE_HEADER_H_
@@ -0,0 +1,152 @@
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "common/trading_calendar.hpp"
+
+
+namespace atp {
+namespace time {
+
+using namespace boost::gregorian;
+using boost::uint64_t;
+
+
+static const time_duration HALF_DAY_RTH_END_EST(13, 0, 0, 0);
+static const time_duration HALF_DAY_EXT_END(17, 0, 0, 0);
+
+/// Unscheduled closings of the exchange.
+static const date SPECIAL_CLOSINGS[] = {
+  date(2001, Sep, 11), date(2001, Sep, 12), date(2001, Sep, 13),
+  date(2001, Sep, 14),
+  date(2004, Jun, 11),  // Reagan
+  date(2007, Jan, 2),   // Ford
+  date(2012, Oct, 29), date(2012, Oct, 30),  // Sandy
+  date(2018, Dec, 5),   // Bush
+  date(2025, Jan, 9),   // Carter
+};
+
+
+static date easter(int y)
+{
+  // Anonymous Gregorian algorithm
+  int a = y % 19, b = y / 100, c = y % 100;
+  int d = b / 4, e = b % 4, f = (b + 8) / 25;
+  int g = (b - f + 1) / 3;
+  int h = (19 * a + b - d - g + 15) % 30;
+  int i = c / 4, k = c % 4;
+  int l = (32 + 2 * e + 2 * i - h - k) % 7;
+  int m = (a + 11 * h + 22 * l) / 451;
+  int month = (h + l - 7 * m + 114) / 31;
+  int day = ((h + l - 7 * m + 114) % 31) + 1;
+  return date(y, month, day);
+}
+
+/// Fixed date holidays falling on Saturday are observed on Friday and on
+/// Sunday are observed on Monday.
+static date observed(const date& d)
+{
+  switch (d.day_of_week()) {
+    case Saturday: return d - days(1);
+    case Sunday: return d + days(1);
+    default: return d;
+  }
+}
+
+static bool is_holiday(const date& d)
+{
+  int y = d.year();
+  typedef nth_day_of_the_week_in_month nth_dow;
+  typedef last_day_of_the_week_in_month last_dow;
+
+  // New Year's Day is not observed on the Friday before.
+  date new_year(y, Jan, 1);
+  if (new_year.day_of_week() != Saturday && d == observed(new_year)) {
+    return true;
+  }
+  if (d == nth_dow(nth_dow::third, Monday, Jan).get_date(y) ||
+      d == nth_dow(nth_dow::third, Monday, Feb).get_date(y) ||
+      d == easter(y) - days(2) ||
+      d == last_dow(Monday, May).get_date(y) ||
+      (y >= 2022 && d == observed(date(y, Jun, 19))) ||
+      d == observed(date(y, Jul, 4)) ||
+      d == nth_dow(nth_dow::first, Monday, Sep).get_date(y) ||
+      d == nth_dow(nth_dow::fourth, Thursday, Nov).get_date(y) ||
+      d == observed(date(y, Dec, 25))) {
+    return true;
+  }
+  const date* end = SPECIAL_CLOSINGS +
+      sizeof(SPECIAL_CLOSINGS) / sizeof(SPECIAL_CLOSINGS[0]);
+  return std::find(SPECIAL_CLOSINGS, end, d) != end;
+}
+
+bool TradingCalendar::is_trading_day(const date& d)
+{
+  return d.day_of_week() != Saturday && d.day_of_week() != Sunday &&
+      !is_holiday(d);
+}
+
+bool TradingCalendar::is_half_day(const date& d)
+{
+  if (!is_trading_day(d)) {
+    return false;
+  }
+  int y = d.year();
+  typedef nth_day_of_the_week_in_month nth_dow;
+
+  // Day before Independence Day, day after Thanksgiving, Christmas Eve.
+  return (d == date(y, Jul, 3) && d.day_of_week() != Friday) ||
+      d == nth_dow(nth_dow::fourth, Thursday, Nov).get_date(y) + days(1) ||
+      (d == date(y, Dec, 24) && d.day_of_week() != Friday);
+}
+
+static uint64_t utc_micros(const date& d, const time_duration& est)
+{
+  return as_micros(us_eastern::local_to_utc(ptime(d, est)));
+}
+
+
+TradingCalendar::TradingCalendar(const date& first, const date& last) :
+    first_day_(first),
+    first_(as_micros(ptime(first))),
+    last_(as_micros(ptime(last + days(1))))
+{
+  for (day_iterator d(first); *d <= last; ++d) {
+    session_t s;
+    if (is_trading_day(*d)) {
+      bool half = is_half_day(*d);
+      s.ext_start = utc_micros(*d, EXT_START);
+      s.rth_start = utc_micros(*d, RTH_START_EST);
+      s.rth_end = utc_micros(*d, half ? HALF_DAY_RTH_END_EST : RTH_END_EST);
+      s.ext_end = utc_micros(*d, half ? HALF_DAY_EXT_END : EXT_END);
+    } else {
+      // Empty session at the end of the UTC day so that lookups fall
+      // through to the previous day's session.
+      uint64_t end = as_micros(ptime(*d + days(1)));
+      s.ext_start = s.rth_start = s.rth_end = s.ext_end = end;
+    }
+    sessions_.push_back(s);
+  }
+  LOG(INFO) << "Trading calendar " << first << " to " << last
+            << ", " << sessions_.size() << " days.";
+}
+
+const TradingCalendar& TradingCalendar::instance()
+{
+  static TradingCalendar calendar(date(2000, Jan, 1), date(2040, Dec, 31));
+  return calendar;
+}
+
+const session_t* TradingCalendar::session(const date& d) const
+{
+  if (d < first_day_ || static_cast<size_t>(
+          (d - first_day_).days()) >= sessions_.size()) {
+    return NULL;
+  }
+  return &sessions_[(d - first_day_).days()];
+}
+
+
+} // namespace time
+} // namespace atp
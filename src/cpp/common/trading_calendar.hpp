@@ -0,0 +1,125 @@
+#ifndef ATP_TRADING_CALENDAR_H_
+#define ATP_TRADING_CALENDAR_H_
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
+
+#include "common/time_utils.hpp"
+
+
+namespace atp {
+namespace time {
+
+
+/// Session boundaries of one trading day, in UTC micros.
+/// The session is [start, end).  If the market is closed, all four are the
+/// end of the UTC day: an empty session that lookups fall through.
+struct session_t
+{
+  boost::uint64_t ext_start;
+  boost::uint64_t rth_start;
+  boost::uint64_t rth_end;
+  boost::uint64_t ext_end;
+};
+
+
+/// Precomputed US equities trading calendar.  Each trading day (US/Eastern)
+/// in the range has its regular and extended hours resolved to UTC micros,
+/// taking into account daylight saving, weekends, NYSE holidays and early
+/// closes (13:00 regular / 17:00 extended).  Checks are a table lookup and
+/// a few integer comparisons.  Timestamps outside the range fall back to
+/// checkRTH / checkEXT.
+class TradingCalendar
+{
+ public:
+
+  TradingCalendar(const boost::gregorian::date& first,
+                  const boost::gregorian::date& last);
+
+  /// Shared calendar covering 2000 to 2040.
+  static const TradingCalendar& instance();
+
+  /// Returns true if the US/Eastern date is a full or half trading day.
+  static bool is_trading_day(const boost::gregorian::date& d);
+
+  /// Returns true if the US/Eastern date closes early.
+  static bool is_half_day(const boost::gregorian::date& d);
+
+  inline bool is_rth(boost::uint64_t ts) const
+  {
+    const session_t* s = find(ts);
+    if (s == NULL) {
+      return ts < first_ || ts >= last_ ?
+          checkRTH(as_ptime(ts)) : false;
+    }
+    return ts >= s->rth_start && ts < s->rth_end;
+  }
+
+  inline bool is_ext(boost::uint64_t ts) const
+  {
+    const session_t* s = find(ts);
+    if (s == NULL) {
+      return ts < first_ || ts >= last_ ?
+          checkEXT(as_ptime(ts)) : false;
+    }
+    return ts >= s->ext_start && ts < s->ext_end;
+  }
+
+  /// Returns true if the timestamp is within extended hours and, if rth,
+  /// also within the regular trading hours.
+  inline bool check(boost::uint64_t ts, bool rth) const
+  {
+    return rth ? is_rth(ts) : is_ext(ts);
+  }
+
+  /// Returns the session of the given US/Eastern date, or NULL if the date
+  /// is outside the range of the calendar.
+  const session_t* session(const boost::gregorian::date& d) const;
+
+ private:
+
+  static const boost::uint64_t DAY_MICROS = 24ULL * 60 * 60 * 1000000;
+
+  /// Sessions of US/Eastern day d start on UTC day d (at 08:00 or 09:00)
+  /// and may end on UTC day d + 1, so only two entries can contain ts.
+  inline const session_t* find(boost::uint64_t ts) const
+  {
+    if (ts < first_ || ts >= last_) {
+      return NULL;
+    }
+    size_t day = (ts - first_) / DAY_MICROS;
+    const session_t* s = &sessions_[day];
+    if (ts < s->ext_start && day > 0) {
+      --s;
+    }
+    return ts < s->ext_end ? s : NULL;
+  }
+
+  boost::gregorian::date first_day_;
+  boost::uint64_t first_;
+  boost::uint64_t last_;
+  std::vector<session_t> sessions_;
+};
+
+
+/// Returns true if time given is within the regular trading hours (RTH)
+/// of a trading day.
+inline bool is_rth(boost::uint64_t ts)
+{
+  return TradingCalendar::instance().is_rth(ts);
+}
+
+/// Returns true if time given is within the extended trading hours (EXT)
+/// of a trading day.
+inline bool is_ext(boost::uint64_t ts)
+{
+  return TradingCalendar::instance().is_ext(ts);
+}
+
+
+} // namespace time
+} // namespace atp
+
+#endif //ATP_TRADING_CALENDAR_H_
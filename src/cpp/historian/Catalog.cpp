@@ -0,0 +1,274 @@
+
+#include <algorithm>
+
+#include "common/intern_table.hpp"
+#include "historian/Catalog.hpp"
+
+
+namespace historian {
+
+using boost::uint64_t;
+using std::string;
+using std::vector;
+
+
+struct StartsBefore
+{
+  template <typename I>
+  bool operator()(const I& interval, uint64_t t) const
+  {
+    return interval.start < t;
+  }
+
+  template <typename I>
+  bool operator()(uint64_t t, const I& interval) const
+  {
+    return t < interval.start;
+  }
+};
+
+
+void Catalog::Index::insert(const interval_t& interval)
+{
+  // Inserted after intervals with the same start.
+  vector<interval_t>::iterator pos =
+      std::upper_bound(intervals.begin(), intervals.end(),
+                       interval.start, StartsBefore());
+  size_t i = pos - intervals.begin();
+  intervals.insert(pos, interval);
+  maxStop.push_back(0);
+  rebuild(i);
+}
+
+void Catalog::Index::erase(size_t i)
+{
+  intervals.erase(intervals.begin() + i);
+  maxStop.pop_back();
+  rebuild(i);
+}
+
+void Catalog::Index::rebuild(size_t from)
+{
+  for (size_t i = from; i < intervals.size(); ++i) {
+    uint64_t before = i > 0 ? maxStop[i - 1] : 0;
+    maxStop[i] = std::max(before, intervals[i].stop);
+  }
+}
+
+void Catalog::Index::find(uint64_t first, uint64_t last,
+                          vector<size_t>* found) const
+{
+  // Intervals that start before last.
+  size_t end = std::lower_bound(intervals.begin(), intervals.end(),
+                                last, StartsBefore()) - intervals.begin();
+  size_t mark = found->size();
+  for (size_t i = end; i > 0 && maxStop[i - 1] >= first; --i) {
+    if (intervals[i - 1].stop >= first) {
+      found->push_back(i - 1);
+    }
+  }
+  std::reverse(found->begin() + mark, found->end());
+}
+
+
+Catalog::Catalog(uint64_t maxGapMicros) :
+    maxGap_(maxGapMicros), sessions_(0)
+{
+}
+
+void Catalog::Add(const SessionLog& log)
+{
+  interval_t interval;
+  interval.start = log.start_timestamp();
+  interval.stop = std::max(log.start_timestamp(), log.stop_timestamp());
+  interval.records = log.records();
+  interval.source = log.source();
+
+  boost::mutex::scoped_lock lock(mutex_);
+  Index& index = index_[log.symbol()];
+
+  vector<size_t> overlaps;
+  index.find(interval.start, interval.stop + 1, &overlaps);
+
+  uint64_t observed = 0;
+  for (vector<size_t>::reverse_iterator i = overlaps.rbegin();
+       i != overlaps.rend(); ++i) {
+    const interval_t& other = index.intervals[*i];
+    if (other.start == interval.start && other.stop == interval.stop &&
+        other.source == interval.source) {
+      return;  // already known
+    }
+    if (other.source.empty()) {
+      // Built from writes of the records of this session.
+      interval.start = std::min(interval.start, other.start);
+      interval.stop = std::max(interval.stop, other.stop);
+      observed += other.records;
+      index.erase(*i);
+      --sessions_;
+    }
+  }
+  if (interval.records == 0) {
+    interval.records = observed;
+  }
+  index.insert(interval);
+  ++sessions_;
+}
+
+void Catalog::Update(const string& symbol, uint64_t ts, bool isNew)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  update(index_[symbol], ts, isNew);
+}
+
+void Catalog::Update(atp::common::intern_id_t symbolId, uint64_t ts,
+                     bool isNew)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  Index* index = indexOf(symbolId);
+  if (index != NULL) {
+    update(*index, ts, isNew);
+  }
+}
+
+void Catalog::Update(const vector<written_t>& written)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  for (vector<written_t>::const_iterator w = written.begin();
+       w != written.end(); ++w) {
+    Index* index = w->symbolId != atp::common::NO_INTERN_ID ?
+        indexOf(w->symbolId) : &index_[*w->symbol];
+    if (index != NULL) {
+      update(*index, w->ts, w->isNew);
+    }
+  }
+}
+
+Catalog::Index* Catalog::indexOf(atp::common::intern_id_t symbolId)
+{
+  if (symbolId < byId_.size() && byId_[symbolId] != NULL) {
+    return byId_[symbolId];
+  }
+  const string& symbol = atp::common::symbols().name(symbolId);
+  if (symbol.empty()) {
+    return NULL;  // not an id of this process' table
+  }
+  if (symbolId >= byId_.size()) {
+    byId_.resize(symbolId + 1, NULL);
+  }
+  byId_[symbolId] = &index_[symbol];  // map nodes are never moved
+  return byId_[symbolId];
+}
+
+void Catalog::update(Index& index, uint64_t ts, bool isNew)
+{
+  uint64_t first = ts > maxGap_ ? ts - maxGap_ : 0;
+
+  // Appending to the last interval, built from writes, with no other
+  // interval near ts: the common case of records written in order.
+  size_t n = index.intervals.size();
+  if (n > 0 && index.intervals[n - 1].source.empty() &&
+      index.intervals[n - 1].start <= ts &&
+      index.intervals[n - 1].stop >= first &&
+      (n == 1 || index.maxStop[n - 2] < first)) {
+    interval_t& last = index.intervals[n - 1];
+    bool inside = ts <= last.stop;
+    if (isNew || !inside) {
+      ++last.records;
+    }
+    last.stop = std::max(last.stop, ts);
+    index.maxStop[n - 1] = std::max(index.maxStop[n - 1], last.stop);
+    return;
+  }
+
+  // Intervals within the gap of ts, on either side.
+  vector<size_t>& near = near_;
+  near.clear();
+  index.find(first, ts + maxGap_ + 1, &near);
+
+  bool inside = false;
+  for (vector<size_t>::const_iterator i = near.begin(); i != near.end(); ++i) {
+    const interval_t& interval = index.intervals[*i];
+    if (interval.start <= ts && ts <= interval.stop) {
+      if (!interval.source.empty()) {
+        return;  // counted by the session log
+      }
+      inside = true;
+    }
+  }
+
+  // ts and the intervals built from writes near it become one interval.
+  // A record inside one may be written again, e.g. by a reload, so it is
+  // only counted if known to be new.
+  interval_t merged;
+  merged.start = ts;
+  merged.stop = ts;
+  merged.records = (isNew || !inside) ? 1 : 0;
+  for (vector<size_t>::reverse_iterator i = near.rbegin();
+       i != near.rend(); ++i) {
+    const interval_t& interval = index.intervals[*i];
+    if (!interval.source.empty()) {
+      continue;
+    }
+    merged.start = std::min(merged.start, interval.start);
+    merged.stop = std::max(merged.stop, interval.stop);
+    merged.records += interval.records;
+    index.erase(*i);
+    --sessions_;
+  }
+  index.insert(merged);
+  ++sessions_;
+}
+
+void Catalog::find(const string& symbol, const Index& index,
+                   uint64_t first, uint64_t last,
+                   vector<SessionLog>* sessions) const
+{
+  vector<size_t> found;
+  index.find(first, last, &found);
+  for (vector<size_t>::const_iterator i = found.begin();
+       i != found.end(); ++i) {
+    const interval_t& interval = index.intervals[*i];
+    SessionLog log;
+    log.set_symbol(symbol);
+    log.set_start_timestamp(interval.start);
+    log.set_stop_timestamp(interval.stop);
+    log.set_source(interval.source);
+    if (interval.records > 0) {
+      log.set_records(interval.records);
+    }
+    sessions->push_back(log);
+  }
+}
+
+size_t Catalog::Find(const string& symbol, uint64_t first, uint64_t last,
+                     vector<SessionLog>* sessions) const
+{
+  size_t count = sessions->size();
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!symbol.empty()) {
+    std::map<string, Index>::const_iterator found = index_.find(symbol);
+    if (found != index_.end()) {
+      find(symbol, found->second, first, last, sessions);
+    }
+  } else {
+    for (std::map<string, Index>::const_iterator itr = index_.begin();
+         itr != index_.end(); ++itr) {
+      find(itr->first, itr->second, first, last, sessions);
+    }
+  }
+  return sessions->size() - count;
+}
+
+size_t Catalog::Symbols() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return index_.size();
+}
+
+size_t Catalog::Sessions() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return sessions_;
+}
+
+} // namespace historian
@@ -0,0 +1,121 @@
+#ifndef HISTORIAN_CATALOG_H_
+#define HISTORIAN_CATALOG_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+
+#include "common.hpp"
+#include "common/intern_table.hpp"
+#include "proto/historian.pb.h"
+
+
+namespace historian {
+
+using proto::historian::SessionLog;
+
+
+/// In-memory catalog of the data in the db: for each symbol, the sessions
+/// (time intervals) for which there are records.  Loaded from the session
+/// logs in the db and extended as records are written, so that clients can
+/// find out what data there is without scanning the db.
+///
+/// Thread safe.
+class Catalog : NoCopyAndAssign
+{
+ public:
+
+  /// Records more than maxGapMicros after the end of a session start a new
+  /// session.
+  explicit Catalog(boost::uint64_t maxGapMicros = 5 * 60 * 1000000ULL);
+
+  /// Adds a session log.  Sessions built from written records that overlap
+  /// it are merged into it.
+  void Add(const SessionLog& log);
+
+  /// Records that a record of the symbol at ts was written.  isNew if
+  /// the record was not in the db before; otherwise it is counted only if
+  /// ts is outside the sessions known, so that writing the same records
+  /// again does not count them twice.  Records inside a session log are
+  /// counted by the log.
+  void Update(const std::string& symbol, boost::uint64_t ts,
+              bool isNew = false);
+
+  /// As above, for the symbol with the id in atp::common::symbols().  The
+  /// caller checks the intern stamp of ids from other processes.  After
+  /// the first update of a symbol, finding its sessions is array indexing.
+  void Update(atp::common::intern_id_t symbolId, boost::uint64_t ts,
+              bool isNew = false);
+
+  /// A record written, by symbol id if not NO_INTERN_ID, else by symbol.
+  struct written_t
+  {
+    const std::string* symbol;
+    atp::common::intern_id_t symbolId;
+    boost::uint64_t ts;
+    bool isNew;
+  };
+
+  /// Updates for the records of a batch, under one lock.
+  void Update(const std::vector<written_t>& written);
+
+  /// Appends the sessions of the symbol, or all symbols if symbol is empty,
+  /// that overlap [first, last), ordered by symbol and start.  Returns the
+  /// number of sessions found.
+  size_t Find(const std::string& symbol,
+              boost::uint64_t first, boost::uint64_t last,
+              std::vector<SessionLog>* sessions) const;
+
+  size_t Symbols() const;
+
+  size_t Sessions() const;
+
+ private:
+
+  struct interval_t
+  {
+    boost::uint64_t start;
+    boost::uint64_t stop;      // inclusive
+    boost::uint64_t records;   // 0 if unknown
+    std::string source;        // empty if built from writes
+  };
+
+  /// Intervals of a symbol sorted by start, with maxStop[i] the latest stop
+  /// of intervals 0..i.  A search walks back from the last interval that
+  /// starts before the end of the range, and stops as soon as maxStop is
+  /// before the start of the range.  Appends, the common case for writes,
+  /// only touch the last interval.
+  struct Index
+  {
+    std::vector<interval_t> intervals;
+    std::vector<boost::uint64_t> maxStop;
+
+    void insert(const interval_t& interval);
+    void erase(size_t i);
+    void rebuild(size_t from);
+    void find(boost::uint64_t first, boost::uint64_t last,
+              std::vector<size_t>* found) const;
+  };
+
+  // Must hold the lock
+  void update(Index& index, boost::uint64_t ts, bool isNew);
+  Index* indexOf(atp::common::intern_id_t symbolId);
+
+  void find(const std::string& symbol, const Index& index,
+            boost::uint64_t first, boost::uint64_t last,
+            std::vector<SessionLog>* sessions) const;
+
+  boost::uint64_t maxGap_;
+  mutable boost::mutex mutex_;
+  std::map<std::string, Index> index_;
+  std::vector<Index*> byId_;  // into index_, by symbol id
+  std::vector<size_t> near_;  // scratch of update
+  size_t sessions_;
+};
+
+} // namespace historian
+
+#endif //HISTORIAN_CATALOG_H_
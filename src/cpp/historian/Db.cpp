@@ -1,7 +1,10 @@
 
+#include <limits>
 #include <sstream>
 
 #include <boost/optional.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -16,7 +19,10 @@
 
 #include "historian/historian.hpp"
 #include "historian/internal.hpp"
+#include "historian/Catalog.hpp"
+#include "historian/DuplicateFilter.hpp"
 
+#include "varz/trace.hpp"
 #include "varz/varz.hpp"
 
 
@@ -32,6 +38,7 @@ using proto::historian::Type;
 
 using proto::historian::QueryByRange;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
 
 
 DEFINE_int32(leveldb_max_open_files, 0,
@@ -41,11 +48,13 @@ DEFINE_int32(leveldb_block_size, 0,
 DEFINE_int32(leveldb_write_buffer_size, 0,
              "Leveldb write buffer size - default is 4MB");
 
-DEFINE_VARZ_int64(leveldb_writes, 0, "total writes");
-DEFINE_VARZ_int64(leveldb_write_start, 0, "timestamp for start of write");
-DEFINE_VARZ_int64(leveldb_write_finish, 0, "timestamp for finish of write");
-DEFINE_VARZ_int64(leveldb_write_elapsed, 0, "micros from write start to finish");
-DEFINE_VARZ_int64(leveldb_write_micros, 0, "micros taken to write");
+DEFINE_VARZ_counter(leveldb_writes, "total writes");
+DEFINE_VARZ_gauge(leveldb_write_start, 0, "timestamp for start of write");
+DEFINE_VARZ_gauge(leveldb_write_finish, 0, "timestamp for finish of write");
+DEFINE_VARZ_gauge(leveldb_write_elapsed, 0, "micros from write start to finish");
+DEFINE_VARZ_histogram(leveldb_write_micros, "micros taken to write");
+DEFINE_VARZ_histogram(historian_catalog_update_micros,
+                      "micros in updating the catalog for a write or a batch");
 
 
 namespace historian {
@@ -60,6 +69,7 @@ class Db::implementation
 
   ~implementation()
   {
+    dedup_.Stop();  // the loader reads the db
     if (levelDb_ != NULL) {
       delete levelDb_;
     }
@@ -82,6 +92,7 @@ class Db::implementation
 
     leveldb::Status status = leveldb::DB::Open(options, dbFile_, &levelDb_);
     if (status.ok()) {
+      loadCatalog();
       return true;
     } else {
       levelDb_ = NULL;
@@ -90,22 +101,92 @@ class Db::implementation
   }
 
   /**
-   * Writing to db via Writer objects.
+   * Writing to db via Writer objects.  Duplicates of records are
+   * checked via the duplicate filter instead of reading the key.
    */
   template <typename T>
   bool write(const T& value, bool overwrite = true)
   {
-    internal::Writer<T> writer;
-    VARZ_leveldb_write_start = now_micros();
-    VARZ_leveldb_write_micros = VARZ_leveldb_write_start;
+    if (overwrite) {
+      return write_record(value);
+    }
+    std::vector<T> values(1, value);
+    return write(values, overwrite) == 1;
+  }
+
+  bool write(const SessionLog& value, bool overwrite = true)
+  {
+    // Few and keyed by start and stop; read before write as before.
+    return write_record(value, overwrite);
+  }
 
-    // If write blocks for a long time, VARZ_leveldb_write_micros will be a large
-    // value that can be easily detected.
+  /**
+   * Writes the values, skipping those already in the db if not overwrite.
+   * Returns the number of values written.
+   */
+  template <typename T>
+  int write(const std::vector<T>& values, bool overwrite = true)
+  {
+    internal::KeyBuilder<T> buildKey;
+    std::vector<std::string> keys;
+    keys.reserve(values.size());
+    for (typename std::vector<T>::const_iterator v = values.begin();
+         v != values.end(); ++v) {
+      keys.push_back(buildKey(*v));
+    }
+
+    std::vector<bool> duplicate(values.size(), false);
+    if (!overwrite && levelDb_ != NULL) {
+      boost::lock_guard<boost::mutex> lock(dedupMutex_);
+      dedup_.Check(levelDb_, keys, &duplicate);
+    }
+
+    // The catalog is updated for the whole batch at once.
+    std::vector<Catalog::written_t> catalogUpdates;
+    catalogUpdates.reserve(values.size());
+
+    int written = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (duplicate[i]) {
+        continue;
+      }
+      // Known to be new if checked for duplicates.
+      if (write_record(values[i], true, !overwrite, &catalogUpdates)) {
+        boost::lock_guard<boost::mutex> lock(dedupMutex_);
+        dedup_.Added(keys[i]);
+        ++written;
+      }
+    }
+    if (!catalogUpdates.empty()) {
+      boost::int64_t start = now_micros();
+      catalog_.Update(catalogUpdates);
+      VARZ_historian_catalog_update_micros.Record(now_micros() - start);
+    }
+    return written;
+  }
+
+  /// New records are not in the db before; see Catalog::Update.  The
+  /// catalog update is appended to catalogUpdates if given.
+  template <typename T>
+  bool write_record(const T& value, bool overwrite = true, bool isNew = false,
+                    std::vector<Catalog::written_t>* catalogUpdates = NULL)
+  {
+    internal::Writer<T> writer;
+    // If write blocks for a long time, VARZ_leveldb_write_start will be
+    // after VARZ_leveldb_write_finish, which can be easily detected.
+    // Writers may be on several threads; the gauges show the last write.
+    boost::int64_t start = now_micros();
+    VARZ_leveldb_write_start = start;
 
     bool written = writer(value, levelDb_, overwrite);
-    VARZ_leveldb_write_finish = now_micros();
-    VARZ_leveldb_write_elapsed = VARZ_leveldb_write_finish - VARZ_leveldb_write_start;
-    VARZ_leveldb_write_micros = VARZ_leveldb_write_finish - VARZ_leveldb_write_micros;
+    if (written) {
+      // Not overwriting, the writer only writes records not in the db.
+      updateCatalog(value, isNew || !overwrite, catalogUpdates);
+    }
+    boost::int64_t finish = now_micros();
+    VARZ_leveldb_write_finish = finish;
+    VARZ_leveldb_write_elapsed = finish - start;
+    VARZ_leveldb_write_micros.Record(finish - start);
     VARZ_leveldb_writes++;
     return written;
   }
@@ -136,14 +217,103 @@ class Db::implementation
     return count;
   }
 
+  int query(const QueryCatalog& query, Visitor* visit)
+  {
+    uint64_t last = query.has_utc_last_micros() ?
+        query.utc_last_micros() : std::numeric_limits<uint64_t>::max();
+    std::vector<SessionLog> sessions;
+    catalog_.Find(query.symbol(), query.utc_first_micros(), last, &sessions);
+
+    internal::KeyBuilder<SessionLog> buildKey;
+    int count = 0;
+    for (std::vector<SessionLog>::const_iterator log = sessions.begin();
+         log != sessions.end(); ++log, ++count) {
+      Record record = proto::historian::wrap<SessionLog>(*log);
+      record.set_key(buildKey(*log));
+      if (!(*visit)(record)) break;
+    }
+    return count;
+  }
+
   const std::string GetDbPath()
   {
     return dbFile_;
   }
 
  private:
+
+  /// Loads the session logs in the db into the catalog.
+  void loadCatalog()
+  {
+    boost::scoped_ptr<leveldb::Iterator> iterator(
+        levelDb_->NewIterator(leveldb::ReadOptions()));
+    const std::string start = ENTITY_SESSION_LOG + ':';
+    const std::string stop = ENTITY_SESSION_LOG + ';';
+    int count = 0;
+    for (iterator->Seek(start);
+         iterator->Valid() && iterator->key().ToString() < stop;
+         iterator->Next()) {
+      Record record;
+      if (record.ParseFromString(iterator->value().ToString()) &&
+          record.has_session_log()) {
+        catalog_.Add(record.session_log());
+        ++count;
+      }
+    }
+    LOG(INFO) << "Catalog loaded " << count << " session logs, "
+              << catalog_.Symbols() << " symbols.";
+  }
+
+  void updateCatalog(const SessionLog& log, bool isNew,
+                     std::vector<Catalog::written_t>* catalogUpdates)
+  {
+    catalog_.Add(log);
+  }
+
+  template <typename T>
+  void updateCatalog(const T& value, bool isNew,
+                     std::vector<Catalog::written_t>* catalogUpdates)
+  {
+    Catalog::written_t w = written(value, isNew);
+    if (catalogUpdates != NULL) {
+      catalogUpdates->push_back(w);
+      return;
+    }
+    boost::int64_t start = now_micros();
+    if (w.symbolId != atp::common::NO_INTERN_ID) {
+      catalog_.Update(w.symbolId, w.ts, isNew);
+    } else {
+      catalog_.Update(*w.symbol, w.ts, isNew);
+    }
+    VARZ_historian_catalog_update_micros.Record(now_micros() - start);
+  }
+
+  /// Catalog update of a record; by symbol id if the record has one of
+  /// this process' intern tables.
+  static Catalog::written_t written(const MarketData& value, bool isNew)
+  {
+    Catalog::written_t w = { &value.symbol(), atp::common::NO_INTERN_ID,
+                             value.timestamp(), isNew };
+    if (value.has_symbol_id() &&
+        atp::common::is_local_intern_stamp(value.intern_stamp())) {
+      w.symbolId = value.symbol_id();
+    }
+    return w;
+  }
+
+  template <typename T>
+  static Catalog::written_t written(const T& value, bool isNew)
+  {
+    Catalog::written_t w = { &value.symbol(), atp::common::NO_INTERN_ID,
+                             value.timestamp(), isNew };
+    return w;
+  }
+
   std::string dbFile_;
   leveldb::DB* levelDb_;
+  DuplicateFilter dedup_;
+  boost::mutex dedupMutex_;  // writers may be on several threads
+  Catalog catalog_;
 };
 
 
@@ -165,16 +335,48 @@ int Db::Query(const QueryByRange& query, Visitor* visit)
   return impl_->query(query.first(), query.last(), visit);
 }
 
+int Db::Query(const QueryCatalog& query, Visitor* visit)
+{
+  return impl_->query(query, visit);
+}
+
 int Db::Query(const std::string& start, const std::string& stop,
              Visitor* visit)
 {
   return impl_->query(start, stop, visit);
 }
 
+int Db::Query(proto::historian::Type type, atp::common::intern_id_t symbolId,
+              boost::uint32_t internStamp,
+              boost::uint64_t first, boost::uint64_t last, Visitor* visit)
+{
+  QueryBySymbol query;
+  query.set_type(type);
+  query.set_symbol("");
+  query.set_symbol_id(symbolId);
+  query.set_intern_stamp(internStamp);
+  query.set_utc_first_micros(first);
+  query.set_utc_last_micros(last);
+  return Query(query, visit);
+}
+
 int Db::Query(const QueryBySymbol& query, Visitor* visit)
 {
   using namespace historian::internal;
   using namespace proto::historian;
+  if (query.symbol().empty() && query.has_symbol_id()) {
+    if (!atp::common::is_local_intern_stamp(query.intern_stamp())) {
+      LOG(WARNING) << "Query with ids of other intern tables, stamp "
+                   << query.intern_stamp();
+      return 0;
+    }
+    QueryBySymbol byName(query);
+    byName.set_symbol(atp::common::symbols().name(query.symbol_id()));
+    if (byName.symbol().empty()) {
+      return 0;  // unknown id
+    }
+    return Query(byName, visit);
+  }
   switch (query.type()) {
     case IB_MARKET_DATA: {
       KeyBuilder<MarketData> buildKey;
@@ -230,7 +432,11 @@ template <typename T>
 bool Db::Write(const T& value, bool overwrite)
 {
   if (!validate(value)) return false;
-  return impl_->write(value, overwrite);
+  bool written = impl_->write(value, overwrite);
+  if (written) {
+    atp::varz::TraceCurrent(atp::varz::TRACE_WRITE);
+  }
+  return written;
 }
 
 // Instantiate the templates for the closed set of types we support:
@@ -238,6 +444,31 @@ template bool Db::Write<MarketData>(const MarketData&, bool);
 template bool Db::Write<MarketDepth>(const MarketDepth&, bool);
 template bool Db::Write<SessionLog>(const SessionLog&, bool);
 
+template <typename T>
+int Db::Write(const std::vector<T>& values, bool overwrite)
+{
+  typename std::vector<T>::const_iterator v = values.begin();
+  for (; v != values.end() && validate(*v); ++v) {}
+  int written = 0;
+  if (v == values.end()) {
+    written = impl_->write(values, overwrite);
+  } else {
+    // Copy only if there are invalid values to drop.
+    std::vector<T> valid;
+    for (v = values.begin(); v != values.end(); ++v) {
+      if (validate(*v)) valid.push_back(*v);
+    }
+    written = impl_->write(valid, overwrite);
+  }
+  if (written > 0) {
+    atp::varz::TraceCurrent(atp::varz::TRACE_WRITE);
+  }
+  return written;
+}
+
+template int Db::Write<MarketData>(const std::vector<MarketData>&, bool);
+template int Db::Write<MarketDepth>(const std::vector<MarketDepth>&, bool);
+
 const std::string Db::GetDbPath()
 {
   return impl_->GetDbPath();
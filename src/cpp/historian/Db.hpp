@@ -2,9 +2,12 @@
 #define HISTORIAN_DB_H_
 
 #include <string>
+#include <vector>
 
+#include <boost/cstdint.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include "common/intern_table.hpp"
 
 #include "historian/Visitor.hpp"
 
@@ -13,6 +16,7 @@ namespace historian {
 
 using proto::historian::QueryByRange;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
 
 class Db
 {
@@ -26,11 +30,29 @@ class Db
 
   template <typename T> bool Write(const T& value, bool overwrite = true);
 
+  /// Writes a batch of values; returns the number written.  With overwrite
+  /// false, values already in the db are skipped, checked for the whole
+  /// batch at once.
+  template <typename T> int Write(const std::vector<T>& values,
+                                  bool overwrite = true);
+
   int Query(const std::string& start, const std::string& stop,
             Visitor* visit);
   int Query(const QueryByRange& query, Visitor* visit);
   int Query(const QueryBySymbol& query, Visitor* visit);
 
+  /// Query by symbol, with the symbol given by its interned id and the
+  /// intern stamp of the caller's tables; finds nothing if the stamp is not
+  /// that of this process' tables.  Records written with ids (MarketData
+  /// symbol_id and intern_stamp) update the catalog by id as well.
+  int Query(proto::historian::Type type, atp::common::intern_id_t symbolId,
+            boost::uint32_t internStamp,
+            boost::uint64_t first, boost::uint64_t last, Visitor* visit);
+
+  /// Sessions of data available, from the in-memory catalog; does not
+  /// touch the db.
+  int Query(const QueryCatalog& query, Visitor* visit);
+
   const std::string GetDbPath();
 
 
@@ -24,6 +24,7 @@ using proto::historian::Query;
 using proto::historian::Query_Type;
 using proto::historian::QueryByRange;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
 
 
 namespace historian {
@@ -42,6 +43,12 @@ inline void set(Query* query, const QueryBySymbol& q)
   query->mutable_query_by_symbol()->CopyFrom(q);
 }
 
+inline void set(Query* query, const QueryCatalog& q)
+{
+  query->set_type(proto::historian::Query_Type_QUERY_CATALOG);
+  query->mutable_query_catalog()->CopyFrom(q);
+}
+
 template <typename T>
 size_t send(Query_Type type, const T& q,
             const boost::scoped_ptr<socket_t>& socket, const string& callback)
@@ -218,6 +225,22 @@ int DbReactorClient::Query(const QueryBySymbol& query, Visitor* visitor)
   }
   return 0;
 }
+
+int DbReactorClient::Query(const QueryCatalog& query, Visitor* visitor)
+{
+  using namespace historian::internal;
+  if (send(proto::historian::Query_Type_QUERY_CATALOG, query, socket_,
+           callbackEndpoint_) > 0) {
+    string message;
+    uint64_t responseId = processQueryResponse(socket_, &message);
+    if (responseId > 0) {
+      return processCallback(responseId, callbackSocket_, visitor);
+    } else {
+      HISTORIAN_REACTOR_ERROR << "Error from server: " << message;
+    }
+  }
+  return 0;
+}
 } // historian
 
 
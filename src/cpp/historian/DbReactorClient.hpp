@@ -15,6 +15,7 @@ using zmq::context_t;
 using zmq::socket_t;
 using proto::historian::QueryByRange;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
 
 
 class DbReactorClient
@@ -30,6 +31,9 @@ class DbReactorClient
 
   int Query(const QueryBySymbol& query, Visitor* visitor);
 
+  /// Visits SessionLog records of the data available.
+  int Query(const QueryCatalog& query, Visitor* visitor);
+
  private:
   string endpoint_;
   string callbackEndpoint_;
@@ -32,6 +32,7 @@ using proto::historian::Query;
 using proto::historian::Query_Type;
 using proto::historian::QueryByRange;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
 
 
 class DbVisitor : public historian::Visitor
@@ -110,7 +111,11 @@ ostream& operator<<(ostream& out, const QueryBySymbol& q)
 {
   out << "QueryBySymbol<"
       << q.type() << ">@"
-      << q.symbol()
+      << q.symbol();
+  if (q.has_symbol_id()) {
+    out << "#" << q.symbol_id() << "/" << q.intern_stamp();
+  }
+  out
       << "[" << q.utc_first_micros()
       << ", " << q.utc_last_micros()
       << ")"
@@ -119,6 +124,16 @@ ostream& operator<<(ostream& out, const QueryBySymbol& q)
   return out;
 }
 
+ostream& operator<<(ostream& out, const QueryCatalog& q)
+{
+  out << "QueryCatalog@"
+      << (q.has_symbol() ? q.symbol() : "*")
+      << "[" << q.utc_first_micros()
+      << ", " << q.utc_last_micros()
+      << ")";
+  return out;
+}
+
 template <typename Q>
 inline int handleQuery(const uint64_t responseId,
                        const boost::shared_ptr<Db>& db,
@@ -136,6 +151,10 @@ template int handleQuery<QueryBySymbol>(const uint64_t responseId,
                                         const boost::shared_ptr<Db>&,
                                         const QueryBySymbol&, socket_t&);
 
+template int handleQuery<QueryCatalog>(const uint64_t responseId,
+                                       const boost::shared_ptr<Db>&,
+                                       const QueryCatalog&, socket_t&);
+
 
 class CallbackStreamer
 {
@@ -190,6 +209,12 @@ class CallbackStreamer
             (responseId_, db_, query_.query_by_symbol(), *callback_);
         break;
 
+
+      case Query_Type_QUERY_CATALOG :
+        count = handleQuery<QueryCatalog>
+            (responseId_, db_, query_.query_catalog(), *callback_);
+        break;
+
     }
     uint64_t elapsed = now_micros() - start;
 
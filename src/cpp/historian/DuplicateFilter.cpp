@@ -0,0 +1,332 @@
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <glog/logging.h>
+
+#include "historian/DuplicateFilter.hpp"
+#include "varz/varz.hpp"
+
+
+DEFINE_VARZ_int64(historian_dedup_keys_checked, 0,
+                  "keys checked for duplicates");
+DEFINE_VARZ_int64(historian_dedup_keys_probed, 0,
+                  "keys that hit the bloom filter and were read from db");
+DEFINE_VARZ_int64(historian_dedup_duplicates, 0, "duplicate keys found");
+DEFINE_VARZ_int64(historian_dedup_sessions_loaded, 0,
+                  "sessions scanned into bloom filters");
+
+
+namespace historian {
+
+using boost::uint64_t;
+using std::string;
+using std::vector;
+
+
+static const uint64_t DAY_MICROS = 24ULL * 60 * 60 * 1000000;
+
+/// Number of Next() tried before Seek() when sweeping to the next key.
+static const int MAX_NEXT_BEFORE_SEEK = 8;
+
+
+static uint64_t fnv1a(const string& s)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < s.size(); ++i) {
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+BloomFilter::BloomFilter(size_t expectedKeys, size_t bitsPerKey) :
+    numBits_(std::max<size_t>(64, expectedKeys * bitsPerKey)),
+    // k = ln 2 * bits per key, rounded
+    numHashes_(std::max<size_t>(1, (bitsPerKey * 69 + 50) / 100)),
+    count_(0)
+{
+  bits_.resize((numBits_ + 63) / 64, 0);
+  numBits_ = bits_.size() * 64;
+}
+
+void BloomFilter::Add(const string& key)
+{
+  uint64_t h = fnv1a(key);
+  uint64_t h1 = h & 0xffffffff;
+  uint64_t h2 = (h >> 32) | 1;
+  for (size_t i = 0; i < numHashes_; ++i) {
+    uint64_t bit = (h1 + i * h2) % numBits_;
+    bits_[bit / 64] |= (1ULL << (bit % 64));
+  }
+  ++count_;
+}
+
+bool BloomFilter::MayContain(const string& key) const
+{
+  uint64_t h = fnv1a(key);
+  uint64_t h1 = h & 0xffffffff;
+  uint64_t h2 = (h >> 32) | 1;
+  for (size_t i = 0; i < numHashes_; ++i) {
+    uint64_t bit = (h1 + i * h2) % numBits_;
+    if ((bits_[bit / 64] & (1ULL << (bit % 64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+DuplicateFilter::DuplicateFilter(size_t maxSessions,
+                                 size_t expectedKeysPerSession) :
+    maxSessions_(maxSessions),
+    expectedKeysPerSession_(expectedKeysPerSession),
+    loading_(false),
+    stopping_(false),
+    generation_(0)
+{
+}
+
+DuplicateFilter::~DuplicateFilter()
+{
+  Stop();
+}
+
+static string as_string(uint64_t v)
+{
+  char buff[24];
+  int len = snprintf(buff, sizeof(buff), "%llu",
+                     static_cast<unsigned long long>(v));
+  return string(buff, len);
+}
+
+BloomFilter* DuplicateFilter::GetSession(leveldb::DB* db, const string& key)
+{
+  size_t pos = key.rfind(':');
+  if (pos == string::npos || pos + 1 == key.size()) {
+    return NULL;
+  }
+  uint64_t ts = strtoull(key.c_str() + pos + 1, NULL, 10);
+  if (ts == 0) {
+    return NULL;
+  }
+  const string prefix = key.substr(0, pos + 1);
+  uint64_t day = ts / DAY_MICROS;
+  const string id = prefix + as_string(day);
+
+  std::map<string, Session>::iterator found = sessions_.find(id);
+  if (found != sessions_.end()) {
+    return found->second.filter.get();
+  }
+  if (stopping_) {
+    return NULL;
+  }
+
+  if (sessions_.size() >= maxSessions_ && !loadOrder_.empty()) {
+    // A load in progress of the evicted session is dropped when done.
+    sessions_.erase(loadOrder_.front());
+    loadOrder_.pop_front();
+  }
+  sessions_[id] = Session();
+  loadOrder_.push_back(id);
+
+  // Timestamps in micros have the same number of digits (16) from 2001
+  // to 2286, so the keys of the day are a contiguous range.
+  Load load;
+  load.db = db;
+  load.id = id;
+  load.start = prefix + as_string(day * DAY_MICROS);
+  load.stop = prefix + as_string((day + 1) * DAY_MICROS);
+  load.generation = generation_;
+  loads_.push_back(load);
+  if (!loader_) {
+    loader_.reset(new boost::thread(
+        boost::bind(&DuplicateFilter::RunLoader, this)));
+  }
+  changed_.notify_all();
+  return NULL;
+}
+
+void DuplicateFilter::RunLoader()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  while (true) {
+    while (loads_.empty() && !stopping_) {
+      changed_.wait(lock);
+    }
+    if (stopping_) {
+      break;
+    }
+    Load load = loads_.front();
+    loads_.pop_front();
+    loading_ = true;
+    lock.unlock();
+
+    vector<string> existing;
+    boost::scoped_ptr<leveldb::Iterator> iterator(
+        load.db->NewIterator(leveldb::ReadOptions()));
+    for (iterator->Seek(load.start);
+         iterator->Valid() && iterator->key().compare(load.stop) < 0;
+         iterator->Next()) {
+      existing.push_back(iterator->key().ToString());
+    }
+    iterator.reset();
+
+    lock.lock();
+    loading_ = false;
+    std::map<string, Session>::iterator found = sessions_.find(load.id);
+    if (load.generation == generation_ && found != sessions_.end() &&
+        !found->second.filter) {
+      Session& session = found->second;
+      BloomFilterPtr filter(new BloomFilter(
+          std::max(expectedKeysPerSession_,
+                   (existing.size() + session.added.size()) * 2)));
+      for (vector<string>::const_iterator k = existing.begin();
+           k != existing.end(); ++k) {
+        filter->Add(*k);
+      }
+      // Written while loading, possibly after the scan.
+      for (vector<string>::const_iterator k = session.added.begin();
+           k != session.added.end(); ++k) {
+        filter->Add(*k);
+      }
+      session.added.clear();
+      session.filter = filter;
+      VARZ_historian_dedup_sessions_loaded++;
+
+      LOG(INFO) << "Dedup session " << load.id << " loaded with "
+                << existing.size() << " keys.";
+    }
+    changed_.notify_all();
+  }
+}
+
+void DuplicateFilter::WaitForLoads()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  while ((!loads_.empty() || loading_) && !stopping_) {
+    changed_.wait(lock);
+  }
+}
+
+void DuplicateFilter::Stop()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopping_ = true;
+    loads_.clear();
+    changed_.notify_all();
+  }
+  if (loader_) {
+    loader_->join();
+    loader_.reset();
+  }
+}
+
+struct CompareKeys
+{
+  CompareKeys(const vector<string>& keys) : keys_(keys) {}
+
+  bool operator()(size_t a, size_t b) const
+  {
+    int c = keys_[a].compare(keys_[b]);
+    return c < 0 || (c == 0 && a < b);
+  }
+
+  const vector<string>& keys_;
+};
+
+size_t DuplicateFilter::Check(leveldb::DB* db, const vector<string>& keys,
+                              vector<bool>* duplicate)
+{
+  duplicate->assign(keys.size(), false);
+  VARZ_historian_dedup_keys_checked += keys.size();
+
+  vector<size_t> sorted(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    sorted[i] = i;
+  }
+  std::sort(sorted.begin(), sorted.end(), CompareKeys(keys));
+
+  size_t duplicates = 0;
+  vector<size_t> probes;
+  boost::mutex::scoped_lock lock(mutex_);
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    const string& key = keys[sorted[i]];
+    if (i > 0 && key == keys[sorted[i - 1]]) {
+      // Repeat within the batch; the first one wins.
+      (*duplicate)[sorted[i]] = true;
+      ++duplicates;
+      continue;
+    }
+    BloomFilter* filter = GetSession(db, key);
+    if (filter == NULL || filter->MayContain(key)) {
+      probes.push_back(sorted[i]);
+    }
+  }
+  lock.unlock();
+
+  // Probes are in key order, so one iterator moves forward through them.
+  boost::scoped_ptr<leveldb::Iterator> iterator(
+      db->NewIterator(leveldb::ReadOptions()));
+  bool positioned = false;
+  for (vector<size_t>::const_iterator p = probes.begin();
+       p != probes.end(); ++p) {
+    const string& key = keys[*p];
+    if (!positioned) {
+      iterator->Seek(key);
+      positioned = true;
+    } else {
+      int steps = 0;
+      while (iterator->Valid() && iterator->key().compare(key) < 0 &&
+             steps++ < MAX_NEXT_BEFORE_SEEK) {
+        iterator->Next();
+      }
+      if (iterator->Valid() && iterator->key().compare(key) < 0) {
+        iterator->Seek(key);
+      }
+    }
+    if (iterator->Valid() && iterator->key().compare(key) == 0) {
+      (*duplicate)[*p] = true;
+      ++duplicates;
+    }
+  }
+
+  VARZ_historian_dedup_keys_probed += probes.size();
+  VARZ_historian_dedup_duplicates += duplicates;
+  return duplicates;
+}
+
+void DuplicateFilter::Added(const string& key)
+{
+  size_t pos = key.rfind(':');
+  if (pos == string::npos) {
+    return;
+  }
+  uint64_t ts = strtoull(key.c_str() + pos + 1, NULL, 10);
+  const string id = key.substr(0, pos + 1) + as_string(ts / DAY_MICROS);
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<string, Session>::iterator found = sessions_.find(id);
+  if (found == sessions_.end()) {
+    return;
+  }
+  if (found->second.filter) {
+    found->second.filter->Add(key);
+  } else {
+    found->second.added.push_back(key);
+  }
+}
+
+void DuplicateFilter::Clear()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  sessions_.clear();
+  loadOrder_.clear();
+  loads_.clear();
+  ++generation_;
+}
+
+} // namespace historian
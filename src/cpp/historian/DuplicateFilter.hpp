@@ -0,0 +1,138 @@
+#ifndef HISTORIAN_DUPLICATE_FILTER_H_
+#define HISTORIAN_DUPLICATE_FILTER_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <leveldb/db.h>
+
+#include "common.hpp"
+
+
+namespace historian {
+
+
+/// Bloom filter of strings.  Uses double hashing of a 64-bit FNV-1a hash
+/// to derive the bit positions.
+class BloomFilter
+{
+ public:
+
+  BloomFilter(size_t expectedKeys, size_t bitsPerKey = 10);
+
+  void Add(const std::string& key);
+
+  /// False means the key was definitely never added.
+  bool MayContain(const std::string& key) const;
+
+  size_t Count() const
+  {
+    return count_;
+  }
+
+ private:
+  std::vector<boost::uint64_t> bits_;
+  size_t numBits_;
+  size_t numHashes_;
+  size_t count_;
+};
+
+
+/// Finds the keys, of a batch about to be written with overwrite = false,
+/// that already exist in the db.
+///
+/// Keys are primary record keys of the form prefix:symbol:timestamp.  A
+/// session is the set of keys of one prefix:symbol in one UTC day.  The
+/// first time a session is seen, a loader thread reads its existing keys
+/// in one iterator scan into a Bloom filter, so that the write path never
+/// waits for the scan.  Until the filter is loaded, every key of the
+/// session is read from the db.  Keys written afterwards, including while
+/// the session loads, are added via Added().  A key that misses the filter
+/// is new and costs no read.  Keys that hit the filter are confirmed in
+/// one ordered iterator sweep over the batch, instead of a Get per key.
+///
+/// Check and Added are called by one thread at a time; the db must not be
+/// written to other than through the owner of the filter, and must outlive
+/// the loader (see Stop).
+class DuplicateFilter : NoCopyAndAssign
+{
+ public:
+
+  explicit DuplicateFilter(size_t maxSessions = 256,
+                           size_t expectedKeysPerSession = 1 << 16);
+
+  ~DuplicateFilter();
+
+  /// Sets (*duplicate)[i] to true if keys[i] is in the db or is a repeat
+  /// of an earlier key in the batch.  Returns the number of duplicates.
+  size_t Check(leveldb::DB* db, const std::vector<std::string>& keys,
+               std::vector<bool>* duplicate);
+
+  /// Records that the key has been written.
+  void Added(const std::string& key);
+
+  /// Drops all sessions, e.g. after the db is modified externally.
+  void Clear();
+
+  /// Blocks until the sessions seen so far are loaded.
+  void WaitForLoads();
+
+  /// Drops the loads not started and joins the loader thread.
+  void Stop();
+
+  /// Sessions loaded or loading.
+  size_t Sessions() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return sessions_.size();
+  }
+
+ private:
+
+  typedef boost::shared_ptr<BloomFilter> BloomFilterPtr;
+
+  struct Session
+  {
+    BloomFilterPtr filter;           // NULL while loading
+    std::vector<std::string> added;  // while loading
+  };
+
+  struct Load
+  {
+    leveldb::DB* db;
+    std::string id;
+    std::string start;
+    std::string stop;
+    boost::uint64_t generation;
+  };
+
+  /// Returns the filter of the session of the key, queueing the load of
+  /// the session if new.  Returns NULL if the session is loading, or if
+  /// the key has no timestamp.  Must hold the lock.
+  BloomFilter* GetSession(leveldb::DB* db, const std::string& key);
+
+  void RunLoader();
+
+  size_t maxSessions_;
+  size_t expectedKeysPerSession_;
+
+  mutable boost::mutex mutex_;
+  boost::condition_variable changed_;
+  std::map<std::string, Session> sessions_;
+  std::deque<std::string> loadOrder_;
+  std::deque<Load> loads_;
+  bool loading_;
+  bool stopping_;
+  boost::uint64_t generation_;  // of Clear
+  boost::scoped_ptr<boost::thread> loader_;
+};
+
+} // namespace historian
+
+#endif //HISTORIAN_DUPLICATE_FILTER_H_
@@ -0,0 +1,89 @@
+
+#include <map>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "log_levels.h"
+#include "proto/historian.hpp"
+
+#include "historian/GapFetcher.hpp"
+
+
+namespace historian {
+
+using boost::uint64_t;
+using proto::historian::QueryBySymbol;
+using proto::historian::Record;
+
+
+namespace internal {
+
+/// Keeps the records of the publisher in the range of the gap, by seq.
+class GapVisitor : public Visitor
+{
+ public:
+  GapVisitor(const sequence_gap_t& gap, std::map<uint64_t, string>* found) :
+      gap_(gap), found_(found)
+  {
+  }
+
+  virtual bool operator()(const Record& record)
+  {
+    if (record.has_ib_marketdata()) {
+      keep(record.ib_marketdata());
+    } else if (record.has_ib_marketdepth()) {
+      keep(record.ib_marketdepth());
+    }
+    return true;
+  }
+
+ private:
+  template <typename Message>
+  void keep(const Message& message)
+  {
+    if (message.has_seq() && message.publisher_id() == gap_.publisher &&
+        message.seq() >= gap_.first && message.seq() <= gap_.last) {
+      message.SerializeToString(&(*found_)[message.seq()]);
+    }
+  }
+
+  const sequence_gap_t& gap_;
+  std::map<uint64_t, string>* found_;
+};
+
+} // internal
+
+
+bool GapFetcher::operator()(const string& topic, const sequence_gap_t& gap,
+                            std::vector<string>* messages)
+{
+  QueryBySymbol query;
+  const string depthPrefix = ENTITY_IB_MARKET_DEPTH + ":";
+  if (boost::algorithm::starts_with(topic, depthPrefix)) {
+    query.set_type(proto::historian::IB_MARKET_DEPTH);
+    query.set_symbol(topic.substr(depthPrefix.size()));
+  } else {
+    query.set_type(proto::historian::IB_MARKET_DATA);
+    query.set_symbol(topic);
+  }
+  query.set_utc_first_micros(gap.after_ts);
+  query.set_utc_last_micros(gap.before_ts);
+
+  std::map<uint64_t, string> found;
+  internal::GapVisitor visitor(gap, &found);
+  client_->Query(query, &visitor);
+
+  for (std::map<uint64_t, string>::iterator itr = found.begin();
+       itr != found.end();
+       ++itr) {
+    messages->push_back(itr->second);
+  }
+  if (found.size() < gap.size()) {
+    LOG(WARNING) << "Found " << found.size() << " of " << gap.size()
+                 << " messages missed on " << topic << " from " << gap.first;
+  }
+  return !found.empty();
+}
+
+
+} // historian
@@ -0,0 +1,40 @@
+#ifndef HISTORIAN_GAP_FETCHER_H_
+#define HISTORIAN_GAP_FETCHER_H_
+
+#include <string>
+#include <vector>
+
+#include "common/sequence_tracker.hpp"
+#include "historian/DbReactorClient.hpp"
+
+namespace historian {
+
+
+using atp::common::sequence_gap_t;
+
+
+/// Fetches market data or depth messages missed by a subscriber from the
+/// historian, by the timestamps around the gap and the sequence numbers
+/// recorded with the messages.  Only what the historian has recorded by
+/// the time of the query is found.  For use as the gap fetcher of
+/// atp::service::MarketDataSubscriber.
+class GapFetcher
+{
+ public:
+
+  /// The client must be connected and outlive the fetcher.
+  explicit GapFetcher(DbReactorClient* client) : client_(client) {}
+
+  /// topic - AAPL.STK, or depth:AAPL.STK for market depth.
+  /// Returns false if none of the messages were found.
+  bool operator()(const string& topic, const sequence_gap_t& gap,
+                  std::vector<string>* messages);
+
+ private:
+  DbReactorClient* client_;
+};
+
+
+} // historian
+
+#endif //HISTORIAN_GAP_FETCHER_H_
@@ -41,6 +41,22 @@ using boost::uint64_t;
 
 using namespace leveldb;
 
+
+/// Builds keys of the form prefix:symbol:timestamp.  Called for every
+/// record written, so this avoids stream formatting.
+inline const string build_key(const string& prefix, const string& symbol,
+                              uint64_t time_micros)
+{
+  char ts[24];
+  int len = snprintf(ts, sizeof(ts), "%llu",
+                     static_cast<unsigned long long>(time_micros));
+  string key;
+  key.reserve(prefix.size() + symbol.size() + len + 2);
+  key.append(prefix).append(1, ':').append(symbol).append(1, ':')
+      .append(ts, len);
+  return key;
+}
+
 bool write_db(leveldb::WriteBatch* batch, leveldb::DB* levelDb)
 {
   Status s = levelDb->Write(WriteOptions(), batch);
@@ -143,9 +159,7 @@ template <> struct KeyBuilder<MarketData>
 
   const string operator()(const string& symbol, uint64_t time_micros)
   {
-    ostringstream key;
-    key << ENTITY_IB_MARKET_DATA << ':' << symbol << ':' << time_micros;
-    return key.str();
+    return build_key(ENTITY_IB_MARKET_DATA, symbol, time_micros);
   }
 
   const string operator()(const string& symbol, ptime timestamp)
@@ -163,9 +177,7 @@ template <> struct KeyBuilder<MarketDepth>
 
   const string operator()(const string& symbol, uint64_t time_micros)
   {
-    ostringstream key;
-    key << ENTITY_IB_MARKET_DEPTH << ':' << symbol << ':' << time_micros;
-    return key.str();
+    return build_key(ENTITY_IB_MARKET_DEPTH, symbol, time_micros);
   }
 
   const string operator()(const string& symbol, ptime timestamp)
@@ -261,11 +273,10 @@ struct Writer<MarketData>
                              const string& event,
                              uint64_t timestamp)
   {
-    ostringstream key;
-    key << INDEX_IB_MARKET_DATA_BY_EVENT << ':'
-        << symbol << ':'
-        << event << ':' << timestamp;
-    return key.str();
+    string prefix;
+    prefix.reserve(INDEX_IB_MARKET_DATA_BY_EVENT.size() + symbol.size() + 1);
+    prefix.append(INDEX_IB_MARKET_DATA_BY_EVENT).append(1, ':').append(symbol);
+    return build_key(prefix, event, timestamp);
   }
 
   bool operator()(const MarketData& value,
@@ -44,6 +44,10 @@ class ApiEventDispatcher
 
   virtual EWrapper* GetEWrapper() = 0;
 
+  /// Called on the event thread before its outbound sockets are closed,
+  /// to send what the dispatcher holds back.
+  virtual void FlushOutbound() {}
+
 
  protected:
 
@@ -1,4 +1,7 @@
+#include <errno.h>
+#include <string.h>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include <boost/bind.hpp>
@@ -16,6 +19,18 @@
 
 using boost::asio::ip::tcp;
 
+DEFINE_bool(ibSocketNoDelay, true,
+            "Disables Nagle's algorithm on the gateway socket.");
+DEFINE_int32(ibSocketReceiveBufferBytes, 0,
+             "SO_RCVBUF of the gateway socket; 0 for the system default.");
+DEFINE_int32(ibReadBufferBytes, 1 << 20,
+             "Bytes read from the gateway socket ahead of parsing.");
+DEFINE_bool(ibBusyPoll, false,
+            "Spins reading the gateway socket instead of waiting for it.");
+
+// Events of all the connections of the process.
+DECLARE_VARZ_int64(api_events);
+
 DEFINE_VARZ_int64(asio_socket_connection_exceptions, 0, "");
 DEFINE_VARZ_int64(asio_socket_connection_resets, 0, "");
 DEFINE_VARZ_int64(asio_socket_connection_closes, 0, "");
@@ -28,6 +43,13 @@ DEFINE_VARZ_int64(asio_socket_send_latency_micros_total, 0, "");
 DEFINE_VARZ_int64(asio_socket_send_latency_micros_count, 0, "");
 
 DEFINE_VARZ_int64(asio_socket_receive_errors, 0, "");
+DEFINE_VARZ_int64(asio_socket_bytes_received, 0, "");
+DEFINE_VARZ_int64(asio_socket_wakeups, 0, "wakeups with bytes read");
+DEFINE_VARZ_int64(asio_socket_read_buffer_full, 0, "wakeups filling the buffer");
+DEFINE_VARZ_histogram(asio_socket_bytes_per_read, "bytes per read syscall");
+DEFINE_VARZ_histogram(asio_socket_reads_per_wakeup, "");
+DEFINE_VARZ_histogram(asio_socket_events_per_wakeup,
+                      "api events parsed per wakeup");
 DEFINE_VARZ_int64(asio_socket_event_loop_errors, 0, "");
 DEFINE_VARZ_int64(asio_socket_event_loop_stopped, false, "");
 
@@ -44,7 +66,8 @@ AsioEClientDriver::AsioEClientDriver(boost::asio::io_service& ioService,
     callback_(cb),
     socketOk_(false),
     state_(STARTING),
-    clientId_(-1)
+    clientId_(-1),
+    buffer_(FLAGS_ibReadBufferBytes > 0 ? FLAGS_ibReadBufferBytes : 8192)
 {
   LOG(INFO) << "Starting Driver";
 
@@ -89,6 +112,11 @@ bool AsioEClientDriver::Connect(const char *host,
         "Connecting to " << endpoint << std::endl;
 
     int64 start = now_micros();
+    if (!socket_.is_open()) {
+      // Opened ahead of connect for SO_RCVBUF to set the window scale.
+      socket_.open(endpoint.protocol());
+      setSocketOptions();
+    }
     socket_.connect(endpoint);
     int64 elapsed = now_micros() - start;
 
@@ -120,6 +148,22 @@ bool AsioEClientDriver::Connect(const char *host,
   return result;
 }
 
+void AsioEClientDriver::setSocketOptions()
+{
+  boost::system::error_code ec;
+  socket_.set_option(tcp::no_delay(FLAGS_ibSocketNoDelay), ec);
+  if (ec) {
+    LOG(WARNING) << "Failed to set TCP_NODELAY: " << ec;
+  }
+  if (FLAGS_ibSocketReceiveBufferBytes > 0) {
+    socket_.set_option(boost::asio::socket_base::receive_buffer_size(
+        FLAGS_ibSocketReceiveBufferBytes), ec);
+    if (ec) {
+      LOG(WARNING) << "Failed to set SO_RCVBUF: " << ec;
+    }
+  }
+}
+
 void AsioEClientDriver::reset()
 {
   boost::unique_lock<boost::mutex> lock(socketMutex_);
@@ -242,46 +286,79 @@ int AsioEClientDriver::Send(const char* buf, size_t sz) {
 
 /// @implement ApiSocket::Receive
 int AsioEClientDriver::Receive(char* buf, size_t sz) {
+  // The event thread parses only when bytes are buffered, so this blocks
+  // only if the api asks for more on its own.
+  if (buffer_.buffered() > 0) {
+    return buffer_.take(buf, sz);
+  }
   size_t read = -1;
   try {
 
     read = socket_.receive(boost::asio::buffer(buf, sz));
 
   } catch (boost::system::system_error e) {
-
-    VARZ_asio_socket_receive_errors++;
-
-    if (state_ == RUNNING) {
-      LOG(WARNING) << "Receive failed: " << e.what() << std::endl;
-    }
-    socketOk_ = false;
-    state_ = STOPPING;
-    closeSocket();
+    onReceiveError(e.what());
   }
   return read;
 }
 
+void AsioEClientDriver::onReceiveError(const std::string& what)
+{
+  VARZ_asio_socket_receive_errors++;
 
-// Event handling loop.  This runs in a separate thread.
-void AsioEClientDriver::block() {
-
-  if (callback_) {
-    callback_->onEventThreadStart();
+  if (state_ == RUNNING) {
+    LOG(WARNING) << "Receive failed: " << what << std::endl;
   }
+  socketOk_ = false;
+  state_ = STOPPING;
+  closeSocket();
+}
 
-  // Wait for the socket to be connected
-  int64 start = now_micros();
-  boost::unique_lock<boost::mutex> lock(mutex_);
-  while (state_ != RUNNING) {
-    socketRunning_.wait(lock);
+bool AsioEClientDriver::readAvailable()
+{
+  int fd = socket_.native_handle();
+  size_t bytes = 0;
+  int reads = 0;
+  while (buffer_.available() > 0) {
+    size_t requested = buffer_.available();
+    ssize_t n = buffer_.fill(fd);
+    if (n > 0) {
+      reads++;
+      bytes += n;
+      VARZ_asio_socket_bytes_per_read.Record(static_cast<int64>(n));
+      if (static_cast<size_t>(n) < requested) {
+        break;  // drained; another read would only return EAGAIN
+      }
+    } else if (n == 0) {
+      onReceiveError("Connection closed by peer.");
+      return false;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else {
+      onReceiveError(strerror(errno));
+      return false;
+    }
   }
+  if (reads > 0) {
+    VARZ_asio_socket_wakeups++;
+    VARZ_asio_socket_bytes_received += bytes;
+    VARZ_asio_socket_reads_per_wakeup.Record(static_cast<int64>(reads));
+    if (buffer_.available() == 0) {
+      VARZ_asio_socket_read_buffer_full++;
+    }
+  }
+  return true;
+}
 
-  int64 elapsed = now_micros() - start;
-  LOG(INFO) << "Connection ready. Begin processing messages (dt="
-            << elapsed << " microseconds)." << std::endl;
-
+bool AsioEClientDriver::processBuffered()
+{
+  int64 events = VARZ_api_events;
   bool processed = true;
-  while (IsSocketOK() && processed) {
+  // Each check takes in at most the api's own read size and parses the
+  // complete messages; a partial one is kept by the api for the next.
+  while (processed && buffer_.buffered() > 0 && IsSocketOK()) {
     try {
 
       processed = protocolHandler_.CheckMessages();
@@ -303,6 +380,58 @@ void AsioEClientDriver::block() {
       closeSocket();
     }
   }
+  VARZ_asio_socket_events_per_wakeup.Record(VARZ_api_events - events);
+  return processed;
+}
+
+void AsioEClientDriver::startRead()
+{
+  socket_.async_read_some(boost::asio::null_buffers(),
+                          boost::bind(&AsioEClientDriver::onReadable, this,
+                                      boost::asio::placeholders::error));
+}
+
+void AsioEClientDriver::onReadable(const boost::system::error_code& ec)
+{
+  if (ec) {
+    if (ec != boost::asio::error::operation_aborted) {
+      onReceiveError(ec.message());
+    }
+    return;  // the io_service runs out of work and the loop ends
+  }
+  if (IsSocketOK() && readAvailable() && processBuffered() && IsSocketOK()) {
+    startRead();
+  }
+}
+
+
+// Event handling loop.  This runs in a separate thread.
+void AsioEClientDriver::block() {
+
+  if (callback_) {
+    callback_->onEventThreadStart();
+  }
+
+  // Wait for the socket to be connected
+  int64 start = now_micros();
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (state_ != RUNNING) {
+    socketRunning_.wait(lock);
+  }
+
+  int64 elapsed = now_micros() - start;
+  LOG(INFO) << "Connection ready. Begin processing messages (dt="
+            << elapsed << " microseconds)." << std::endl;
+
+  if (FLAGS_ibBusyPoll) {
+    while (IsSocketOK() && readAvailable() &&
+           (buffer_.buffered() == 0 || processBuffered())) {
+    }
+  } else {
+    ioService_.reset();
+    startRead();
+    ioService_.run();
+  }
 
   VARZ_asio_socket_event_loop_stopped = true;
 
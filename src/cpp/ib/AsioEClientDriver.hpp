@@ -8,6 +8,7 @@
 
 #include "ib/internal.hpp"
 #include "ib/ApiProtocolHandler.hpp"
+#include "ib/read_buffer.hpp"
 
 
 using boost::asio::ip::tcp;
@@ -16,6 +17,13 @@ namespace ib {
 namespace internal {
 
 
+/// Drives the IB api over a socket from an event thread of its own.
+///
+/// The event thread waits for the socket to be readable on the io_service
+/// (or spins on it with --ibBusyPoll), reads everything available into a
+/// large ReadBuffer, then parses all the complete messages before waiting
+/// again.  Receive, through which the IB api pulls its input, is served
+/// from that buffer.
 class AsioEClientDriver : public ApiSocket {
 
  public:
@@ -64,6 +72,22 @@ class AsioEClientDriver : public ApiSocket {
 
   bool closeSocket();
 
+  /// Applies the socket options of the flags.
+  void setSocketOptions();
+
+  /// Waits for the socket to be readable on the io_service.
+  void startRead();
+  void onReadable(const boost::system::error_code& ec);
+
+  /// Reads without blocking until the socket or the buffer is exhausted.
+  /// False if the connection is closed or failed.
+  bool readAvailable();
+
+  /// Parses the buffered messages.  False on errors.
+  bool processBuffered();
+
+  void onReceiveError(const std::string& what);
+
   boost::asio::io_service& ioService_;
   ApiProtocolHandler& protocolHandler_;
 
@@ -84,6 +108,8 @@ class AsioEClientDriver : public ApiSocket {
   boost::condition_variable socketRunning_;
   int clientId_;
 
+  ReadBuffer buffer_;
+
   int64 sendDt_;
   int64 receiveDt_;
   int64 processMessageDt_;
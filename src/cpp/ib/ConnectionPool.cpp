@@ -0,0 +1,279 @@
+#include <sstream>
+
+#include <glog/logging.h>
+
+#include "log_levels.h"
+#include "proto/ib.pb.h"
+#include "varz/varz.hpp"
+#include "zmq/ZmqUtils.hpp"
+
+#include "ib/ConnectionPool.hpp"
+
+
+DEFINE_VARZ_int64(connection_pool_requests, 0, "");
+DEFINE_VARZ_int64(connection_pool_requests_rejected, 0,
+                  "subscriptions over the line cap of every connection");
+DEFINE_VARZ_int64(connection_pool_requests_errors, 0, "");
+DEFINE_VARZ_int64(connection_pool_subscriptions, 0, "");
+DEFINE_VARZ_int64(connection_pool_subscriptions_moved, 0, "");
+DEFINE_VARZ_int64(connection_pool_subscriptions_waiting, 0, "");
+DEFINE_VARZ_int64(connection_pool_connections, 0, "members connected");
+
+
+namespace IBAPI {
+
+namespace p = proto::ib;
+using ib::internal::SubscriptionBalancer;
+
+
+static const std::string REQUEST_MARKET_DATA =
+    p::RequestMarketData::default_instance().GetTypeName();
+static const std::string CANCEL_MARKET_DATA =
+    p::CancelMarketData::default_instance().GetTypeName();
+static const std::string REQUEST_MARKET_DEPTH =
+    p::RequestMarketDepth::default_instance().GetTypeName();
+static const std::string CANCEL_MARKET_DEPTH =
+    p::CancelMarketDepth::default_instance().GetTypeName();
+
+
+void ConnectionPool::MemberSessionSettings(
+    const SessionSetting& setting, int size,
+    const std::string& memberEndpointPrefix,
+    ConnectionPool::SessionSettings* members)
+{
+  SessionSetting front(setting);
+  for (int i = 0; i < size; ++i) {
+    unsigned int clientId = front.getConnectionId() + i;
+    std::ostringstream endpoint;
+    endpoint << memberEndpointPrefix << clientId;
+    members->push_back(SessionSetting(clientId, front.getIp(),
+                                      front.getPort(), endpoint.str()));
+  }
+}
+
+ConnectionPool::ConnectionPool(const std::string& reactorAddress,
+                               const ConnectionPool::SessionSettings& members,
+                               size_t maxLinesPerConnection,
+                               zmq::context_t* context) :
+    reactorAddress_(reactorAddress),
+    context_(context),
+    ownsContext_(context == NULL),
+    balancer_(members.size(), maxLinesPerConnection),
+    stopping_(false)
+{
+  if (ownsContext_) {
+    context_ = new zmq::context_t(1);
+  }
+  SessionSettings settings(members);
+  SessionSettings::iterator itr = settings.begin();
+  for (; itr != settings.end(); ++itr) {
+    zmq::socket_t* socket = new zmq::socket_t(*context_, ZMQ_PUSH);
+    int linger = 0;  // not to hold up shutdown for a member that is gone
+    socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    socket->connect(itr->getConnectorReactorAddress().c_str());
+    clientIds_.push_back(itr->getConnectionId());
+    memberAddresses_.push_back(itr->getConnectorReactorAddress());
+    sockets_.push_back(socket);
+    IBAPI_CONNECTION_POOL_LOGGER
+        << "Member " << itr->getConnectionId() << " @ "
+        << itr->getConnectorReactorAddress();
+  }
+  reactor_.reset(new atp::zmq::Reactor(ZMQ_PULL, reactorAddress_, *this,
+                                       context_));
+  LOG(INFO) << "Connection pool of " << clientIds_.size()
+            << " connections, " << maxLinesPerConnection
+            << " lines each, at " << reactorAddress_;
+}
+
+ConnectionPool::~ConnectionPool()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  for (size_t i = 0; i < sockets_.size(); ++i) {
+    delete sockets_[i];
+  }
+  sockets_.clear();
+  // The reactor exits when the context terminates; see SocketConnector.
+  if (ownsContext_) {
+    delete context_;
+  }
+}
+
+size_t ConnectionPool::member(unsigned int clientId) const
+{
+  for (size_t i = 0; i < clientIds_.size(); ++i) {
+    if (clientIds_[i] == clientId) {
+      return i;
+    }
+  }
+  return clientIds_.size();
+}
+
+size_t ConnectionPool::lines(unsigned int clientId)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  size_t index = member(clientId);
+  return index < clientIds_.size() ? balancer_.lines(index) : 0;
+}
+
+void ConnectionPool::send(size_t member,
+                          const std::vector<std::string>& frames)
+{
+  try {
+    for (size_t i = 0; i < frames.size(); ++i) {
+      atp::zmq::send_copy(*sockets_[member], frames[i],
+                          i + 1 < frames.size());
+    }
+  } catch (zmq::error_t e) {
+    VARZ_connection_pool_requests_errors++;
+    LOG(ERROR) << "Cannot forward to " << memberAddresses_[member] << ": "
+               << e.what();
+  }
+}
+
+void ConnectionPool::send(
+    const std::vector<SubscriptionBalancer::Assignment>& assignments)
+{
+  for (size_t i = 0; i < assignments.size(); ++i) {
+    send(assignments[i].member, assignments[i].request.frames);
+  }
+}
+
+void ConnectionPool::onConnect(unsigned int clientId)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  size_t index = member(clientId);
+  if (index == clientIds_.size() || balancer_.connected(index)) {
+    return;
+  }
+  std::vector<SubscriptionBalancer::Assignment> placed;
+  balancer_.connect(index, &placed);
+  send(placed);
+
+  VARZ_connection_pool_connections++;
+  VARZ_connection_pool_subscriptions_waiting = balancer_.waiting();
+  LOG(INFO) << "Pool member " << clientId << " connected, "
+            << placed.size() << " waiting subscriptions requested.";
+}
+
+void ConnectionPool::onDisconnect(unsigned int clientId)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  size_t index = member(clientId);
+  if (index == clientIds_.size() || !balancer_.connected(index)) {
+    return;
+  }
+  VARZ_connection_pool_connections--;
+  if (stopping_) {
+    return;
+  }
+  std::vector<SubscriptionBalancer::Assignment> moved;
+  size_t left = balancer_.disconnect(index, &moved);
+  send(moved);
+
+  VARZ_connection_pool_subscriptions_moved += moved.size();
+  VARZ_connection_pool_subscriptions_waiting = balancer_.waiting();
+  LOG(WARNING) << "Pool member " << clientId << " disconnected: "
+               << moved.size() << " subscriptions moved, " << left
+               << " waiting for a connection.";
+}
+
+void ConnectionPool::stop()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  stopping_ = true;
+}
+
+void ConnectionPool::route(const std::vector<std::string>& frames)
+{
+  const std::string& key = frames[0];
+  bool subscribe = key == REQUEST_MARKET_DATA || key == REQUEST_MARKET_DEPTH;
+  bool cancel = key == CANCEL_MARKET_DATA || key == CANCEL_MARKET_DEPTH;
+
+  if (!subscribe && !cancel) {
+    size_t primary = balancer_.primary();
+    send(primary < clientIds_.size() ? primary : 0, frames);
+    return;
+  }
+
+  // All four start with timestamp, message_id and the contract, whose id
+  // is the ticker id.
+  p::CancelMarketData proto;
+  if (frames.size() != 2 || !proto.ParsePartialFromString(frames[1]) ||
+      !proto.has_contract()) {
+    VARZ_connection_pool_requests_errors++;
+    LOG(ERROR) << "Bad " << key << ", dropped.";
+    return;
+  }
+
+  SubscriptionBalancer::Kind kind =
+      (key == REQUEST_MARKET_DEPTH || key == CANCEL_MARKET_DEPTH) ?
+      SubscriptionBalancer::MARKET_DEPTH : SubscriptionBalancer::MARKET_DATA;
+  long id = proto.contract().id();
+  size_t index = clientIds_.size();
+
+  if (cancel) {
+    if (balancer_.unsubscribe(kind, id, &index)) {
+      VARZ_connection_pool_subscriptions = balancer_.subscriptions();
+      VARZ_connection_pool_subscriptions_waiting = balancer_.waiting();
+    } else {
+      index = balancer_.primary();  // for the gateway to report the error
+    }
+    if (index < clientIds_.size()) {
+      send(index, frames);
+    }
+    return;
+  }
+
+  if (key == REQUEST_MARKET_DATA) {
+    p::RequestMarketData request;
+    if (request.ParsePartialFromString(frames[1]) && request.snapshot()) {
+      // Holds a line only until the snapshot ends.
+      size_t primary = balancer_.primary();
+      send(primary < clientIds_.size() ? primary : 0, frames);
+      return;
+    }
+  }
+
+  SubscriptionBalancer::Request request;
+  request.kind = kind;
+  request.id = id;
+  request.frames = frames;
+  if (!balancer_.subscribe(request, &index)) {
+    VARZ_connection_pool_requests_rejected++;
+    LOG(WARNING) << "Every connection of the pool is at the line cap; "
+                 << "dropped " << key << " of " << id;
+    return;
+  }
+  VARZ_connection_pool_subscriptions = balancer_.subscriptions();
+  VARZ_connection_pool_subscriptions_waiting = balancer_.waiting();
+  if (index < clientIds_.size()) {
+    send(index, frames);
+  }
+}
+
+/// @implement Reactor::Strategy
+bool ConnectionPool::respond(zmq::socket_t& socket)
+{
+  std::vector<std::string> frames;
+  try {
+    bool more = true;
+    while (more) {
+      std::string frame;
+      more = atp::zmq::receive(socket, &frame);
+      frames.push_back(frame);
+    }
+  } catch (zmq::error_t e) {
+    LOG(ERROR) << "Pool reactor stopped: " << e.what();
+    return false;
+  }
+
+  VARZ_connection_pool_requests++;
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  if (!sockets_.empty()) {
+    route(frames);
+  }
+  return true;
+}
+
+
+} // namespace IBAPI
@@ -0,0 +1,103 @@
+#ifndef IBAPI_CONNECTION_POOL_H_
+#define IBAPI_CONNECTION_POOL_H_
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <zmq.hpp>
+
+#include "common.hpp"
+#include "ib/SessionSetting.hpp"
+#include "ib/subscription_balancer.hpp"
+#include "zmq/Reactor.hpp"
+
+
+namespace IBAPI {
+
+
+/// Fans the control messages of one reactor endpoint out to a pool of
+/// SocketConnectors, each a client id of its own against the gateway, to
+/// get around the cap on market data lines per client connection.
+///
+/// RequestMarketData / RequestMarketDepth go to the connection with the
+/// fewest lines, and their cancels to the connection that has them.  When
+/// a connection goes down its subscriptions are requested again on the
+/// others.  Everything else goes to the first connection up.  The events of
+/// all the connections are published on the same outbound channels, as
+/// the connectors of a SocketInitiator share them.
+///
+/// Messages are forwarded as they arrive: the members' reactors parse
+/// them and make the api calls, as without a pool.  The pool's reactor is
+/// a ZMQ_PULL socket, so no replies are sent.
+class ConnectionPool : public atp::zmq::Reactor::Strategy
+{
+ public:
+
+  typedef std::list< SessionSetting > SessionSettings;
+
+  /// The members of a pool of size client ids starting at the session id of
+  /// the setting, with their reactors at <memberEndpointPrefix><id>, e.g.
+  /// ipc:///tmp/firehose-pool-101.
+  static void MemberSessionSettings(const SessionSetting& setting, int size,
+                                    const std::string& memberEndpointPrefix,
+                                    SessionSettings* members);
+
+  /// Binds the reactor at reactorAddress and connects to the reactors of
+  /// the members.
+  ConnectionPool(const std::string& reactorAddress,
+                 const SessionSettings& members,
+                 size_t maxLinesPerConnection,
+                 zmq::context_t* context = NULL);
+
+  ~ConnectionPool();
+
+  /// A member connected to the gateway.
+  void onConnect(unsigned int clientId);
+
+  /// A member lost its connection to the gateway.
+  void onDisconnect(unsigned int clientId);
+
+  /// Stops moving subscriptions, e.g. while all the members disconnect at
+  /// shutdown.
+  void stop();
+
+  /// Lines of the member.
+  size_t lines(unsigned int clientId);
+
+  /// @implement Reactor::Strategy
+  bool respond(zmq::socket_t& socket);
+
+ private:
+
+  /// Index of the member, or size() if not a member.
+  size_t member(unsigned int clientId) const;
+
+  void send(size_t member, const std::vector<std::string>& frames);
+
+  void send(
+      const std::vector<ib::internal::SubscriptionBalancer::Assignment>& a);
+
+  void route(const std::vector<std::string>& frames);
+
+  std::string reactorAddress_;
+  std::vector<unsigned int> clientIds_;
+  std::vector<std::string> memberAddresses_;
+  std::vector<zmq::socket_t*> sockets_;
+
+  zmq::context_t* context_;
+  bool ownsContext_;
+
+  boost::mutex mutex_;
+  ib::internal::SubscriptionBalancer balancer_;
+  bool stopping_;
+
+  boost::scoped_ptr<atp::zmq::Reactor> reactor_;
+};
+
+
+} // namespace IBAPI
+
+#endif // IBAPI_CONNECTION_POOL_H_
@@ -1,5 +1,6 @@
 
-#include <sstream>
+#include <algorithm>
+
 #include "common.hpp"
 #include "log_levels.h"
 
@@ -11,23 +12,32 @@
 #include "historian/constants.hpp"
 
 #include "varz/varz.hpp"
+#include "zmq/BufferPool.hpp"
 #include "zmq/ZmqUtils.hpp"
 
 #include "ib/MarketEventDispatcher.hpp"
 
 
-DEFINE_VARZ_int64(mk_event_dispatch_publish_total_bytes, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_count, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_last_ts, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_interval_micros, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_serialization_errors, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_unresolved_keys, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_micros, 0, "");
+DEFINE_VARZ_counter(mk_event_dispatch_publish_total_bytes, "");
+DEFINE_VARZ_counter(mk_event_dispatch_publish_count, "");
+DEFINE_VARZ_gauge(mk_event_dispatch_publish_last_ts, 0, "");
+DEFINE_VARZ_gauge(mk_event_dispatch_publish_interval_micros, 0, "");
+DEFINE_VARZ_counter(mk_event_dispatch_publish_serialization_errors, "");
+DEFINE_VARZ_counter(mk_event_dispatch_publish_unresolved_keys, "");
+DEFINE_VARZ_histogram(mk_event_dispatch_publish_micros, "");
+
 
+DEFINE_VARZ_counter(mk_event_dispatch_publish_depth_total_bytes, "");
+DEFINE_VARZ_counter(mk_event_dispatch_publish_depth_count, "");
+DEFINE_VARZ_counter(mk_event_dispatch_publish_depth_unresolved_keys, "");
 
-DEFINE_VARZ_int64(mk_event_dispatch_publish_depth_total_bytes, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_depth_count, 0, "");
-DEFINE_VARZ_int64(mk_event_dispatch_publish_depth_unresolved_keys, 0, "");
+DEFINE_VARZ_counter(mk_event_dispatch_batch_count, "");
+DEFINE_VARZ_counter(mk_event_dispatch_batch_records, "");
+DEFINE_VARZ_counter(mk_event_dispatch_batch_bytes, "");
+DEFINE_VARZ_counter(mk_event_dispatch_batch_delay_micros_total,
+                    "first message of a batch to send");
+DEFINE_VARZ_gauge(mk_event_dispatch_batch_delay_micros, 0, "last batch");
+DEFINE_VARZ_gauge(mk_event_dispatch_batch_size, 0, "records, last batch");
 
 namespace ib {
 namespace internal {
@@ -38,13 +48,146 @@ using proto::ib::MarketDepth;
 
 MarketEventDispatcher::MarketEventDispatcher(
     IBAPI::Application& app,
-    const IBAPI::SessionID& sessionId) :
-    IBAPI::ApiEventDispatcher(app, sessionId)
+    const IBAPI::SessionID& sessionId,
+    atp::capture::Writer* capture,
+    bool binaryTicks) :
+    IBAPI::ApiEventDispatcher(app, sessionId),
+    capture_(capture),
+    shareInternIds_(atp::common::symbols().is_shared() &&
+                    atp::common::events().is_shared()),
+    internStamp_(atp::common::intern_stamp()),
+    binaryTicks_(binaryTicks && shareInternIds_),
+    publisherId_(now_micros()),
+    batchMaxMicros_(0),
+    batchMaxBytes_(0),
+    pendingSince_(0)
 {
   VARZ_mk_event_dispatch_publish_last_ts = now_micros();
+
+  if (shareInternIds_) {
+    size_t count = sizeof(TickTypeNames) / sizeof(TickTypeNames[0]);
+    for (size_t i = 0; i < count; ++i) {
+      eventIds_.push_back(atp::common::events().intern(TickTypeNames[i]));
+    }
+  }
+  if (binaryTicks && !binaryTicks_) {
+    LOG(WARNING) << "Binary ticks need shared intern tables; sending protos.";
+  }
+}
+
+MarketEventDispatcher::~MarketEventDispatcher()
+{
+  if (batchMaxBytes_ == 0) {
+    return;
+  }
+  // The socket is only there if destroyed on the callback thread; the
+  // connector normally flushes when its event thread stops.
+  if (!pendingBatches_.empty()) {
+    if (getOutboundSocket(0) != NULL) {
+      sendBatches(now_micros());
+    } else {
+      size_t records = 0;
+      for (size_t i = 0; i < pendingBatches_.size(); ++i) {
+        records += pendingBatches_[i].second->count();
+      }
+      LOG(WARNING) << "Dropped " << records << " batched messages of "
+                   << pendingBatches_.size() << " topics: no socket.";
+    }
+  }
+  LOG(INFO) << "Sent " << VARZ_mk_event_dispatch_batch_records
+            << " messages in " << VARZ_mk_event_dispatch_batch_count
+            << " batches, average delay (usec) "
+            << VARZ_mk_event_dispatch_batch_delay_micros_total /
+      std::max<boost::int64_t>(1, VARZ_mk_event_dispatch_batch_count);
+}
+
+void MarketEventDispatcher::setBatching(boost::uint64_t maxMicros,
+                                        size_t maxBytes)
+{
+  if (maxMicros == 0 || maxBytes == 0 || batchMaxBytes_ > 0) {
+    return;
+  }
+  batchMaxMicros_ = maxMicros;
+  batchMaxBytes_ = maxBytes;
+  LOG(INFO) << "Batching up to " << maxBytes << " bytes or " << maxMicros
+            << " usec per topic.";
+}
+
+void MarketEventDispatcher::FlushOutbound()
+{
+  if (!pendingBatches_.empty() && getOutboundSocket(0) != NULL) {
+    sendBatches(now_micros());
+  }
+}
+
+void MarketEventDispatcher::flushAgedBatches(boost::uint64_t now)
+{
+  if (!pendingBatches_.empty() && now - pendingSince_ >= batchMaxMicros_) {
+    sendBatches(now);
+  }
+}
+
+void MarketEventDispatcher::onBatched(const std::string& topic,
+                                      atp::common::tick_batch* batch,
+                                      boost::uint64_t ts)
+{
+  if (batch->count() == 1) {
+    // Not listed: batches are taken off the list when sent.
+    if (pendingBatches_.empty()) {
+      pendingSince_ = ts;
+    }
+    pendingBatches_.push_back(pending_t(&topic, batch));
+  }
+  if (batch->bytes() >= batchMaxBytes_) {
+    sendPendingBatch(topic, batch, ts);
+  }
+}
+
+void MarketEventDispatcher::sendBatch(const std::string& topic,
+                                      atp::common::tick_batch* batch,
+                                      boost::uint64_t now)
+{
+  if (batch->empty()) {
+    return;
+  }
+  zmq::socket_t* socket = getOutboundSocket(0);
+  atp::zmq::send_zero_copy(*socket, topic, true);
+  atp::zmq::send_copy(*socket, batch->data(), false);
+
+  boost::uint64_t delay = now > batch->start() ? now - batch->start() : 0;
+  VARZ_mk_event_dispatch_batch_count++;
+  VARZ_mk_event_dispatch_batch_records += batch->count();
+  VARZ_mk_event_dispatch_batch_bytes += batch->bytes();
+  VARZ_mk_event_dispatch_batch_delay_micros_total += delay;
+  VARZ_mk_event_dispatch_batch_delay_micros = delay;
+  VARZ_mk_event_dispatch_batch_size = batch->count();
+  batch->clear();
 }
 
-MarketEventDispatcher::~MarketEventDispatcher() {}
+void MarketEventDispatcher::sendPendingBatch(const std::string& topic,
+                                             atp::common::tick_batch* batch,
+                                             boost::uint64_t now)
+{
+  if (batch->empty()) {
+    return;
+  }
+  sendBatch(topic, batch, now);
+  for (size_t i = 0; i < pendingBatches_.size(); ++i) {
+    if (pendingBatches_[i].second == batch) {
+      pendingBatches_[i] = pendingBatches_.back();
+      pendingBatches_.pop_back();
+      break;
+    }
+  }
+}
+
+void MarketEventDispatcher::sendBatches(boost::uint64_t now)
+{
+  for (size_t i = 0; i < pendingBatches_.size(); ++i) {
+    sendBatch(*pendingBatches_[i].first, pendingBatches_[i].second, now);
+  }
+  pendingBatches_.clear();
+}
 
 
 void MarketEventDispatcher::onPublish(boost::uint64_t start, size_t sent)
@@ -68,7 +211,140 @@ void MarketEventDispatcher::onUnresolvedTopic()
 
 void MarketEventDispatcher::onCompletedPublishRequest(boost::uint64_t start)
 {
-  VARZ_mk_event_dispatch_publish_micros = now_micros() - start;
+  VARZ_mk_event_dispatch_publish_micros.Record(now_micros() - start);
+}
+
+MarketEventDispatcher::topic_frames_t*
+MarketEventDispatcher::getTopicFrames(TickerId tickerId)
+{
+  topic_frames_map::iterator found = topicFrames_.find(tickerId);
+  if (found != topicFrames_.end()) {
+    return &found->second;
+  }
+
+  const TickerMap::Entry* ticker = TickerMap::getEntry(tickerId);
+  if (ticker == NULL) {
+    // Not cached, so a later subscription of the ticker is picked up.
+    return NULL;
+  }
+  return &topicFrames_.insert(
+      std::make_pair(tickerId, topic_frames_t(ticker))).first->second;
+}
+
+size_t MarketEventDispatcher::send(const std::string& topic,
+                                   const ::google::protobuf::Message& message,
+                                   atp::capture::RecordType type,
+                                   boost::uint64_t ts,
+                                   atp::common::tick_batch* batch,
+                                   boost::uint64_t tracedSeq)
+{
+  // frames
+  // 1. topic
+  // 2. protobuff, or a batch of them
+
+  size_t size = message.ByteSize();
+  if (batch != NULL && tracedSeq == 0) {
+    char* record = batch->append(size, ts);
+    message.SerializeWithCachedSizesToArray(
+        reinterpret_cast< ::google::protobuf::uint8*>(record));
+    if (capture_ != NULL) {
+      capture_->append(type, ts, record, size);
+    }
+    onBatched(topic, batch, ts);
+    return size;
+  }
+
+  // A traced message goes after the batch of the topic.
+  if (batch != NULL) {
+    sendPendingBatch(topic, batch, ts);
+  }
+  size_t header = tracedSeq > 0 ? atp::common::TRACE_HEADER_SIZE : 0;
+
+  zmq::socket_t* socket = getOutboundSocket(0);
+  atp::zmq::BufferPool& pool = atp::zmq::BufferPool::instance();
+
+  if (header + size > pool.buffer_size()) {
+    // Rare; copy as before.
+    std::string proto(header, '\0');
+    if (!message.AppendToString(&proto)) {
+      return 0;
+    }
+    if (capture_ != NULL) {
+      capture_->append(type, ts, proto.data() + header, size);
+    }
+    if (header > 0) {
+      atp::common::encode_trace_header(publisherId_, tracedSeq, &proto[0]);
+    }
+    size_t sent = atp::zmq::send_zero_copy(*socket, topic, true);
+    return sent + atp::zmq::send_copy(*socket, proto, false);
+  }
+
+  char* buffer = pool.acquire();
+  if (header > 0) {
+    atp::common::encode_trace_header(publisherId_, tracedSeq, buffer);
+  }
+  message.SerializeWithCachedSizesToArray(
+      reinterpret_cast< ::google::protobuf::uint8*>(buffer + header));
+
+  // Before sending, since the buffer belongs to zmq after.
+  if (capture_ != NULL) {
+    capture_->append(type, ts, buffer + header, size);
+  }
+
+  size_t sent = atp::zmq::send_zero_copy(*socket, topic, true);
+  return sent + pool.send(*socket, buffer, header + size, false);
+}
+
+size_t MarketEventDispatcher::send(const std::string& topic,
+                                   const atp::common::binary_tick_t& tick,
+                                   atp::common::tick_batch* batch,
+                                   boost::uint64_t tracedSeq)
+{
+  size_t size = atp::common::binary_tick_size(tick);
+  if (batch != NULL && tracedSeq == 0) {
+    char* record = batch->append(size, tick.timestamp);
+    atp::common::encode_binary_tick(tick, record);
+    if (capture_ != NULL) {
+      capture_->append(atp::capture::MARKET_DATA, tick.timestamp, record, size);
+    }
+    onBatched(topic, batch, tick.timestamp);
+    return size;
+  }
+
+  if (batch != NULL) {
+    sendPendingBatch(topic, batch, tick.timestamp);
+  }
+  size_t header = tracedSeq > 0 ? atp::common::TRACE_HEADER_SIZE : 0;
+
+  zmq::socket_t* socket = getOutboundSocket(0);
+  atp::zmq::BufferPool& pool = atp::zmq::BufferPool::instance();
+
+  if (header + size > pool.buffer_size()) {
+    std::string encoded(header + size, '\0');
+    atp::common::encode_binary_tick(tick, &encoded[header]);
+    if (capture_ != NULL) {
+      capture_->append(atp::capture::MARKET_DATA, tick.timestamp,
+                       encoded.data() + header, size);
+    }
+    if (header > 0) {
+      atp::common::encode_trace_header(publisherId_, tracedSeq, &encoded[0]);
+    }
+    size_t sent = atp::zmq::send_zero_copy(*socket, topic, true);
+    return sent + atp::zmq::send_copy(*socket, encoded, false);
+  }
+
+  char* buffer = pool.acquire();
+  if (header > 0) {
+    atp::common::encode_trace_header(publisherId_, tracedSeq, buffer);
+  }
+  atp::common::encode_binary_tick(tick, buffer + header);
+  if (capture_ != NULL) {
+    capture_->append(atp::capture::MARKET_DATA, tick.timestamp,
+                     buffer + header, size);
+  }
+
+  size_t sent = atp::zmq::send_zero_copy(*socket, topic, true);
+  return sent + pool.send(*socket, buffer, header + size, false);
 }
 
 void MarketEventDispatcher::publishDepth(TickerId tickerId,
@@ -79,20 +355,20 @@ void MarketEventDispatcher::publishDepth(TickerId tickerId,
 {
   boost::uint64_t now = now_micros();
 
-  std::string topic;
-  if (TickerMap::getSubscriptionKeyFromId(tickerId, &topic)) {
-
-    std::ostringstream zmq_topic;
-    zmq_topic << historian::ENTITY_IB_MARKET_DEPTH << ':' << topic;
+  topic_frames_t* frames = getTopicFrames(tickerId);
+  if (frames != NULL) {
 
-    MarketDepth ibMarketDepth;
+    MarketDepth& ibMarketDepth = marketDepth_;
+    ibMarketDepth.Clear();
     ibMarketDepth.set_timestamp(timed.getMicros());
-    ibMarketDepth.set_symbol(topic);
+    ibMarketDepth.set_symbol(frames->ticker->topic);
     ibMarketDepth.set_price(price);
     ibMarketDepth.set_size(size);
     ibMarketDepth.set_level(level);
     ibMarketDepth.set_mm(mm);
     ibMarketDepth.set_contract_id(tickerId);
+    ibMarketDepth.set_publisher_id(publisherId_);
+    ibMarketDepth.set_seq(frames->depthSeq + 1);
     using namespace proto::ib;
     switch (side) {
 
@@ -113,17 +389,12 @@ void MarketEventDispatcher::publishDepth(TickerId tickerId,
 
     }
 
-    // frames
-    // 1. topic
-    // 2. protobuff
-
-    std::string proto;
-    if (ibMarketDepth.SerializeToString(&proto)) {
-
-      zmq::socket_t* socket = getOutboundSocket(0);
-      size_t sent = atp::zmq::send_copy(*socket, zmq_topic.str(), true);
-      sent += atp::zmq::send_copy(*socket, proto, false);
+    size_t sent = send(frames->ticker->depthTopic, ibMarketDepth,
+                       atp::capture::MARKET_DEPTH, ibMarketDepth.timestamp(),
+                       batchFor(&frames->depthBatch));
+    if (sent > 0) {
 
+      frames->depthSeq++;
       VARZ_mk_event_dispatch_publish_depth_count++;
       VARZ_mk_event_dispatch_publish_depth_total_bytes += sent;
       VARZ_mk_event_dispatch_publish_interval_micros =
@@ -133,7 +404,7 @@ void MarketEventDispatcher::publishDepth(TickerId tickerId,
     } else {
 
       LOG(ERROR) << "Unable to serialize: " << timed.getMicros()
-                 << zmq_topic.str();
+                 << frames->ticker->depthTopic;
 
       VARZ_mk_event_dispatch_publish_serialization_errors++;
 
@@ -148,7 +419,8 @@ void MarketEventDispatcher::publishDepth(TickerId tickerId,
 
   }
 
-  VARZ_mk_event_dispatch_publish_micros = now_micros() - now;
+  flushAgedBatches(now);
+  VARZ_mk_event_dispatch_publish_micros.Record(now_micros() - now);
 }
 
 
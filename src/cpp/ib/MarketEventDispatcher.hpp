@@ -2,7 +2,15 @@
 #define IB_INTERNAL_MARKET_EVENT_DISPATCHER_H_
 
 #include <string>
+#include <utility>
+#include <vector>
+#include <boost/unordered_map.hpp>
 #include "common.hpp"
+#include "common/binary_tick.hpp"
+#include "common/intern_table.hpp"
+#include "common/tick_batch.hpp"
+#include "common/tick_capture.hpp"
+#include "common/trace_header.hpp"
 #include "log_levels.h"
 
 #include "ib/TickerMap.hpp"
@@ -12,6 +20,7 @@
 #include "proto/ib.pb.h"
 #include "historian/constants.hpp"
 
+#include "varz/trace.hpp"
 #include "varz/varz.hpp"
 #include "zmq/ZmqUtils.hpp"
 
@@ -30,50 +39,109 @@ using proto::ib::MarketDepth;
 class MarketEventDispatcher : virtual public IBAPI::ApiEventDispatcher
 {
  public:
+  /// If capture is not NULL, every published message is also appended
+  /// to the binary tick capture.  With binaryTicks, market data goes out
+  /// as binary ticks (see atp::common::binary_tick_t) instead of protos;
+  /// this needs intern tables shared with the subscribers and is ignored
+  /// otherwise.  Depth is always sent as protos.
   MarketEventDispatcher(IBAPI::Application& app,
-                        const IBAPI::SessionID& sessionId);
+                        const IBAPI::SessionID& sessionId,
+                        atp::capture::Writer* capture = NULL,
+                        bool binaryTicks = false);
 
   ~MarketEventDispatcher();
 
+  /// Publishes the messages of each topic in batches (see
+  /// common/tick_batch.hpp) of up to maxBytes, sent with the first callback
+  /// at least maxMicros after their first message.  The outbound socket
+  /// belongs to the callback thread, so a batch waits for the next callback
+  /// (or the end of the connection) if the gateway goes quiet.  Trades
+  /// latency for fewer, larger messages; the varz mk_event_dispatch_batch_*
+  /// tell the size and delay of the batches.  Call before the connection
+  /// starts; 0 for either disables batching.
+  void setBatching(boost::uint64_t maxMicros, size_t maxBytes);
+
 
   // Implementation in version specific impl directory.
   virtual EWrapper* GetEWrapper();
 
+  /// Sends the pending batches.
+  virtual void FlushOutbound();
+
   template <typename T>
   void publish(TickerId tickerId, TickType tickType, const T& value,
                TimeTracking& timed)
   {
     boost::uint64_t now = now_micros();
 
-    std::string tick = TickTypeNames[tickType];
-    std::string topic;
-
-    if (TickerMap::getSubscriptionKeyFromId(tickerId, &topic)) {
-
-      MarketData ibMarketData;
-      ibMarketData.set_symbol(topic);
-      ibMarketData.set_timestamp(timed.getMicros());
-      ibMarketData.set_event(tick);
-      ibMarketData.set_contract_id(tickerId);
-      proto::common::set_as(value, ibMarketData.mutable_value());
-
-      // frames
-      // 1. topic
-      // 2. protobuff
+    topic_frames_t* frames = getTopicFrames(tickerId);
+    if (frames != NULL) {
+
+      // Sampled ticks are traced from the callback on (see varz/trace.hpp).
+      boost::uint64_t tracedSeq = 0;
+      if (atp::varz::TraceSampled(frames->seq + 1)) {
+        tracedSeq = frames->seq + 1;
+        atp::varz::Trace(publisherId_, tracedSeq, atp::varz::TRACE_CALLBACK,
+                         timed.getMicros());
+        atp::varz::Trace(publisherId_, tracedSeq, atp::varz::TRACE_PUBLISH,
+                         now);
+      }
 
-      std::string proto;
-      if (ibMarketData.SerializeToString(&proto)) {
+      size_t sent = 0;
+      if (binaryTicks_ && static_cast<size_t>(tickType) < eventIds_.size()) {
+
+        atp::common::binary_tick_t& tick = binaryTick_;
+        tick.symbol_id = frames->ticker->symbolId;
+        tick.event_id = eventIds_[tickType];
+        tick.intern_stamp = internStamp_;
+        tick.contract_id = tickerId;
+        tick.timestamp = timed.getMicros();
+        tick.publisher_id = publisherId_;
+        tick.seq = frames->seq + 1;
+        tick.set(value);
+        sent = send(frames->ticker->topic, tick, batchFor(&frames->batch),
+                    tracedSeq);
 
-        zmq::socket_t* socket = getOutboundSocket(0);
+      } else {
 
-        size_t sent = atp::zmq::send_copy(*socket, topic, true);
-        sent += atp::zmq::send_copy(*socket, proto, false);
+        // Reused across ticks so that the strings and the value keep their
+        // capacity and setting the fields does not allocate.
+        MarketData& ibMarketData = marketData_;
+        ibMarketData.Clear();
+        ibMarketData.set_symbol(frames->ticker->topic);
+        ibMarketData.set_timestamp(timed.getMicros());
+        ibMarketData.set_event(TickTypeNames[tickType]);
+        ibMarketData.set_contract_id(tickerId);
+        proto::common::set_as(value, ibMarketData.mutable_value());
+        ibMarketData.set_publisher_id(publisherId_);
+        ibMarketData.set_seq(frames->seq + 1);
+
+        if (shareInternIds_) {
+          ibMarketData.set_symbol_id(frames->ticker->symbolId);
+          ibMarketData.set_intern_stamp(internStamp_);
+          if (static_cast<size_t>(tickType) < eventIds_.size()) {
+            ibMarketData.set_event_id(eventIds_[tickType]);
+          }
+        }
+
+        sent = send(frames->ticker->topic, ibMarketData,
+                    atp::capture::MARKET_DATA, ibMarketData.timestamp(),
+                    batchFor(&frames->batch), tracedSeq);
+      }
+      if (sent > 0) {
 
+        frames->seq++;
+        if (tracedSeq > 0) {
+          atp::varz::Trace(publisherId_, tracedSeq, atp::varz::TRACE_SEND);
+        }
         onPublish(now, sent);
+
       } else {
 
         LOG(ERROR) << "Unable to serialize: " << timed.getMicros()
-                   << topic << ", event=" << tick << ", value=" << value;
+                   << frames->ticker->topic
+                   << ", event=" << TickTypeNames[tickType]
+                   << ", value=" << value;
 
         onSerializeError();
       }
@@ -84,6 +152,7 @@ class MarketEventDispatcher : virtual public IBAPI::ApiEventDispatcher
 
       onUnresolvedTopic();
     }
+    flushAgedBatches(now);
     onCompletedPublishRequest(now);
   }
 
@@ -97,6 +166,94 @@ class MarketEventDispatcher : virtual public IBAPI::ApiEventDispatcher
   void onSerializeError();
   void onUnresolvedTopic();
   void onCompletedPublishRequest(boost::uint64_t start);
+
+  /// Topic frames of a ticker, cached on first use.  The topics are those
+  /// of the TickerMap entry, sent zero copy since they never change or move.
+  struct topic_frames_t
+  {
+    explicit topic_frames_t(const TickerMap::Entry* ticker) :
+        ticker(ticker), seq(0), depthSeq(0) {}
+
+    const TickerMap::Entry* ticker;
+
+    // Last sequence numbers sent on the topics.
+    boost::uint64_t seq;
+    boost::uint64_t depthSeq;
+
+    // Messages not yet sent, when batching.
+    atp::common::tick_batch batch;
+    atp::common::tick_batch depthBatch;
+  };
+
+  /// Returns NULL if the ticker id has no subscription.
+  topic_frames_t* getTopicFrames(TickerId tickerId);
+
+  /// Sends topic + serialized message, serializing straight into a buffer
+  /// of the pool that zmq returns to the pool once sent, or into the batch
+  /// of the topic if not NULL.  Also appends the message to the capture,
+  /// if any.  Returns the bytes sent or batched, or 0 if the message
+  /// cannot be serialized.
+  ///
+  /// A traced message (tracedSeq > 0) is sent alone behind a trace header
+  /// (see common/trace_header.hpp), after what is batched for the topic.
+  size_t send(const std::string& topic,
+              const ::google::protobuf::Message& message,
+              atp::capture::RecordType type, boost::uint64_t ts,
+              atp::common::tick_batch* batch,
+              boost::uint64_t tracedSeq = 0);
+
+  /// Sends topic + encoded tick, as above.
+  size_t send(const std::string& topic,
+              const atp::common::binary_tick_t& tick,
+              atp::common::tick_batch* batch,
+              boost::uint64_t tracedSeq = 0);
+
+  /// The batch, if batching.
+  atp::common::tick_batch* batchFor(atp::common::tick_batch* batch)
+  {
+    return batchMaxBytes_ > 0 ? batch : NULL;
+  }
+
+  void onBatched(const std::string& topic, atp::common::tick_batch* batch,
+                 boost::uint64_t ts);
+  void sendBatch(const std::string& topic, atp::common::tick_batch* batch,
+                 boost::uint64_t now);
+
+  /// Sends the batch ahead of the others, e.g. when full, and takes it off
+  /// the pending list.
+  void sendPendingBatch(const std::string& topic,
+                        atp::common::tick_batch* batch, boost::uint64_t now);
+  void sendBatches(boost::uint64_t now);
+
+  /// Sends the pending batches if the oldest is due.
+  void flushAgedBatches(boost::uint64_t now);
+
+  atp::capture::Writer* capture_;
+
+  // Interned ids of the tick types, indexed by TickType, and the stamp
+  // of the tables sent with them.
+  bool shareInternIds_;
+  std::vector<atp::common::intern_id_t> eventIds_;
+  boost::uint32_t internStamp_;
+  bool binaryTicks_;
+
+  // Distinguishes the sequences of this run from those of earlier runs.
+  boost::uint64_t publisherId_;
+
+  // Only touched by the thread that delivers the api callbacks, which is
+  // also the only user of the outbound socket.
+  typedef boost::unordered_map<TickerId, topic_frames_t> topic_frames_map;
+  topic_frames_map topicFrames_;
+  MarketData marketData_;
+  MarketDepth marketDepth_;
+  atp::common::binary_tick_t binaryTick_;
+
+  // Batches not empty, each listed once, and when the oldest was started.
+  boost::uint64_t batchMaxMicros_;
+  size_t batchMaxBytes_;
+  typedef std::pair<const std::string*, atp::common::tick_batch*> pending_t;
+  std::vector<pending_t> pendingBatches_;
+  boost::uint64_t pendingSince_;
 };
 
 
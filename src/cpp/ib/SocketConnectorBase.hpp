@@ -63,6 +63,8 @@ class SocketConnectorBase :
       outboundChannels_(outboundChannels),
       outboundContext_(outboundContext),
       dispatcher_(NULL),
+      strategy_(NULL),
+      clientId_(0),
       socketConnector_(NULL)
   {
   }
@@ -192,6 +194,9 @@ class SocketConnectorBase :
   /// @see AsioEClientDriver::EventCallback
   void onEventThreadStop()
   {
+    if (dispatcher_ != NULL) {
+      dispatcher_->FlushOutbound();
+    }
     IBAPI_ABSTRACT_SOCKET_CONNECTOR_LOGGER << "Closing outbound sockets.";
     // Need to delete the outbound sockets here since this is running in the
     // same thread as onEventThreadStart() which created the outbound sockets.
@@ -218,6 +223,12 @@ class SocketConnectorBase :
   {
     IBAPI_ABSTRACT_SOCKET_CONNECTOR_LOGGER
         << "EClient socket closed:" << success;
+
+    // Also when the gateway drops the connection, e.g. for a pool to move
+    // the subscriptions of the connection.
+    if (strategy_ != NULL) {
+      strategy_->onDisconnect(*socketConnector_, clientId_);
+    }
   }
 
   /// @see EWrapperEventCollector
@@ -277,6 +288,8 @@ class SocketConnectorBase :
           LOG(INFO) << "ClientId[" << clientId << "]: Connected in "
                     << elapsed << " microseconds.";
 
+          strategy_ = strategy;
+          clientId_ = clientId;
           strategy->onConnect(*socketConnector_, clientId);
           return clientId;
 
@@ -520,6 +533,10 @@ class SocketConnectorBase :
 
   IBAPI::ApiEventDispatcher* dispatcher_;
 
+  // Of the connection, for the strategy to be told when it closes.
+  SocketConnector::Strategy* strategy_;
+  unsigned int clientId_;
+
  protected:
   SocketConnector* socketConnector_;
 };
@@ -12,6 +12,7 @@
 
 #include "common.hpp"
 #include "log_levels.h"
+#include "ib/ConnectionPool.hpp"
 #include "ib/SocketInitiator.hpp"
 #include "ib/SessionID.hpp"
 #include "zmq/Publisher.hpp"
@@ -378,7 +379,8 @@ class SocketInitiatorImpl : public SocketInitiator {
 
 SocketInitiator::SocketInitiator(Application& app,
                                  const SessionSettings& settings)
-    : impl_(new SocketInitiatorImpl(app, settings, *this))
+    : impl_(new SocketInitiatorImpl(app, settings, *this)),
+      pool_(NULL)
 {
 }
 
@@ -422,12 +424,20 @@ bool SocketInitiator::isLoggedOn()
   return impl_->isLoggedOn();
 }
 
+void SocketInitiator::setConnectionPool(ConnectionPool* pool)
+{
+  pool_ = pool;
+}
+
 /// @implement SocketConnector::Strategy
 void SocketInitiator::onConnect(SocketConnector& connector, int clientId)
 {
   IBAPI_SOCKET_INITIATOR_LOGGER
       << "Connector(" << &connector << "): "
       << "Connection (" << clientId << ") established.";
+  if (pool_ != NULL) {
+    pool_->onConnect(clientId);
+  }
 }
 
 /// @implement SocketConnector::Strategy
@@ -461,6 +471,9 @@ void SocketInitiator::onDisconnect(SocketConnector& connector,
   IBAPI_SOCKET_INITIATOR_LOGGER
       << "Connector(" << &connector << "): "
       << "Connection (" << clientId << ") disconnected.";
+  if (pool_ != NULL) {
+    pool_->onDisconnect(clientId);
+  }
 }
 
 } // namespace ib
@@ -16,6 +16,7 @@
 
 namespace IBAPI {
 
+class ConnectionPool;
 
 /// Models after SocketInitiator in QuickFIX API:
 /// http://goo.gl/S4bJa
@@ -61,6 +62,10 @@ class SocketInitiator : public Initiator,
   virtual void stop(bool force = false);
   virtual bool isLoggedOn();
 
+  /// Tells the pool when its members connect and disconnect.  The pool
+  /// must outlive the connections.
+  void setConnectionPool(ConnectionPool* pool);
+
   /// @implement SocketConnector::Strategy
   void onConnect(SocketConnector&, int clientId);
 
@@ -77,10 +82,11 @@ class SocketInitiator : public Initiator,
   void onTimeout(SocketConnector&);
 
  protected:
-  SocketInitiator(){}
+  SocketInitiator() : pool_(NULL) {}
 
  private:
   boost::scoped_ptr<SocketInitiator> impl_;
+  ConnectionPool* pool_;
 };
 
 } // namespace IBAPI
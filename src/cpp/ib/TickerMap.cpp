@@ -1,14 +1,20 @@
 
+#include <deque>
 #include <map>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include <glog/logging.h>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "log_levels.h"
 #include "utils.hpp"
+#include "common/intern_table.hpp"
+#include "historian/constants.hpp"
 #include "ib/TickerMap.hpp"
 #include "ib/ticker_id.hpp"
 
@@ -17,12 +23,98 @@ namespace internal {
 
 typedef boost::shared_ptr< Contract > ContractPtr;
 
-static std::map< long, std::string > TICKER_ID_SYMBOL_MAP;
+// Guarded by the mutex.
 static std::map< std::string, long > SYMBOL_TICKER_ID_MAP;
 static std::map< long, ContractPtr > TICKER_ID_CONTRACT_MAP;
 
 static boost::mutex __ticker_map_mutex;
 
+
+// Open addressed table of the entries by ticker id, at most half full.
+// Slots are claimed by storing the id after the entry, so a reader that
+// sees the id sees the entry.  Id 0 marks an empty slot; ticker ids are
+// never 0.
+struct ticker_table_t
+{
+  explicit ticker_table_t(size_t capacity) :
+      mask(capacity - 1),
+      ids(new boost::atomic<long>[capacity]),
+      entries(new boost::atomic<const TickerMap::Entry*>[capacity])
+  {
+    for (size_t i = 0; i < capacity; ++i) {
+      ids[i].store(0, boost::memory_order_relaxed);
+      entries[i].store(NULL, boost::memory_order_relaxed);
+    }
+  }
+
+  size_t capacity() const
+  {
+    return mask + 1;
+  }
+
+  size_t mask;
+  boost::scoped_array<boost::atomic<long> > ids;
+  boost::scoped_array<boost::atomic<const TickerMap::Entry*> > entries;
+};
+
+static const size_t TICKER_TABLE_MIN_CAPACITY = 1024;
+
+// Tables replaced when growing are kept, for readers still probing them.
+// Guarded by the mutex, as are the entries; the deque never moves them.
+static boost::atomic<const ticker_table_t*> TICKER_TABLE(NULL);
+static std::vector< boost::shared_ptr<ticker_table_t> > TICKER_TABLES;
+static std::deque< TickerMap::Entry > TICKER_ENTRIES;
+
+static inline size_t ticker_slot(long tickerId, size_t mask)
+{
+  return static_cast<size_t>(
+      static_cast<boost::uint64_t>(tickerId) * 0x9E3779B97F4A7C15ULL >> 20)
+      & mask;
+}
+
+static void insert_entry(ticker_table_t* table, const TickerMap::Entry* entry)
+{
+  size_t i = ticker_slot(entry->tickerId, table->mask);
+  while (table->ids[i].load(boost::memory_order_relaxed) != 0) {
+    i = (i + 1) & table->mask;
+  }
+  table->entries[i].store(entry, boost::memory_order_relaxed);
+  table->ids[i].store(entry->tickerId, boost::memory_order_release);
+}
+
+// Must hold the mutex.
+static const TickerMap::Entry* add_entry(long tickerId,
+                                         const std::string& symbol)
+{
+  TickerMap::Entry entry;
+  entry.tickerId = tickerId;
+  entry.topic = symbol;
+  entry.depthTopic = historian::ENTITY_IB_MARKET_DEPTH + ":" + symbol;
+  entry.symbolId = atp::common::symbols().intern(symbol);
+  entry.index = TICKER_ENTRIES.size();
+  TICKER_ENTRIES.push_back(entry);
+  const TickerMap::Entry* added = &TICKER_ENTRIES.back();
+
+  ticker_table_t* current =
+      TICKER_TABLES.empty() ? NULL : TICKER_TABLES.back().get();
+  if (current != NULL && 2 * TICKER_ENTRIES.size() <= current->capacity()) {
+    insert_entry(current, added);
+    return added;
+  }
+
+  // Publish a bigger copy.
+  size_t capacity = current != NULL ?
+      2 * current->capacity() : TICKER_TABLE_MIN_CAPACITY;
+  boost::shared_ptr<ticker_table_t> table(new ticker_table_t(capacity));
+  for (std::deque<TickerMap::Entry>::const_iterator e = TICKER_ENTRIES.begin();
+       e != TICKER_ENTRIES.end(); ++e) {
+    insert_entry(table.get(), &*e);
+  }
+  TICKER_TABLES.push_back(table);
+  TICKER_TABLE.store(table.get(), boost::memory_order_release);
+  return added;
+}
+
 ContractPtr clone_contract(const Contract& contract)
 {
   ContractPtr c(new Contract());
@@ -121,15 +213,16 @@ long TickerMap::registerContract(const Contract& contract)
       tickerId = TICKER_ID_CONTRACT_MAP.size() + 1;
   }
 
-  if (TICKER_ID_SYMBOL_MAP.find(tickerId) == TICKER_ID_SYMBOL_MAP.end()) {
+  const Entry* entry = getEntry(tickerId);
+  if (entry == NULL) {
 
     ContractPtr clone = clone_contract(contract);
     clone->conId = tickerId;
     std::string symbol;
     if (symbol_from_contract(contract, &symbol)) {
-      TICKER_ID_SYMBOL_MAP[tickerId] = symbol;
       SYMBOL_TICKER_ID_MAP[symbol] = tickerId;
       TICKER_ID_CONTRACT_MAP[tickerId] = clone;
+      add_entry(tickerId, symbol);
     } else {
       // Error
       tickerId = -1;
@@ -138,7 +231,7 @@ long TickerMap::registerContract(const Contract& contract)
     // There's an entry.  Verify that the symbol is the same
     std::string check;
     if (symbol_from_contract(contract, &check)) {
-      if (TICKER_ID_SYMBOL_MAP[tickerId] != check) {
+      if (entry->topic != check) {
         tickerId = -1; // Error
       }
     } else {
@@ -148,26 +241,67 @@ long TickerMap::registerContract(const Contract& contract)
   return tickerId;
 }
 
+const TickerMap::Entry* TickerMap::getEntry(long tickerId)
+{
+  const ticker_table_t* table = TICKER_TABLE.load(boost::memory_order_acquire);
+  if (table == NULL || tickerId == 0) {
+    return NULL;
+  }
+  for (size_t i = ticker_slot(tickerId, table->mask); ;
+       i = (i + 1) & table->mask) {
+    long id = table->ids[i].load(boost::memory_order_acquire);
+    if (id == tickerId) {
+      return table->entries[i].load(boost::memory_order_relaxed);
+    }
+    if (id == 0) {
+      return NULL;
+    }
+  }
+}
+
+size_t TickerMap::size()
+{
+  boost::unique_lock<boost::mutex> lock(__ticker_map_mutex);
+  return TICKER_ENTRIES.size();
+}
+
 bool TickerMap::getSubscriptionKeyFromId(long tickerId, std::string* output)
 {
-  if (TICKER_ID_SYMBOL_MAP.find(tickerId) == TICKER_ID_SYMBOL_MAP.end()) {
+  const Entry* entry = getEntry(tickerId);
+  if (entry == NULL) {
     // Use conversion
     ib::internal::SymbolFromTickerId(tickerId, output);
     return false; // Since we don't have any mappings.
   } else {
-    *output = TICKER_ID_SYMBOL_MAP[tickerId];
+    *output = entry->topic;
     return true;
   }
 }
 
+bool TickerMap::getSubscriptionKeyFromId(long tickerId, std::string* output,
+                                         atp::common::intern_id_t* symbolId)
+{
+  const Entry* entry = getEntry(tickerId);
+  if (entry == NULL) {
+    *symbolId = atp::common::NO_INTERN_ID;
+    return getSubscriptionKeyFromId(tickerId, output);
+  }
+  *symbolId = entry->symbolId;
+  *output = entry->topic;
+  return true;
+}
+
 bool TickerMap::getTickerIdFromSubscriptionKey(const std::string& key, long* id)
 {
-  if (SYMBOL_TICKER_ID_MAP.find(key) == SYMBOL_TICKER_ID_MAP.end()) {
+  boost::unique_lock<boost::mutex> lock(__ticker_map_mutex);
+  std::map< std::string, long >::const_iterator found =
+      SYMBOL_TICKER_ID_MAP.find(key);
+  if (found == SYMBOL_TICKER_ID_MAP.end()) {
     // Use conversion
     *id = ib::internal::SymbolToTickerId(key);
     return false; // Since we don't have any mappings.
   } else {
-    *id = SYMBOL_TICKER_ID_MAP[key];
+    *id = found->second;
     return true;
   }
 }
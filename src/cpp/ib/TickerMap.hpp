@@ -5,6 +5,7 @@
 #include <string>
 #include <Shared/Contract.h>
 
+#include "common/intern_table.hpp"
 #include "ib/contract_symbol.hpp"
 
 namespace ib {
@@ -17,17 +18,46 @@ bool convert_to_contract(const std::map<std::string, std::string> input,
 
 /**
  * Interface for mapping ticker ids to contracts and symbols.
+ *
+ * Lookups by ticker id, made for every tick, read an open addressed table
+ * without locks.  Registering a contract, under a lock, appends its entry
+ * and claims a slot in the current table; when that table is half full a
+ * table twice the size is filled and published in its place.  Entries are
+ * never changed, moved or freed once registered, and replaced tables are
+ * kept for the readers still probing them, so readers never wait and what
+ * they return stays valid.
  */
 class TickerMap
 {
  public:
 
+  /// A registered contract, with what is sent with its ticks.
+  struct Entry
+  {
+    long tickerId;
+    std::string topic;        // subscription key, e.g. AAPL.STK
+    std::string depthTopic;   // depth:AAPL.STK
+    atp::common::intern_id_t symbolId;
+    size_t index;             // dense, in the order of registration
+  };
+
   /// Registers the contract and assigns a unique id for use with reqMktData.
   static long registerContract(const Contract& contract);
 
+  /// The entry of the id, or NULL if it is not registered.  Lock-free; the
+  /// entry is valid for the life of the process.
+  static const Entry* getEntry(long tickerId);
+
+  /// Number of contracts registered.
+  static size_t size();
+
   /// Given the id, get a contract symbol.
   static bool getSubscriptionKeyFromId(long tickerId, std::string* output);
 
+  /// Given the id, get the contract symbol and its interned symbol id.
+  static bool getSubscriptionKeyFromId(long tickerId, std::string* output,
+                                       atp::common::intern_id_t* symbolId);
+
   /// Given the subscription key, get the tickerId.
   static bool getTickerIdFromSubscriptionKey(const std::string& key, long* id);
 };
@@ -16,6 +16,8 @@ DEFINE_VARZ_int64(api_requests, 0, "");
 DEFINE_VARZ_int64(api_last_ts, 0, "");
 DEFINE_VARZ_int64(api_event_interval_micros, 0, "");
 DEFINE_VARZ_int64(api_event_marketdata_process_micros, 0, "");
+DEFINE_VARZ_counter(api_event_log_records, "");
+DEFINE_VARZ_counter(api_event_log_closed, "events logged by glog, closed");
 
 
 // Macro for writing field value.
@@ -57,12 +59,43 @@ int LoggingEWrapper::get_connection_id() {
   return connection_id_;
 }
 
+bool LoggingEWrapper::log_event(event_t* event, const std::string* text) {
+  EventLog* log = event_log();
+  if (log == NULL) {
+    return false;
+  }
+  boost::uint64_t t = now();
+  event->ts_utc = t;
+  event->connection_id = connection_id_;
+  if (!(text != NULL ? log->log(*event, *text) : log->log(*event))) {
+    VARZ_api_event_log_closed++;
+    return false;
+  }
+  VARZ_api_event_log_records++;
+  VARZ_api_events++;
+  VARZ_api_event_interval_micros = t - VARZ_api_last_ts;
+  VARZ_api_last_ts = t;
+  TIME_EVENT_MARKETDATA;
+  return true;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // EWrapper Methods
 //
 void LoggingEWrapper::tickPrice(TickerId tickerId, TickType field,
                                 double price, int canAutoExecute) {
+  if (event_log() != NULL) {
+    event_t event = event_t();
+    event.type = EVENT_TICK_PRICE;
+    event.field = field;
+    event.id = tickerId;
+    event.value = price;
+    event.size = canAutoExecute;
+    if (log_event(&event)) {
+      return;
+    }
+  }
   LOG_EVENT
       << __f__(tickerId)
       << __tick_type_enum(field)
@@ -71,6 +104,16 @@ void LoggingEWrapper::tickPrice(TickerId tickerId, TickType field,
   TIME_EVENT_MARKETDATA;
 }
 void LoggingEWrapper::tickSize(TickerId tickerId, TickType field, int size) {
+  if (event_log() != NULL) {
+    event_t event = event_t();
+    event.type = EVENT_TICK_SIZE;
+    event.field = field;
+    event.id = tickerId;
+    event.size = size;
+    if (log_event(&event)) {
+      return;
+    }
+  }
   LOG_EVENT
       << __f__(tickerId)
       << __tick_type_enum(field)
@@ -98,6 +141,16 @@ void LoggingEWrapper::tickOptionComputation(
 }
 void LoggingEWrapper::tickGeneric(
     TickerId tickerId, TickType tickType, double value) {
+  if (event_log() != NULL) {
+    event_t event = event_t();
+    event.type = EVENT_TICK_GENERIC;
+    event.field = tickType;
+    event.id = tickerId;
+    event.value = value;
+    if (log_event(&event)) {
+      return;
+    }
+  }
   LOG_EVENT
       << __f__(tickerId)
       << __tick_type_enum(tickType)
@@ -106,6 +159,15 @@ void LoggingEWrapper::tickGeneric(
 }
 void LoggingEWrapper::tickString(TickerId tickerId, TickType tickType,
                                  const IBString& value) {
+  if (event_log() != NULL) {
+    event_t event = event_t();
+    event.type = EVENT_TICK_STRING;
+    event.field = tickType;
+    event.id = tickerId;
+    if (log_event(&event, &value)) {
+      return;
+    }
+  }
   LOG_EVENT
       << __f__(tickerId)
       << __tick_type_enum(tickType)
@@ -216,6 +278,19 @@ void LoggingEWrapper::execDetailsEnd(int reqId) {
 void LoggingEWrapper::updateMktDepth(TickerId id, int position,
                                      int operation, int side,
                                      double price, int size) {
+  if (event_log() != NULL) {
+    event_t event = event_t();
+    event.type = EVENT_UPDATE_MKT_DEPTH;
+    event.id = id;
+    event.position = position;
+    event.operation = operation;
+    event.side = side;
+    event.value = price;
+    event.size = size;
+    if (log_event(&event)) {
+      return;
+    }
+  }
   LOG_EVENT
       << __f__(id)
       << __f__(position)
@@ -228,6 +303,19 @@ void LoggingEWrapper::updateMktDepth(TickerId id, int position,
 void LoggingEWrapper::updateMktDepthL2(TickerId id, int position,
                                        IBString marketMaker, int operation,
                                        int side, double price, int size) {
+  if (event_log() != NULL) {
+    event_t event = event_t();
+    event.type = EVENT_UPDATE_MKT_DEPTH_L2;
+    event.id = id;
+    event.position = position;
+    event.operation = operation;
+    event.side = side;
+    event.value = price;
+    event.size = size;
+    if (log_event(&event, &marketMaker)) {
+      return;
+    }
+  }
   LOG_EVENT
       << __f__(id)
       << __f__(position)
@@ -26,6 +26,7 @@
 #include <Shared/Order.h>
 
 #include "common.hpp"
+#include "ib/event_log.hpp"
 
 using namespace std;
 
@@ -45,6 +46,11 @@ class LoggingEWrapper : public TimeTracking, public EWrapper {
   int get_connection_id();
 
  private:
+  /// Logs the event, with its text if any, to the event log of the
+  /// process instead of glog.  False if there is none, or it is closed,
+  /// for the caller to use glog.
+  bool log_event(event_t* event, const std::string* text = NULL);
+
   unsigned int connection_id_;
 
 
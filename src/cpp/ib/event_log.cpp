@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include <glog/logging.h>
+
+#include "log_levels.h"
+#include "ib/event_log.hpp"
+#include "ib/tick_types.hpp"
+
+
+namespace ib {
+namespace internal {
+
+using boost::uint32_t;
+using boost::uint64_t;
+namespace io = boost::iostreams;
+
+
+static boost::atomic<EventLog*> EVENT_LOG_INSTANCE(NULL);
+
+EventLog* event_log()
+{
+  return EVENT_LOG_INSTANCE.load(boost::memory_order_acquire);
+}
+
+void set_event_log(EventLog* log)
+{
+  EVENT_LOG_INSTANCE.store(log, boost::memory_order_release);
+}
+
+
+EventRing::EventRing(size_t size) :
+    mask_(0),
+    tail_(0),
+    head_(0)
+{
+  size_t slots = 1;
+  while (slots < size) {
+    slots <<= 1;
+  }
+  slots_.reset(new Slot[slots]);
+  mask_ = slots - 1;
+  for (size_t i = 0; i < slots; ++i) {
+    slots_[i].seq.store(i, boost::memory_order_relaxed);
+  }
+}
+
+
+EventLog::EventLog(const std::string& dir, const std::string& prefix,
+                   bool compress, size_t ring_size, int flush_millis) :
+    ring_(ring_size),
+    flush_millis_(flush_millis > 0 ? flush_millis : 1),
+    running_(false),
+    closed_(true),
+    producers_(0),
+    written_(0),
+    dropped_(0),
+    waits_(0)
+{
+  std::ostringstream name;
+  name.imbue(std::locale(std::cout.getloc(),
+                         new boost::posix_time::time_facet("%Y%m%d-%H%M%S")));
+  name << dir << '/' << prefix << '-'
+       << boost::posix_time::second_clock::local_time() << ".evl"
+       << (compress ? ".gz" : "");
+  path_ = name.str();
+
+  io::file_sink file(path_, std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Cannot open event log " << path_;
+    return;
+  }
+  out_.reset(new io::filtering_ostream());
+  if (compress) {
+    out_->push(io::gzip_compressor());
+  }
+  out_->push(file);
+
+  uint32_t record_size = sizeof(event_t);
+  out_->write(EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+  out_->write(reinterpret_cast<const char*>(&EVENT_LOG_VERSION),
+              sizeof(EVENT_LOG_VERSION));
+  out_->write(reinterpret_cast<const char*>(&record_size),
+              sizeof(record_size));
+
+  running_ = true;
+  closed_ = false;
+  thread_.reset(new boost::thread(&EventLog::run, this));
+  LOG(INFO) << "Logging events to " << path_;
+}
+
+EventLog::~EventLog()
+{
+  close();
+}
+
+bool EventLog::log(const event_t& event, const std::string& text)
+{
+  size_t size = std::min(text.size(), EVENT_MAX_TEXT_SIZE);
+  if (size <= EVENT_TEXT_SIZE) {
+    event_t record = event;
+    memcpy(record.text, text.data(), size);
+    record.text_size = static_cast<boost::uint16_t>(size);
+    return log(&record, 1);
+  }
+
+  // Rare: tickString values are mostly short.
+  size_t count = 1 + (size - 1) / EVENT_TEXT_SIZE;
+  if (count > ring_.size()) {
+    count = ring_.size();
+    size = count * EVENT_TEXT_SIZE;
+  }
+  std::vector<event_t> records(count, event_t());
+  records[0] = event;
+  records[0].text_size = static_cast<boost::uint16_t>(size);
+  for (size_t i = 0; i < count; ++i) {
+    size_t offset = i * EVENT_TEXT_SIZE;
+    size_t bytes = std::min(EVENT_TEXT_SIZE, size - offset);
+    if (i > 0) {
+      records[i].ts_utc = event.ts_utc;
+      records[i].connection_id = event.connection_id;
+      records[i].type = EVENT_TEXT;
+      records[i].id = event.id;
+      records[i].text_size = static_cast<boost::uint16_t>(bytes);
+    }
+    memcpy(records[i].text, text.data() + offset, bytes);
+  }
+  return log(&records[0], count);
+}
+
+bool EventLog::wait_and_push(const event_t* events, size_t count)
+{
+  waits_.fetch_add(1, boost::memory_order_relaxed);
+  for (int spins = 0; !closed_.load(boost::memory_order_seq_cst); ++spins) {
+    if (spins < 100) {
+      boost::this_thread::yield();
+    } else {
+      boost::this_thread::sleep(boost::posix_time::microseconds(100));
+    }
+    if (ring_.push(events, count)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t EventLog::drain()
+{
+  size_t count = 0;
+  event_t event;
+  while (ring_.pop(&event)) {
+    out_->write(reinterpret_cast<const char*>(&event), sizeof(event));
+    ++count;
+  }
+  if (count > 0) {
+    written_.fetch_add(count, boost::memory_order_relaxed);
+  }
+  return count;
+}
+
+void EventLog::run()
+{
+  // Writing in rounds keeps the writes large; a round that drains half the
+  // ring is followed by another at once.
+  while (running_.load(boost::memory_order_acquire)) {
+    if (drain() < ring_.size() / 2) {
+      boost::this_thread::sleep(
+          boost::posix_time::milliseconds(flush_millis_));
+    }
+  }
+}
+
+void EventLog::close()
+{
+  boost::lock_guard<boost::mutex> lock(close_mutex_);
+  if (out_.get() == NULL) {
+    return;
+  }
+  // Producers that saw the log open finish (or give up waiting) before
+  // the last drain.
+  closed_.store(true, boost::memory_order_seq_cst);
+  while (producers_.load(boost::memory_order_seq_cst) > 0) {
+    boost::this_thread::yield();
+  }
+  running_ = false;
+  if (thread_.get() != NULL) {
+    thread_->join();
+    thread_.reset();
+  }
+  drain();
+  out_->reset();  // flushes and closes the file
+  out_.reset();
+  LOG(INFO) << "Closed event log " << path_ << ": " << written()
+            << " events written, " << dropped() << " dropped, "
+            << waits() << " waits on a full ring.";
+}
+
+
+EventLogReader::EventLogReader(const std::string& path) :
+    open_(false),
+    hasNext_(false)
+{
+  io::file_source file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Cannot open event log " << path;
+    return;
+  }
+  if (boost::algorithm::ends_with(path, ".gz")) {
+    in_.push(io::gzip_decompressor());
+  }
+  in_.push(file);
+
+  char header[EVENT_LOG_HEADER_SIZE];
+  if (!in_.read(header, sizeof(header)) ||
+      memcmp(header, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC)) != 0) {
+    LOG(ERROR) << "Not an event log: " << path;
+    return;
+  }
+  uint32_t version, record_size;
+  memcpy(&version, header + 8, sizeof(version));
+  memcpy(&record_size, header + 12, sizeof(record_size));
+  // Version 1 has no EVENT_TEXT records, and is read the same.
+  if (version < 1 || version > EVENT_LOG_VERSION ||
+      record_size != sizeof(event_t)) {
+    LOG(ERROR) << "Unsupported event log " << path << ", version "
+               << version << ", record size " << record_size;
+    return;
+  }
+  open_ = true;
+}
+
+bool EventLogReader::read(event_t* event)
+{
+  if (hasNext_) {
+    *event = next_;
+    hasNext_ = false;
+    return true;
+  }
+  return open_ &&
+      in_.read(reinterpret_cast<char*>(event), sizeof(*event)).gcount() ==
+      static_cast<std::streamsize>(sizeof(*event));
+}
+
+bool EventLogReader::next(event_t* event)
+{
+  do {
+    if (!read(event)) {
+      return false;
+    }
+  } while (event->type == EVENT_TEXT);  // of a text cut short
+
+  size_t size = event->text_size;
+  event->text_size = static_cast<boost::uint16_t>(
+      std::min(size, EVENT_TEXT_SIZE));
+  text_.assign(event->text, event->text_size);
+  while (text_.size() < size && read(&next_)) {
+    if (next_.type != EVENT_TEXT) {
+      hasNext_ = true;
+      break;
+    }
+    text_.append(next_.text,
+                 std::min<size_t>(next_.text_size, EVENT_TEXT_SIZE));
+  }
+  return true;
+}
+
+
+// Same as the __f__ macro of LoggingEWrapper.
+#define __f__(m) "," << #m << '=' << m
+
+void write_text(const event_t& event, std::ostream* out,
+                const std::string* text)
+{
+  *out << "cid=" << event.connection_id
+       << ",ts_utc=" << event.ts_utc;
+
+  static const size_t TICK_TYPES =
+      sizeof(TickTypeNames) / sizeof(TickTypeNames[0]);
+  const std::string field = event.field < TICK_TYPES ?
+      TickTypeNames[event.field] : std::string("UNKNOWN");
+  const std::string record_text = text != NULL ? *text :
+      std::string(event.text, std::min<size_t>(event.text_size,
+                                               EVENT_TEXT_SIZE));
+  long tickerId = static_cast<long>(event.id);
+  long id = tickerId;
+  double price = event.value;
+  double value = event.value;
+  int size = event.size;
+  int canAutoExecute = event.size;
+  int position = event.position;
+  int operation = event.operation;
+  int side = event.side;
+
+  switch (event.type) {
+    case EVENT_TICK_PRICE:
+      *out << ",event=tickPrice" << __f__(tickerId) << ",field=" << field
+           << __f__(price) << __f__(canAutoExecute);
+      break;
+    case EVENT_TICK_SIZE:
+      *out << ",event=tickSize" << __f__(tickerId) << ",field=" << field
+           << __f__(size);
+      break;
+    case EVENT_TICK_GENERIC:
+      *out << ",event=tickGeneric" << __f__(tickerId) << ",field=" << field
+           << __f__(value);
+      break;
+    case EVENT_TICK_STRING:
+      *out << ",event=tickString" << __f__(tickerId) << ",field=" << field
+           << ",value=" << record_text;
+      break;
+    case EVENT_UPDATE_MKT_DEPTH:
+      *out << ",event=updateMktDepth" << __f__(id) << __f__(position)
+           << __f__(operation) << __f__(side) << __f__(price) << __f__(size);
+      break;
+    case EVENT_UPDATE_MKT_DEPTH_L2:
+      *out << ",event=updateMktDepthL2" << __f__(id) << __f__(position)
+           << ",marketMaker=" << record_text << __f__(operation)
+           << __f__(side) << __f__(price) << __f__(size);
+      break;
+    default:
+      *out << ",event=unknown,type=" << static_cast<int>(event.type);
+  }
+}
+
+#undef __f__
+
+
+} // internal
+} // ib
@@ -0,0 +1,330 @@
+#ifndef IB_INTERNAL_EVENT_LOG_H_
+#define IB_INTERNAL_EVENT_LOG_H_
+
+#include <string.h>
+
+#include <iostream>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "common.hpp"
+
+
+/// Binary log of the market data events of the IB api.
+///
+/// LoggingEWrapper logs every event as a line of text through glog, which
+/// formats and takes glog's file lock on the thread of the callback.  With
+/// an EventLog installed, the market data events are instead copied as
+/// fixed size records into a lock-free ring, and a writer thread appends
+/// them to a file, gzipped if its name ends in .gz:
+///
+///   header   : magic[8] "ATPEVLG1", uint32 version, uint32 record size
+///   record*  : event_t, in host (little endian) byte order
+///
+/// A text longer than a record continues in the EVENT_TEXT records right
+/// after it.  While the log is open it holds every market data event: a
+/// callback that finds the ring full waits for the writer.  event_log_text
+/// converts a file back into the text lines of glog, which LogReader
+/// consumes.  All other events are still logged by glog, as are market
+/// data events once the log is closed.
+namespace ib {
+namespace internal {
+
+
+enum EventType {
+  EVENT_TICK_PRICE = 1,
+  EVENT_TICK_SIZE = 2,
+  EVENT_TICK_GENERIC = 3,
+  EVENT_TICK_STRING = 4,
+  EVENT_UPDATE_MKT_DEPTH = 5,
+  EVENT_UPDATE_MKT_DEPTH_L2 = 6,
+  EVENT_TEXT = 7                // more of the text of the event before
+};
+
+static const char EVENT_LOG_MAGIC[8] = { 'A','T','P','E','V','L','G','1' };
+static const boost::uint32_t EVENT_LOG_VERSION = 2;
+static const size_t EVENT_LOG_HEADER_SIZE = 8 + 4 + 4;
+
+static const size_t EVENT_TEXT_SIZE = 80;
+
+/// Longest text logged; the rest is cut.
+static const size_t EVENT_MAX_TEXT_SIZE = 0xffff;
+
+
+/// One event.  Fields not used by the type of event are 0.
+struct event_t
+{
+  boost::uint64_t ts_utc;       // micros
+  boost::uint32_t connection_id;
+  boost::uint8_t type;          // EventType
+  boost::uint8_t field;         // TickType of tick events
+  boost::uint16_t text_size;    // of the whole text, see EVENT_TEXT
+  boost::int64_t id;            // tickerId, or id of depth
+  double value;                 // price, or value of tickGeneric
+  boost::int32_t size;          // size, or canAutoExecute of tickPrice
+  boost::int32_t position;
+  boost::int32_t operation;
+  boost::int32_t side;
+  char text[EVENT_TEXT_SIZE];   // value of tickString, or marketMaker
+
+  /// Sets the text, false if it does not fit.
+  bool set_text(const std::string& s)
+  {
+    if (s.size() > EVENT_TEXT_SIZE) {
+      return false;
+    }
+    memcpy(text, s.data(), s.size());
+    text_size = static_cast<boost::uint16_t>(s.size());
+    return true;
+  }
+};
+
+
+/// Bounded multi-producer, single-consumer queue of events.  Producers
+/// never block: push fails if the ring is full.
+class EventRing : NoCopyAndAssign
+{
+ public:
+
+  /// The size is rounded up to a power of 2.
+  explicit EventRing(size_t size);
+
+  inline bool push(const event_t& event)
+  {
+    return push(&event, 1);
+  }
+
+  /// Pushes the events into consecutive slots, so that they are popped
+  /// together, or none if they do not fit.
+  inline bool push(const event_t* events, size_t count)
+  {
+    if (count == 0 || count > size()) {
+      return false;
+    }
+    boost::uint64_t pos = tail_.load(boost::memory_order_relaxed);
+    for (;;) {
+      Slot& slot = slots_[pos & mask_];
+      boost::uint64_t seq = slot.seq.load(boost::memory_order_acquire);
+      boost::int64_t diff = static_cast<boost::int64_t>(seq - pos);
+      if (diff == 0) {
+        // Slots are freed in order, so the others are free if the last is.
+        boost::uint64_t last = pos + count - 1;
+        if (count > 1 &&
+            slots_[last & mask_].seq.load(boost::memory_order_acquire) !=
+            last) {
+          boost::uint64_t tail = tail_.load(boost::memory_order_relaxed);
+          if (tail == pos) {
+            return false;  // full
+          }
+          pos = tail;
+          continue;
+        }
+        if (tail_.compare_exchange_weak(pos, pos + count,
+                                        boost::memory_order_relaxed)) {
+          for (size_t i = 0; i < count; ++i) {
+            Slot& next = slots_[(pos + i) & mask_];
+            next.event = events[i];
+            next.seq.store(pos + i + 1, boost::memory_order_release);
+          }
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = tail_.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Takes the oldest event; only one thread may pop.
+  inline bool pop(event_t* event)
+  {
+    Slot& slot = slots_[head_ & mask_];
+    boost::uint64_t seq = slot.seq.load(boost::memory_order_acquire);
+    if (seq != head_ + 1) {
+      return false;  // empty, or being pushed
+    }
+    *event = slot.event;
+    slot.seq.store(head_ + mask_ + 1, boost::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+  size_t size() const
+  {
+    return mask_ + 1;
+  }
+
+ private:
+
+  struct Slot
+  {
+    boost::atomic<boost::uint64_t> seq;
+    event_t event;
+  };
+
+  boost::scoped_array<Slot> slots_;
+  size_t mask_;
+  boost::atomic<boost::uint64_t> tail_ __attribute__((aligned(64)));
+  boost::uint64_t head_ __attribute__((aligned(64)));
+};
+
+
+/// Writes the events logged to a file from a thread of its own.
+class EventLog : NoCopyAndAssign
+{
+ public:
+
+  /// The file is <dir>/<prefix>-YYYYMMDD-HHMMSS.evl, plus .gz if compress.
+  /// Events are written every flush_millis, or sooner when the ring is
+  /// half full.
+  EventLog(const std::string& dir, const std::string& prefix,
+           bool compress = false, size_t ring_size = 1 << 16,
+           int flush_millis = 10);
+
+  ~EventLog();
+
+  /// Copies the event into the ring, waiting for the writer if it is
+  /// behind by a whole ring.  False (and counted as dropped) if the log is
+  /// closed, or not open.
+  inline bool log(const event_t& event)
+  {
+    return log(&event, 1);
+  }
+
+  /// Logs the event with its text, which continues in EVENT_TEXT records
+  /// if longer than a record.  The text is cut at EVENT_MAX_TEXT_SIZE, or
+  /// as much as the ring holds.
+  bool log(const event_t& event, const std::string& text);
+
+  /// Writes the events logged so far and closes the file.  Events logged
+  /// after close fail.
+  void close();
+
+  bool is_open() const
+  {
+    return out_.get() != NULL;
+  }
+
+  const std::string& current_file() const
+  {
+    return path_;
+  }
+
+  boost::uint64_t written() const
+  {
+    return written_.load(boost::memory_order_relaxed);
+  }
+
+  boost::uint64_t dropped() const
+  {
+    return dropped_.load(boost::memory_order_relaxed);
+  }
+
+  /// Times a producer found the ring full and waited.
+  boost::uint64_t waits() const
+  {
+    return waits_.load(boost::memory_order_relaxed);
+  }
+
+ private:
+
+  inline bool log(const event_t* events, size_t count)
+  {
+    // Counted in before looking at closed_, for close to wait for the
+    // producers that saw the log open.
+    producers_.fetch_add(1, boost::memory_order_seq_cst);
+    bool logged = !closed_.load(boost::memory_order_seq_cst) &&
+        (ring_.push(events, count) || wait_and_push(events, count));
+    producers_.fetch_sub(1, boost::memory_order_release);
+    if (!logged) {
+      dropped_.fetch_add(1, boost::memory_order_relaxed);
+    }
+    return logged;
+  }
+
+  /// Spins, then sleeps, until the events fit or the log is closed.
+  bool wait_and_push(const event_t* events, size_t count);
+
+  void run();
+  size_t drain();
+
+  EventRing ring_;
+  int flush_millis_;
+  std::string path_;
+  boost::scoped_ptr<boost::iostreams::filtering_ostream> out_;
+  boost::atomic<bool> running_;
+  boost::atomic<bool> closed_;
+  boost::atomic<int> producers_;
+  boost::atomic<boost::uint64_t> written_;
+  boost::atomic<boost::uint64_t> dropped_;
+  boost::atomic<boost::uint64_t> waits_;
+  boost::scoped_ptr<boost::thread> thread_;
+  boost::mutex close_mutex_;
+};
+
+
+/// The event log of the process, NULL if none.
+EventLog* event_log();
+
+/// Installs the event log of the process, or NULL to stop using it.
+/// The log must outlive every use; close it before uninstalling.
+void set_event_log(EventLog* log);
+
+
+/// Sequential access to the events of a file.
+class EventLogReader : NoCopyAndAssign
+{
+ public:
+
+  explicit EventLogReader(const std::string& path);
+
+  /// True if the file was opened and has a valid header.
+  bool is_open() const
+  {
+    return open_;
+  }
+
+  /// Reads the next event.  Returns false at the end of the file.  The
+  /// event holds the text that fits its record; text() has all of it.
+  bool next(event_t* event);
+
+  /// The text of the last event read.
+  const std::string& text() const
+  {
+    return text_;
+  }
+
+ private:
+
+  bool read(event_t* event);
+
+  boost::iostreams::filtering_istream in_;
+  bool open_;
+  std::string text_;
+
+  // Read ahead, past a text cut short.
+  bool hasNext_;
+  event_t next_;
+};
+
+
+/// Writes the event as the text LoggingEWrapper logs through glog, e.g.
+///
+///   cid=1,ts_utc=1360000000000000,event=tickPrice,tickerId=5,field=BID,...
+///
+/// with text, if not NULL, in place of that of the record.
+void write_text(const event_t& event, std::ostream* out,
+                const std::string* text = NULL);
+
+
+} // internal
+} // ib
+
+#endif //IB_INTERNAL_EVENT_LOG_H_
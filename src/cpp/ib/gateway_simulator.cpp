@@ -0,0 +1,989 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind.hpp>
+
+#include <glog/logging.h>
+
+#include "utils.hpp"
+#include "ib/gateway_simulator.hpp"
+#include "ib/tick_types.hpp"
+
+
+namespace ib {
+namespace internal {
+
+using boost::asio::ip::tcp;
+using boost::uint64_t;
+
+
+// Message ids of EClientSocketBase.
+enum Incoming {
+  TICK_PRICE = 1,
+  TICK_SIZE = 2,
+  ORDER_STATUS = 3,
+  NEXT_VALID_ID = 9,
+  MARKET_DEPTH = 12,
+  MARKET_DEPTH_L2 = 13,
+  MANAGED_ACCTS = 15,
+  TICK_GENERIC = 45,
+  TICK_STRING = 46,
+  CURRENT_TIME = 49,
+  OPEN_ORDER_END = 53,
+  ACCT_DOWNLOAD_END = 54,
+  EXECUTION_DATA_END = 55,
+  TICK_SNAPSHOT_END = 57
+};
+
+enum Outgoing {
+  REQ_MKT_DATA = 1,
+  CANCEL_MKT_DATA = 2,
+  PLACE_ORDER = 3,
+  CANCEL_ORDER = 4,
+  REQ_OPEN_ORDERS = 5,
+  REQ_ACCT_DATA = 6,
+  REQ_EXECUTIONS = 7,
+  REQ_IDS = 8,
+  REQ_MKT_DEPTH = 10,
+  CANCEL_MKT_DEPTH = 11,
+  REQ_NEWS_BULLETINS = 12,
+  CANCEL_NEWS_BULLETINS = 13,
+  SET_SERVER_LOGLEVEL = 14,
+  REQ_AUTO_OPEN_ORDERS = 15,
+  REQ_ALL_OPEN_ORDERS = 16,
+  REQ_MANAGED_ACCTS = 17,
+  REQ_CURRENT_TIME = 49,
+  REQ_GLOBAL_CANCEL = 58,
+  REQ_MARKET_DATA_TYPE = 59
+};
+
+// Server versions from which the client sends the fields.
+static const int MIN_SERVER_VER_WHAT_IF_ORDERS = 36;
+static const int MIN_SERVER_VER_PTA_ORDERS = 39;
+static const int MIN_SERVER_VER_UNDER_COMP = 40;
+static const int MIN_SERVER_VER_ALGO_ORDERS = 41;
+static const int MIN_SERVER_VER_NOT_HELD = 44;
+static const int MIN_SERVER_VER_SEC_ID_TYPE = 45;
+static const int MIN_SERVER_VER_PLACE_ORDER_CONID = 46;
+static const int MIN_SERVER_VER_REQ_MKT_DATA_CONID = 47;
+static const int MIN_SERVER_VER_SSHORTX_OLD = 51;
+static const int MIN_SERVER_VER_HEDGE_ORDERS = 54;
+static const int MIN_SERVER_VER_OPT_OUT_SMART_ROUTING = 56;
+static const int MIN_SERVER_VER_SMART_COMBO_ROUTING_PARAMS = 57;
+static const int MIN_SERVER_VER_DELTA_NEUTRAL_CONID = 58;
+
+
+WireEncoder& WireEncoder::operator<<(long value)
+{
+  char buff[32];
+  snprintf(buff, sizeof(buff), "%ld", value);
+  return *this << static_cast<const char*>(buff);
+}
+
+WireEncoder& WireEncoder::operator<<(int value)
+{
+  return *this << static_cast<long>(value);
+}
+
+WireEncoder& WireEncoder::operator<<(double value)
+{
+  char buff[32];
+  snprintf(buff, sizeof(buff), "%.10g", value);
+  return *this << static_cast<const char*>(buff);
+}
+
+
+bool WireDecoder::read(std::string* value)
+{
+  const char* nul = static_cast<const char*>(memchr(ptr_, '\0', end_ - ptr_));
+  if (nul == NULL) {
+    return false;
+  }
+  value->assign(ptr_, nul - ptr_);
+  ptr_ = nul + 1;
+  return true;
+}
+
+bool WireDecoder::read(long* value)
+{
+  std::string field;
+  if (!read(&field)) {
+    return false;
+  }
+  *value = atol(field.c_str());
+  return true;
+}
+
+bool WireDecoder::read(int* value)
+{
+  long field;
+  if (!read(&field)) {
+    return false;
+  }
+  *value = static_cast<int>(field);
+  return true;
+}
+
+bool WireDecoder::read(double* value)
+{
+  std::string field;
+  if (!read(&field)) {
+    return false;
+  }
+  *value = atof(field.c_str());
+  return true;
+}
+
+bool WireDecoder::skip(int count)
+{
+  for (int i = 0; i < count; ++i) {
+    const char* nul =
+        static_cast<const char*>(memchr(ptr_, '\0', end_ - ptr_));
+    if (nul == NULL) {
+      return false;
+    }
+    ptr_ = nul + 1;
+  }
+  return true;
+}
+
+
+void encode_event(const event_t& event, std::string* out)
+{
+  WireEncoder msg(out);
+  long id = static_cast<long>(event.id);
+  int field = event.field;
+  switch (event.type) {
+    case EVENT_TICK_PRICE:
+      msg << TICK_PRICE << 1 << id << field << event.value;
+      break;
+    case EVENT_TICK_SIZE:
+      msg << TICK_SIZE << 1 << id << field << event.size;
+      break;
+    case EVENT_TICK_GENERIC:
+      msg << TICK_GENERIC << 6 << id << field << event.value;
+      break;
+    case EVENT_TICK_STRING:
+      msg << TICK_STRING << 6 << id << field
+          << std::string(event.text, event.text_size);
+      break;
+    case EVENT_UPDATE_MKT_DEPTH:
+      msg << MARKET_DEPTH << 1 << id << event.position << event.operation
+          << event.side << event.value << event.size;
+      break;
+    case EVENT_UPDATE_MKT_DEPTH_L2:
+      msg << MARKET_DEPTH_L2 << 1 << id << event.position
+          << std::string(event.text, event.text_size) << event.operation
+          << event.side << event.value << event.size;
+      break;
+  }
+}
+
+
+static int tick_type(const std::string& name)
+{
+  static const size_t TICK_TYPES =
+      sizeof(TickTypeNames) / sizeof(TickTypeNames[0]);
+  for (size_t i = 0; i < TICK_TYPES; ++i) {
+    if (TickTypeNames[i] == name) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+bool parse_event_line(const std::string& line, event_t* event)
+{
+  size_t start = line.find("cid=");
+  if (start == std::string::npos) {
+    return false;
+  }
+  std::map<std::string, std::string> fields;
+  while (start < line.size()) {
+    size_t end = line.find(',', start);
+    if (end == std::string::npos) {
+      end = line.size();
+    }
+    size_t eq = line.find('=', start);
+    if (eq < end) {
+      fields[line.substr(start, eq - start)] =
+          line.substr(eq + 1, end - eq - 1);
+    }
+    start = end + 1;
+  }
+
+  *event = event_t();
+  event->ts_utc = strtoull(fields["ts_utc"].c_str(), NULL, 10);
+  event->connection_id = atoi(fields["cid"].c_str());
+  const std::string& name = fields["event"];
+  if (name == "tickPrice") {
+    event->type = EVENT_TICK_PRICE;
+    event->value = atof(fields["price"].c_str());
+    event->size = atoi(fields["canAutoExecute"].c_str());
+  } else if (name == "tickSize") {
+    event->type = EVENT_TICK_SIZE;
+    event->size = atoi(fields["size"].c_str());
+  } else if (name == "tickGeneric") {
+    event->type = EVENT_TICK_GENERIC;
+    event->value = atof(fields["value"].c_str());
+  } else if (name == "tickString") {
+    // The value is last, and may have commas.
+    event->type = EVENT_TICK_STRING;
+    size_t value = line.find(",value=");
+    if (value == std::string::npos ||
+        !event->set_text(line.substr(value + 7))) {
+      return false;
+    }
+  } else if (name == "updateMktDepth" || name == "updateMktDepthL2") {
+    event->type = name == "updateMktDepth" ?
+        EVENT_UPDATE_MKT_DEPTH : EVENT_UPDATE_MKT_DEPTH_L2;
+    event->id = atol(fields["id"].c_str());
+    event->position = atoi(fields["position"].c_str());
+    event->operation = atoi(fields["operation"].c_str());
+    event->side = atoi(fields["side"].c_str());
+    event->value = atof(fields["price"].c_str());
+    event->size = atoi(fields["size"].c_str());
+    return event->type == EVENT_UPDATE_MKT_DEPTH ||
+        event->set_text(fields["marketMaker"]);
+  } else {
+    return false;
+  }
+  event->id = atol(fields["tickerId"].c_str());
+  int field = tick_type(fields["field"]);
+  if (field < 0) {
+    return false;
+  }
+  event->field = static_cast<boost::uint8_t>(field);
+  return true;
+}
+
+
+SimulatedSession::SimulatedSession(int serverVersion, long nextOrderId,
+                                   bool fillOrders,
+                                   const std::string& accounts) :
+    serverVersion_(serverVersion),
+    nextOrderId_(nextOrderId),
+    fillOrders_(fillOrders),
+    accounts_(accounts),
+    state_(WAIT_CLIENT_VERSION),
+    clientId_(-1),
+    dropped_(0),
+    permId_(1),
+    generation_(0)
+{
+}
+
+void SimulatedSession::receive(const char* data, size_t size,
+                               std::string* out)
+{
+  in_.append(data, size);
+  const char* end = in_.data() + in_.size();
+  WireDecoder in(in_.data(), end);
+  for (;;) {
+    const char* start = in.position();
+    if (start == end || !parse(&in, out)) {
+      in = WireDecoder(start, end);
+      break;
+    }
+  }
+  in_.erase(0, in.position() - in_.data());
+}
+
+bool SimulatedSession::subscriptions(uint64_t* generation,
+                                     std::set<long>* marketData,
+                                     std::set<long>* marketDepth)
+{
+  if (generation_.load(boost::memory_order_acquire) == *generation) {
+    return false;
+  }
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  *generation = generation_.load(boost::memory_order_relaxed);
+  *marketData = marketData_;
+  *marketDepth = marketDepth_;
+  return true;
+}
+
+void SimulatedSession::subscribe(std::set<long>* ids, long id, bool add)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  if (add) {
+    ids->insert(id);
+  } else {
+    ids->erase(id);
+  }
+  generation_.fetch_add(1, boost::memory_order_release);
+}
+
+static void order_status(long orderId, const char* status, int filled,
+                         int remaining, double price, long permId,
+                         int clientId, std::string* out)
+{
+  WireEncoder(out) << ORDER_STATUS << 6 << orderId << status << filled
+                   << remaining << price << permId << 0 << price
+                   << clientId << "";
+}
+
+// Reads placeOrder, after its version, as EClientSocketBase of API 9.66
+// sends it to the server version; false if incomplete.
+static bool read_order(WireDecoder* in, int serverVersion, long* id,
+                       int* quantity, double* limit)
+{
+  std::string secType, deltaNeutralOrderType, hedgeType, algoStrategy;
+  int count = 0;
+
+  // Contract, then action ... auxPrice.
+  if (!in->read(id) ||
+      !in->skip(serverVersion >= MIN_SERVER_VER_PLACE_ORDER_CONID ? 2 : 1) ||
+      !in->read(&secType) ||
+      !in->skip(8) ||  // expiry ... localSymbol
+      !in->skip(serverVersion >= MIN_SERVER_VER_SEC_ID_TYPE ? 2 : 0) ||
+      !in->skip(1) || !in->read(quantity) || !in->skip(1) ||
+      !in->read(limit) || !in->skip(1)) {
+    return false;
+  }
+  // tif ... hidden
+  if (!in->skip(14)) {
+    return false;
+  }
+  if (secType == "BAG") {
+    // conId ... designatedLocation, exemptCode of each leg.
+    int legFields = serverVersion >= MIN_SERVER_VER_SSHORTX_OLD ? 8 : 7;
+    if (!in->read(&count) || !in->skip(count * legFields)) {
+      return false;
+    }
+    if (serverVersion >= MIN_SERVER_VER_SMART_COMBO_ROUTING_PARAMS &&
+        (!in->read(&count) || !in->skip(count * 2))) {
+      return false;
+    }
+  }
+  // sharesAllocation ... designatedLocation, exemptCode
+  if (!in->skip(serverVersion >= MIN_SERVER_VER_SSHORTX_OLD ? 11 : 10)) {
+    return false;
+  }
+  // ocaType ... volatilityType, then the delta neutral order.
+  if (!in->skip(18) || !in->read(&deltaNeutralOrderType) || !in->skip(1)) {
+    return false;
+  }
+  if (serverVersion >= MIN_SERVER_VER_DELTA_NEUTRAL_CONID &&
+      !deltaNeutralOrderType.empty() && !in->skip(4)) {
+    return false;
+  }
+  // continuousUpdate ... scalePriceIncrement
+  if (!in->skip(6)) {
+    return false;
+  }
+  if (serverVersion >= MIN_SERVER_VER_HEDGE_ORDERS &&
+      (!in->read(&hedgeType) || !in->skip(hedgeType.empty() ? 0 : 1))) {
+    return false;
+  }
+  if (serverVersion >= MIN_SERVER_VER_OPT_OUT_SMART_ROUTING &&
+      !in->skip(1)) {
+    return false;
+  }
+  if (serverVersion >= MIN_SERVER_VER_PTA_ORDERS && !in->skip(2)) {
+    return false;  // clearingAccount, clearingIntent
+  }
+  if (serverVersion >= MIN_SERVER_VER_NOT_HELD && !in->skip(1)) {
+    return false;
+  }
+  if (serverVersion >= MIN_SERVER_VER_UNDER_COMP &&
+      (!in->read(&count) || !in->skip(count ? 3 : 0))) {
+    return false;
+  }
+  if (serverVersion >= MIN_SERVER_VER_ALGO_ORDERS) {
+    if (!in->read(&algoStrategy)) {
+      return false;
+    }
+    if (!algoStrategy.empty() &&
+        (!in->read(&count) || !in->skip(count * 2))) {
+      return false;
+    }
+  }
+  // whatIf
+  return serverVersion < MIN_SERVER_VER_WHAT_IF_ORDERS || in->skip(1);
+}
+
+bool SimulatedSession::parse(WireDecoder* in, std::string* out)
+{
+  WireEncoder reply(out);
+
+  if (state_ == WAIT_CLIENT_VERSION) {
+    int clientVersion;
+    if (!in->read(&clientVersion)) {
+      return false;
+    }
+    char now[32];
+    time_t t = time(NULL);
+    strftime(now, sizeof(now), "%Y%m%d %H:%M:%S UTC", gmtime(&t));
+    reply << serverVersion_ << now;
+    state_ = WAIT_CLIENT_ID;
+    return true;
+  }
+  if (state_ == WAIT_CLIENT_ID) {
+    if (!in->read(&clientId_)) {
+      return false;
+    }
+    reply << NEXT_VALID_ID << 1 << nextOrderId_;
+    reply << MANAGED_ACCTS << 1 << accounts_;
+    state_ = CONNECTED;
+    LOG(INFO) << "Client " << clientId_ << " connected.";
+    return true;
+  }
+
+  int msgId, version;
+  if (!in->read(&msgId) || !in->read(&version)) {
+    return false;
+  }
+  long id;
+  switch (msgId) {
+    case REQ_MKT_DATA: {
+      std::string secType;
+      int legs = 0, underComp = 0, snapshot = 0;
+      if (!in->read(&id) ||
+          !in->skip(serverVersion_ >= MIN_SERVER_VER_REQ_MKT_DATA_CONID ?
+                    2 : 1) ||  // conId, symbol
+          !in->read(&secType) ||
+          // expiry ... localSymbol
+          !in->skip(8)) {
+        return false;
+      }
+      if (secType == "BAG" && (!in->read(&legs) || !in->skip(legs * 4))) {
+        return false;
+      }
+      if (serverVersion_ >= MIN_SERVER_VER_UNDER_COMP &&
+          (!in->read(&underComp) || !in->skip(underComp ? 3 : 0))) {
+        return false;
+      }
+      if (!in->skip(1) || !in->read(&snapshot)) {  // genericTicks
+        return false;
+      }
+      if (snapshot) {
+        reply << TICK_SNAPSHOT_END << 1 << id;
+      } else {
+        subscribe(&marketData_, id, true);
+      }
+      return true;
+    }
+    case CANCEL_MKT_DATA:
+      if (!in->read(&id)) {
+        return false;
+      }
+      subscribe(&marketData_, id, false);
+      return true;
+    case REQ_MKT_DEPTH:
+      // symbol ... localSymbol, numRows
+      if (!in->read(&id) || !in->skip(version >= 3 ? 10 : 9)) {
+        return false;
+      }
+      subscribe(&marketDepth_, id, true);
+      return true;
+    case CANCEL_MKT_DEPTH:
+      if (!in->read(&id)) {
+        return false;
+      }
+      subscribe(&marketDepth_, id, false);
+      return true;
+    case PLACE_ORDER: {
+      int quantity;
+      double limit;
+      if (!read_order(in, serverVersion_, &id, &quantity, &limit)) {
+        return false;
+      }
+      nextOrderId_ = std::max(nextOrderId_, id + 1);
+      long permId = permId_++;
+      order_status(id, "Submitted", 0, quantity, 0., permId, clientId_, out);
+      if (fillOrders_) {
+        order_status(id, "Filled", quantity, 0, limit, permId, clientId_, out);
+      }
+      return true;
+    }
+    case CANCEL_ORDER:
+      if (!in->read(&id)) {
+        return false;
+      }
+      order_status(id, "Cancelled", 0, 0, 0., 0, clientId_, out);
+      return true;
+    case REQ_OPEN_ORDERS:
+    case REQ_ALL_OPEN_ORDERS:
+      reply << OPEN_ORDER_END << 1;
+      return true;
+    case REQ_ACCT_DATA:
+      if (!in->skip(version >= 2 ? 2 : 1)) {
+        return false;
+      }
+      reply << ACCT_DOWNLOAD_END << 1 << accounts_;
+      return true;
+    case REQ_EXECUTIONS:
+      // reqId, then the filter: clientId ... side
+      if (!in->read(&id) || !in->skip(7)) {
+        return false;
+      }
+      reply << EXECUTION_DATA_END << 1 << id;
+      return true;
+    case REQ_IDS:
+      if (!in->skip(1)) {
+        return false;
+      }
+      reply << NEXT_VALID_ID << 1 << nextOrderId_;
+      return true;
+    case REQ_MANAGED_ACCTS:
+      reply << MANAGED_ACCTS << 1 << accounts_;
+      return true;
+    case REQ_CURRENT_TIME:
+      reply << CURRENT_TIME << 1 << static_cast<long>(time(NULL));
+      return true;
+    case REQ_NEWS_BULLETINS:
+    case SET_SERVER_LOGLEVEL:
+    case REQ_AUTO_OPEN_ORDERS:
+    case REQ_MARKET_DATA_TYPE:
+      return in->skip(1);
+    case CANCEL_NEWS_BULLETINS:
+    case REQ_GLOBAL_CANCEL:
+      return true;
+    default:
+      // Cannot tell where it ends.
+      LOG(WARNING) << "Client " << clientId_ << ": unsupported request "
+                   << msgId << ", dropping the bytes received with it.";
+      dropped_ += in->skip_all();
+      return true;
+  }
+}
+
+
+ReplayTicks::ReplayTicks(const std::vector<std::string>& files, bool loop,
+                         bool remap) :
+    files_(files),
+    loop_(loop),
+    remap_(remap),
+    file_(0),
+    turn_(0)
+{
+  if (!files_.empty()) {
+    open(0);
+  }
+}
+
+bool ReplayTicks::open(size_t file)
+{
+  reader_.reset();
+  text_.reset();
+  if (file >= files_.size()) {
+    if (!loop_ || files_.empty()) {
+      return false;
+    }
+    file = 0;
+  }
+  file_ = file;
+  const std::string& path = files_[file];
+  LOG(INFO) << "Replaying " << path;
+  if (boost::algorithm::ends_with(path, ".evl") ||
+      boost::algorithm::ends_with(path, ".evl.gz")) {
+    reader_.reset(new EventLogReader(path));
+    return reader_->is_open();
+  }
+  text_.reset(new std::ifstream(path.c_str()));
+  if (!*text_) {
+    LOG(ERROR) << "Cannot read " << path;
+    return false;
+  }
+  return true;
+}
+
+bool ReplayTicks::read(event_t* event)
+{
+  for (;;) {
+    if (reader_.get() != NULL) {
+      if (reader_->next(event)) {
+        return true;
+      }
+    } else if (text_.get() != NULL) {
+      std::string line;
+      while (std::getline(*text_, line)) {
+        if (parse_event_line(line, event)) {
+          return true;
+        }
+      }
+    } else {
+      return false;
+    }
+    if (!open(file_ + 1)) {
+      return false;
+    }
+  }
+}
+
+bool ReplayTicks::next(const std::set<long>& marketData,
+                       const std::set<long>& marketDepth, event_t* event)
+{
+  while (read(event)) {
+    bool depth = event->type == EVENT_UPDATE_MKT_DEPTH ||
+        event->type == EVENT_UPDATE_MKT_DEPTH_L2;
+    const std::set<long>& ids = depth ? marketDepth : marketData;
+    long id = static_cast<long>(event->id);
+    if (ids.count(id) > 0) {
+      return true;
+    }
+    if (!remap_ || ids.empty()) {
+      continue;
+    }
+    std::map<long, long>& tickers = tickers_[depth ? 1 : 0];
+    std::map<long, long>::iterator mapped = tickers.find(id);
+    if (mapped == tickers.end() || ids.count(mapped->second) == 0) {
+      std::set<long>::const_iterator itr = ids.begin();
+      std::advance(itr, turn_++ % ids.size());
+      tickers[id] = *itr;
+      mapped = tickers.find(id);
+    }
+    event->id = mapped->second;
+    return true;
+  }
+  return false;
+}
+
+
+SyntheticTicks::SyntheticTicks(int depthEvery) :
+    depthEvery_(depthEvery),
+    count_(0),
+    seed_(1),
+    lastTicker_(0),
+    lastDepth_(0),
+    hasSize_(false)
+{
+}
+
+long SyntheticTicks::after(const std::set<long>& ids, long last)
+{
+  std::set<long>::const_iterator itr = ids.upper_bound(last);
+  return itr == ids.end() ? *ids.begin() : *itr;
+}
+
+bool SyntheticTicks::next(const std::set<long>& marketData,
+                          const std::set<long>& marketDepth, event_t* event)
+{
+  count_++;
+  *event = event_t();
+  event->ts_utc = now_micros();
+
+  if (!marketDepth.empty() &&
+      (marketData.empty() ||
+       (depthEvery_ > 0 && count_ % depthEvery_ == 0))) {
+    long id = lastDepth_ = after(marketDepth, lastDepth_);
+    int updates = depthUpdates_[id]++;
+    double& mid = prices_[id];
+    if (mid == 0.) {
+      mid = 100. + id % 100;
+    }
+    event->type = EVENT_UPDATE_MKT_DEPTH;
+    event->id = id;
+    event->position = updates % 10;
+    event->operation = updates < 20 ? 0 : 1;  // insert, then update
+    event->side = (updates / 10) % 2;         // ask, bid
+    event->value = mid + (event->side == 1 ? -0.01 : 0.01) *
+        (event->position + 1);
+    event->size = 100 * (1 + rand_r(&seed_) % 10);
+    return true;
+  }
+
+  if (hasSize_) {
+    hasSize_ = false;
+    *event = size_;
+    return true;
+  }
+  if (marketData.empty()) {
+    return false;
+  }
+
+  long id = lastTicker_ = after(marketData, lastTicker_);
+  double& mid = prices_[id];
+  if (mid == 0.) {
+    mid = 100. + id % 100;
+  }
+  mid = std::max(0.01, mid + 0.01 * (rand_r(&seed_) % 3 - 1));
+
+  static const int FIELDS[] = { BID, ASK, LAST };
+  static const int SIZE_FIELDS[] = { BID_SIZE, ASK_SIZE, LAST_SIZE };
+  int turn = static_cast<int>((count_ / 2) % 3);
+
+  event->type = EVENT_TICK_PRICE;
+  event->id = id;
+  event->field = FIELDS[turn];
+  event->value = mid + (turn == 0 ? -0.01 : turn == 1 ? 0.01 : 0.);
+
+  size_ = *event;
+  size_.type = EVENT_TICK_SIZE;
+  size_.field = SIZE_FIELDS[turn];
+  size_.value = 0.;
+  size_.size = 100 * (1 + rand_r(&seed_) % 10);
+  hasSize_ = true;
+  return true;
+}
+
+
+struct GatewaySimulator::Connection
+{
+  Connection(boost::asio::io_service& ioService, int serverVersion,
+             bool fillOrders) :
+      socket(ioService),
+      session(serverVersion, 1, fillOrders),
+      open(true),
+      generation(0)
+  {
+  }
+
+  tcp::socket socket;
+  SimulatedSession session;
+  boost::atomic<bool> open;
+  boost::mutex writeMutex;
+
+  // Used by the thread of run only.
+  uint64_t generation;
+  std::set<long> marketData;
+  std::set<long> marketDepth;
+  std::string pending;
+};
+
+
+GatewaySimulator::GatewaySimulator(unsigned int port, TickSource* source,
+                                   int serverVersion, double rate,
+                                   double speed, bool fillOrders) :
+    acceptor_(ioService_, tcp::endpoint(tcp::v4(), port)),
+    source_(source),
+    serverVersion_(serverVersion),
+    rate_(rate),
+    speed_(speed),
+    fillOrders_(fillOrders),
+    running_(true),
+    sent_(0)
+{
+  LOG(INFO) << "Simulated gateway listening on " << port
+            << ", server version " << serverVersion_;
+  threads_.create_thread(boost::bind(&GatewaySimulator::accept, this));
+}
+
+GatewaySimulator::~GatewaySimulator()
+{
+  stop();
+  threads_.join_all();
+}
+
+void GatewaySimulator::stop()
+{
+  if (!running_.exchange(false)) {
+    return;
+  }
+  boost::system::error_code ec;
+  // Wakes up the blocking accept.
+  ::shutdown(acceptor_.native_handle(), SHUT_RDWR);
+  acceptor_.close(ec);
+
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    connections_[i]->socket.shutdown(tcp::socket::shutdown_both, ec);
+  }
+}
+
+void GatewaySimulator::accept()
+{
+  while (running_) {
+    ConnectionPtr connection(
+        new Connection(ioService_, serverVersion_, fillOrders_));
+    boost::system::error_code ec;
+    acceptor_.accept(connection->socket, ec);
+    if (ec) {
+      if (running_) {
+        LOG(ERROR) << "Accept failed: " << ec.message();
+      }
+      return;
+    }
+    connection->socket.set_option(tcp::no_delay(true), ec);
+    LOG(INFO) << "Accepted " << connection->socket.remote_endpoint(ec);
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    connections_.push_back(connection);
+    threads_.create_thread(
+        boost::bind(&GatewaySimulator::read, this, connection));
+  }
+}
+
+void GatewaySimulator::read(ConnectionPtr connection)
+{
+  char buff[64 * 1024];
+  for (;;) {
+    boost::system::error_code ec;
+    size_t n = connection->socket.read_some(
+        boost::asio::buffer(buff, sizeof(buff)), ec);
+    if (ec) {
+      break;
+    }
+    std::string reply;
+    connection->session.receive(buff, n, &reply);
+    if (!reply.empty() && !write(connection.get(), reply)) {
+      break;
+    }
+  }
+  connection->open = false;
+  LOG(INFO) << "Client " << connection->session.clientId()
+            << " disconnected, " << connection->session.dropped()
+            << " bytes dropped.";
+}
+
+bool GatewaySimulator::write(Connection* connection, const std::string& bytes)
+{
+  boost::lock_guard<boost::mutex> lock(connection->writeMutex);
+  boost::system::error_code ec;
+  boost::asio::write(connection->socket, boost::asio::buffer(bytes), ec);
+  if (ec) {
+    connection->open = false;
+    return false;
+  }
+  return true;
+}
+
+void GatewaySimulator::flush(std::vector<ConnectionPtr>* connections)
+{
+  for (size_t i = 0; i < connections->size(); ++i) {
+    Connection* connection = (*connections)[i].get();
+    if (!connection->pending.empty()) {
+      write(connection, connection->pending);
+      connection->pending.clear();
+    }
+  }
+}
+
+void GatewaySimulator::run()
+{
+  static const size_t BATCH = 1024;
+
+  std::vector<ConnectionPtr> connections;
+  std::set<long> marketData, marketDepth;
+  std::string bytes;
+  event_t event;
+
+  // The rate is kept from rateStart, when rateSent events were sent.
+  int64 rateStart = now_micros();
+  uint64_t rateSent = 0;
+  bool idle = true;
+  int64 lastStats = rateStart;
+  uint64_t lastSent = 0;
+  uint64_t firstTs = 0;
+  int64 firstMicros = 0;
+
+  while (running_) {
+    // Picks up new connections and subscriptions.
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      std::vector<ConnectionPtr> open;
+      for (size_t i = 0; i < connections_.size(); ++i) {
+        if (connections_[i]->open) {
+          open.push_back(connections_[i]);
+        }
+      }
+      connections_.swap(open);
+      connections = connections_;
+    }
+    bool changed = false;
+    for (size_t i = 0; i < connections.size(); ++i) {
+      Connection* c = connections[i].get();
+      changed = c->session.subscriptions(&c->generation, &c->marketData,
+                                         &c->marketDepth) || changed;
+    }
+    if (changed || marketData.size() + marketDepth.size() == 0) {
+      marketData.clear();
+      marketDepth.clear();
+      for (size_t i = 0; i < connections.size(); ++i) {
+        marketData.insert(connections[i]->marketData.begin(),
+                          connections[i]->marketData.end());
+        marketDepth.insert(connections[i]->marketDepth.begin(),
+                           connections[i]->marketDepth.end());
+      }
+    }
+    if (marketData.empty() && marketDepth.empty()) {
+      idle = true;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      continue;
+    }
+
+    int64 now = now_micros();
+    if (idle) {
+      // No budget for the time nobody was subscribed, and the pace of the
+      // replay starts over.
+      rateStart = now;
+      rateSent = sent();
+      firstTs = 0;
+      idle = false;
+    }
+    if (now - lastStats >= 10000000) {
+      LOG(INFO) << "Sent " << sent() << " events, "
+                << (sent() - lastSent) * 1000000 / (now - lastStats)
+                << " per second, to " << connections.size() << " clients.";
+      lastStats = now;
+      lastSent = sent();
+    }
+
+    size_t batch = BATCH;
+    if (rate_ > 0) {
+      double due = rate_ * (now - rateStart) / 1000000. -
+          (sent() - rateSent);
+      // Clients slower than the rate, or a wait for the replay's pace, are
+      // not made up in a burst: at most 100 msec or a batch is due.
+      double maxDue = std::max(static_cast<double>(BATCH), rate_ / 10.);
+      if (due > maxDue) {
+        rateStart = now - static_cast<int64>(maxDue * 1000000. / rate_);
+        rateSent = sent();
+        due = maxDue;
+      }
+      if (due < 1.) {
+        boost::this_thread::sleep(boost::posix_time::microseconds(100));
+        continue;
+      }
+      batch = std::min(batch, static_cast<size_t>(due));
+    }
+
+    for (size_t i = 0; i < batch && running_; ++i) {
+      if (!source_->next(marketData, marketDepth, &event)) {
+        flush(&connections);
+        LOG(INFO) << "End of events, " << sent() << " sent.";
+        return;
+      }
+
+      if (speed_ > 0 && event.ts_utc > 0) {
+        if (firstTs == 0 || event.ts_utc < firstTs) {
+          firstTs = event.ts_utc;  // first, or the replay looped
+          firstMicros = now_micros();
+        }
+        int64 due = firstMicros +
+            static_cast<int64>((event.ts_utc - firstTs) / speed_);
+        int64 wait = due - now_micros();
+        if (wait > 0) {
+          flush(&connections);
+          boost::this_thread::sleep(boost::posix_time::microseconds(wait));
+        }
+      }
+
+      bytes.clear();
+      encode_event(event, &bytes);
+      bool depth = event.type == EVENT_UPDATE_MKT_DEPTH ||
+          event.type == EVENT_UPDATE_MKT_DEPTH_L2;
+      long id = static_cast<long>(event.id);
+      for (size_t c = 0; c < connections.size(); ++c) {
+        Connection* connection = connections[c].get();
+        if ((depth ? connection->marketDepth : connection->marketData)
+            .count(id) > 0) {
+          connection->pending.append(bytes);
+        }
+      }
+      sent_.fetch_add(1, boost::memory_order_relaxed);
+    }
+    flush(&connections);
+  }
+}
+
+
+} // internal
+} // ib
@@ -0,0 +1,297 @@
+#ifndef IB_INTERNAL_GATEWAY_SIMULATOR_H_
+#define IB_INTERNAL_GATEWAY_SIMULATOR_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "common.hpp"
+#include "ib/event_log.hpp"
+
+
+/// A stand-in for the IB gateway, for load testing the connectors on one
+/// machine.  It speaks the socket protocol of EClientSocketBase: the
+/// handshake, nextValidId and managedAccounts, market data and depth
+/// subscriptions, and acks of orders; and it sends the events of a
+/// TickSource -- captured event logs, or a synthetic storm -- to the
+/// subscribers at a controlled rate.
+///
+/// Messages of the protocol are fields terminated by NUL, without a length,
+/// so only the requests parsed below can be told apart.  Each is parsed
+/// field by field as the client sends it to the server version announced,
+/// and one split over reads of the socket waits for the rest of its bytes.
+namespace ib {
+namespace internal {
+
+
+/// Fields of an outbound message.
+class WireEncoder
+{
+ public:
+
+  explicit WireEncoder(std::string* out) : out_(out) {}
+
+  WireEncoder& operator<<(const std::string& value)
+  {
+    out_->append(value);
+    out_->push_back('\0');
+    return *this;
+  }
+
+  WireEncoder& operator<<(const char* value)
+  {
+    out_->append(value);
+    out_->push_back('\0');
+    return *this;
+  }
+
+  WireEncoder& operator<<(long value);
+  WireEncoder& operator<<(int value);
+  WireEncoder& operator<<(double value);
+
+ private:
+  std::string* out_;
+};
+
+
+/// Fields of an inbound message.  A read fails, and should be retried with
+/// more bytes, if the field is not complete.
+class WireDecoder
+{
+ public:
+
+  WireDecoder(const char* begin, const char* end) :
+      ptr_(begin), end_(end) {}
+
+  bool read(std::string* value);
+  bool read(long* value);
+  bool read(int* value);
+  bool read(double* value);
+
+  /// Skips count fields.
+  bool skip(int count);
+
+  /// Skips all the bytes left, and returns their count.
+  size_t skip_all()
+  {
+    size_t count = end_ - ptr_;
+    ptr_ = end_;
+    return count;
+  }
+
+  const char* position() const
+  {
+    return ptr_;
+  }
+
+ private:
+  const char* ptr_;
+  const char* end_;
+};
+
+
+/// Appends the message of the gateway that makes the client call the
+/// EWrapper method of the event, e.g. TICK_PRICE for tickPrice.  Prices
+/// are sent without size (version 1), for the client to call tickPrice
+/// only; a live gateway's tickSize that follows is an event of its own.
+void encode_event(const event_t& event, std::string* out);
+
+/// Parses a line of LoggingEWrapper's glog output, e.g.
+///
+///   ...] cid=1,ts_utc=1360000000000000,event=tickPrice,tickerId=5,...
+///
+/// into the event, false if it is not a market data event.
+bool parse_event_line(const std::string& line, event_t* event);
+
+
+/// Protocol state of one client connection.  Bytes received are parsed
+/// into requests, and the replies appended to the output.
+class SimulatedSession : NoCopyAndAssign
+{
+ public:
+
+  SimulatedSession(int serverVersion, long nextOrderId, bool fillOrders,
+                   const std::string& accounts = "DU000000");
+
+  /// Consumes the bytes received; replies are appended to out.
+  void receive(const char* data, size_t size, std::string* out);
+
+  bool connected() const
+  {
+    return state_ == CONNECTED;
+  }
+
+  int clientId() const
+  {
+    return clientId_;
+  }
+
+  /// Copies the ticker ids subscribed if they changed since generation.
+  bool subscriptions(boost::uint64_t* generation,
+                     std::set<long>* marketData,
+                     std::set<long>* marketDepth);
+
+  /// Requests and bytes dropped, not understood.
+  size_t dropped() const
+  {
+    return dropped_;
+  }
+
+ private:
+
+  /// Parses one message, false if incomplete.
+  bool parse(WireDecoder* in, std::string* out);
+
+  void subscribe(std::set<long>* ids, long id, bool add);
+
+  enum State { WAIT_CLIENT_VERSION, WAIT_CLIENT_ID, CONNECTED };
+
+  int serverVersion_;
+  long nextOrderId_;
+  bool fillOrders_;
+  std::string accounts_;
+  State state_;
+  int clientId_;
+  std::string in_;
+  size_t dropped_;
+  long permId_;
+
+  boost::mutex mutex_;
+  boost::atomic<boost::uint64_t> generation_;
+  std::set<long> marketData_;
+  std::set<long> marketDepth_;
+};
+
+
+/// Events sent by the simulator.
+class TickSource : NoCopyAndAssign
+{
+ public:
+  virtual ~TickSource() {}
+
+  /// The next event for the ticker ids subscribed, false at the end.
+  virtual bool next(const std::set<long>& marketData,
+                    const std::set<long>& marketDepth, event_t* event) = 0;
+};
+
+
+/// Events of binary event logs or LoggingEWrapper's glog files, in order.
+/// Ticker ids not subscribed are skipped, or with remap, mapped onto the
+/// subscribed ids in turn.
+class ReplayTicks : public TickSource
+{
+ public:
+
+  ReplayTicks(const std::vector<std::string>& files, bool loop, bool remap);
+
+  bool next(const std::set<long>& marketData,
+            const std::set<long>& marketDepth, event_t* event);
+
+ private:
+
+  bool read(event_t* event);
+  bool open(size_t file);
+
+  std::vector<std::string> files_;
+  bool loop_;
+  bool remap_;
+  size_t file_;
+  boost::shared_ptr<EventLogReader> reader_;
+  boost::shared_ptr<std::istream> text_;
+  std::map<long, long> tickers_[2];  // market data, depth
+  size_t turn_;
+};
+
+
+/// Random walks of bid, ask and last, each price followed by its size, for
+/// the tickers subscribed in turn; and with depth subscribed, a depth update
+/// every depthEvery events.  Never ends.
+class SyntheticTicks : public TickSource
+{
+ public:
+
+  explicit SyntheticTicks(int depthEvery = 10);
+
+  bool next(const std::set<long>& marketData,
+            const std::set<long>& marketDepth, event_t* event);
+
+ private:
+
+  /// The ticker after last in turn.
+  static long after(const std::set<long>& ids, long last);
+
+  int depthEvery_;
+  boost::uint64_t count_;
+  unsigned int seed_;
+  long lastTicker_;
+  long lastDepth_;
+  std::map<long, double> prices_;
+  std::map<long, int> depthUpdates_;
+  event_t size_;
+  bool hasSize_;
+};
+
+
+/// Accepts client connections and sends them the events of the source.
+class GatewaySimulator : NoCopyAndAssign
+{
+ public:
+
+  /// rate - events per second, 0 for as fast as the clients read.
+  /// speed - multiple of the pace of the events' timestamps, 0 to ignore
+  ///     them; the rate still applies.
+  GatewaySimulator(unsigned int port, TickSource* source,
+                   int serverVersion = 53, double rate = 0, double speed = 0,
+                   bool fillOrders = false);
+
+  ~GatewaySimulator();
+
+  /// Sends events until the source ends or stop is called.
+  void run();
+
+  void stop();
+
+  boost::uint64_t sent() const
+  {
+    return sent_.load(boost::memory_order_relaxed);
+  }
+
+ private:
+
+  struct Connection;
+  typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+  void accept();
+  void read(ConnectionPtr connection);
+  bool write(Connection* connection, const std::string& bytes);
+
+  /// Sends the events pending in each connection's buffer.
+  void flush(std::vector<ConnectionPtr>* connections);
+
+  boost::asio::io_service ioService_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  TickSource* source_;
+  int serverVersion_;
+  double rate_;
+  double speed_;
+  bool fillOrders_;
+
+  boost::atomic<bool> running_;
+  boost::atomic<boost::uint64_t> sent_;
+  boost::mutex mutex_;
+  std::vector<ConnectionPtr> connections_;
+  boost::thread_group threads_;
+};
+
+
+} // internal
+} // ib
+
+#endif // IB_INTERNAL_GATEWAY_SIMULATOR_H_
@@ -0,0 +1,60 @@
+
+#include <boost/algorithm/string.hpp>
+#include <vector>
+
+#include "historian/constants.hpp"
+#include "proto/binary_tick.hpp"
+#include "proto/ib.pb.h"
+
+#include "ib/market_data_conflation.hpp"
+
+
+namespace ib {
+namespace internal {
+
+
+const std::string MarketDataConflation::DEFAULT_EVENTS =
+    "BID,ASK,BID_SIZE,ASK_SIZE";
+
+
+MarketDataConflation::MarketDataConflation(const std::string& events)
+{
+  std::vector<std::string> names;
+  boost::split(names, events, boost::is_any_of(","));
+  for (size_t i = 0; i < names.size(); ++i) {
+    boost::trim(names[i]);
+    if (!names[i].empty()) {
+      events_.insert(names[i]);
+    }
+  }
+}
+
+bool MarketDataConflation::operator()(const atp::zmq::frames_t& message,
+                                      std::string* key) const
+{
+  // frames
+  // 1. topic
+  // 2. protobuff or binary tick
+  if (message.size() != 2) {
+    return false;
+  }
+  const std::string& topic = message[0];
+  if (topic.compare(0, historian::ENTITY_IB_MARKET_DEPTH.size(),
+                    historian::ENTITY_IB_MARKET_DEPTH) == 0) {
+    return false;
+  }
+
+  proto::ib::MarketData marketData;
+  if (!proto::ib::parse_market_data(message[1], &marketData) ||
+      events_.find(marketData.event()) == events_.end()) {
+    return false;
+  }
+  key->assign(topic);
+  key->push_back(':');
+  key->append(marketData.event());
+  return true;
+}
+
+
+} // internal
+} // ib
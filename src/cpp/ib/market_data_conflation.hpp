@@ -0,0 +1,39 @@
+#ifndef IB_MARKET_DATA_CONFLATION_H_
+#define IB_MARKET_DATA_CONFLATION_H_
+
+#include <set>
+#include <string>
+
+#include "zmq/ConflatingPublisher.hpp"
+
+namespace ib {
+namespace internal {
+
+
+/// Conflation classifier of the messages published by the firehose, for
+/// the atp::zmq::ConflatingPublisher.  Market data events in the given set
+/// (quotes, by default) are conflated by symbol and event.  Everything else
+/// -- trades (LAST / LAST_SIZE), depth deltas, unparseable messages -- is
+/// never conflated.  Messages are protos or binary ticks, traced or not
+/// (see proto::ib::parse_market_data); tick batches are classified tick
+/// by tick by the atp::zmq::Conflater.
+class MarketDataConflation
+{
+ public:
+
+  static const std::string DEFAULT_EVENTS;
+
+  /// events - comma-delimited tick type names, e.g. BID,ASK
+  explicit MarketDataConflation(const std::string& events = DEFAULT_EVENTS);
+
+  bool operator()(const atp::zmq::frames_t& message, std::string* key) const;
+
+ private:
+  std::set<std::string> events_;
+};
+
+
+} // internal
+} // ib
+
+#endif // IB_MARKET_DATA_CONFLATION_H_
@@ -0,0 +1,120 @@
+#ifndef IB_INTERNAL_READ_BUFFER_H_
+#define IB_INTERNAL_READ_BUFFER_H_
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "common.hpp"
+
+
+namespace ib {
+namespace internal {
+
+
+/// Ring of bytes read from a socket and not yet parsed.  A read fills all
+/// the free space at once (both segments when it wraps around, as readv
+/// would) without blocking, so that one wakeup of the reader takes in
+/// everything the kernel has buffered.  Used by one thread only.
+class ReadBuffer : NoCopyAndAssign
+{
+ public:
+
+  /// The size is rounded up to a power of 2.
+  explicit ReadBuffer(size_t size) :
+      mask_(0), head_(0), tail_(0)
+  {
+    size_t bytes = 1;
+    while (bytes < size) {
+      bytes <<= 1;
+    }
+    data_.reset(new char[bytes]);
+    mask_ = bytes - 1;
+  }
+
+  size_t size() const
+  {
+    return mask_ + 1;
+  }
+
+  /// Bytes read and not yet taken.
+  size_t buffered() const
+  {
+    return static_cast<size_t>(tail_ - head_);
+  }
+
+  size_t available() const
+  {
+    return size() - buffered();
+  }
+
+  /// Reads from the socket into the free space without blocking.  Returns
+  /// as recv does: the bytes read, 0 at the end of the stream, or -1 with
+  /// errno set (EAGAIN if there is nothing to read, or no free space).
+  ssize_t fill(int fd)
+  {
+    if (available() == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    struct iovec iov[2];
+    size_t segments = free_segments(iov);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = segments;
+    ssize_t n = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (n > 0) {
+      tail_ += n;
+    }
+    return n;
+  }
+
+  /// Copies up to sz of the oldest bytes to buf and returns the count.
+  size_t take(char* buf, size_t sz)
+  {
+    size_t n = std::min(sz, buffered());
+    size_t offset = static_cast<size_t>(head_ & mask_);
+    size_t first = std::min(n, size() - offset);
+    memcpy(buf, data_.get() + offset, first);
+    memcpy(buf + first, data_.get(), n - first);
+    head_ += n;
+    return n;
+  }
+
+ private:
+
+  size_t free_segments(struct iovec* iov)
+  {
+    size_t offset = static_cast<size_t>(tail_ & mask_);
+    size_t len = available();
+    size_t first = std::min(len, size() - offset);
+    iov[0].iov_base = data_.get() + offset;
+    iov[0].iov_len = first;
+    if (first == len) {
+      return 1;
+    }
+    iov[1].iov_base = data_.get();
+    iov[1].iov_len = len - first;
+    return 2;
+  }
+
+  boost::scoped_array<char> data_;
+  boost::uint64_t mask_;
+  boost::uint64_t head_;
+  boost::uint64_t tail_;
+};
+
+
+} // internal
+} // ib
+
+#endif //IB_INTERNAL_READ_BUFFER_H_
@@ -0,0 +1,141 @@
+#include "ib/subscription_balancer.hpp"
+
+namespace ib {
+namespace internal {
+
+
+SubscriptionBalancer::SubscriptionBalancer(size_t members,
+                                           size_t maxLinesPerMember) :
+    members_(members),
+    maxLines_(maxLinesPerMember)
+{
+}
+
+size_t SubscriptionBalancer::least_loaded() const
+{
+  size_t best = members_.size();
+  for (size_t i = 0; i < members_.size(); ++i) {
+    const Member& member = members_[i];
+    if (member.connected && member.lines < maxLines_ &&
+        (best == members_.size() || member.lines < members_[best].lines)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void SubscriptionBalancer::assign(Subscription* subscription, size_t member)
+{
+  if (subscription->member < members_.size()) {
+    members_[subscription->member].lines--;
+  }
+  subscription->member = member;
+  if (member < members_.size()) {
+    members_[member].lines++;
+  }
+}
+
+bool SubscriptionBalancer::subscribe(const Request& request, size_t* member)
+{
+  key_t key(request.kind, request.id);
+  std::map<key_t, Subscription>::iterator found = subscriptions_.find(key);
+  if (found != subscriptions_.end() &&
+      found->second.member < members_.size()) {
+    *member = found->second.member;
+    return true;
+  }
+  size_t best = least_loaded();
+  if (best == members_.size() && primary() < members_.size()) {
+    return false;  // every live member is at the cap
+  }
+  Subscription& subscription = subscriptions_[key];
+  if (found == subscriptions_.end()) {
+    subscription.member = members_.size();
+  }
+  subscription.request = request;
+  assign(&subscription, best);
+  *member = best;
+  return true;
+}
+
+bool SubscriptionBalancer::unsubscribe(Kind kind, long id, size_t* member)
+{
+  std::map<key_t, Subscription>::iterator found =
+      subscriptions_.find(key_t(kind, id));
+  if (found == subscriptions_.end()) {
+    return false;
+  }
+  *member = found->second.member;
+  assign(&found->second, members_.size());
+  subscriptions_.erase(found);
+  return true;
+}
+
+void SubscriptionBalancer::connect(size_t member,
+                                   std::vector<Assignment>* placed)
+{
+  members_[member].connected = true;
+  std::map<key_t, Subscription>::iterator itr = subscriptions_.begin();
+  for (; itr != subscriptions_.end(); ++itr) {
+    Subscription& subscription = itr->second;
+    if (subscription.member < members_.size()) {
+      continue;
+    }
+    size_t best = least_loaded();
+    if (best == members_.size()) {
+      break;
+    }
+    assign(&subscription, best);
+    Assignment assignment = { best, subscription.request };
+    placed->push_back(assignment);
+  }
+}
+
+size_t SubscriptionBalancer::disconnect(size_t member,
+                                        std::vector<Assignment>* moved)
+{
+  members_[member].connected = false;
+  size_t left = 0;
+  std::map<key_t, Subscription>::iterator itr = subscriptions_.begin();
+  for (; itr != subscriptions_.end(); ++itr) {
+    Subscription& subscription = itr->second;
+    if (subscription.member != member) {
+      continue;
+    }
+    size_t best = least_loaded();
+    assign(&subscription, best);
+    if (best == members_.size()) {
+      left++;
+      continue;
+    }
+    Assignment assignment = { best, subscription.request };
+    moved->push_back(assignment);
+  }
+  return left;
+}
+
+size_t SubscriptionBalancer::primary() const
+{
+  for (size_t i = 0; i < members_.size(); ++i) {
+    if (members_[i].connected) {
+      return i;
+    }
+  }
+  return members_.size();
+}
+
+size_t SubscriptionBalancer::waiting() const
+{
+  size_t count = 0;
+  std::map<key_t, Subscription>::const_iterator itr = subscriptions_.begin();
+  for (; itr != subscriptions_.end(); ++itr) {
+    if (itr->second.member >= members_.size()) {
+      count++;
+    }
+  }
+  return count;
+}
+
+
+} // internal
+} // ib
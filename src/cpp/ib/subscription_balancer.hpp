@@ -0,0 +1,121 @@
+#ifndef IB_SUBSCRIPTION_BALANCER_H_
+#define IB_SUBSCRIPTION_BALANCER_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+
+namespace ib {
+namespace internal {
+
+
+/// Assigns the market data and depth subscriptions of a pool of gateway
+/// connections (client ids) to the connection with the fewest lines, up to
+/// a cap per connection.  Subscriptions made while no connection is up, and
+/// those of a connection that goes down that fit nowhere else, wait for a
+/// connection to come up.
+///
+/// Only bookkeeping: the requests are kept as they arrived so that the
+/// caller can send them again, and members are indexes 0..size-1.
+class SubscriptionBalancer : NoCopyAndAssign
+{
+ public:
+
+  enum Kind { MARKET_DATA = 0, MARKET_DEPTH = 1 };
+
+  /// A subscribing request as received, e.g. the frames of a zmq message.
+  struct Request
+  {
+    Kind kind;
+    long id;                      // contract id
+    std::vector<std::string> frames;
+  };
+
+  /// A request to send (again) to a member.
+  struct Assignment
+  {
+    size_t member;
+    Request request;
+  };
+
+  SubscriptionBalancer(size_t members, size_t maxLinesPerMember);
+
+  /// The member for a new subscription: the live member with the fewest
+  /// lines, or the member that already has it.  While no member is live the
+  /// subscription waits and member is size().  False, and not kept, if
+  /// every live member is at the cap.
+  bool subscribe(const Request& request, size_t* member);
+
+  /// Removes the subscription.  False if there is none; otherwise member
+  /// is the one that had it, or size() if it was waiting.
+  bool unsubscribe(Kind kind, long id, size_t* member);
+
+  /// Marks the member live and assigns it the waiting subscriptions.
+  void connect(size_t member, std::vector<Assignment>* placed);
+
+  /// Marks the member down and moves its subscriptions to the others.
+  /// Returns the count of those left waiting.
+  size_t disconnect(size_t member, std::vector<Assignment>* moved);
+
+  /// The member for requests that are not subscriptions: the first live,
+  /// or size() if none is.
+  size_t primary() const;
+
+  size_t size() const
+  {
+    return members_.size();
+  }
+
+  bool connected(size_t member) const
+  {
+    return members_[member].connected;
+  }
+
+  size_t lines(size_t member) const
+  {
+    return members_[member].lines;
+  }
+
+  /// Subscriptions, assigned or waiting.
+  size_t subscriptions() const
+  {
+    return subscriptions_.size();
+  }
+
+  size_t waiting() const;
+
+ private:
+
+  typedef std::pair<int, long> key_t;
+
+  struct Member
+  {
+    Member() : connected(false), lines(0) {}
+    bool connected;
+    size_t lines;
+  };
+
+  struct Subscription
+  {
+    size_t member;                // size() while waiting
+    Request request;
+  };
+
+  /// The live member with the fewest lines under the cap, or size().
+  size_t least_loaded() const;
+
+  void assign(Subscription* subscription, size_t member);
+
+  std::vector<Member> members_;
+  size_t maxLines_;
+  std::map<key_t, Subscription> subscriptions_;
+};
+
+
+} // internal
+} // ib
+
+#endif // IB_SUBSCRIPTION_BALANCER_H_
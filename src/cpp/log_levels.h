@@ -14,6 +14,7 @@
 #define ASIO_ECLIENT_SOCKET_DEBUG VLOG(30)
 
 #define IBAPI_SOCKET_INITIATOR_LOGGER VLOG(5)
+#define IBAPI_CONNECTION_POOL_LOGGER VLOG(5)
 #define IBAPI_SOCKET_CONNECTOR_LOGGER VLOG(50)
 #define IBAPI_SOCKET_CONNECTOR_ERROR LOG(INFO)
 #define IBAPI_SOCKET_CONNECTOR_WARNING LOG(WARNING)
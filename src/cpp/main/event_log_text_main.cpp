@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "ib/event_log.hpp"
+
+
+/// Converts binary event logs written by the firehose (see --eventLogDir)
+/// into the text LoggingEWrapper logs through glog, one event per line, so
+/// that LogReader can replay them, e.g.
+///
+///   event_log_text --actions=firehose.INFO firehose-*.evl.gz > events.log
+///   lp --logfile=events.log ...
+///
+/// The ticker ids of the events are mapped to symbols by the reqMktData
+/// and reqMktDepth actions, which are still logged by glog only; those of
+/// the --actions files are written first.  The binary log holds every
+/// market data event from its opening to its closing.
+DEFINE_string(actions, "",
+              "Comma-delimited glog files whose action lines are copied "
+              "ahead of the events.");
+
+
+static size_t copy_actions(const std::string& file)
+{
+  std::ifstream in(file.c_str());
+  if (!in) {
+    LOG(ERROR) << "Cannot read " << file;
+    return 0;
+  }
+  size_t count = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.find(",action=") != std::string::npos) {
+      std::cout << line << '\n';
+      count++;
+    }
+  }
+  return count;
+}
+
+
+int main(int argc, char** argv)
+{
+  google::SetUsageMessage("event_log_text [--actions=<glog>,...] <evl> ...");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  std::istringstream actions(FLAGS_actions);
+  std::string file;
+  while (std::getline(actions, file, ',')) {
+    if (!file.empty()) {
+      LOG(INFO) << file << ": " << copy_actions(file) << " actions";
+    }
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    ib::internal::EventLogReader reader(argv[i]);
+    if (!reader.is_open()) {
+      return 1;
+    }
+    size_t count = 0;
+    ib::internal::event_t event;
+    while (reader.next(&event)) {
+      ib::internal::write_text(event, &std::cout, &reader.text());
+      std::cout << '\n';
+      count++;
+    }
+    LOG(INFO) << argv[i] << ": " << count << " events";
+  }
+  std::cout.flush();
+  return 0;
+}
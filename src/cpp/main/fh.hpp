@@ -9,6 +9,7 @@
 
 #include <glog/logging.h>
 
+#include "common/tick_capture.hpp"
 #include "ib/ApplicationBase.hpp"
 #include "ib/SocketInitiator.hpp"
 #include "ib/MarketEventDispatcher.hpp"
@@ -40,7 +41,14 @@ class Firehose : public IBAPI::ApplicationBase
 {
  public:
 
-  Firehose() {}
+  explicit Firehose(atp::capture::Writer* capture = NULL,
+                    bool binaryTicks = false) :
+      capture_(capture),
+      binaryTicks_(binaryTicks),
+      batchMicros_(0),
+      batchBytes_(0)
+  {}
+
   ~Firehose() {}
 
   virtual bool IsMessageSupported(const std::string& key)
@@ -50,7 +58,18 @@ class Firehose : public IBAPI::ApplicationBase
 
   virtual ApiEventDispatcher* GetApiEventDispatcher(const SessionID& sessionId)
   {
-    return new ib::internal::MarketEventDispatcher(*this, sessionId);
+    ib::internal::MarketEventDispatcher* dispatcher =
+        new ib::internal::MarketEventDispatcher(*this, sessionId,
+                                                capture_, binaryTicks_);
+    dispatcher->setBatching(batchMicros_, batchBytes_);
+    return dispatcher;
+  }
+
+  /// See MarketEventDispatcher::setBatching.
+  void setBatching(boost::uint64_t maxMicros, size_t maxBytes)
+  {
+    batchMicros_ = maxMicros;
+    batchBytes_ = maxBytes;
   }
 
   void onLogon(const SessionID& sessionId)
@@ -63,6 +82,12 @@ class Firehose : public IBAPI::ApplicationBase
     LOG(INFO) << "Session " << sessionId << " logged off.";
   }
 
+ private:
+  atp::capture::Writer* capture_;
+  bool binaryTicks_;
+  boost::uint64_t batchMicros_;
+  size_t batchBytes_;
+
 };
 
 
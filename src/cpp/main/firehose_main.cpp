@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <signal.h>
 #include <sstream>
 #include <map>
@@ -10,6 +11,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
 #include <boost/format.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -19,6 +21,11 @@
 #include "varz/VarzServer.hpp"
 
 #include "common.hpp"
+#include "common/intern_table.hpp"
+#include "ib/ConnectionPool.hpp"
+#include "ib/event_log.hpp"
+#include "ib/market_data_conflation.hpp"
+#include "zmq/ConflatingPublisher.hpp"
 #include "fh.hpp"
 
 using std::map;
@@ -33,6 +40,9 @@ using IBAPI::SocketInitiator;
 
 static IBAPI::SocketInitiator* INITIATOR_INSTANCE;
 static atp::varz::VarzServer* VARZ_INSTANCE;
+static atp::capture::Writer* CAPTURE_INSTANCE;
+static ib::internal::EventLog* EVENT_LOG_INSTANCE;
+static IBAPI::ConnectionPool* POOL_INSTANCE;
 
 
 DEFINE_string(connectors, atp::global::FH_CONNECTOR_SPECS,
@@ -42,6 +52,51 @@ DEFINE_string(outbound, atp::global::FH_OUTBOUND_ENDPOINTS,
 DEFINE_bool(publish, atp::global::FH_OUTBOUND_PUBLISH,
             "True to publish at outbound endpoints, false to push to them");
 DEFINE_int32(varz, atp::global::FH_VARZ_PORT, "The port varz server runs on.");
+DEFINE_string(captureDir, "",
+              "Directory for binary tick capture files; empty to disable.");
+DEFINE_string(capturePrefix, "firehose", "File name prefix of capture files.");
+DEFINE_string(eventLogDir, "",
+              "Directory of the binary log of market data events, written "
+              "off the callback thread instead of glog; empty to disable.");
+DEFINE_bool(eventLogCompress, true, "Gzip the binary event log.");
+DEFINE_int32(eventLogRingSize, 1 << 16,
+             "Events buffered for the event log writer.  Events are logged "
+             "through glog while the buffer is full.");
+DEFINE_int32(poolSize, 0,
+             "Client ids opened against the gateway of the (single) "
+             "connector spec, with market data requests to its control "
+             "endpoint spread across them; 0 for one connection.");
+DEFINE_int32(poolMaxLines, 100, "Market data lines per pooled client id.");
+DEFINE_string(poolEndpointPrefix, "ipc:///tmp/firehose-pool-",
+              "Control endpoints of the pooled connections, suffixed by "
+              "client id.");
+DEFINE_string(internDir, "",
+              "Directory of symbol / event id tables shared with subscribers.");
+DEFINE_bool(binaryTicks, false,
+            "Publish market data as compact binary ticks instead of protos. "
+            "Requires --internDir, shared with all subscribers.");
+DEFINE_int32(batchMicros, 0,
+             "Publish the messages of each topic in batches sent at most "
+             "this many usec after their first message; 0 to disable.");
+DEFINE_int32(batchBytes, 16 * 1024, "Max bytes of a batch.");
+DEFINE_string(conflatedOutbound, "",
+              "Comma-delimited endpoints of conflating publishers, one per "
+              "class of slow subscribers; empty to disable.");
+DEFINE_string(conflateUpstream, atp::global::FH_CONFLATE_UPSTREAM_ENDPOINT,
+              "Endpoint the conflating publishers subscribe to.");
+DEFINE_int32(conflateMaxRate, atp::global::FH_CONFLATE_MAX_RATE,
+             "Max messages/sec sent by each conflating publisher; 0 for "
+             "no limit.  Messages over the rate are queued and conflated.  "
+             "With zmq 3 this is the only way subscribers fall behind: "
+             "their own slowness is not seen, so the tier is a rate "
+             "limiter.");
+DEFINE_int32(conflateMaxBacklog, atp::global::FH_CONFLATE_MAX_BACKLOG,
+             "Max messages queued by each conflating publisher; the oldest "
+             "are dropped past it.");
+DEFINE_string(conflateEvents,
+              ib::internal::MarketDataConflation::DEFAULT_EVENTS,
+              "Comma-delimited events conflated while subscribers are "
+              "behind.  Trades and depth are never conflated.");
 
 DEFINE_VARZ_bool(fh_as_publisher, false, "if instance is also a publisher.");
 DEFINE_VARZ_string(fh_connector_specs, "", "Connector specs");
@@ -56,6 +111,9 @@ void OnTerminate(int param)
   UNUSED(param);
 
   LOG(INFO) << "===================== SHUTTING DOWN =======================";
+  if (POOL_INSTANCE) {
+    POOL_INSTANCE->stop();
+  }
   if (INITIATOR_INSTANCE) {
     INITIATOR_INSTANCE->stop();
     LOG(INFO) << "Stopped initiator.";
@@ -64,6 +122,13 @@ void OnTerminate(int param)
     VARZ_INSTANCE->stop();
     LOG(INFO) << "Stopped varz.";
   }
+  if (CAPTURE_INSTANCE) {
+    CAPTURE_INSTANCE->close();
+    LOG(INFO) << "Closed tick capture.";
+  }
+  if (EVENT_LOG_INSTANCE) {
+    EVENT_LOG_INSTANCE->close();
+  }
   LOG(INFO) << "Bye.";
   exit(1);
 }
@@ -83,6 +148,12 @@ int main(int argc, char** argv)
 
   atp::version_info::log("firehose");
 
+  // Must be before any symbol is interned.
+  if (!FLAGS_internDir.empty() &&
+      !atp::common::open_intern_tables(FLAGS_internDir)) {
+    LOG(FATAL) << "Cannot open intern tables in " << FLAGS_internDir;
+  }
+
   atp::varz::Varz::initialize();
 
 
@@ -118,13 +189,73 @@ int main(int argc, char** argv)
 
     LOG(INFO) << "Starting initiator.";
 
-    Firehose firehose;
-    SocketInitiator initiator(firehose, settings);
+    boost::scoped_ptr<atp::capture::Writer> capture;
+    if (!FLAGS_captureDir.empty()) {
+      LOG(INFO) << "Capturing ticks to " << FLAGS_captureDir;
+      capture.reset(new atp::capture::Writer(FLAGS_captureDir,
+                                             FLAGS_capturePrefix));
+      CAPTURE_INSTANCE = capture.get();
+    }
+
+    boost::scoped_ptr<ib::internal::EventLog> eventLog;
+    if (!FLAGS_eventLogDir.empty()) {
+      eventLog.reset(new ib::internal::EventLog(
+          FLAGS_eventLogDir, "firehose", FLAGS_eventLogCompress,
+          FLAGS_eventLogRingSize));
+      if (!eventLog->is_open()) {
+        LOG(FATAL) << "Cannot open event log in " << FLAGS_eventLogDir;
+      }
+      EVENT_LOG_INSTANCE = eventLog.get();
+      ib::internal::set_event_log(eventLog.get());
+    }
+
+    // The pool takes the control endpoint of the connector spec, and its
+    // members the client ids from the session id on.
+    SocketInitiator::SessionSettings members;
+    if (FLAGS_poolSize > 1) {
+      if (settings.size() != 1) {
+        LOG(FATAL) << "--poolSize requires a single connector spec.";
+      }
+      IBAPI::ConnectionPool::MemberSessionSettings(
+          settings.front(), FLAGS_poolSize, FLAGS_poolEndpointPrefix,
+          &members);
+    }
+
+    Firehose firehose(capture.get(), FLAGS_binaryTicks);
+    if (FLAGS_batchMicros > 0) {
+      firehose.setBatching(FLAGS_batchMicros, FLAGS_batchBytes);
+    }
+    SocketInitiator initiator(firehose, members.empty() ? settings : members);
 
     INITIATOR_INSTANCE = &initiator;
 
+    boost::scoped_ptr<IBAPI::ConnectionPool> pool;
+    if (!members.empty()) {
+      pool.reset(new IBAPI::ConnectionPool(
+          settings.front().getConnectorReactorAddress(), members,
+          FLAGS_poolMaxLines));
+      POOL_INSTANCE = pool.get();
+      initiator.setConnectionPool(pool.get());
+    }
+
     if (SocketInitiator::Configure(initiator, outboundMap, FLAGS_publish)) {
 
+      vector<string> conflated;
+      if (!FLAGS_conflatedOutbound.empty()) {
+        boost::split(conflated, FLAGS_conflatedOutbound,
+                     boost::is_any_of(","));
+      }
+      ib::internal::MarketDataConflation classifier(FLAGS_conflateEvents);
+      boost::ptr_vector<atp::zmq::ConflatingPublisher> conflating;
+      for (vector<string>::const_iterator endpoint = conflated.begin();
+           endpoint != conflated.end(); ++endpoint) {
+        LOG(INFO) << "Starting conflating publisher at " << *endpoint;
+        conflating.push_back(new atp::zmq::ConflatingPublisher(
+            FLAGS_conflateUpstream, *endpoint, classifier,
+            FLAGS_conflateMaxRate,
+            static_cast<size_t>(std::max(0, FLAGS_conflateMaxBacklog))));
+      }
+
       LOG(INFO) << "Start connections";
       initiator.start();
 
@@ -69,6 +69,11 @@ const ConnectorSpec FH_CONNECTOR_SPECS = build_connector_spec(
     FH_CONTROLLER_ENDPOINT);
 const OutboundEndPoint FH_OUTBOUND_ENDPOINTS = build_outbound_spec(
     FH_OUTBOUND_ENDPOINT);
+// conflating tier for slow subscribers, subscribing to the firehose
+const ZmqEndPoint FH_CONFLATE_UPSTREAM_ENDPOINT = atp::zmq::EndPoint::tcp(
+    FH_OUTBOUND_PORT, FH_HOST);
+const int FH_CONFLATE_MAX_RATE = 2000;
+const int FH_CONFLATE_MAX_BACKLOG = 100000;
 
 //// lp - log publisher
 const Host LP_HOST = FH_BIND_HOST; // for server socket bind
@@ -27,6 +27,7 @@
 #include "ib/ticker_id.hpp"
 #include "ib/tick_types.hpp"
 #include "ib/TickerMap.hpp"
+#include "common/trading_calendar.hpp"
 #include "historian/historian.hpp"
 
 
@@ -39,6 +40,8 @@ DEFINE_int64(gapInMinutes, 5,
              "Number of minutes gap to start a new session log");
 DEFINE_bool(checkDuplicate, false,
             "True to read for existing record before writing db.");
+DEFINE_int32(dedupBatchSize, 10000,
+             "Records per batch checked for duplicates, if checkDuplicate.");
 DEFINE_bool(syncstdio, false, "cin syncs with stdio (slower).");
 DEFINE_bool(est, true, "True to use EST for input/output; internal still utc.");
 
@@ -424,6 +427,7 @@ static void updateSessionLog(const string& source, const T& data,
     SymbolSessionLogs[symbol]->set_source(source);
     SymbolSessionLogs[symbol]->set_start_timestamp(data.timestamp());
     SymbolSessionLogs[symbol]->set_stop_timestamp(0);
+    SymbolSessionLogs[symbol]->set_records(1);
 
     LOG(INFO) << "Set up session log for " << symbol;
 
@@ -457,10 +461,13 @@ static void updateSessionLog(const string& source, const T& data,
         log->set_start_timestamp(data.timestamp());
         // reset it.
         log->set_stop_timestamp(0);
+        log->set_records(0);
       }
     }
 
     SymbolSessionLogs[symbol]->set_stop_timestamp(data.timestamp());
+    SymbolSessionLogs[symbol]->set_records(
+        SymbolSessionLogs[symbol]->records() + 1);
   }
 }
 
@@ -473,6 +480,42 @@ static bool WriteDb(const string& source, const T& value,
   return db->Write<T>(value, canOverWrite);
 }
 
+/// With checkDuplicate, records are written in batches so that checking
+/// for existing records is one ordered sweep of the db per batch instead
+/// of a read per record.
+template <typename T>
+class BatchWriter
+{
+ public:
+  BatchWriter(const boost::shared_ptr<historian::Db>& db) : db_(db)
+  {
+    pending_.reserve(FLAGS_dedupBatchSize);
+  }
+
+  void Write(const string& source, const T& value,
+             int* written, int* duplicates)
+  {
+    updateSessionLog<T>(source, value, db_);
+    pending_.push_back(value);
+    if (pending_.size() >= static_cast<size_t>(FLAGS_dedupBatchSize)) {
+      Flush(written, duplicates);
+    }
+  }
+
+  void Flush(int* written, int* duplicates)
+  {
+    if (pending_.empty()) return;
+    int count = db_->Write<T>(pending_, false);
+    *written += count;
+    *duplicates += pending_.size() - count;
+    pending_.clear();
+  }
+
+ private:
+  boost::shared_ptr<historian::Db> db_;
+  std::vector<T> pending_;
+};
+
 static bool WriteSessionLogs(const string& source,
                              const boost::shared_ptr<historian::Db>& db)
 {
@@ -526,6 +569,9 @@ int main(int argc, char** argv)
 
   LOG(INFO) << "Files = " << logfiles.size();
 
+  const atp::time::TradingCalendar& calendar =
+      atp::time::TradingCalendar::instance();
+
   for (std::vector<string>::const_iterator logfile = logfiles.begin();
        logfile != logfiles.end();
        ++logfile) {
@@ -558,6 +604,9 @@ int main(int argc, char** argv)
     int dbWrittenRecords = 0;
     int dbDuplicateRecords = 0;
 
+    atp::utils::BatchWriter<historian::MarketData> dataWriter(db);
+    atp::utils::BatchWriter<historian::MarketDepth> depthWriter(db);
+
     boost::uint64_t process_start = now_micros();
     boost::int64_t last_ts = 0;
     boost::uint64_t last_log = 0;
@@ -577,17 +626,13 @@ int main(int argc, char** argv)
           historian::MarketData event;
           if (atp::utils::checkEvent(nv) && atp::utils::Convert(nv, &event)) {
 
-            ptime t = atp::time::as_ptime(event.timestamp());
-            bool ext = atp::time::checkEXT(t);
-            if (!ext) {
-              continue; // outside trading hours
-            }
-
-            bool rth = atp::time::checkRTH(t);
-            if (!rth && FLAGS_rth) {
-              // Skip if not RTH and we want only data during trading hours.
+            // Skip if outside trading hours, or not RTH and we want only
+            // data during regular trading hours.
+            if (!calendar.check(event.timestamp(), FLAGS_rth)) {
               continue;
             }
+
+            ptime t = atp::time::as_ptime(event.timestamp());
             if (last_log_t == boost::posix_time::not_a_date_time) {
               last_log_t = t;
               last_log = now_micros();
@@ -613,11 +658,12 @@ int main(int argc, char** argv)
               }
             }
 
-            bool written = atp::utils::WriteDb(source, event, db);
-            if (written) {
+            if (FLAGS_checkDuplicate) {
+              dataWriter.Write(source, event,
+                               &dbWrittenRecords, &dbDuplicateRecords);
+            } else if (atp::utils::WriteDb(source, event, db)) {
               dbWrittenRecords++;
-              LOG_READER_LOGGER << "Db written " << written
-                                << event.ByteSize();
+              LOG_READER_LOGGER << "Db written " << event.ByteSize();
             } else {
               dbDuplicateRecords++;
             }
@@ -628,19 +674,13 @@ int main(int argc, char** argv)
             historian::MarketDepth event;
             if (atp::utils::Convert(nv, &event)) {
 
-              ptime t = atp::time::as_ptime(event.timestamp());
-
-              bool ext = atp::time::checkEXT(t);
-              if (!ext) {
-                continue; // outside trading hours
-              }
-
-              bool rth = atp::time::checkRTH(t);
-
-              if (!rth && FLAGS_rth) {
-                // Skip if not RTH and we want only data during trading hours.
+              // Skip if outside trading hours, or not RTH and we want only
+              // data during regular trading hours.
+              if (!calendar.check(event.timestamp(), FLAGS_rth)) {
                 continue;
               }
+
+              ptime t = atp::time::as_ptime(event.timestamp());
               if (last_log_t == boost::posix_time::not_a_date_time) {
                 last_log_t = t;
                 last_log = now_micros();
@@ -667,11 +707,12 @@ int main(int argc, char** argv)
                 }
               }
 
-              bool written = atp::utils::WriteDb(source, event, db);
-              if (written) {
+              if (FLAGS_checkDuplicate) {
+                depthWriter.Write(source, event,
+                                  &dbWrittenRecords, &dbDuplicateRecords);
+              } else if (atp::utils::WriteDb(source, event, db)) {
                   dbWrittenRecords++;
-                  LOG_READER_LOGGER << "Db written " << written
-                                    << event.ByteSize();
+                  LOG_READER_LOGGER << "Db written " << event.ByteSize();
               } else {
                 dbDuplicateRecords++;
               }
@@ -690,6 +731,9 @@ int main(int argc, char** argv)
       }
     }
 
+    dataWriter.Flush(&dbWrittenRecords, &dbDuplicateRecords);
+    depthWriter.Flush(&dbWrittenRecords, &dbDuplicateRecords);
+
     boost::uint64_t process_finish = now_micros();
 
     LOG(INFO) << "Processed " << lines << " lines with "
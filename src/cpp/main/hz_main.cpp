@@ -6,20 +6,24 @@
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "log_levels.h"
+#include "varz/trace.hpp"
 #include "varz/varz.hpp"
 #include "zmq/Reactor.hpp"
+#include "zmq/RouterReactor.hpp"
 
 #include "proto/historian.hpp"
 #include "proto/ostream.hpp"
 
 #include "historian/Db.hpp"
 #include "historian/DbReactorStrategy.hpp"
+#include "common/intern_table.hpp"
 #include "common/time_utils.hpp"
 
 #include "service/MarketDataSubscriber.hpp"
@@ -30,6 +34,9 @@
 // Flags for reactor / db query processor
 DEFINE_string(ep, atp::global::HZ_QUERY_ENDPOINT, "Reactor port");
 DEFINE_string(leveldb, "", "Leveldb");
+DEFINE_int32(queryWorkers, 1,
+             "Threads handling queries; more than 1 to handle the queries of "
+             "different clients concurrently.");
 
 // Flags for subscriber
 DEFINE_bool(subscribe, true, "True to turn on subscriber and write to db.");
@@ -41,14 +48,28 @@ DEFINE_string(pubsubEp, atp::global::HZ_SUBSCRIBER_ENDPOINT,
 DEFINE_string(topics, "", "Comma-delimited subscription topics");
 DEFINE_int32(varz, 18001, "varz server port");
 DEFINE_bool(overwrite, true, "True to overwrite db records, false to check.");
+DEFINE_bool(tradingHoursOnly, false,
+            "True to persist only events within trading hours.");
+DEFINE_bool(rth, false, "Regular trading hours only, if tradingHoursOnly.");
+DEFINE_int32(shards, 0,
+             "Threads writing to the db, by symbol; 0 to write on the "
+             "receiving thread.");
+DEFINE_string(internDir, "",
+              "Directory of symbol / event id tables shared with firehose.");
+
+DEFINE_int32(writeBatch, 256,
+             "Records written to the db at once by each writing thread; "
+             "fewer when there are no more messages to process.");
 
 DEFINE_int32(messageBlockSize, 10000, "For periodic output to logs.");
 
-DEFINE_VARZ_int64(subscriber_message_process_micros, 0, "micros in handling message");
-DEFINE_VARZ_int64(subscriber_messages_received, 0, "total messages");
-DEFINE_VARZ_int64(subscriber_messages_persisted, 0, "total messages persisted");
-DEFINE_VARZ_int64(subscriber_messages_persisted_marketdata, 0, "total messages persisted");
-DEFINE_VARZ_int64(subscriber_messages_persisted_marketdepth, 0, "total messages persisted");
+DEFINE_VARZ_histogram(subscriber_message_process_micros, "micros in handling message");
+DEFINE_VARZ_counter(subscriber_messages_received, "total messages");
+DEFINE_VARZ_counter(subscriber_messages_persisted, "total messages persisted");
+DEFINE_VARZ_counter(subscriber_messages_persisted_marketdata, "total messages persisted");
+DEFINE_VARZ_counter(subscriber_messages_persisted_marketdepth, "total messages persisted");
+DEFINE_VARZ_histogram(subscriber_batch_write_micros, "micros in writing a batch");
+DEFINE_VARZ_histogram(subscriber_batch_size, "records per batch written");
 DEFINE_VARZ_string(subscriber_topics, "", "subscriber topics");
 
 using namespace std;
@@ -84,21 +105,23 @@ class DbWriterSubscriber : public atp::service::MarketDataSubscriber
   }
 
  protected:
+  /// Records are buffered per thread and written in batches (see
+  /// historian::Db::Write), of up to writeBatch records or whatever is
+  /// buffered when the thread runs out of messages (see flush).
   virtual bool process(const string& topic, const MarketData& marketData)
   {
     boost::uint64_t now = now_micros();
     VARZ_subscriber_messages_received++;
-    if (db_->Write(marketData, FLAGS_overwrite)) {
-
-      VARZ_subscriber_messages_persisted++;
-      VARZ_subscriber_messages_persisted_marketdata++;
-
-      if (VARZ_subscriber_messages_persisted % FLAGS_messageBlockSize == 0) {
-        LOG(INFO) << VARZ_subscriber_messages_persisted << " messages written. "
-                  << topic << "=>" << marketData;
-      }
+    batch_t* b = batch();
+    b->marketData.push_back(marketData);
+    b->lastTopic = topic;
+    // A traced tick is written now, so its write stage is its own.
+    if (b->marketData.size() >= static_cast<size_t>(FLAGS_writeBatch) ||
+        atp::varz::TracingCurrent()) {
+      write(b->marketData, VARZ_subscriber_messages_persisted_marketdata,
+            b->lastTopic);
     }
-    VARZ_subscriber_message_process_micros = now_micros() - now;
+    VARZ_subscriber_message_process_micros.Record(now_micros() - now);
     return true;
   }
 
@@ -106,21 +129,84 @@ class DbWriterSubscriber : public atp::service::MarketDataSubscriber
   {
     boost::uint64_t now = now_micros();
     VARZ_subscriber_messages_received++;
-    if (db_->Write(marketDepth, FLAGS_overwrite)) {
-
-      VARZ_subscriber_messages_persisted++;
-      VARZ_subscriber_messages_persisted_marketdepth++;
-
-      if (VARZ_subscriber_messages_persisted % FLAGS_messageBlockSize == 0) {
-        LOG(INFO) << VARZ_subscriber_messages_persisted << " messages written. "
-                  << topic << "=>" << marketDepth;
-      }
+    batch_t* b = batch();
+    b->marketDepth.push_back(marketDepth);
+    b->lastTopic = topic;
+    if (b->marketDepth.size() >= static_cast<size_t>(FLAGS_writeBatch)) {
+      write(b->marketDepth, VARZ_subscriber_messages_persisted_marketdepth,
+            b->lastTopic);
     }
-    VARZ_subscriber_message_process_micros = now_micros() - now;
+    VARZ_subscriber_message_process_micros.Record(now_micros() - now);
     return true;
   }
 
+  virtual void flush()
+  {
+    batch_t* b = batches_.get();
+    if (b == NULL) {
+      return;
+    }
+    write(b->marketData, VARZ_subscriber_messages_persisted_marketdata,
+          b->lastTopic);
+    write(b->marketDepth, VARZ_subscriber_messages_persisted_marketdepth,
+          b->lastTopic);
+  }
+
  private:
+
+  struct batch_t
+  {
+    vector<MarketData> marketData;
+    vector<MarketDepth> marketDepth;
+    string lastTopic;
+  };
+
+  batch_t* batch()
+  {
+    batch_t* b = batches_.get();
+    if (b == NULL) {
+      b = new batch_t();
+      b->marketData.reserve(FLAGS_writeBatch);
+      b->marketDepth.reserve(FLAGS_writeBatch);
+      batches_.reset(b);
+    }
+    return b;
+  }
+
+  /// Writes and clears the batch.
+  template <typename T>
+  void write(vector<T>& batch, atp::varz::Counter& persisted,
+             const string& topic)
+  {
+    if (batch.empty()) {
+      return;
+    }
+    boost::uint64_t start = now_micros();
+    int written = db_->Write(batch, FLAGS_overwrite);
+    VARZ_subscriber_batch_write_micros.Record(now_micros() - start);
+    VARZ_subscriber_batch_size.Record(batch.size());
+
+    VARZ_subscriber_messages_persisted += written;
+    persisted += written;
+    if (logBlock(written)) {
+      LOG(INFO) << VARZ_subscriber_messages_persisted << " messages written. "
+                << topic << "=>" << batch.back();
+    }
+    batch.clear();
+  }
+
+  /// True every messageBlockSize messages persisted by the calling thread;
+  /// with shards each counts its own.
+  static bool logBlock(int written)
+  {
+    static __thread boost::int64_t persisted = 0;
+    boost::int64_t before = persisted;
+    persisted += written;
+    return persisted / FLAGS_messageBlockSize !=
+        before / FLAGS_messageBlockSize;
+  }
+
+  boost::thread_specific_ptr<batch_t> batches_;  // of each writing thread
   boost::shared_ptr<historian::Db> db_;
 };
 
@@ -131,6 +217,13 @@ const boost::shared_ptr<historian::Db>& GetDbSingleton()
   return DB;
 }
 
+/// For the query workers of a RouterReactor; all share the db.
+atp::zmq::Reactor::Strategy* NewDbReactorStrategy(
+    const boost::shared_ptr<historian::Db>& db)
+{
+  return new historian::DbReactorStrategy(db);
+}
+
 void OnTerminate(int param)
 {
   LOG(INFO) << "===================== SHUTTING DOWN =======================";
@@ -159,6 +252,12 @@ int main(int argc, char** argv)
   google::InitGoogleLogging(argv[0]);
   atp::varz::Varz::initialize();
 
+  // Must be before any symbol is interned.
+  if (!FLAGS_internDir.empty() &&
+      !atp::common::open_intern_tables(FLAGS_internDir)) {
+    LOG(FATAL) << "Cannot open intern tables in " << FLAGS_internDir;
+  }
+
   VARZ_subscriber_topics = FLAGS_topics;
 
   // Signal handler: Ctrl-C
@@ -186,8 +285,16 @@ int main(int argc, char** argv)
   LOG(INFO) << "Starting context.";
   zmq::context_t context(1);
 
-  atp::zmq::Reactor reactor(strategy.socketType(),
-                            FLAGS_ep, strategy, &context);
+  boost::scoped_ptr<atp::zmq::Reactor> reactor;
+  boost::scoped_ptr<atp::zmq::RouterReactor> routerReactor;
+  if (FLAGS_queryWorkers > 1) {
+    routerReactor.reset(new atp::zmq::RouterReactor(
+        FLAGS_ep, boost::bind(&NewDbReactorStrategy, db),
+        FLAGS_queryWorkers, &context));
+  } else {
+    reactor.reset(new atp::zmq::Reactor(strategy.socketType(),
+                                        FLAGS_ep, strategy, &context));
+  }
 
   LOG(INFO) << "Db ready for write.";
 
@@ -200,6 +307,8 @@ int main(int argc, char** argv)
                                   FLAGS_id, FLAGS_adminEp, FLAGS_eventEp,
                                   FLAGS_pubsubEp, subscriptions,
                                   FLAGS_varz, &context);
+    subscriber.setTradingHoursFilter(FLAGS_tradingHoursOnly, FLAGS_rth);
+    subscriber.setShards(FLAGS_shards);
 
     // Open another db connection for writes
     if (!subscriber.isReady()) {
@@ -212,7 +321,11 @@ int main(int argc, char** argv)
   } else {
 
     // Block until exit
-    reactor.block();
+    if (routerReactor) {
+      routerReactor->block();
+    } else {
+      reactor->block();
+    }
 
   }
 }
@@ -40,6 +40,9 @@ DEFINE_string(symbol, "", "Symbol");
 DEFINE_string(first, "", "First of range");
 DEFINE_string(last, "", "Last of range");
 DEFINE_string(event, "", "Event (e.g. BID, ASK)");
+DEFINE_bool(catalog, false,
+            "True to list the sessions of data available for symbol "
+            "(all if empty) in the range.");
 
 
 ////////////////////////////////////////////////////////
@@ -57,6 +60,7 @@ using proto::ib::MarketDepth;
 using proto::historian::SessionLog;
 using proto::historian::IndexedValue;
 using proto::historian::QueryBySymbol;
+using proto::historian::QueryCatalog;
 
 using namespace historian;
 using namespace proto::historian;
@@ -90,8 +94,37 @@ int main(int argc, char** argv)
   ptime end;
 
   // EST to UTC
-  atp::time::parse(FLAGS_first, &start);
-  atp::time::parse(FLAGS_last, &end);
+  if (FLAGS_first.size() > 0) atp::time::parse(FLAGS_first, &start);
+  if (FLAGS_last.size() > 0) atp::time::parse(FLAGS_last, &end);
+
+  if (FLAGS_catalog) {
+    QueryCatalog q;
+    if (FLAGS_symbol.size() > 0) {
+      q.set_symbol(FLAGS_symbol);
+    }
+    if (start != boost::posix_time::not_a_date_time) {
+      q.set_utc_first_micros(atp::time::as_micros(start));
+    }
+    if (end != boost::posix_time::not_a_date_time) {
+      q.set_utc_last_micros(atp::time::as_micros(end));
+    }
+
+    struct CatalogVisitor : public historian::Visitor {
+      virtual bool operator()(const Record& data)
+      {
+        optional<SessionLog> log = as<SessionLog>(data);
+        if (log && FLAGS_cout) {
+          std::cout << *log << std::endl;
+        }
+        return true;
+      }
+    } catalogVisitor;
+
+    LOG(INFO) << "Query: " << q;
+    int count = client.Query(q, &catalogVisitor);
+    LOG(INFO) << "Sessions = " << count;
+    return 0;
+  }
 
   QueryBySymbol q;
   q.set_symbol(FLAGS_symbol);
@@ -0,0 +1,83 @@
+#include <signal.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "ib/gateway_simulator.hpp"
+
+
+/// A simulated IB gateway for load testing the firehose and connectors on
+/// one machine, with no account or market hours, e.g.
+///
+///   ibgsim --port=4001 --rate=200000
+///   ibgsim --replay=firehose-1.evl.gz --speed=10 --loop --remap
+///
+/// The firehose connects to it as to a gateway; its subscriptions get the
+/// synthetic ticks, or the events captured by --eventLogDir or the glog of
+/// LoggingEWrapper replayed.
+DEFINE_int32(port, 4001, "Port to listen on");
+DEFINE_int32(serverVersion, 53, "Server version announced to the clients");
+DEFINE_double(rate, 0, "Events per second; 0 for as fast as clients read");
+DEFINE_string(replay, "",
+              "Comma-delimited event logs (.evl, .evl.gz) or glog files to "
+              "replay; synthetic ticks if empty");
+DEFINE_double(speed, 0,
+              "Multiple of the pace of the replayed timestamps; 0 to ignore");
+DEFINE_bool(loop, false, "Replay the files again at the end");
+DEFINE_bool(remap, true,
+            "Map the ticker ids replayed onto those subscribed");
+DEFINE_bool(fillOrders, false, "Fill orders at their limit price");
+DEFINE_int32(depthEvery, 10,
+             "Synthetic ticks: a depth update every so many events");
+
+
+static ib::internal::GatewaySimulator* SIMULATOR = NULL;
+
+void OnTerminate(int param)
+{
+  if (SIMULATOR != NULL) {
+    SIMULATOR->stop();
+  }
+}
+
+
+int main(int argc, char** argv)
+{
+  google::SetUsageMessage("Simulated IB gateway.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  boost::scoped_ptr<ib::internal::TickSource> source;
+  if (FLAGS_replay.empty()) {
+    source.reset(new ib::internal::SyntheticTicks(FLAGS_depthEvery));
+  } else {
+    std::vector<std::string> files;
+    std::istringstream replay(FLAGS_replay);
+    std::string file;
+    while (std::getline(replay, file, ',')) {
+      if (!file.empty()) {
+        files.push_back(file);
+      }
+    }
+    source.reset(new ib::internal::ReplayTicks(files, FLAGS_loop,
+                                               FLAGS_remap));
+  }
+
+  ib::internal::GatewaySimulator simulator(FLAGS_port, source.get(),
+                                           FLAGS_serverVersion, FLAGS_rate,
+                                           FLAGS_speed, FLAGS_fillOrders);
+  SIMULATOR = &simulator;
+  signal(SIGINT, OnTerminate);
+  signal(SIGTERM, OnTerminate);
+
+  simulator.run();
+
+  SIMULATOR = NULL;
+  LOG(INFO) << "Sent " << simulator.sent() << " events.";
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <json_spirit.h>
+
+#include "varz/histogram.hpp"
+#include "varz/trace.hpp"
+
+
+/// Joins the trace records of the processes of the pipeline, as dumped
+/// from /varz/traces of each, e.g.
+///
+///   curl -s localhost:18001/varz/traces > fh.json
+///   curl -s localhost:18002/varz/traces > hz.json
+///   trace_join fh.json hz.json
+///
+/// and prints the latency between successive stages of the traced ticks,
+/// and from the callback to the last stage.  The stages of a tick up to
+/// the Publisher happen once; those of the subscribers are joined per
+/// process, so a tick received by two subscribers counts twice.  Times
+/// of processes on different hosts are only as close as their clocks.
+DEFINE_bool(ticks, false, "Also prints the stages of every tick.");
+
+
+using std::map;
+using std::string;
+using std::vector;
+using atp::varz::Histogram;
+
+typedef std::pair<boost::uint64_t, boost::uint64_t> trace_key_t;
+typedef vector<boost::uint64_t> stamps_t;  // by stage, 0 if none
+
+static const int ORIGIN_STAGES = atp::varz::TRACE_FORWARD + 1;
+
+
+static bool read_traces(const string& file, int process,
+                        map<trace_key_t, stamps_t>* origin,
+                        map<std::pair<trace_key_t, int>, stamps_t>* consumer)
+{
+  std::ifstream in(file.c_str());
+  json_spirit::Value value;
+  if (!in || !json_spirit::read(in, value) ||
+      value.type() != json_spirit::obj_type) {
+    LOG(ERROR) << "Cannot read " << file;
+    return false;
+  }
+  const json_spirit::Value& records =
+      json_spirit::find_value(value.get_obj(), "records");
+  if (records.type() != json_spirit::array_type) {
+    LOG(ERROR) << "No records in " << file;
+    return false;
+  }
+
+  const json_spirit::Array& array = records.get_array();
+  for (size_t i = 0; i < array.size(); ++i) {
+    const json_spirit::Array& record = array[i].get_array();
+    if (record.size() != 4) {
+      continue;
+    }
+    trace_key_t key(record[0].get_uint64(), record[1].get_uint64());
+    int stage = atp::varz::TraceStageOf(record[2].get_str());
+    if (stage < 0) {
+      continue;
+    }
+    stamps_t& stamps = (stage < ORIGIN_STAGES) ?
+        (*origin)[key] : (*consumer)[std::make_pair(key, process)];
+    stamps.resize(atp::varz::TRACE_STAGES, 0);
+    stamps[stage] = record[3].get_uint64();
+  }
+  LOG(INFO) << file << ": " << array.size() << " records";
+  return true;
+}
+
+static void print(const string& label, const Histogram& h)
+{
+  printf("%-24s %8llu %10.1f %8llu %8llu %8llu %8llu\n", label.c_str(),
+         static_cast<unsigned long long>(h.Count()), h.Mean(),
+         static_cast<unsigned long long>(h.Percentile(0.5)),
+         static_cast<unsigned long long>(h.Percentile(0.9)),
+         static_cast<unsigned long long>(h.Percentile(0.99)),
+         static_cast<unsigned long long>(h.Max()));
+}
+
+
+int main(int argc, char** argv)
+{
+  google::SetUsageMessage("trace_join <traces.json> ...");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  map<trace_key_t, stamps_t> origin;
+  map<std::pair<trace_key_t, int>, stamps_t> consumer;
+  for (int i = 1; i < argc; ++i) {
+    if (!read_traces(argv[i], i, &origin, &consumer)) {
+      return 1;
+    }
+  }
+
+  // Each path is the stages of the origin and those of one consumer.
+  vector<stamps_t> paths;
+  for (map<std::pair<trace_key_t, int>, stamps_t>::const_iterator c =
+           consumer.begin(); c != consumer.end(); ++c) {
+    stamps_t path = c->second;
+    map<trace_key_t, stamps_t>::const_iterator o = origin.find(c->first.first);
+    if (o != origin.end()) {
+      std::copy(o->second.begin(), o->second.begin() + ORIGIN_STAGES,
+                path.begin());
+    }
+    paths.push_back(path);
+  }
+  for (map<trace_key_t, stamps_t>::const_iterator o = origin.begin();
+       o != origin.end(); ++o) {
+    map<std::pair<trace_key_t, int>, stamps_t>::const_iterator c =
+        consumer.lower_bound(std::make_pair(o->first, 0));
+    if (c == consumer.end() || c->first.first != o->first) {
+      paths.push_back(o->second);
+    }
+  }
+
+  // Latency into each stage from the stage before it on the path.
+  map<std::pair<int, int>, Histogram> stages;
+  Histogram total;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const stamps_t& path = paths[i];
+    int first = -1, last = -1;
+    std::ostringstream tick;
+    for (int stage = 0; stage < atp::varz::TRACE_STAGES; ++stage) {
+      if (path[stage] == 0) {
+        continue;
+      }
+      if (last >= 0) {
+        boost::int64_t dt = path[stage] - path[last];
+        stages[std::make_pair(last, stage)].Record(dt);
+        tick << " " << atp::varz::TraceStageName(stage) << "=+" << dt;
+      } else {
+        first = stage;
+        tick << atp::varz::TraceStageName(stage) << "=" << path[stage];
+      }
+      last = stage;
+    }
+    if (first >= 0 && last > first) {
+      total.Record(static_cast<boost::int64_t>(path[last] - path[first]));
+    }
+    if (FLAGS_ticks) {
+      printf("%s\n", tick.str().c_str());
+    }
+  }
+
+  printf("%lu ticks traced\n\n", static_cast<unsigned long>(paths.size()));
+  printf("%-24s %8s %10s %8s %8s %8s %8s\n", "micros", "count", "mean",
+         "p50", "p90", "p99", "max");
+  for (map<std::pair<int, int>, Histogram>::const_iterator s = stages.begin();
+       s != stages.end(); ++s) {
+    print(string(atp::varz::TraceStageName(s->first.first)) + " -> " +
+          atp::varz::TraceStageName(s->first.second), s->second);
+  }
+  print("end to end", total);
+  return 0;
+}
@@ -3,11 +3,13 @@
 
 
 #include <string>
+#include <vector>
 
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
+#include "common/intern_table.hpp"
 #include "platform/types.hpp"
 #include "platform/callback.hpp"
 #include "platform/sequential_pipeline.hpp"
@@ -44,6 +46,27 @@ inline const event_code_t& get_event_code(const EventClass& event);
 template <typename EventClass, typename V>
 inline const V& get_value(const EventClass& event);
 
+/// Interned id of the event code, if the event carries one that can be
+/// used for lookups in this process.
+template <typename EventClass>
+inline atp::common::intern_id_t get_event_id(const EventClass& event)
+{
+  return atp::common::NO_INTERN_ID;
+}
+
+/// Interns event codes that are strings; other codes have no id.
+template <typename event_code_t>
+inline atp::common::intern_id_t intern_event_code(const event_code_t& code)
+{
+  return atp::common::NO_INTERN_ID;
+}
+
+template <>
+inline atp::common::intern_id_t intern_event_code(const string& code)
+{
+  return atp::common::events().intern(code);
+}
+
 
 /// based on the event code and the type of the event,
 /// dispatches to the appropriate callback that's been registered
@@ -68,6 +91,36 @@ class value_updater
     {
       dispatch_map_.insert(
           std::pair<event_code_t, callback >(event_code, cb));
+
+      atp::common::intern_id_t id = intern_event_code(event_code);
+      if (id != atp::common::NO_INTERN_ID) {
+        if (id >= by_id_.size()) {
+          by_id_.resize(id + 1);
+        }
+        by_id_[id] = cb;
+      }
+    }
+
+    /// dispatches by the interned id of the event code, falling back to
+    /// the lookup by event code if there is no id.
+    int dispatch(atp::common::intern_id_t id,
+                 const event_code_t& event, const timestamp_t& ts, const V& v)
+    {
+      if (id == atp::common::NO_INTERN_ID) {
+        return dispatch(event, ts, v);
+      }
+      if (id >= by_id_.size() || by_id_[id].empty()) {
+        return error_code::NO_UPDATER_CONTINUE;
+      }
+      try {
+        by_id_[id](ts, v);
+        return error_code::DISPATCHED; // dispatched.
+
+      } catch (...) {
+        LOG(WARNING) << "Exception while processing " << event
+                     << ": " << ts << "," << v;
+        return error_code::EXCEPTION;
+      }
     }
 
     /// dispatches an event, with a timestamp and a typed value to the
@@ -94,6 +147,7 @@ class value_updater
     typedef unordered_map<event_code_t, callback > dispatch_map;
 
     dispatch_map dispatch_map_;
+    std::vector<callback> by_id_;
   };
 
   inline void bind(const event_code_t& event,
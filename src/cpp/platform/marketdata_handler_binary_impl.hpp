@@ -0,0 +1,90 @@
+#ifndef ATP_PLATFORM_MARKETDATA_HANDLER_BINARY_IMPL_H_
+#define ATP_PLATFORM_MARKETDATA_HANDLER_BINARY_IMPL_H_
+
+#include "common/binary_tick.hpp"
+#include "common/intern_table.hpp"
+#include "common/trace_header.hpp"
+#include "platform/marketdata_handler.hpp"
+
+
+/// Contains template specializations for atp::common::binary_tick_t, so
+/// that a marketdata_handler<binary_tick_t> dispatches binary ticks by
+/// event id straight from the received bytes, without building a proto.
+/// Takes binary ticks only; use marketdata_handler<MarketData> for topics
+/// that may carry protos.
+
+using atp::common::binary_tick_t;
+
+namespace atp {
+namespace platform {
+namespace marketdata {
+
+template <>
+inline bool deserialize(const string& raw, binary_tick_t& m)
+{
+  const char* data = raw.data();
+  size_t size = raw.size();
+  atp::common::skip_trace_header(&data, &size);
+  // The ids are of no use with tables other than the publisher's.
+  return atp::common::decode_binary_tick(data, size, &m) &&
+      atp::common::is_local_intern_stamp(m.intern_stamp);
+}
+
+template <>
+inline timestamp_t get_timestamp<binary_tick_t>(const binary_tick_t& m)
+{
+  return m.timestamp;
+}
+
+template <>
+inline const string& get_event_code<binary_tick_t, string>(
+    const binary_tick_t& m)
+{
+  return atp::common::events().name(m.event_id);
+}
+
+template <>
+inline atp::common::intern_id_t get_event_id<binary_tick_t>(
+    const binary_tick_t& m)
+{
+  return m.event_id;
+}
+
+template <>
+inline int value_updater<binary_tick_t, string>::operator()(
+    const timestamp_t& ts, const string& event_code, const binary_tick_t& event)
+{
+  switch (event.type) {
+    case binary_tick_t::DOUBLE: {
+      return double_dispatcher_.dispatch(
+          event.event_id, event_code, ts, event.value.double_value);
+    }
+
+    case binary_tick_t::INT: {
+      return int_dispatcher_.dispatch(
+          event.event_id, event_code, ts,
+          static_cast<int>(event.value.int_value));
+    }
+
+    case binary_tick_t::STRING: {
+      return string_dispatcher_.dispatch(
+          event.event_id, event_code, ts, event.string());
+    }
+
+    case binary_tick_t::TIMESTAMP: {
+      return timestamp_dispatcher_.dispatch(
+          event.event_id, event_code, ts,
+          static_cast<timestamp_t>(event.value.timestamp_value));
+    }
+
+    default:
+      return atp::platform::marketdata::error_code::NO_VALUE_TYPE_MATCH;
+  }
+}
+
+} // marketdata
+} // platform
+} // atp
+
+
+#endif //ATP_PLATFORM_MARKETDATA_HANDLER_BINARY_IMPL_H_
@@ -3,6 +3,7 @@
 
 #include "platform/marketdata_handler.hpp"
 
+#include "proto/binary_tick.hpp"
 #include "proto/common.pb.h"
 #include "proto/ib.pb.h"
 
@@ -18,10 +19,12 @@ namespace atp {
 namespace platform {
 namespace marketdata {
 
+/// Takes binary ticks as well; see marketdata_handler_binary_impl.hpp to
+/// process those without building a proto.
 template <>
 inline bool deserialize(const string& raw, MarketData& m)
 {
-  return m.ParseFromString(raw);
+  return proto::ib::parse_market_data(raw, &m);
 }
 
 template <>
@@ -36,30 +39,43 @@ inline const string& get_event_code<MarketData, string>(const MarketData& m)
   return m.event();
 }
 
+/// Event ids on the wire are only meaningful if they come from the intern
+/// tables of this process, e.g. the publisher's opened from the same
+/// --internDir; otherwise the event is dispatched by name.
+template <>
+inline atp::common::intern_id_t get_event_id<MarketData>(const MarketData& m)
+{
+  return m.has_event_id() &&
+      atp::common::is_local_intern_stamp(m.intern_stamp()) ?
+      m.event_id() : atp::common::NO_INTERN_ID;
+}
+
 template <>
 int value_updater<MarketData, string>::operator()(const timestamp_t& ts,
                                                   const string& event_code,
                                                   const MarketData& event)
 {
+  atp::common::intern_id_t id = get_event_id(event);
+
   switch (event.value().type()) {
     case proto::common::Value::DOUBLE: {
       return double_dispatcher_.dispatch(
-          event_code, ts, event.value().double_value());
+          id, event_code, ts, event.value().double_value());
     }
 
     case proto::common::Value::INT: {
       return int_dispatcher_.dispatch(
-          event_code, ts, event.value().int_value());
+          id, event_code, ts, event.value().int_value());
     }
 
     case proto::common::Value::STRING: {
       return string_dispatcher_.dispatch(
-          event_code, ts, event.value().string_value());
+          id, event_code, ts, event.value().string_value());
     }
 
     case proto::common::Value::TIMESTAMP: {
       return timestamp_dispatcher_.dispatch(
-          event_code, ts,
+          id, event_code, ts,
           static_cast<timestamp_t>(event.value().timestamp_value()));
     }
 
@@ -1,12 +1,22 @@
 
 
+#include <boost/atomic.hpp>
 #include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <glog/logging.h>
 
 
 #include "common.hpp"
+#include "log_levels.h"
+#include "common/sequence_tracker.hpp"
+#include "common/tick_batch.hpp"
+#include "proto/sequence.hpp"
+#include "varz/varz.hpp"
+#include "zmq/Forwarder.hpp"
+#include "zmq/ShmRing.hpp"
 #include "zmq/ZmqUtils.hpp"
 
 #include "platform/message_processor.hpp"
@@ -19,11 +29,38 @@ using boost::scoped_ptr;
 using boost::thread;
 
 
+DEFINE_VARZ_counter(message_processor_sequence_gaps, "");
+DEFINE_VARZ_counter(message_processor_sequence_missed,
+                    "messages in sequence gaps");
+DEFINE_VARZ_counter(message_processor_sequence_stale, "");
+DEFINE_VARZ_counter(message_processor_sequence_resets, "publisher restarts");
+DEFINE_VARZ_int64(message_processor_batches, 0, "");
+
+
 namespace atp {
 namespace platform {
 
 using atp::platform::message_processor;
 
+// Messages taken from the socket and rings per wakeup.
+static const size_t MAX_BATCH = 1024;
+
+// Messages queued for a worker before the listener waits for it.
+static const size_t MAX_PENDING = 64 * 1024;
+
+// Listener wait, so it notices when a worker's handler stops processing.
+#ifdef ZMQ_3X
+static const long POLL_TIMEOUT = 100;  // msec
+#else
+static const long POLL_TIMEOUT = 100000;  // usec
+#endif
+
+// Wait on one ring while the others, or the socket, may get messages.  The
+// writer of the ring wakes the listener at once; the rest are checked at
+// least this often.  A lone ring is waited on as long as the socket.
+static const boost::int64_t RING_WAIT_MICROS = 1000;
+static const boost::int64_t RING_ONLY_WAIT_MICROS = 100000;
+
 
 class message_processor::implementation : NoCopyAndAssign
 {
@@ -31,13 +68,21 @@ class message_processor::implementation : NoCopyAndAssign
 
   implementation(const vector<string>& endpoints,
                  const message_processor::protobuf_handlers_map& handlers,
-                 ::zmq::context_t* context) :
+                 ::zmq::context_t* context,
+                 size_t workers,
+                 bool checkSequences) :
     endpoints_(endpoints),
     handlers_(handlers),
     context_(context == NULL ? new ::zmq::context_t(1) : context),
     ready_(false),
-    listener_thread_(new thread(boost::bind(&implementation::run, this)))
+    stopped_(false),
+    checkSequences_(checkSequences)
   {
+    for (size_t i = 0; i < workers; ++i) {
+      workers_.push_back(new worker_t());
+    }
+    listener_thread_.reset(new thread(boost::bind(&implementation::run, this)));
+
     boost::unique_lock<mutex> lock(mutex_);
     while (!ready_) until_ready_.wait(lock);
   }
@@ -54,14 +99,46 @@ class message_processor::implementation : NoCopyAndAssign
 
  private:
 
+  typedef message_processor::protobuf_handlers_map::handler_type handler_t;
+
+  struct delivery_t
+  {
+    int id;
+    string message;
+  };
+
+  typedef vector<delivery_t> deliveries_t;
+
+  /// Messages of the topics assigned to a worker, in order.  The listener
+  /// appends a batch at a time; the worker takes all pending at once.
+  struct worker_t : NoCopyAndAssign
+  {
+    worker_t() : stop(false) {}
+
+    mutex lock;
+    condition_variable changed;
+    deliveries_t pending;
+    bool stop;
+    scoped_ptr<thread> runner;
+  };
+
   void run()
   {
     ::zmq::socket_t socket(*context_, ZMQ_SUB);
 
+    // Shared memory rings of publishers on this host.
+    boost::ptr_vector<atp::zmq::ShmRingReader> rings;
+
     for (vector<string>::const_iterator itr = endpoints_.begin();
          itr != endpoints_.end();
          ++itr) {
 
+      if (atp::zmq::ShmRing::is_shm(*itr)) {
+        rings.push_back(new atp::zmq::ShmRingReader(*itr));
+        LOG(INFO) << "Reading ring " << *itr;
+        continue;
+      }
+
       try {
 
         socket.connect(itr->c_str());
@@ -72,13 +149,31 @@ class message_processor::implementation : NoCopyAndAssign
       }
     }
 
-    // Add subscriptions by the handler key
+    // Add subscriptions by the handler key.  Topics get dense ids, so the
+    // workers and sequences of a topic are found by indexing.
     message_processor::protobuf_handlers_map::message_keys_itr itr;
     for (itr = handlers_.begin(); itr != handlers_.end(); ++itr) {
       string topic = itr->first;
       socket.setsockopt(ZMQ_SUBSCRIBE, topic.c_str(), topic.length());
+      for (size_t i = 0; i < rings.size(); ++i) {
+        rings[i].subscribe(topic);
+      }
+      if (topic_ids_.insert(std::make_pair(topic,
+                                           static_cast<int>(topics_.size())))
+          .second) {
+        topics_.push_back(topic);
+        handlers_by_id_.push_back(itr->second);
+      }
       LOG(INFO) << "subscribed to " << topic;
     }
+    bool socketOnly = rings.empty();
+    bool ringOnly = rings.size() == 1 && rings.size() == endpoints_.size();
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].runner.reset(new thread(
+          boost::bind(&implementation::work, this, &workers_[i])));
+    }
+    batches_.resize(workers_.size());
 
     {
       boost::lock_guard<mutex> lock(mutex_);
@@ -86,42 +181,230 @@ class message_processor::implementation : NoCopyAndAssign
     }
     until_ready_.notify_all();
 
-    LOG(INFO) << "Ready to handle messages.";
+    LOG(INFO) << "Ready to handle messages, workers = " << workers_.size();
 
-    string topic, message;
-    topic.reserve(20);
-    message.reserve(200);
+    atp::zmq::frames_t frames;
+    size_t turn = 0;
+    size_t waitTurn = 0;
 
-    bool run = true;
-    do {
+    while (!stopped_) {
 
       try {
 
-        if (atp::zmq::receive(socket, &topic) &&
-            !atp::zmq::receive(socket, &message)) {
-          run = handlers_.process_raw_message(topic, message);
-
-        } else {
-          LOG(INFO) << "Got instead [" << topic << "][" << message << ']';
+        // Idle: block on the socket or on the futex of a ring, which
+        // spins briefly first (see ShmRingReader::receive).
+        if (!receive_next(socket, rings, &turn, &frames)) {
+          if (socketOnly) {
+            ::zmq::pollitem_t item = { socket, 0, ZMQ_POLLIN, 0 };
+            ::zmq::poll(&item, 1, POLL_TIMEOUT);
+            continue;
+          }
+          waitTurn = (waitTurn + 1) % rings.size();
+          boost::int64_t wait =
+              ringOnly ? RING_ONLY_WAIT_MICROS : RING_WAIT_MICROS;
+          if (!rings[waitTurn].receive(&frames, wait)) {
+            continue;
+          }
         }
 
+        // Everything already received, up to a batch, is handed to the
+        // workers at once.
+        size_t count = 0;
+        do {
+          if (frames.size() != 2) {
+            LOG(INFO) << "Got instead " << frames.size() << " frames ["
+                      << (frames.empty() ? "" : frames[0]) << ']';
+          } else if (!dispatch(&frames)) {
+            stopped_ = true;
+          }
+        } while (!stopped_ && ++count < MAX_BATCH &&
+                 receive_next(socket, rings, &turn, &frames));
+
+        flush();
+
       } catch (::zmq::error_t e) {
         LOG(WARNING) << "Exception[" << e.num() << "][" << e.what() << "]";
         if (e.num() == EINTR) {
           LOG(WARNING) << "Continuing";
         } else {
-          run = false;
+          break;
         }
       }
-    } while (run);
+    }
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      {
+        boost::lock_guard<mutex> lock(workers_[i].lock);
+        workers_[i].stop = true;
+      }
+      workers_[i].changed.notify_all();
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].runner->join();
+    }
 
     LOG(INFO) << "Listening thread stopped.";
   }
 
+  /// Takes one message without waiting, trying the rings and the socket in
+  /// turn.
+  bool receive_next(::zmq::socket_t& socket,
+                    boost::ptr_vector<atp::zmq::ShmRingReader>& rings,
+                    size_t* turn,
+                    atp::zmq::frames_t* frames)
+  {
+    for (size_t i = 0; i <= rings.size(); ++i) {
+      bool received = *turn < rings.size() ?
+          rings[*turn].receive(frames, 0) :
+          atp::zmq::receive_frames(socket, frames,
+                                   atp::zmq::FORWARD_NOBLOCK);
+      *turn = (*turn + 1) % (rings.size() + 1);
+      if (received) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Handles the message, or each message of a batch of the publisher
+  /// (see common/tick_batch.hpp), or queues them for the worker of their
+  /// topic.  Returns false to stop processing.
+  bool dispatch(atp::zmq::frames_t* frames)
+  {
+    boost::unordered_map<string, int>::const_iterator found =
+        topic_ids_.find((*frames)[0]);
+    if (found == topic_ids_.end()) {
+      LOG(INFO) << "Cannot resolve handler " << (*frames)[0];
+      return false;
+    }
+    int id = found->second;
+    if (!atp::common::is_tick_batch((*frames)[1])) {
+      return deliver(id, &(*frames)[1]);
+    }
+    VARZ_message_processor_batches++;
+    atp::common::tick_batch_reader batch((*frames)[1]);
+    string record;
+    while (batch.next(&record)) {
+      if (!deliver(id, &record)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Takes the message, leaving it empty if queued.
+  bool deliver(int id, string* message)
+  {
+    if (checkSequences_) {
+      checkSequence(id, *message);
+    }
+    if (workers_.empty()) {
+      return handle(id, *message);
+    }
+    deliveries_t& batch = batches_[id % workers_.size()];
+    batch.push_back(delivery_t());
+    batch.back().id = id;
+    batch.back().message.swap(*message);
+    return true;
+  }
+
+  void checkSequence(int id, const string& message)
+  {
+    boost::uint64_t publisher, seq;
+    if (!proto::ib::read_sequence(message, &publisher, &seq)) {
+      return;
+    }
+    atp::common::sequence_gap_t gap;
+    boost::uint64_t resets = sequences_.resets();
+    switch (sequences_.check(id, publisher, seq, 0, &gap)) {
+      case atp::common::sequence_tracker<int>::GAP:
+        VARZ_message_processor_sequence_gaps++;
+        VARZ_message_processor_sequence_missed += gap.size();
+        ZMQ_SUBSCRIBER_LOGGER << "Missed " << gap.size() << " messages of "
+                              << topics_[id] << " from " << gap.first;
+        break;
+      case atp::common::sequence_tracker<int>::STALE:
+        VARZ_message_processor_sequence_stale++;
+        break;
+      default:
+        break;
+    }
+    VARZ_message_processor_sequence_resets += sequences_.resets() - resets;
+  }
+
+  bool handle(int id, const string& message)
+  {
+    try {
+      return handlers_by_id_[id](topics_[id], message);
+    } catch (...) {
+      return false;
+    }
+  }
+
+  void flush()
+  {
+    for (size_t i = 0; i < batches_.size(); ++i) {
+      if (batches_[i].empty()) {
+        continue;
+      }
+      worker_t& worker = workers_[i];
+      {
+        boost::unique_lock<mutex> lock(worker.lock);
+        while (worker.pending.size() >= MAX_PENDING && !stopped_) {
+          worker.changed.wait(lock);
+        }
+        if (worker.pending.empty()) {
+          // Swapped vectors keep their capacity going back and forth.
+          worker.pending.swap(batches_[i]);
+        } else {
+          worker.pending.insert(worker.pending.end(),
+                                batches_[i].begin(), batches_[i].end());
+        }
+      }
+      batches_[i].clear();
+      worker.changed.notify_all();
+    }
+  }
+
+  void work(worker_t* worker)
+  {
+    deliveries_t batch;
+    while (true) {
+      {
+        boost::unique_lock<mutex> lock(worker->lock);
+        while (worker->pending.empty() && !worker->stop) {
+          worker->changed.wait(lock);
+        }
+        if (worker->pending.empty()) {
+          break;
+        }
+        batch.swap(worker->pending);
+      }
+      worker->changed.notify_all();
+
+      // Messages after a handler stops processing are dropped, as they
+      // would be by a single thread.
+      for (size_t i = 0; i < batch.size() && !stopped_; ++i) {
+        if (!handle(batch[i].id, batch[i].message)) {
+          stopped_ = true;
+        }
+      }
+      batch.clear();
+    }
+  }
+
   vector<string> endpoints_;
   const message_processor::protobuf_handlers_map& handlers_;
   ::zmq::context_t* context_;
   bool ready_;
+  boost::atomic<bool> stopped_;
+  boost::unordered_map<string, int> topic_ids_;
+  vector<string> topics_;  // by id
+  vector<handler_t> handlers_by_id_;
+  boost::ptr_vector<worker_t> workers_;
+  vector<deliveries_t> batches_;  // for each worker, on the listener
+  bool checkSequences_;
+  atp::common::sequence_tracker<int> sequences_;  // by topic id
   scoped_ptr<thread> listener_thread_;
   mutex mutex_;
   condition_variable until_ready_;
@@ -130,15 +413,21 @@ class message_processor::implementation : NoCopyAndAssign
 
 message_processor::message_processor(const string& endpoint,
                                      const protobuf_handlers_map& handlers,
-                                     ::zmq::context_t* context) :
-    impl_(new implementation(vector<string>(1, endpoint), handlers, context))
+                                     ::zmq::context_t* context,
+                                     size_t workers,
+                                     bool checkSequences) :
+    impl_(new implementation(vector<string>(1, endpoint), handlers, context,
+                             workers, checkSequences))
 {
 }
 
 message_processor::message_processor(const vector<string>& endpoints,
                                      const protobuf_handlers_map& handlers,
-                                     ::zmq::context_t* context) :
-    impl_(new implementation(endpoints, handlers, context))
+                                     ::zmq::context_t* context,
+                                     size_t workers,
+                                     bool checkSequences) :
+    impl_(new implementation(endpoints, handlers, context, workers,
+                             checkSequences))
 {
 }
 
@@ -43,6 +43,8 @@ class message_processor : NoCopyAndAssign
 
    public:
 
+    typedef handler_t handler_type;
+
     typedef typename unordered_map<message_key_t, handler_t>::const_iterator
     message_keys_itr;
 
@@ -102,15 +104,29 @@ class message_processor : NoCopyAndAssign
 
   typedef handlers_map<string, string> protobuf_handlers_map;
 
+  // Handlers must all be registered before the processor is created.
+  //
+  // workers - 0 to call handlers on the listener thread.  Otherwise each
+  // topic is assigned to one of the worker threads, so messages of a topic
+  // are handled in order while different topics are handled in parallel.
+  // Processing stops when any handler returns false.
+  //
+  // checkSequences - count gaps in the sequence numbers of market data
+  // messages (see proto/sequence.hpp) for each topic.
+
   // Single endpoint
   message_processor(const string& endpoint,
                     const protobuf_handlers_map& handlers,
-                    ::zmq::context_t* context = NULL);
+                    ::zmq::context_t* context = NULL,
+                    size_t workers = 0,
+                    bool checkSequences = false);
 
   // Subscription to multiple endpoints
   message_processor(const vector<string>& endpoints,
                     const protobuf_handlers_map& handlers,
-                    ::zmq::context_t* context = NULL);
+                    ::zmq::context_t* context = NULL,
+                    size_t workers = 0,
+                    bool checkSequences = false);
   ~message_processor();
 
   void block();
@@ -0,0 +1,124 @@
+#ifndef PROTO_BINARY_TICK_H_
+#define PROTO_BINARY_TICK_H_
+
+#include <string>
+
+#include "common/binary_tick.hpp"
+#include "common/intern_table.hpp"
+#include "common/trace_header.hpp"
+#include "proto/ib.pb.h"
+
+
+namespace proto {
+namespace ib {
+
+
+using atp::common::binary_tick_t;
+
+
+/// Sets the tick from the MarketData.  Returns false if the message has
+/// no interned symbol or event id, which the binary encoding requires.
+/// A string value points into m.
+inline bool to_binary_tick(const MarketData& m, binary_tick_t* tick)
+{
+  if (m.symbol_id() == atp::common::NO_INTERN_ID ||
+      m.event_id() == atp::common::NO_INTERN_ID) {
+    return false;
+  }
+  tick->symbol_id = m.symbol_id();
+  tick->event_id = m.event_id();
+  tick->contract_id = static_cast<boost::uint32_t>(m.contract_id());
+  tick->timestamp = m.timestamp();
+  tick->publisher_id = m.publisher_id();
+  tick->seq = m.seq();
+  tick->intern_stamp = m.intern_stamp();
+
+  const proto::common::Value& value = m.value();
+  switch (value.type()) {
+    case proto::common::Value::DOUBLE:
+      tick->set(value.double_value());
+      break;
+    case proto::common::Value::INT:
+      tick->type = binary_tick_t::INT;
+      tick->value.int_value = value.int_value();
+      break;
+    case proto::common::Value::STRING:
+      tick->set(value.string_value());
+      break;
+    case proto::common::Value::TIMESTAMP:
+      tick->type = binary_tick_t::TIMESTAMP;
+      tick->value.timestamp_value = value.timestamp_value();
+      break;
+  }
+  return true;
+}
+
+/// Sets the MarketData from the tick, resolving the symbol and the event
+/// names in the intern tables.  Returns false if the ids are of other
+/// tables (see is_local_intern_stamp), or an id is unknown.
+inline bool from_binary_tick(const binary_tick_t& tick, MarketData* m)
+{
+  if (!atp::common::is_local_intern_stamp(tick.intern_stamp)) {
+    return false;
+  }
+  const std::string& symbol = atp::common::symbols().name(tick.symbol_id);
+  const std::string& event = atp::common::events().name(tick.event_id);
+  if (symbol.empty() || event.empty()) {
+    return false;
+  }
+  m->Clear();
+  m->set_symbol(symbol);
+  m->set_event(event);
+  m->set_symbol_id(tick.symbol_id);
+  m->set_event_id(tick.event_id);
+  m->set_intern_stamp(tick.intern_stamp);
+  m->set_contract_id(tick.contract_id);
+  m->set_timestamp(tick.timestamp);
+  m->set_publisher_id(tick.publisher_id);
+  m->set_seq(tick.seq);
+
+  proto::common::Value* value = m->mutable_value();
+  switch (tick.type) {
+    case binary_tick_t::DOUBLE:
+      value->set_type(proto::common::Value::DOUBLE);
+      value->set_double_value(tick.value.double_value);
+      break;
+    case binary_tick_t::INT:
+      value->set_type(proto::common::Value::INT);
+      value->set_int_value(tick.value.int_value);
+      break;
+    case binary_tick_t::STRING:
+      value->set_type(proto::common::Value::STRING);
+      value->set_string_value(tick.string_value, tick.string_size);
+      break;
+    case binary_tick_t::TIMESTAMP:
+      value->set_type(proto::common::Value::TIMESTAMP);
+      value->set_timestamp_value(tick.value.timestamp_value);
+      break;
+  }
+  return true;
+}
+
+/// Parses a market data message in either encoding, traced or not (see
+/// common/trace_header.hpp).
+inline bool parse_market_data(const char* data, size_t size, MarketData* m)
+{
+  atp::common::skip_trace_header(&data, &size);
+  if (atp::common::is_binary_tick(data, size)) {
+    binary_tick_t tick;
+    return atp::common::decode_binary_tick(data, size, &tick) &&
+        from_binary_tick(tick, m);
+  }
+  return m->ParseFromArray(data, static_cast<int>(size));
+}
+
+inline bool parse_market_data(const std::string& data, MarketData* m)
+{
+  return parse_market_data(data.data(), data.size(), m);
+}
+
+
+} // ib
+} // proto
+
+#endif //PROTO_BINARY_TICK_H_
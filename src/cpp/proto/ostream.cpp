@@ -120,12 +120,15 @@ std::ostream& operator<<(std::ostream& out, const SessionLog& log)
   using namespace atp::time;
   using namespace proto::common;
   ptime t1 = to_est(as_ptime(log.start_timestamp()));
-  ptime t2 = to_est(as_ptime(log.start_timestamp()));
+  ptime t2 = to_est(as_ptime(log.stop_timestamp()));
 
   out << log.symbol() << ","
       << "start=" << t1 << ","
       << "end=" << t2 << ","
       << "source=" << log.source();
+  if (log.has_records()) {
+    out << ",records=" << log.records();
+  }
   return out;
 }
 
@@ -151,6 +154,19 @@ std::ostream& operator<<(std::ostream& out, const QueryBySymbol& q)
   return out;
 }
 
+std::ostream& operator<<(std::ostream& out, const QueryCatalog& q)
+{
+  using namespace atp::time;
+  ptime t1 = to_est(as_ptime(q.utc_first_micros()));
+  out << "QueryCatalog[symbol=" << q.symbol() << ","
+      << "start=" << t1;
+  if (q.has_utc_last_micros()) {
+    out << ",stop=" << to_est(as_ptime(q.utc_last_micros()));
+  }
+  out << "]";
+  return out;
+}
+
 std::ostream& operator<<(std::ostream& os, const OrderStatus& o)
 {
   os << "OrderStatus="
@@ -35,6 +35,8 @@ std::ostream& operator<<(std::ostream& out, const QueryByRange& q);
 
 std::ostream& operator<<(std::ostream& out, const QueryBySymbol& q);
 
+std::ostream& operator<<(std::ostream& out, const QueryCatalog& q);
+
 std::ostream& operator<<(std::ostream& os, const OrderStatus& o);
 
 std::ostream& operator<<(std::ostream& out, const Id& v);
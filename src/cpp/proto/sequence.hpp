@@ -0,0 +1,86 @@
+#ifndef PROTO_SEQUENCE_H_
+#define PROTO_SEQUENCE_H_
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "common/binary_tick.hpp"
+#include "common/trace_header.hpp"
+#include "proto/ib.pb.h"
+
+
+namespace proto {
+namespace ib {
+
+
+BOOST_STATIC_ASSERT(static_cast<int>(MarketData::kPublisherIdFieldNumber) ==
+                    static_cast<int>(MarketDepth::kPublisherIdFieldNumber));
+BOOST_STATIC_ASSERT(static_cast<int>(MarketData::kSeqFieldNumber) ==
+                    static_cast<int>(MarketDepth::kSeqFieldNumber));
+
+
+/// Reads the publisher_id and seq of a serialized MarketData or MarketDepth
+/// without parsing the rest of the message, so that processors of raw
+/// messages can check sequences.  Also reads binary ticks (see
+/// atp::common::binary_tick_t) and traced messages (see
+/// common/trace_header.hpp).  Returns false if there is no seq.
+inline bool read_sequence(const std::string& serialized,
+                          boost::uint64_t* publisher, boost::uint64_t* seq)
+{
+  using google::protobuf::io::CodedInputStream;
+  using google::protobuf::internal::WireFormatLite;
+
+  if (atp::common::read_trace_header(serialized.data(), serialized.size(),
+                                     publisher, seq)) {
+    return *seq != 0;
+  }
+
+  if (atp::common::is_binary_tick(serialized)) {
+    atp::common::binary_tick_t tick;
+    if (!atp::common::decode_binary_tick(serialized, &tick) || tick.seq == 0) {
+      return false;
+    }
+    *publisher = tick.publisher_id;
+    *seq = tick.seq;
+    return true;
+  }
+
+  CodedInputStream in(
+      reinterpret_cast<const google::protobuf::uint8*>(serialized.data()),
+      static_cast<int>(serialized.size()));
+
+  bool found = false;
+  *publisher = 0;
+  google::protobuf::uint32 tag;
+  while ((tag = in.ReadTag()) != 0) {
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    bool varint = WireFormatLite::GetTagWireType(tag) ==
+        WireFormatLite::WIRETYPE_VARINT;
+    google::protobuf::uint64 value;
+    if (varint && field == MarketData::kPublisherIdFieldNumber) {
+      if (!in.ReadVarint64(&value)) {
+        return false;
+      }
+      *publisher = value;
+    } else if (varint && field == MarketData::kSeqFieldNumber) {
+      if (!in.ReadVarint64(&value)) {
+        return false;
+      }
+      *seq = value;
+      found = true;
+    } else if (!WireFormatLite::SkipField(&in, tag)) {
+      return false;
+    }
+  }
+  return found;
+}
+
+
+} // ib
+} // proto
+
+#endif //PROTO_SEQUENCE_H_
@@ -0,0 +1,98 @@
+
+#include "log_levels.h"
+#include "common/tick_capture.hpp"
+#include "common/time_utils.hpp"
+#include "common/trading_calendar.hpp"
+#include "proto/binary_tick.hpp"
+#include "service/CaptureReader.hpp"
+
+
+namespace atp {
+namespace log_reader {
+
+namespace p = proto::ib;
+
+
+size_t CaptureReader::Process(marketdata_visitor_t& marketdata_visitor,
+                              marketdepth_visitor_t& marketdepth_visitor,
+                              const time_duration_t& duration,
+                              const time_t& start)
+{
+  LOG(INFO) << "Opening capture " << capturefile_;
+
+  atp::capture::File file(capturefile_);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Unable to open " << capturefile_;
+    return 0;
+  }
+
+  boost::uint64_t start_micros = 0;
+  if (!start.is_special()) {
+    start_micros = atp::time::as_micros(start);
+    file.seek(start_micros);
+  }
+  boost::uint64_t stop_micros = 0;
+
+  const atp::time::TradingCalendar& calendar =
+      atp::time::TradingCalendar::instance();
+
+  size_t records = 0;
+  size_t matchedRecords = 0;
+
+  p::MarketData marketdata;
+  p::MarketDepth marketdepth;
+
+  atp::capture::record_t record;
+  bool stopped = false;
+  while (!stopped && file.next(&record)) {
+    records++;
+
+    if (record.timestamp < start_micros) {
+      continue; // do not start yet.
+    }
+    if (!calendar.check(record.timestamp, rth_)) {
+      continue;
+    }
+
+    if (stop_micros == 0 && !duration.is_special()) {
+      stop_micros = record.timestamp + duration.total_microseconds();
+    }
+    if (stop_micros > 0 && record.timestamp > stop_micros) {
+      LOG(INFO) << "Scanned " << duration << ". Stopping.";
+      break;
+    }
+
+    switch (record.type) {
+      case atp::capture::MARKET_DATA:
+        if (p::parse_market_data(record.payload, record.size, &marketdata)) {
+          matchedRecords++;
+          if (!marketdata_visitor(marketdata)) {
+            LOG(INFO) << "Visitor stopped the scan.";
+            stopped = true;
+          }
+          continue;
+        }
+        break;
+      case atp::capture::MARKET_DEPTH:
+        if (marketdepth.ParseFromArray(record.payload, record.size)) {
+          matchedRecords++;
+          if (!marketdepth_visitor(marketdepth)) {
+            LOG(INFO) << "Visitor stopped the scan.";
+            stopped = true;
+          }
+          continue;
+        }
+        break;
+    }
+    LOG_READER_LOGGER << "Skipping record of type " << record.type
+                      << " at " << record.timestamp;
+  }
+
+  LOG(INFO) << "Processed " << records << " capture records with "
+            << matchedRecords << " matched.";
+  return matchedRecords;
+}
+
+
+} // log_reader
+} // atp
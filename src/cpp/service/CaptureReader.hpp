@@ -0,0 +1,45 @@
+#ifndef ATP_SERVICE_CAPTURE_READER_H_
+#define ATP_SERVICE_CAPTURE_READER_H_
+
+#include <string>
+
+#include "service/LogReader.hpp"
+
+
+namespace atp {
+namespace log_reader {
+
+
+/////////////////////////////////////////////////////////////
+/// Reader of the binary tick capture files written by firehose.
+/// Drives the same visitors as LogReader without any text parsing.
+class CaptureReader
+{
+ public:
+
+  typedef LogReader::marketdata_visitor_t marketdata_visitor_t;
+  typedef LogReader::marketdepth_visitor_t marketdepth_visitor_t;
+
+  CaptureReader(const string& capturefile, bool rth = true) :
+      capturefile_(capturefile), rth_(rth)
+  {
+  }
+
+  /// Process the capture with the given visitors for marketdata and
+  /// marketdepth.  Uses the file index to skip ahead to start.  A visitor
+  /// returning false stops the scan.
+  size_t Process(marketdata_visitor_t& marketdata_visitor,
+                 marketdepth_visitor_t& marketdepth_visitor,
+                 const time_duration_t& duration = pos_infin,
+                 const time_t& start = neg_infin);
+
+ private:
+  string capturefile_;
+  bool rth_;
+};
+
+
+} // log_reader
+} // atp
+
+#endif //ATP_SERVICE_CAPTURE_READER_H_
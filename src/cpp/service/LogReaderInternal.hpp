@@ -23,6 +23,7 @@
 
 #include "log_levels.h"
 #include "common/time_utils.hpp"
+#include "common/trading_calendar.hpp"
 #include "ib/contract_symbol.hpp"
 #include "proto/ib.pb.h"
 
@@ -225,21 +226,16 @@ static bool get_timestamp(const log_record_t& event, ptime* timestamp)
 
 static bool check_time(const log_record_t& event, bool regular_trading_hours)
 {
-  ptime t;
-  if (!get_timestamp(event, &t)) {
+  log_record_t::const_iterator found = event.find("ts_utc");
+  if (found == event.end()) {
     return false;
   }
+  log_timer_t ts = boost::lexical_cast<log_timer_t>(found->second);
 
-  bool ext = atp::time::checkEXT(t);
-  if (!ext) {
-    return false; // outside trading hours
-  }
-  bool rth = atp::time::checkRTH(t);
-  if (!rth && regular_trading_hours) {
-    // Skip if not RTH and we want only data during trading hours.
-    return false;
-  }
-  return true;
+  // Skip if outside trading hours, or not RTH and we want only data
+  // during regular trading hours.
+  return atp::time::TradingCalendar::instance().check(
+      ts, regular_trading_hours);
 }
 
 
@@ -1,33 +1,49 @@
 #ifndef ATP_SERVICE_MARKETDATA_SUBSCRIBER_H_
 #define ATP_SERVICE_MARKETDATA_SUBSCRIBER_H_
 
+#include <algorithm>
 #include <map>
+#include <sstream>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/assign.hpp>
+#include <boost/atomic.hpp>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/date_time/gregorian/greg_month.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include "log_levels.h"
 #include "utils.hpp"
+#include "common/async_gap_fetcher.hpp"
+#include "common/sequence_tracker.hpp"
+#include "common/tick_batch.hpp"
+#include "common/trace_header.hpp"
+#include "common/trading_calendar.hpp"
 #include "historian/constants.hpp"
+#include "proto/binary_tick.hpp"
 #include "proto/historian.hpp"
+#include "varz/trace.hpp"
 #include "varz/varz.hpp"
+#include "zmq/Forwarder.hpp"
+#include "zmq/ShmRing.hpp"
 #include "zmq/ZmqUtils.hpp"
 
 #include "service/ManagedAgent.hpp"
 
 
-DEFINE_VARZ_int64(marketdata_process_latency_micros, 0, "");
-DEFINE_VARZ_int64(marketdata_process_latency_micros_total, 0, "");
-DEFINE_VARZ_int64(marketdata_process_latency_micros_count, 0, "");
-DEFINE_VARZ_int64(marketdata_process_latency_over_budget, 0, "");
-DEFINE_VARZ_int64(marketdata_process_latency_drift_micros, 0, "");
+DEFINE_VARZ_histogram(marketdata_process_latency_micros, "");
+DEFINE_VARZ_counter(marketdata_process_latency_micros_total, "");
+DEFINE_VARZ_counter(marketdata_process_latency_micros_count, "");
+DEFINE_VARZ_counter(marketdata_process_latency_over_budget, "");
+DEFINE_VARZ_gauge(marketdata_process_latency_drift_micros, 0, "");
 
 DEFINE_VARZ_bool(marketdata_process_stopped, false, "");
 
@@ -35,19 +51,37 @@ DEFINE_VARZ_string(marketdata_id, "", "");
 DEFINE_VARZ_string(marketdata_subscribes, "", "");
 DEFINE_VARZ_string(marketdata_unsubscribes, "", "");
 
-DEFINE_VARZ_int64(marketdata_event_last_ts, 0, "");
-DEFINE_VARZ_int64(marketdata_event_interval_micros, 0, "");
-
-DEFINE_VARZ_int64(marketdepth_process_latency_micros, 0, "");
-DEFINE_VARZ_int64(marketdepth_process_latency_micros_total, 0, "");
-DEFINE_VARZ_int64(marketdepth_process_latency_micros_count, 0, "");
-DEFINE_VARZ_int64(marketdepth_process_latency_over_budget, 0, "");
-DEFINE_VARZ_int64(marketdepth_process_latency_drift_micros, 0, "");
+DEFINE_VARZ_gauge(marketdata_event_last_ts, 0, "");
+DEFINE_VARZ_gauge(marketdata_event_interval_micros, 0, "");
+DEFINE_VARZ_counter(marketdata_outside_trading_hours, "");
+DEFINE_VARZ_gauge(marketdata_shm_ring_overruns, 0, "");
+DEFINE_VARZ_counter(marketdata_shard_queue_full, "");
+DEFINE_VARZ_string(marketdata_shard_queue_depth, "", "by shard");
+DEFINE_VARZ_string(marketdata_shard_latency_micros, "",
+                   "receive to processed, by shard");
+DEFINE_VARZ_string(marketdata_shard_processed, "", "by shard");
+DEFINE_VARZ_counter(marketdata_sequence_gaps, "");
+DEFINE_VARZ_counter(marketdata_sequence_missed, "messages in sequence gaps");
+DEFINE_VARZ_counter(marketdata_sequence_recovered, "");
+DEFINE_VARZ_counter(marketdata_sequence_fetch_dropped, "gaps not fetched "
+                    "for the rate limit or queue of the fetcher");
+DEFINE_VARZ_counter(marketdata_sequence_conflated, "gaps of conflated topics, "
+                    "not fetched");
+DEFINE_VARZ_counter(marketdata_sequence_stale, "");
+DEFINE_VARZ_counter(marketdata_sequence_resets, "publisher restarts");
+DEFINE_VARZ_counter(marketdata_batches, "");
+
+DEFINE_VARZ_histogram(marketdepth_process_latency_micros, "");
+DEFINE_VARZ_counter(marketdepth_process_latency_micros_total, "");
+DEFINE_VARZ_counter(marketdepth_process_latency_micros_count, "");
+DEFINE_VARZ_counter(marketdepth_process_latency_over_budget, "");
+DEFINE_VARZ_gauge(marketdepth_process_latency_drift_micros, 0, "");
 
 DEFINE_VARZ_bool(marketdepth_process_stopped, false, "");
 
-DEFINE_VARZ_int64(marketdepth_event_last_ts, 0, "");
-DEFINE_VARZ_int64(marketdepth_event_interval_micros, 0, "");
+DEFINE_VARZ_gauge(marketdepth_event_last_ts, 0, "");
+DEFINE_VARZ_gauge(marketdepth_event_interval_micros, 0, "");
+DEFINE_VARZ_counter(marketdepth_outside_trading_hours, "");
 
 namespace atp {
 namespace service {
@@ -56,6 +90,8 @@ namespace service {
 using namespace std;
 
 
+using atp::common::sequence_gap_t;
+using atp::common::sequence_tracker;
 using boost::posix_time::time_duration;
 using proto::ib::MarketData;
 using proto::ib::MarketDepth;
@@ -77,7 +113,17 @@ class MarketDataSubscriber : public ManagedAgent
       subscriptions_(subscriptions),
       contextPtr_(context),
       ownContext_(context == NULL),
-      offsetLatency_(false)
+      offsetLatency_(false),
+      filterTradingHours_(false),
+      rthOnly_(true),
+      nextFrame_(0),
+      ringMessages_(0),
+      shardCount_(0),
+      shardQueueSize_(0),
+      stopped_(false),
+      shardVarzSecond_(0),
+      maxFetchesPerSecond_(10),
+      conflated_(false)
   {
     VARZ_marketdata_id = getId();
 
@@ -94,8 +140,17 @@ class MarketDataSubscriber : public ManagedAgent
     if (ownContext_) {
       contextPtr_ = new ::zmq::context_t(1);
     }
+    // When market data comes from a shared memory ring the socket is still
+    // connected to the admin endpoint (see ManagedAgent::initialize) and
+    // to any endpoint added by connect; the ring is subscribed to the
+    // admin topic too, for admin messages sent through the publisher.
     socketPtr_ = new ::zmq::socket_t(*contextPtr_, ZMQ_SUB);
-    socketPtr_->connect(endpoint_.c_str());
+    if (atp::zmq::ShmRing::is_shm(endpoint_)) {
+      ring_.reset(new atp::zmq::ShmRingReader(endpoint_));
+      ring_->subscribe(getId());
+    } else {
+      socketPtr_->connect(endpoint_.c_str());
+    }
     LOG(INFO) << "Connected to " << endpoint_;
 
     // Set subscriptions
@@ -125,10 +180,22 @@ class MarketDataSubscriber : public ManagedAgent
     return false;
   }
 
+  /// Skip events outside the trading hours of the trading calendar,
+  /// (regular trading hours only if rth) instead of processing them.
+  void setTradingHoursFilter(bool enabled, bool rth = true)
+  {
+    filterTradingHours_ = enabled;
+    rthOnly_ = rth;
+  }
+
   /// Connect to another endpoint IN ADDITION to the current connection(s).
   bool connect(const string& endpoint)
   {
     boost::unique_lock<boost::mutex> lock(mutex_);
+    if (atp::zmq::ShmRing::is_shm(endpoint)) {
+      LOG(ERROR) << "Cannot add a shared memory ring: " << endpoint;
+      return false;
+    }
     if (socketPtr_ != NULL) {
       socketPtr_->connect(endpoint.c_str());
       return true;
@@ -142,6 +209,9 @@ class MarketDataSubscriber : public ManagedAgent
     if (socketPtr_ != NULL) {
       socketPtr_->setsockopt(ZMQ_SUBSCRIBE,
                              topic.c_str(), topic.length());
+      if (ring_) {
+        ring_->subscribe(topic);
+      }
       VARZ_marketdata_subscribes += topic;
       VARZ_marketdata_subscribes += " ";
       return true;
@@ -155,6 +225,9 @@ class MarketDataSubscriber : public ManagedAgent
     if (socketPtr_ != NULL) {
       socketPtr_->setsockopt(ZMQ_UNSUBSCRIBE,
                              topic.c_str(), topic.length());
+      if (ring_) {
+        ring_->unsubscribe(topic);
+      }
       VARZ_marketdata_unsubscribes += topic;
       VARZ_marketdata_unsubscribes += " ";
       return true;
@@ -167,100 +240,84 @@ class MarketDataSubscriber : public ManagedAgent
     offsetLatency_ = value;
   }
 
-  // The event loop.
-  void processInbound()
+  /// Fetches the serialized messages of a gap in the sequence of a topic,
+  /// in order.  Returns false if the range cannot be fetched.
+  typedef boost::function<
+    bool(const string& topic, const sequence_gap_t& gap,
+         vector<string>* messages)> GapFetcher;
+
+  /// Messages missed on a topic, as told by the sequence numbers set by
+  /// the publisher, are always counted.  With a fetcher (e.g. from the
+  /// historian, see historian::GapFetcher), they are also fetched, on a
+  /// thread of their own and at most maxFetchesPerSecond (see
+  /// atp::common::async_gap_fetcher), and processed like the other
+  /// messages by the thread of the topic when it next gets a message --
+  /// after the messages that followed the gap.
+  ///
+  /// conflated - the endpoint is a conflating tier (see
+  ///     atp::zmq::ConflatingPublisher), where market data topics have
+  ///     gaps by design; only market depth gaps are fetched.
+  ///
+  /// Call before processInbound.
+  void setGapRecovery(GapFetcher fetcher, double maxFetchesPerSecond = 10,
+                      bool conflated = false)
   {
-    using namespace boost::posix_time;
-    using namespace historian;
-    using namespace proto::ib;
-    using boost::uint64_t;
+    gapFetcher_ = fetcher;
+    maxFetchesPerSecond_ = maxFetchesPerSecond;
+    conflated_ = conflated;
+  }
 
+  /// Receives on the thread of processInbound but parses and processes on
+  /// shards worker threads.  Messages are assigned to a shard by symbol,
+  /// so the events of a symbol are processed in order while process() is
+  /// called concurrently for different symbols.  Call before
+  /// processInbound; 0 or 1 processes on the receiving thread.
+  void setShards(int shards, size_t queueSize = 8192)
+  {
+    shardCount_ = shards > 1 ? shards : 0;
+    shardQueueSize_ = queueSize;
+  }
 
-    long count = 0;
-    time_duration latencyOffset;
+  // The event loop.
+  void processInbound()
+  {
+    thread_state_t state;
+    if (gapFetcher_) {
+      asyncGapFetcher_.reset(new atp::common::async_gap_fetcher(
+          gapFetcher_, maxFetchesPerSecond_));
+    }
+    startShards();
 
+    bool unflushed = false;  // processed on this thread since flush()
     while (1) {
 
       string frame1, frame2, frame3; // topic, proto
 
+      if (unflushed && !inputReady()) {
+        flush();
+        unflushed = false;
+      }
+
       int more = 1;
       try {
-        if (more) more = atp::zmq::receive(*socketPtr_, &frame1);
+        if (more) more = receive(&frame1);
       } catch (::zmq::error_t e) {
         LOG(ERROR) << "Got exception: " << e.what();
       }
 
       bool continueProcess = true;
-      // check the topic -- for regular data vs. book data
-      if (boost::algorithm::starts_with(frame1, ENTITY_IB_MARKET_DEPTH)) {
-
-        // MarketDepth
-        try {
-          if (more) atp::zmq::receive(*socketPtr_, &frame2);
-        } catch (::zmq::error_t e) {
-          LOG(ERROR) << "Got exception: " << e.what();
-        }
-
-        MarketDepth marketDepth;
-        if (marketDepth.ParseFromString(frame2)) {
-
-          uint64_t ts = marketDepth.timestamp();
-          VARZ_marketdepth_event_interval_micros =
-              ts -VARZ_marketdepth_event_last_ts;
-          VARZ_marketdepth_event_last_ts = ts;
-
-          // Convert timestamp to posix time.
-          ptime t = from_time_t(ts / 1000000LL);
-          time_duration micros(0, 0, 0, ts % 1000000LL);
-          t += micros;
-
-          // Compute the latency from the message's timestamp to now,
-          // accounting for network transport, parsing, etc.
-          ptime now = microsec_clock::universal_time();
-          time_duration total_latency = now - t;
-
-          if (offsetLatency_) {
-            if (++count == 1) {
-              // compute the offset
-              latencyOffset = total_latency;
-              MARKET_DATA_SUBSCRIBER_LOGGER << "Using latency offset "
-                                            << latencyOffset;
-            } else {
-              // compute the true latency with the offset
-              total_latency -= latencyOffset;
-            }
-          }
-
-          uint64_t process_start = now_micros();
-          continueProcess = process(frame1, marketDepth);
-
-          uint64_t process_dt = now_micros() - process_start;
-
-          VARZ_marketdepth_process_latency_micros = process_dt;
-          VARZ_marketdepth_process_latency_micros_total += process_dt;
-          VARZ_marketdepth_process_latency_micros_count++;
-          VARZ_marketdepth_process_latency_drift_micros = now_micros() - ts;
-
-          if (VARZ_marketdepth_process_latency_micros >=
-              VARZ_marketdepth_event_interval_micros) {
-            VARZ_marketdepth_process_latency_over_budget++;
-          }
-        } else {
-          LOG(ERROR) << "Unable to parse: " << frame1 << ", " << frame2;
-        }
-
-      } else if (boost::algorithm::starts_with(frame1, "admin:")) {
+      if (boost::algorithm::starts_with(frame1, "admin:")) {
 
         // Admin message
 
         try {
-          if (more) more = atp::zmq::receive(*socketPtr_, &frame2);
+          if (more) more = receive(&frame2);
         } catch (::zmq::error_t e) {
           LOG(ERROR) << "Got exception: " << e.what();
         }
 
         try {
-          if (more) more = atp::zmq::receive(*socketPtr_, &frame3);
+          if (more) more = receive(&frame3);
         } catch (::zmq::error_t e) {
           LOG(ERROR) << "Got exception: " << e.what();
         }
@@ -270,61 +327,21 @@ class MarketDataSubscriber : public ManagedAgent
 
       } else {
 
-        // MarketData
+        // MarketData or MarketDepth
 
         try {
-          if (more) more = atp::zmq::receive(*socketPtr_, &frame2);
+          if (more) more = receive(&frame2);
         } catch (::zmq::error_t e) {
           LOG(ERROR) << "Got exception: " << e.what();
         }
 
-        MarketData marketData;
-        if (marketData.ParseFromString(frame2)) {
-
-          uint64_t ts = marketData.timestamp();
-          VARZ_marketdata_event_interval_micros =
-              ts -VARZ_marketdata_event_last_ts;
-          VARZ_marketdata_event_last_ts = ts;
-
-          // Compute the latency from the message's timestamp to now,
-          // accounting for network transport, parsing, etc.
-
-          // Convert timestamp to posix time.
-          ptime t = from_time_t(ts / 1000000LL);
-          time_duration micros(0, 0, 0, ts % 1000000LL);
-          t += micros;
-
-          ptime now = microsec_clock::universal_time();
-          time_duration total_latency = now - t;
-
-          if (offsetLatency_) {
-            if (++count == 1) {
-              // compute the offset
-              latencyOffset = total_latency;
-              MARKET_DATA_SUBSCRIBER_LOGGER << "Using latency offset "
-                                            << latencyOffset;
-            } else {
-              // compute the true latency with the offset
-              total_latency -= latencyOffset;
-            }
-          }
-
-          uint64_t process_start = now_micros();
-          continueProcess = process(frame1, marketData);
-
-          uint64_t process_dt = now_micros() - process_start;
-
-          VARZ_marketdata_process_latency_micros = process_dt;
-          VARZ_marketdata_process_latency_micros_total += process_dt;
-          VARZ_marketdata_process_latency_micros_count++;
-          VARZ_marketdata_process_latency_drift_micros = now_micros() - ts;
-
-          if (VARZ_marketdata_process_latency_micros >=
-              VARZ_marketdata_event_interval_micros) {
-            VARZ_marketdata_process_latency_over_budget++;
-          }
+        if (shards_.empty()) {
+          boost::uint64_t received =
+              atp::common::is_traced(frame2) ? now_micros() : 0;
+          continueProcess = processMessage(frame1, frame2, received, &state);
+          unflushed = true;
         } else {
-          LOG(ERROR) << "Unable to parse: " << frame1 << ", " << frame2;
+          continueProcess = dispatch(&frame1, &frame2);
         }
       }
 
@@ -342,6 +359,16 @@ class MarketDataSubscriber : public ManagedAgent
         break;
       }
     }
+    if (unflushed) {
+      flush();
+    }
+
+    // Before the shards, whose states get the fetched gaps.
+    if (asyncGapFetcher_) {
+      asyncGapFetcher_->stop();
+    }
+    stopShards();
+    asyncGapFetcher_.reset();
   }
 
  protected:
@@ -355,6 +382,527 @@ class MarketDataSubscriber : public ManagedAgent
   virtual bool process(const string& topic, const MarketData& data) = 0;
   virtual bool process(const string& topic, const MarketDepth& data) = 0;
 
+  /// Called by a processing thread when it has no more messages to process
+  /// for now, and before it stops, so that subclasses that buffer what they
+  /// process, e.g. to write in batches, do not hold it while idle.  With
+  /// shards, called on each shard thread.
+  virtual void flush() {}
+
+
+ private:
+
+  /// State of a processing thread: the latency offset (see
+  /// setOffsetLatency), the sequences of the topics it processes and the
+  /// messages of their gaps fetched for it.
+  struct thread_state_t
+  {
+    thread_state_t() : count(0) {}
+
+    long count;
+    time_duration offset;
+    sequence_tracker<> sequences;
+    atp::common::fetched_gaps recovered;
+    vector<atp::common::fetched_gap_t> fetched;
+  };
+
+  /// Counts gaps in the sequence of the topic and, with a gap fetcher,
+  /// requests the missed messages for the thread.
+  template <typename Message>
+  void checkSequence(const string& topic, const Message& message,
+                     thread_state_t* state)
+  {
+    if (!message.has_seq()) {
+      return;
+    }
+
+    sequence_gap_t gap;
+    boost::uint64_t resets = state->sequences.resets();
+    typename sequence_tracker<>::result_t result = state->sequences.check(
+        topic, message.publisher_id(), message.seq(), message.timestamp(),
+        &gap);
+    VARZ_marketdata_sequence_resets += state->sequences.resets() - resets;
+    if (result == sequence_tracker<>::STALE) {
+      VARZ_marketdata_sequence_stale++;
+      return;
+    } else if (result != sequence_tracker<>::GAP) {
+      return;
+    }
+
+    VARZ_marketdata_sequence_gaps++;
+    VARZ_marketdata_sequence_missed += gap.size();
+    if (!asyncGapFetcher_) {
+      MARKET_DATA_SUBSCRIBER_LOGGER << "Missed " << gap.size()
+                                    << " messages of " << topic << " from "
+                                    << gap.first;
+      return;
+    }
+    if (conflated_ && !boost::algorithm::starts_with(
+            topic, historian::ENTITY_IB_MARKET_DEPTH)) {
+      VARZ_marketdata_sequence_conflated++;
+      return;
+    }
+    MARKET_DATA_SUBSCRIBER_LOGGER << "Missed " << gap.size() << " messages of "
+                                  << topic << " from " << gap.first;
+    if (!asyncGapFetcher_->request(topic, gap, &state->recovered)) {
+      VARZ_marketdata_sequence_fetch_dropped++;
+    }
+  }
+
+  /// Processes the messages of the gaps fetched for the thread, if any.
+  bool processRecovered(thread_state_t* state)
+  {
+    if (!state->recovered.take(&state->fetched)) {
+      return true;
+    }
+    boost::uint64_t received = now_micros();
+    for (size_t i = 0; i < state->fetched.size(); ++i) {
+      const atp::common::fetched_gap_t& fetched = state->fetched[i];
+      for (size_t j = 0; j < fetched.messages.size(); ++j) {
+        VARZ_marketdata_sequence_recovered++;
+        if (!processRecord(fetched.topic, fetched.messages[j], received,
+                           state, true)) {
+          return false;
+        }
+      }
+    }
+    state->fetched.clear();
+    return true;
+  }
+
+  /// Processes a message or each message of a batch (see
+  /// common/tick_batch.hpp), in order.  received is the time the message
+  /// was read from the socket.
+  bool processMessage(const string& topic, const string& data,
+                      boost::uint64_t received, thread_state_t* state)
+  {
+    if (!processRecovered(state)) {
+      return false;
+    }
+    if (!atp::common::is_tick_batch(data)) {
+      return processRecord(topic, data, received, state);
+    }
+    VARZ_marketdata_batches++;
+    atp::common::tick_batch_reader batch(data);
+    string record;
+    while (batch.next(&record)) {
+      if (!processRecord(topic, record, received, state)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Parses and processes a MarketData or MarketDepth message.  The stages
+  /// of a traced tick are recorded (see varz/trace.hpp).  Recovered
+  /// messages, fetched for a gap, are not checked for gaps again.
+  bool processRecord(const string& topic, const string& data,
+                     boost::uint64_t received, thread_state_t* state,
+                     bool recovered = false)
+  {
+    using namespace boost::posix_time;
+    using namespace historian;
+    using namespace proto::ib;
+    using boost::uint64_t;
+
+    const atp::time::TradingCalendar& calendar =
+        atp::time::TradingCalendar::instance();
+
+    bool continueProcess = true;
+    // check the topic -- for regular data vs. book data
+    if (boost::algorithm::starts_with(topic, ENTITY_IB_MARKET_DEPTH)) {
+
+      MarketDepth marketDepth;
+      bool parsed = marketDepth.ParseFromString(data);
+      if (parsed && !recovered) {
+        checkSequence(topic, marketDepth, state);
+      }
+      if (parsed && filterTradingHours_ &&
+          !calendar.check(marketDepth.timestamp(), rthOnly_)) {
+
+        VARZ_marketdepth_outside_trading_hours++;
+
+      } else if (parsed) {
+
+        uint64_t ts = marketDepth.timestamp();
+        VARZ_marketdepth_event_interval_micros =
+            ts -VARZ_marketdepth_event_last_ts;
+        VARZ_marketdepth_event_last_ts = ts;
+
+        // Convert timestamp to posix time.
+        ptime t = from_time_t(ts / 1000000LL);
+        time_duration micros(0, 0, 0, ts % 1000000LL);
+        t += micros;
+
+        // Compute the latency from the message's timestamp to now,
+        // accounting for network transport, parsing, etc.
+        ptime now = microsec_clock::universal_time();
+        time_duration total_latency = now - t;
+
+        if (offsetLatency_) {
+          if (++state->count == 1) {
+            // compute the offset
+            state->offset = total_latency;
+            MARKET_DATA_SUBSCRIBER_LOGGER << "Using latency offset "
+                                          << state->offset;
+          } else {
+            // compute the true latency with the offset
+            total_latency -= state->offset;
+          }
+        }
+
+        uint64_t process_start = now_micros();
+        continueProcess = process(topic, marketDepth);
+
+        uint64_t process_dt = now_micros() - process_start;
+
+        VARZ_marketdepth_process_latency_micros.Record(process_dt);
+        VARZ_marketdepth_process_latency_micros_total += process_dt;
+        VARZ_marketdepth_process_latency_micros_count++;
+        VARZ_marketdepth_process_latency_drift_micros = now_micros() - ts;
+
+        if (static_cast<atp::varz::int64>(process_dt) >=
+            VARZ_marketdepth_event_interval_micros) {
+          VARZ_marketdepth_process_latency_over_budget++;
+        }
+      } else {
+        LOG(ERROR) << "Unable to parse: " << topic << ", " << data;
+      }
+
+    } else {
+
+      // Either encoding; binary ticks are converted.
+      MarketData marketData;
+      bool parsed = parse_market_data(data, &marketData);
+      bool traced = parsed && atp::common::is_traced(data);
+      if (traced) {
+        atp::varz::Trace(marketData.publisher_id(), marketData.seq(),
+                         atp::varz::TRACE_RECEIVE, received);
+        atp::varz::Trace(marketData.publisher_id(), marketData.seq(),
+                         atp::varz::TRACE_PARSE);
+      }
+      if (parsed && !recovered) {
+        checkSequence(topic, marketData, state);
+      }
+      if (parsed && filterTradingHours_ &&
+          !calendar.check(marketData.timestamp(), rthOnly_)) {
+
+        VARZ_marketdata_outside_trading_hours++;
+
+      } else if (parsed) {
+
+        uint64_t ts = marketData.timestamp();
+        VARZ_marketdata_event_interval_micros =
+            ts -VARZ_marketdata_event_last_ts;
+        VARZ_marketdata_event_last_ts = ts;
+
+        // Compute the latency from the message's timestamp to now,
+        // accounting for network transport, parsing, etc.
+
+        // Convert timestamp to posix time.
+        ptime t = from_time_t(ts / 1000000LL);
+        time_duration micros(0, 0, 0, ts % 1000000LL);
+        t += micros;
+
+        ptime now = microsec_clock::universal_time();
+        time_duration total_latency = now - t;
+
+        if (offsetLatency_) {
+          if (++state->count == 1) {
+            // compute the offset
+            state->offset = total_latency;
+            MARKET_DATA_SUBSCRIBER_LOGGER << "Using latency offset "
+                                          << state->offset;
+          } else {
+            // compute the true latency with the offset
+            total_latency -= state->offset;
+          }
+        }
+
+        uint64_t process_start = now_micros();
+        if (traced) {
+          atp::varz::Trace(marketData.publisher_id(), marketData.seq(),
+                           atp::varz::TRACE_PROCESS, process_start);
+        }
+        {
+          atp::varz::TraceScope scope(traced, marketData.publisher_id(),
+                                      marketData.seq());
+          continueProcess = process(topic, marketData);
+        }
+
+        uint64_t process_dt = now_micros() - process_start;
+        if (traced) {
+          atp::varz::Trace(marketData.publisher_id(), marketData.seq(),
+                           atp::varz::TRACE_PROCESSED,
+                           process_start + process_dt);
+        }
+
+        VARZ_marketdata_process_latency_micros.Record(process_dt);
+        VARZ_marketdata_process_latency_micros_total += process_dt;
+        VARZ_marketdata_process_latency_micros_count++;
+        VARZ_marketdata_process_latency_drift_micros = now_micros() - ts;
+
+        if (static_cast<atp::varz::int64>(process_dt) >=
+            VARZ_marketdata_event_interval_micros) {
+          VARZ_marketdata_process_latency_over_budget++;
+        }
+      } else {
+        LOG(ERROR) << "Unable to parse: " << topic << ", " << data;
+      }
+    }
+    return continueProcess;
+  }
+
+  /// Message handed from the receiving thread to a shard.  The messages
+  /// cycle between the queue and the free list of the shard, so the
+  /// strings keep their capacity and nothing is allocated per message.
+  struct shard_message_t
+  {
+    string topic;
+    string data;
+    boost::uint64_t received;
+  };
+
+  /// Threads of a shard spin briefly on an empty queue, then block.  The
+  /// other side notifies only while one is blocked, so a busy shard costs
+  /// no system calls.
+  struct shard_t : NoCopyAndAssign
+  {
+    // NULL on the queue stops the worker.
+    shard_t(size_t size) :
+        queue(size + 1), free(size), workerWaiting(false),
+        receiverWaiting(false), processed(0), latencyMicros(0)
+    {
+      for (size_t i = 0; i < size; ++i) {
+        messages.push_back(new shard_message_t());
+        free.push(&messages.back());
+      }
+    }
+
+    boost::lockfree::spsc_queue<shard_message_t*> queue;  // to the worker
+    boost::lockfree::spsc_queue<shard_message_t*> free;   // and back
+    boost::ptr_vector<shard_message_t> messages;
+    boost::scoped_ptr<boost::thread> thread;
+
+    boost::mutex mutex;
+    boost::condition_variable queued;  // for the worker
+    boost::condition_variable freed;   // for the receiving thread
+    boost::atomic<bool> workerWaiting;
+    boost::atomic<bool> receiverWaiting;
+
+    size_t size() const
+    {
+      return messages.size();
+    }
+
+    /// Pushes to the worker, waking it if it waits.
+    void push(shard_message_t* message)
+    {
+      queue.push(message);
+      notify(workerWaiting, queued);
+    }
+
+    /// Returns a message to the receiving thread, waking it if it waits.
+    void release(shard_message_t* message)
+    {
+      free.push(message);
+      notify(receiverWaiting, freed);
+    }
+
+    /// Pops from the queue or free list, blocking after a short spin while
+    /// it is empty, until stop is set.
+    bool pop(boost::lockfree::spsc_queue<shard_message_t*>& from,
+             boost::atomic<bool>& waiting, boost::condition_variable& cond,
+             const boost::atomic<bool>& stop, shard_message_t** message)
+    {
+      for (int spin = 0; spin < 100; ++spin) {
+        if (from.pop(*message)) {
+          return true;
+        }
+        boost::this_thread::yield();
+      }
+      boost::unique_lock<boost::mutex> lock(mutex);
+      waiting = true;
+      // Orders the flag before the check of the queue; see notify().
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+      while (!from.pop(*message)) {
+        if (stop) {
+          waiting = false;
+          return false;
+        }
+        cond.wait(lock);
+      }
+      waiting = false;
+      return true;
+    }
+
+    void notify(boost::atomic<bool>& waiting, boost::condition_variable& cond)
+    {
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+      if (waiting.load(boost::memory_order_relaxed)) {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        cond.notify_one();
+      }
+    }
+
+    boost::atomic<boost::int64_t> processed;
+    boost::atomic<boost::int64_t> latencyMicros;  // receive to processed
+  };
+
+  void startShards()
+  {
+    stopped_ = false;
+    for (int i = 0; i < shardCount_; ++i) {
+      shards_.push_back(new shard_t(shardQueueSize_));
+      shards_.back().thread.reset(new boost::thread(
+          boost::bind(&MarketDataSubscriber::runShard, this, &shards_.back())));
+    }
+    if (!shards_.empty()) {
+      LOG(INFO) << "Processing on " << shards_.size() << " shards.";
+    }
+    shardVarzSecond_ = 0;
+  }
+
+  void stopShards()
+  {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      shards_[i].push(NULL);
+    }
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      shards_[i].thread->join();
+    }
+    shards_.clear();
+  }
+
+  /// Hands the message to the shard of its symbol.  The frames are swapped
+  /// out.  Waits while the shard is full.
+  bool dispatch(string* topic, string* data)
+  {
+    using namespace historian;
+
+    // Depth and market data of a symbol go to the same shard.
+    size_t skip = 0;
+    if (boost::algorithm::starts_with(*topic, ENTITY_IB_MARKET_DEPTH)) {
+      skip = ENTITY_IB_MARKET_DEPTH.size() + 1;
+    }
+    size_t hash = boost::hash_range(topic->begin() +
+                                    std::min(skip, topic->size()),
+                                    topic->end());
+    shard_t& shard = shards_[hash % shards_.size()];
+
+    shard_message_t* message = NULL;
+    if (!shard.free.pop(message)) {
+      VARZ_marketdata_shard_queue_full++;
+      if (!shard.pop(shard.free, shard.receiverWaiting, shard.freed,
+                     stopped_, &message)) {
+        return false;
+      }
+    }
+    message->topic.swap(*topic);
+    message->data.swap(*data);
+    message->received = now_micros();
+    shard.push(message);
+
+    updateShardVarz(message->received);
+    return !stopped_;
+  }
+
+  void runShard(shard_t* shard)
+  {
+    thread_state_t state;
+    const boost::atomic<bool> never(false);  // stopped by a NULL message
+    while (true) {
+      shard_message_t* message = NULL;
+      shard->pop(shard->queue, shard->workerWaiting, shard->queued, never,
+                 &message);
+      if (message == NULL) {
+        flush();
+        break;
+      }
+      if (!processMessage(message->topic, message->data, message->received,
+                          &state)) {
+        stopped_ = true;
+      }
+      shard->latencyMicros = now_micros() - message->received;
+      shard->processed++;
+      shard->release(message);
+      if (shard->queue.read_available() == 0) {
+        flush();
+      }
+    }
+  }
+
+  /// Per shard varz, as space delimited values, once a second.
+  void updateShardVarz(boost::uint64_t now)
+  {
+    if (now / 1000000 == shardVarzSecond_) {
+      return;
+    }
+    shardVarzSecond_ = now / 1000000;
+
+    std::ostringstream depth, latency, processed;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      const char* sep = i > 0 ? " " : "";
+      depth << sep << shards_[i].size() - shards_[i].free.read_available();
+      latency << sep << shards_[i].latencyMicros;
+      processed << sep << shards_[i].processed;
+    }
+    VARZ_marketdata_shard_queue_depth = depth.str();
+    VARZ_marketdata_shard_latency_micros = latency.str();
+    VARZ_marketdata_shard_processed = processed.str();
+  }
+
+  /// True if a message can be received without blocking.  A message of the
+  /// ring is read ahead for receive().
+  bool inputReady()
+  {
+    if (!ring_) {
+      ::zmq::pollitem_t item = { *socketPtr_, 0, ZMQ_POLLIN, 0 };
+      return ::zmq::poll(&item, 1, 0) > 0;
+    }
+    if (nextFrame_ < frames_.size()) {
+      return true;
+    }
+    nextFrame_ = 0;
+    if (ring_->receive(&frames_, 0)) {
+      VARZ_marketdata_shm_ring_overruns = ring_->overruns();
+      return true;
+    }
+    frames_.clear();
+    return false;
+  }
+
+  /// Reads the next frame, returning true if more frames of the message
+  /// follow, like atp::zmq::receive.  With a shared memory ring, messages
+  /// of the ring are interleaved with admin messages from the socket: the
+  /// socket is checked every SOCKET_CHECK_MESSAGES messages of a busy ring
+  /// and whenever the ring has been idle for SOCKET_CHECK_MICROS.
+  bool receive(string* frame)
+  {
+    static const int SOCKET_CHECK_MESSAGES = 256;
+    static const boost::int64_t SOCKET_CHECK_MICROS = 10000;
+
+    if (!ring_) {
+      return atp::zmq::receive(*socketPtr_, frame);
+    }
+    while (nextFrame_ >= frames_.size()) {
+      nextFrame_ = 0;
+      if (++ringMessages_ >= SOCKET_CHECK_MESSAGES) {
+        ringMessages_ = 0;
+        if (atp::zmq::receive_frames(*socketPtr_, &frames_,
+                                     atp::zmq::FORWARD_NOBLOCK)) {
+          break;
+        }
+      }
+      if (ring_->receive(&frames_, SOCKET_CHECK_MICROS)) {
+        VARZ_marketdata_shm_ring_overruns = ring_->overruns();
+      } else {
+        ringMessages_ = SOCKET_CHECK_MESSAGES;
+        frames_.clear();
+      }
+    }
+    frame->assign(frames_[nextFrame_++]);
+    return nextFrame_ < frames_.size();
+  }
 
  private:
   string endpoint_;
@@ -363,7 +911,24 @@ class MarketDataSubscriber : public ManagedAgent
   ::zmq::socket_t* socketPtr_;
   bool ownContext_;
   bool offsetLatency_;
+  bool filterTradingHours_;
+  bool rthOnly_;
   boost::mutex mutex_;
+
+  boost::scoped_ptr<atp::zmq::ShmRingReader> ring_;
+  atp::zmq::frames_t frames_;  // message being read from the ring
+  size_t nextFrame_;
+  int ringMessages_;  // since the socket was last checked
+
+  int shardCount_;
+  size_t shardQueueSize_;
+  boost::ptr_vector<shard_t> shards_;
+  boost::atomic<bool> stopped_;  // process() returned false on a shard
+  boost::uint64_t shardVarzSecond_;
+  GapFetcher gapFetcher_;
+  double maxFetchesPerSecond_;
+  bool conflated_;
+  boost::scoped_ptr<atp::common::async_gap_fetcher> asyncGapFetcher_;
 };
 
 } // namespace service
@@ -0,0 +1,150 @@
+#include <limits>
+#include <stdlib.h>
+
+#include "log_levels.h"
+#include "utils.hpp"
+#include "varz/varz.hpp"
+#include "varz/VarzSampler.hpp"
+
+
+namespace atp {
+namespace varz {
+
+
+static bool is_numeric(const std::string& type)
+{
+  return type == "int32" || type == "int64" || type == "uint64" ||
+      type == "double" || type == "counter" || type == "gauge";
+}
+
+// Slots sampled before a varz was first seen.
+static inline bool is_missing(double v)
+{
+  return v != v;
+}
+
+
+VarzSampler::VarzSampler(int intervalMillis, size_t samples) :
+    intervalMillis_(intervalMillis),
+    capacity_(samples < 2 ? 2 : samples),
+    times_(capacity_, 0),
+    next_(0),
+    count_(0)
+{
+}
+
+VarzSampler::~VarzSampler()
+{
+  stop();
+}
+
+void VarzSampler::start()
+{
+  if (!thread_) {
+    thread_.reset(new boost::thread(&VarzSampler::run, this));
+    VARZ_LOGGER << "Sampling varz every " << intervalMillis_ << " msec, "
+                << capacity_ << " samples.";
+  }
+}
+
+void VarzSampler::stop()
+{
+  if (thread_) {
+    thread_->interrupt();
+    thread_->join();
+    thread_.reset();
+  }
+}
+
+void VarzSampler::run()
+{
+  try {
+    while (true) {
+      boost::this_thread::sleep(
+          boost::posix_time::milliseconds(intervalMillis_));
+      sample(now_micros());
+    }
+  } catch (boost::thread_interrupted& e) {
+    VARZ_LOGGER << "Varz sampler stopped.";
+  }
+}
+
+void VarzSampler::sample(boost::uint64_t now)
+{
+  std::vector<VarzInfo> varzs;
+  GetAllVarzs(&varzs);
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  times_[next_] = now;
+  for (std::vector<VarzInfo>::const_iterator varz = varzs.begin();
+       varz != varzs.end();
+       ++varz) {
+    if (!is_numeric(varz->type)) {
+      continue;
+    }
+    std::vector<double>& series = series_[varz->name];
+    if (series.empty()) {
+      series.resize(capacity_, std::numeric_limits<double>::quiet_NaN());
+    }
+    series[next_] = strtod(varz->current_value.c_str(), NULL);
+  }
+  next_ = (next_ + 1) % capacity_;
+  if (count_ < capacity_) {
+    ++count_;
+  }
+}
+
+void VarzSampler::rates(int seconds, std::map<std::string, double>* out) const
+{
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  if (count_ < 2) {
+    return;
+  }
+  size_t steps = (static_cast<size_t>(seconds) * 1000 + intervalMillis_ - 1) /
+      intervalMillis_;
+  if (steps > count_ - 1) {
+    steps = count_ - 1;
+  }
+  if (steps == 0) {
+    steps = 1;
+  }
+  size_t last = (next_ + capacity_ - 1) % capacity_;
+  size_t first = (last + capacity_ - steps) % capacity_;
+  double dt = static_cast<double>(times_[last] - times_[first]) / 1000000.;
+  if (dt <= 0.) {
+    return;
+  }
+  for (std::map<std::string, std::vector<double> >::const_iterator series =
+           series_.begin();
+       series != series_.end();
+       ++series) {
+    double to = series->second[last];
+    double from = series->second[first];
+    if (!is_missing(to) && !is_missing(from)) {
+      (*out)[series->first] = (to - from) / dt;
+    }
+  }
+}
+
+bool VarzSampler::history(const std::string& name,
+                          std::vector<point_t>* out) const
+{
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  std::map<std::string, std::vector<double> >::const_iterator series =
+      series_.find(name);
+  if (series == series_.end()) {
+    return false;
+  }
+  size_t first = (next_ + capacity_ - count_) % capacity_;
+  for (size_t i = 0; i < count_; ++i) {
+    size_t slot = (first + i) % capacity_;
+    if (!is_missing(series->second[slot])) {
+      out->push_back(point_t(times_[slot], series->second[slot]));
+    }
+  }
+  return true;
+}
+
+
+} // namespace varz
+} // namespace atp
@@ -0,0 +1,73 @@
+#ifndef ATP_VARZ_SAMPLER_H_
+#define ATP_VARZ_SAMPLER_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+
+namespace atp {
+namespace varz {
+
+
+/// Samples every numeric varz (ints, doubles, counters and gauges) at a
+/// fixed interval into a ring holding the last `samples` samples, so
+/// rates and recent history can be served without clients polling and
+/// diffing the varz themselves.  Sampling runs on its own thread between
+/// start() and stop(); the accessors may be called from any thread.
+class VarzSampler
+{
+ public:
+
+  typedef std::pair<boost::uint64_t, double> point_t;  // micros, value
+
+  VarzSampler(int intervalMillis = 1000, size_t samples = 600);
+  ~VarzSampler();
+
+  void start();
+
+  void stop();
+
+  int intervalMillis() const
+  {
+    return intervalMillis_;
+  }
+
+  /// Takes a sample of all numeric varz as of now (micros).  Called by the
+  /// sampling thread, or directly.
+  void sample(boost::uint64_t now);
+
+  /// Per second change of each varz over the last `seconds`, or over the
+  /// history there is if shorter.  Varz with less than two samples in the
+  /// window are left out.
+  void rates(int seconds, std::map<std::string, double>* out) const;
+
+  /// Samples of the varz, oldest first.  Returns false if unknown.
+  bool history(const std::string& name, std::vector<point_t>* out) const;
+
+ private:
+
+  void run();
+
+  const int intervalMillis_;
+  const size_t capacity_;
+
+  mutable boost::mutex mutex_;
+  std::vector<boost::uint64_t> times_;
+  std::map<std::string, std::vector<double> > series_;
+  size_t next_;   // slot of the next sample
+  size_t count_;  // samples in the ring
+
+  boost::scoped_ptr<boost::thread> thread_;
+};
+
+
+} // namespace varz
+} // namespace atp
+
+#endif //ATP_VARZ_SAMPLER_H_
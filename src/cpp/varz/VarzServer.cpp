@@ -1,19 +1,27 @@
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 #include <map>
+#include <stdarg.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <vector>
 
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
 
 extern "C" {
 #include "mongoose/mongoose.h"
 }
 
 #include "log_levels.h"
+#include "varz/profiler.hpp"
 #include "varz/varz.hpp"
+#include "varz/VarzSampler.hpp"
 #include "varz/VarzServer.hpp"
+#include "varz/trace.hpp"
 
 
 namespace atp {
@@ -34,6 +42,257 @@ static const char * HTTP_200 =
   "Content-Type: application/json; charset=utf-8\r\n"
   "\r\n";
 
+static const char * HTTP_200_TEXT =
+  "HTTP/1.1 200 OK\r\n"
+  "Cache: no-cache\r\n"
+  "Content-Type: text/plain; charset=utf-8\r\n"
+  "\r\n";
+
+static const char * HTTP_409 =
+  "HTTP/1.1 409 Conflict\r\n"
+  "Cache: no-cache\r\n"
+  "Content-Type: application/json; charset=utf-8\r\n"
+  "\r\n";
+
+static const char * HTTP_404 =
+  "HTTP/1.1 404 Not Found\r\n"
+  "Cache: no-cache\r\n"
+  "Content-Type: application/json; charset=utf-8\r\n"
+  "\r\n";
+
+// Bounds of /profile, which holds a server thread for its duration.
+static const int PROFILE_SECONDS = 5;
+static const int PROFILE_MAX_SECONDS = 60;
+static const int PROFILE_HZ = 100;
+static const int PROFILE_MAX_HZ = 1000;
+
+// Call sites listed by /heap.
+static const size_t HEAP_TOP_SITES = 100;
+
+// Windows of /varz/rates, in seconds.
+static const int RATE_WINDOWS[] = { 1, 10, 60 };
+static const size_t RATE_WINDOWS_COUNT =
+    sizeof(RATE_WINDOWS) / sizeof(RATE_WINDOWS[0]);
+
+// Responses are rendered into a buffer kept by each server thread, so
+// the memory is reused across requests, and written in one call.
+static boost::thread_specific_ptr<std::string> response_buffer;
+
+static std::string& response(const char* header)
+{
+  if (response_buffer.get() == NULL) {
+    response_buffer.reset(new std::string());
+  }
+  std::string& buffer = *response_buffer;
+  buffer.assign(header);
+  return buffer;
+}
+
+static void appendf(std::string* out, const char* fmt, ...)
+{
+  char buff[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buff, sizeof(buff), fmt, args);
+  va_end(args);
+  if (n > 0) {
+    out->append(buff, std::min(static_cast<size_t>(n), sizeof(buff) - 1));
+  }
+}
+
+// Appends s as the body of a JSON string, for values from the request.
+static void append_json_escaped(std::string* out, const char* s)
+{
+  for (; *s != '\0'; ++s) {
+    unsigned char c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      appendf(out, "\\u%04x", c);
+    } else {
+      out->push_back(c);
+    }
+  }
+}
+
+static void send(struct mg_connection *conn, const std::string& response)
+{
+  mg_write(conn, response.data(), response.size());
+}
+
+static void varz(struct mg_connection *conn)
+{
+  using namespace std;
+
+  string& out = response(HTTP_200);
+  out += "{";
+
+  vector<VarzInfo> varzs;
+  GetAllVarzs(&varzs);
+  int i = 0;
+  for (vector<VarzInfo>::iterator varz = varzs.begin();
+       varz != varzs.end();
+       ++varz) {
+    out += (i++ == 0) ? "\n\"" : ",\n\"";
+    out += varz->name;
+    if (varz->type == "string") {
+      out += "\" : \"";
+      out += varz->current_value;
+      out += "\"";
+    } else {
+      out += "\" : ";
+      out += varz->current_value;
+    }
+  }
+  out += "\n}\n";
+  send(conn, out);
+}
+
+static void rates(struct mg_connection *conn, const VarzSampler& sampler)
+{
+  using namespace std;
+
+  vector<map<string, double> > rates(RATE_WINDOWS_COUNT);
+  for (size_t w = 0; w < RATE_WINDOWS_COUNT; ++w) {
+    sampler.rates(RATE_WINDOWS[w], &rates[w]);
+  }
+
+  string& out = response(HTTP_200);
+  out += "{";
+  int i = 0;
+  for (map<string, double>::const_iterator varz = rates[0].begin();
+       varz != rates[0].end();
+       ++varz) {
+    out += (i++ == 0) ? "\n\"" : ",\n\"";
+    out += varz->first;
+    out += "\" : {";
+    for (size_t w = 0; w < RATE_WINDOWS_COUNT; ++w) {
+      map<string, double>::const_iterator rate = rates[w].find(varz->first);
+      if (rate != rates[w].end()) {
+        appendf(&out, "%s\"%ds\" : %.3f", (w == 0) ? " " : ", ",
+                RATE_WINDOWS[w], rate->second);
+      }
+    }
+    out += " }";
+  }
+  out += "\n}\n";
+  send(conn, out);
+}
+
+static void history(struct mg_connection *conn,
+                    const struct mg_request_info *request_info,
+                    const VarzSampler& sampler)
+{
+  using namespace std;
+
+  char name[256];
+  get_qsvar(request_info, "name", name, sizeof(name));
+
+  vector<VarzSampler::point_t> points;
+  if (!sampler.history(name, &points)) {
+    string& out = response(HTTP_404);
+    out += "{ \"error\" : \"no numeric varz ";
+    append_json_escaped(&out, name);
+    out += "\" }\n";
+    send(conn, out);
+    return;
+  }
+
+  string& out = response(HTTP_200);
+  out += "{ \"name\" : \"";
+  append_json_escaped(&out, name);
+  appendf(&out, "\", \"interval_millis\" : %d,\n"
+          "  \"samples\" : [", sampler.intervalMillis());
+  for (size_t i = 0; i < points.size(); ++i) {
+    appendf(&out, "%s[%llu, %.17g]", (i == 0) ? "\n    " : ",\n    ",
+            static_cast<unsigned long long>(points[i].first),
+            points[i].second);
+  }
+  out += " ]\n}\n";
+  send(conn, out);
+}
+
+static void traces(struct mg_connection *conn)
+{
+  using namespace std;
+
+  vector<TraceRecord> records;
+  Traces().Dump(&records);
+
+  string& out = response(HTTP_200);
+  appendf(&out, "{ \"pid\" : %d,\n  \"records\" : [",
+          static_cast<int>(getpid()));
+  for (size_t i = 0; i < records.size(); ++i) {
+    appendf(&out, "%s[%llu, %llu, \"%s\", %llu]",
+            (i == 0) ? "\n    " : ",\n    ",
+            static_cast<unsigned long long>(records[i].publisher_id),
+            static_cast<unsigned long long>(records[i].seq),
+            TraceStageName(records[i].stage),
+            static_cast<unsigned long long>(records[i].micros));
+  }
+  out += " ]\n}\n";
+  send(conn, out);
+}
+
+static int get_qsint(const struct mg_request_info *request_info,
+                     const char *name, int default_value,
+                     int min_value, int max_value)
+{
+  char value[32];
+  get_qsvar(request_info, name, value, sizeof(value));
+  int v = (value[0] == 0) ? default_value : atoi(value);
+  return std::max(min_value, std::min(max_value, v));
+}
+
+static void profile(struct mg_connection *conn,
+                    const struct mg_request_info *request_info)
+{
+  using namespace std;
+
+  int seconds = get_qsint(request_info, "seconds", PROFILE_SECONDS,
+                          1, PROFILE_MAX_SECONDS);
+  int hz = get_qsint(request_info, "hz", PROFILE_HZ, 1, PROFILE_MAX_HZ);
+
+  string folded;
+  if (!ProfileCpu(seconds, hz, &folded)) {
+    string& out = response(HTTP_409);
+    out += "{ \"error\" : \"a profile is already running\" }\n";
+    send(conn, out);
+    return;
+  }
+  string& out = response(HTTP_200_TEXT);
+  out += folded;
+  send(conn, out);
+}
+
+static void heap(struct mg_connection *conn)
+{
+  using namespace std;
+
+  vector<HeapSite> sites;
+  HeapSites(&sites);
+
+  string& out = response(HTTP_200);
+  appendf(&out, "{ \"enabled\" : %s,\n  \"sites\" : [",
+          HeapProfileEnabled() ? "true" : "false");
+  for (size_t i = 0; i < sites.size() && i < HEAP_TOP_SITES; ++i) {
+    appendf(&out, "%s{ \"allocations\" : %llu, \"bytes\" : %llu, ",
+            (i == 0) ? "\n    " : ",\n    ",
+            static_cast<unsigned long long>(sites[i].allocations),
+            static_cast<unsigned long long>(sites[i].bytes));
+    // Names may be longer than appendf takes.
+    string site = (sites[i].address == NULL) ?
+        string("(other)") : SymbolOf(sites[i].address);
+    replace(site.begin(), site.end(), '"', '\'');
+    out += "\"site\" : \"";
+    out += site;
+    out += "\" }";
+  }
+  out += " ]\n}\n";
+  send(conn, out);
+}
+
 static void *event_handler(enum mg_event event,
                            struct mg_connection *conn,
                            const struct mg_request_info *request_info) {
@@ -46,6 +305,9 @@ static void *event_handler(enum mg_event event,
   VARZ_LOGGER << "Request uri = " << request_info->uri
               << " query string = " << request_info->query_string;
 
+  const VarzSampler* sampler =
+      reinterpret_cast<const VarzSampler*>(request_info->user_data);
+
   if (event == MG_NEW_REQUEST) {
 
     if (strcmp(request_info->uri, "/echo") == 0) {
@@ -61,24 +323,34 @@ static void *event_handler(enum mg_event event,
     } else if (strcmp(request_info->uri, "/varz") == 0) {
 
       VARZ_DEBUG << "varz request";
-      mg_printf(conn, "%s", HTTP_200);
-      mg_printf(conn, "%s", "{");
-
-      vector<VarzInfo> varzs;
-      GetAllVarzs(&varzs);
-      int i = 0;
-      for (vector<VarzInfo>::iterator varz = varzs.begin();
-           varz != varzs.end();
-           ++varz) {
-
-        const std::string fmt = (varz->type == "string") ?
-            "%s\"%s\" : \"%s\"" : "%s\"%s\" : %s";
-        mg_printf(conn, fmt.c_str(),
-                  ((i++ == 0) ? "\n" : ",\n"),
-                  varz->name.c_str(), varz->current_value.c_str());
-      }
+      varz(conn);
+
+    } else if (strcmp(request_info->uri, "/varz/rates") == 0 &&
+               sampler != NULL) {
+
+      VARZ_DEBUG << "varz rates request";
+      rates(conn, *sampler);
+
+    } else if (strcmp(request_info->uri, "/varz/history") == 0 &&
+               sampler != NULL) {
+
+      VARZ_DEBUG << "varz history request";
+      history(conn, request_info, *sampler);
+
+    } else if (strcmp(request_info->uri, "/varz/traces") == 0) {
+
+      VARZ_DEBUG << "varz traces request";
+      traces(conn);
+
+    } else if (strcmp(request_info->uri, "/profile") == 0) {
+
+      VARZ_DEBUG << "profile request";
+      profile(conn, request_info);
+
+    } else if (strcmp(request_info->uri, "/heap") == 0) {
 
-      mg_printf(conn, "\n%s\n", "}");
+      VARZ_DEBUG << "heap request";
+      heap(conn);
 
     } else {
       // No suitable handler found, mark as not processed. Mongoose will
@@ -141,9 +413,11 @@ class MongooseConfig
 class VarzServer::implementation
 {
  public:
-  implementation(int port, int num_threads) :
+  implementation(int port, int num_threads, int sample_millis,
+                 size_t samples) :
       port_(port),
       numThreads_(num_threads),
+      sampler_(sample_millis, samples),
       serverContext_(NULL),
       running_(false)
   {
@@ -165,7 +439,8 @@ class VarzServer::implementation
       MongooseConfig config;
       config.setPort(port_);
       config.setThreads(numThreads_);
-      serverContext_ = mg_start(&event_handler, NULL, config);
+      serverContext_ = mg_start(&event_handler, &sampler_, config);
+      sampler_.start();
 
       VARZ_LOGGER << "Varz server listening on " << port_
                   << " with " << numThreads_ << " threads.";
@@ -181,6 +456,7 @@ class VarzServer::implementation
     if (serverContext_ != NULL && running_) {
       VARZ_LOGGER << "Stopping context.";
       mg_stop(serverContext_);
+      sampler_.stop();
       running_ = false;
     }
   }
@@ -188,13 +464,15 @@ class VarzServer::implementation
  private:
   int port_;
   int numThreads_;
+  VarzSampler sampler_;
   struct mg_context* serverContext_;
   bool running_;
   boost::mutex mutex_;
 };
 
-VarzServer::VarzServer(int port, int num_threads) :
-    impl_(new implementation(port, num_threads))
+VarzServer::VarzServer(int port, int num_threads, int sample_millis,
+                       size_t samples) :
+    impl_(new implementation(port, num_threads, sample_millis, samples))
 {
 }
 
@@ -1,16 +1,33 @@
 #ifndef ATP_VARZ_SERVER_H_
 #define ATP_VARZ_SERVER_H_
 
+#include <stddef.h>
+
 #include <boost/scoped_ptr.hpp>
 
 namespace atp {
 namespace varz {
 
-/// Http server for VARZ monitoring
+/// Http server for VARZ monitoring.  Serves
+///
+///   /varz                  current values
+///   /varz/rates            per second change of the numeric varz over the
+///                          last 1, 10 and 60 seconds
+///   /varz/history?name=x   recent samples of a numeric varz
+///   /varz/traces           trace records of sampled ticks (see trace.hpp)
+///   /profile?seconds=n     cpu profile of the process as folded stacks,
+///                          for flamegraph.pl (see profiler.hpp)
+///   /heap                  allocations by call site, if built with
+///                          ATP_HEAP_PROFILE
+///
+/// Rates and history come from sampling every sample_millis, keeping the
+/// last `samples`.  A profile holds one of the num_threads server threads
+/// until it is done.
 class VarzServer
 {
  public:
-  VarzServer(int port, int num_threads = 2);
+  VarzServer(int port, int num_threads = 2, int sample_millis = 1000,
+             size_t samples = 600);
   ~VarzServer();
 
   /// Starts the varz server
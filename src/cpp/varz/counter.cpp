@@ -0,0 +1,60 @@
+#include <stdlib.h>
+
+#include <new>
+
+#include "varz/counter.hpp"
+
+
+namespace atp {
+namespace varz {
+
+namespace internal {
+
+__thread int thread_slot = -1;
+
+static boost::atomic<int> next_slot(0);
+
+int claim_thread_slot()
+{
+  int slot = next_slot.fetch_add(1, boost::memory_order_relaxed);
+  return slot < Counter::SLOTS ? slot : Counter::SLOTS;
+}
+
+} // namespace internal
+
+
+const int Counter::SLOTS;
+
+Counter::Counter()
+{
+  for (int i = 0; i <= SLOTS; ++i) {
+    slots_[i].value.store(0, boost::memory_order_relaxed);
+  }
+}
+
+void* Counter::operator new(std::size_t size)
+{
+  void* p = NULL;
+  if (posix_memalign(&p, __alignof__(Counter), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void Counter::operator delete(void* p)
+{
+  free(p);
+}
+
+boost::int64_t Counter::Value() const
+{
+  boost::int64_t sum = 0;
+  for (int i = 0; i <= SLOTS; ++i) {
+    sum += slots_[i].value.load(boost::memory_order_relaxed);
+  }
+  return sum;
+}
+
+
+} // namespace varz
+} // namespace atp
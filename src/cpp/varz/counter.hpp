@@ -0,0 +1,167 @@
+#ifndef ATP_VARZ_COUNTER_H_
+#define ATP_VARZ_COUNTER_H_
+
+#include <cstddef>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+
+namespace atp {
+namespace varz {
+
+
+namespace internal {
+
+/// Slot of the calling thread in every Counter, assigned on first use.
+extern __thread int thread_slot;
+int claim_thread_slot();
+
+} // namespace internal
+
+
+/// Counter updated by many threads, e.g. messages handled by the threads
+/// of a pool (see DEFINE_VARZ_counter).  Each thread adds to its own slot,
+/// on its own cache line, with a plain load and store, so counting costs
+/// about as much as ++ on an int64 and threads never contend.  Reading
+/// sums the slots.
+///
+/// The first SLOTS threads to count get a slot of their own; threads
+/// beyond that share one slot, updated atomically.
+class Counter
+{
+ public:
+
+  static const int SLOTS = 32;
+
+  Counter();
+
+  // Heap counters, e.g. the values of varz, keep the slots on their own
+  // cache lines; plain new only guarantees 16 byte alignment.
+  static void* operator new(std::size_t size);
+  static void operator delete(void* p);
+
+  void Add(boost::int64_t n)
+  {
+    int slot = internal::thread_slot;
+    if (slot < 0) {
+      slot = internal::thread_slot = internal::claim_thread_slot();
+    }
+    boost::atomic<boost::int64_t>& value = slots_[slot].value;
+    if (slot < SLOTS) {
+      // Only this thread writes the slot.
+      value.store(value.load(boost::memory_order_relaxed) + n,
+                  boost::memory_order_relaxed);
+    } else {
+      value.fetch_add(n, boost::memory_order_relaxed);
+    }
+  }
+
+  Counter& operator++()
+  {
+    Add(1);
+    return *this;
+  }
+
+  void operator++(int)
+  {
+    Add(1);
+  }
+
+  Counter& operator+=(boost::int64_t n)
+  {
+    Add(n);
+    return *this;
+  }
+
+  /// Sum of the slots; counts being added concurrently may be missed.
+  boost::int64_t Value() const;
+
+  operator boost::int64_t() const
+  {
+    return Value();
+  }
+
+ private:
+
+  struct slot_t
+  {
+    boost::atomic<boost::int64_t> value;
+  } __attribute__((aligned(64)));
+
+  slot_t slots_[SLOTS + 1];  // last one is shared
+};
+
+
+/// Value set and read atomically by any thread, e.g. a queue depth or
+/// the timestamp of the last message (see DEFINE_VARZ_gauge).
+class Gauge
+{
+ public:
+
+  explicit Gauge(boost::int64_t value = 0) : value_(value) {}
+
+  Gauge(const Gauge& other) : value_(other.Value()) {}
+
+  Gauge& operator=(boost::int64_t value)
+  {
+    value_.store(value, boost::memory_order_relaxed);
+    return *this;
+  }
+
+  Gauge& operator=(const Gauge& other)
+  {
+    return *this = other.Value();
+  }
+
+  Gauge& operator+=(boost::int64_t n)
+  {
+    value_.fetch_add(n, boost::memory_order_relaxed);
+    return *this;
+  }
+
+  Gauge& operator-=(boost::int64_t n)
+  {
+    value_.fetch_sub(n, boost::memory_order_relaxed);
+    return *this;
+  }
+
+  Gauge& operator++()
+  {
+    return *this += 1;
+  }
+
+  void operator++(int)
+  {
+    *this += 1;
+  }
+
+  /// Sets the value to v if v is larger.
+  void Max(boost::int64_t v)
+  {
+    boost::int64_t current = value_.load(boost::memory_order_relaxed);
+    while (v > current &&
+           !value_.compare_exchange_weak(current, v,
+                                         boost::memory_order_relaxed)) {
+    }
+  }
+
+  boost::int64_t Value() const
+  {
+    return value_.load(boost::memory_order_relaxed);
+  }
+
+  operator boost::int64_t() const
+  {
+    return Value();
+  }
+
+ private:
+  boost::atomic<boost::int64_t> value_;
+};
+
+
+} // namespace varz
+} // namespace atp
+
+#endif  // ATP_VARZ_COUNTER_H_
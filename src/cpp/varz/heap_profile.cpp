@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+
+#include "varz/profiler.hpp"
+
+
+namespace atp {
+namespace varz {
+
+
+#ifdef ATP_HEAP_PROFILE
+
+namespace internal {
+
+// Open addressed table of call sites, zero initialized before any
+// allocation and updated with atomic builtins, so counting never
+// allocates or locks.  Sites past the table are counted as address 0.
+static const size_t HEAP_SITES = 1 << 14;
+static const size_t MAX_PROBES = 64;
+
+static uintptr_t site_address[HEAP_SITES];
+static boost::uint64_t site_allocations[HEAP_SITES];
+static boost::uint64_t site_bytes[HEAP_SITES];
+
+static inline void count_allocation(const void* caller, size_t size)
+{
+  uintptr_t address = reinterpret_cast<uintptr_t>(caller);
+  size_t slot = static_cast<size_t>(
+      (address >> 4) * 0x9E3779B97F4A7C15ULL) & (HEAP_SITES - 1);
+  for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+    uintptr_t current = site_address[slot];
+    if (current == 0) {
+      current = __sync_val_compare_and_swap(&site_address[slot], 0, address);
+      if (current == 0) {
+        current = address;
+      }
+    }
+    if (current == address) {
+      __sync_fetch_and_add(&site_allocations[slot], 1);
+      __sync_fetch_and_add(&site_bytes[slot], size);
+      return;
+    }
+    slot = (slot + 1) & (HEAP_SITES - 1);
+  }
+  // Full; slot 0 of the table is never claimed by address 0.
+  __sync_fetch_and_add(&site_allocations[0], 1);
+  __sync_fetch_and_add(&site_bytes[0], size);
+}
+
+static inline void* allocate(size_t size, const void* caller)
+{
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p != NULL) {
+    count_allocation(caller, size);
+  }
+  return p;
+}
+
+static bool by_bytes(const HeapSite& a, const HeapSite& b)
+{
+  return a.bytes > b.bytes;
+}
+
+} // namespace internal
+
+bool HeapProfileEnabled()
+{
+  return true;
+}
+
+void HeapSites(std::vector<HeapSite>* sites)
+{
+  using namespace internal;
+  for (size_t i = 0; i < HEAP_SITES; ++i) {
+    if (site_allocations[i] > 0) {
+      HeapSite site;
+      site.address = reinterpret_cast<const void*>(site_address[i]);
+      site.allocations = site_allocations[i];
+      site.bytes = site_bytes[i];
+      sites->push_back(site);
+    }
+  }
+  std::sort(sites->begin(), sites->end(), by_bytes);
+}
+
+#else
+
+bool HeapProfileEnabled()
+{
+  return false;
+}
+
+void HeapSites(std::vector<HeapSite>* sites)
+{
+}
+
+#endif  // ATP_HEAP_PROFILE
+
+
+} // namespace varz
+} // namespace atp
+
+
+#ifdef ATP_HEAP_PROFILE
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+  void* p = atp::varz::internal::allocate(size, __builtin_return_address(0));
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+  void* p = atp::varz::internal::allocate(size, __builtin_return_address(0));
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+  return atp::varz::internal::allocate(size, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+  return atp::varz::internal::allocate(size, __builtin_return_address(0));
+}
+
+void operator delete(void* p) throw()
+{
+  free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+  free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+  free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+  free(p);
+}
+
+#endif  // ATP_HEAP_PROFILE
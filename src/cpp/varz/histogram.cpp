@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "varz/histogram.hpp"
+
+
+namespace atp {
+namespace varz {
+
+
+const int Histogram::SUB_BUCKET_BITS;
+const boost::uint64_t Histogram::SUB_BUCKETS;
+const int Histogram::MAX_VALUE_BITS;
+const size_t Histogram::BUCKETS;
+
+Histogram::Histogram()
+{
+  Clear();
+}
+
+void Histogram::Clear()
+{
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  sum_ = 0;
+  last_ = 0;
+  max_ = 0;
+}
+
+boost::uint64_t Histogram::Percentile(double fraction) const
+{
+  // The buckets rather than count_, which may be off by a racing update.
+  boost::uint64_t total = 0;
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    total += counts_[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  boost::uint64_t rank = static_cast<boost::uint64_t>(fraction * total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  boost::uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      boost::uint64_t value = BucketMax(i);
+      return value < max_ ? value : max_;
+    }
+  }
+  return max_;
+}
+
+std::string Histogram::ToString() const
+{
+  char buffer[256];
+  snprintf(buffer, sizeof(buffer),
+           "{ \"count\" : %llu, \"mean\" : %.1f, \"p50\" : %llu, "
+           "\"p90\" : %llu, \"p99\" : %llu, \"p999\" : %llu, "
+           "\"max\" : %llu }",
+           static_cast<unsigned long long>(count_), Mean(),
+           static_cast<unsigned long long>(Percentile(0.5)),
+           static_cast<unsigned long long>(Percentile(0.9)),
+           static_cast<unsigned long long>(Percentile(0.99)),
+           static_cast<unsigned long long>(Percentile(0.999)),
+           static_cast<unsigned long long>(max_));
+  return buffer;
+}
+
+
+} // namespace varz
+} // namespace atp
@@ -0,0 +1,120 @@
+#ifndef ATP_VARZ_HISTOGRAM_H_
+#define ATP_VARZ_HISTOGRAM_H_
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+
+namespace atp {
+namespace varz {
+
+
+/// Distribution of non-negative values, typically latencies in micros,
+/// for varz that need more than the last sample (see
+/// DEFINE_VARZ_histogram).  Buckets are log-linear as in HDR histograms:
+/// values below 2 * SUB_BUCKETS are counted exactly, and every power of
+/// two above is split in SUB_BUCKETS linear buckets, so a percentile is
+/// within 1 / SUB_BUCKETS (3%) of the true value.  Record is a few
+/// instructions with no locking or allocation.
+///
+/// Unlike Counter and Gauge, concurrent updates are not synchronized; under
+/// contention an update may occasionally be lost.
+class Histogram
+{
+ public:
+
+  static const int SUB_BUCKET_BITS = 5;
+  static const boost::uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+  // Values at or above are counted in the last bucket.  2^40 micros is
+  // about 12 days.
+  static const int MAX_VALUE_BITS = 40;
+  static const size_t BUCKETS =
+      (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  Histogram();
+
+  void Record(boost::uint64_t value)
+  {
+    ++counts_[BucketOf(value)];
+    ++count_;
+    sum_ += value;
+    last_ = value;
+    if (value > max_) {
+      max_ = value;
+    }
+  }
+
+  void Record(boost::int64_t value)
+  {
+    Record(static_cast<boost::uint64_t>(value < 0 ? 0 : value));
+  }
+
+  void Clear();
+
+  boost::uint64_t Count() const
+  {
+    return count_;
+  }
+
+  /// The last value recorded.
+  boost::uint64_t Last() const
+  {
+    return last_;
+  }
+
+  boost::uint64_t Max() const
+  {
+    return max_;
+  }
+
+  double Mean() const
+  {
+    return count_ == 0 ? 0. : static_cast<double>(sum_) / count_;
+  }
+
+  /// Smallest value, to the precision of the buckets, at or above the
+  /// given fraction (e.g. 0.99) of the values recorded.  0 if empty.
+  boost::uint64_t Percentile(double fraction) const;
+
+  /// As a json object of count, mean, p50, p90, p99, p999 and max.
+  std::string ToString() const;
+
+  static size_t BucketOf(boost::uint64_t value)
+  {
+    if (value < 2 * SUB_BUCKETS) {
+      return static_cast<size_t>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= MAX_VALUE_BITS) {
+      return BUCKETS - 1;
+    }
+    int shift = msb - SUB_BUCKET_BITS;
+    return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+  }
+
+  /// Largest value counted in the bucket.
+  static boost::uint64_t BucketMax(size_t bucket)
+  {
+    if (bucket < 2 * SUB_BUCKETS) {
+      return bucket;
+    }
+    int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    boost::uint64_t low = (bucket - shift * SUB_BUCKETS) << shift;
+    return low + (static_cast<boost::uint64_t>(1) << shift) - 1;
+  }
+
+ private:
+  boost::uint64_t counts_[BUCKETS];
+  boost::uint64_t count_;
+  boost::uint64_t sum_;
+  boost::uint64_t last_;
+  boost::uint64_t max_;
+};
+
+
+} // namespace varz
+} // namespace atp
+
+#endif  // ATP_VARZ_HISTOGRAM_H_
@@ -0,0 +1,274 @@
+#include <cxxabi.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <map>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+
+#include "log_levels.h"
+#include "varz/profiler.hpp"
+
+
+namespace atp {
+namespace varz {
+
+
+namespace internal {
+
+static const int MAX_DEPTH = 64;
+
+// Bounds the buffer of a profile, about 130MB; samples past it are counted
+// as dropped.
+static const size_t MAX_SAMPLES = 1 << 18;
+
+// Largest frame walked; a bigger step is taken for the end of the chain.
+static const uintptr_t MAX_FRAME_BYTES = 1 << 20;
+
+struct stack_sample_t
+{
+  int depth;
+  void* frames[MAX_DEPTH];
+};
+
+// The buffer of the profile running, NULL when none.  The handler stays
+// installed once set, since a SIGPROF can still be pending when a profile
+// stops and the default action would kill the process.
+static boost::atomic<stack_sample_t*> samples(NULL);
+static size_t capacity = 0;
+static boost::atomic<size_t> taken(0);
+static boost::atomic<int> in_handler(0);
+static bool installed = false;
+
+static boost::mutex profile_mutex;
+
+// Whether the word at address can be read: msync fails with ENOMEM for a
+// range not mapped.  A system call, so safe in the handler.
+static bool readable(uintptr_t address, uintptr_t* checked_page)
+{
+  static const uintptr_t PAGE = 4096;
+  uintptr_t page = address & ~(PAGE - 1);
+  if (page == *checked_page) {
+    return true;
+  }
+  if (msync(reinterpret_cast<void*>(page), PAGE, MS_ASYNC) != 0) {
+    return false;
+  }
+  *checked_page = page;
+  return true;
+}
+
+// Walks the frame pointers from the interrupted context; backtrace is not
+// async-signal-safe.  Frames built without a frame pointer are skipped
+// (their caller shows instead), and with -fomit-frame-pointer throughout a
+// stack may end early.  Returns the number of frames, the interrupted pc
+// first and return addresses after.
+static int walk_frames(const void* context, void** frames, int max)
+{
+  const ucontext_t* uc = static_cast<const ucontext_t*>(context);
+#if defined(__linux__) && defined(__x86_64__)
+  uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+  uintptr_t sp = uc->uc_mcontext.gregs[REG_RSP];
+  uintptr_t fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__linux__) && defined(__aarch64__)
+  uintptr_t pc = uc->uc_mcontext.pc;
+  uintptr_t sp = uc->uc_mcontext.sp;
+  uintptr_t fp = uc->uc_mcontext.regs[29];
+#else
+  return 0;
+#endif
+  int depth = 0;
+  frames[depth++] = reinterpret_cast<void*>(pc);
+
+  // Frames are above the stack pointer, and each above the one it calls.
+  uintptr_t checked_page = 0;
+  uintptr_t below = sp;
+  while (depth < max && fp > below && fp - below < MAX_FRAME_BYTES &&
+         (fp & (sizeof(uintptr_t) - 1)) == 0 &&
+         readable(fp, &checked_page) &&
+         readable(fp + sizeof(uintptr_t), &checked_page)) {
+    const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+    if (frame[1] == 0) {
+      break;
+    }
+    frames[depth++] = reinterpret_cast<void*>(frame[1]);
+    below = fp;
+    fp = frame[0];
+  }
+  return depth;
+}
+
+static void on_sigprof(int, siginfo_t*, void* context)
+{
+  int saved_errno = errno;
+  // Counted in before looking at the buffer, for the profile to wait for
+  // the handlers that saw it before it is freed.
+  in_handler.fetch_add(1, boost::memory_order_seq_cst);
+  stack_sample_t* buffer = samples.load(boost::memory_order_seq_cst);
+  if (buffer != NULL) {
+    size_t i = taken.fetch_add(1, boost::memory_order_relaxed);
+    if (i < capacity) {
+      buffer[i].depth = walk_frames(context, buffer[i].frames, MAX_DEPTH);
+    }
+  }
+  in_handler.fetch_sub(1, boost::memory_order_release);
+  errno = saved_errno;
+}
+
+static void set_timer(int hz)
+{
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = hz > 0 ? 1000000 / hz : 0;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+// Threads of the process, at least 1.
+static size_t count_threads()
+{
+  size_t count = 0;
+  DIR* tasks = opendir("/proc/self/task");
+  if (tasks != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(tasks)) != NULL) {
+      if (entry->d_name[0] != '.') {
+        count++;
+      }
+    }
+    closedir(tasks);
+  }
+  return std::max<size_t>(1, count);
+}
+
+} // namespace internal
+
+
+std::string SymbolOf(const void* address)
+{
+  Dl_info info;
+  if (dladdr(address, &info) == 0) {
+    char hex[32];
+    snprintf(hex, sizeof(hex), "%p", address);
+    return hex;
+  }
+  if (info.dli_sname != NULL) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    if (status == 0 && demangled != NULL) {
+      std::string name(demangled);
+      free(demangled);
+      return name;
+    }
+    return info.dli_sname;
+  }
+  const char* module = info.dli_fname != NULL ?
+      strrchr(info.dli_fname, '/') : NULL;
+  char offset[32];
+  snprintf(offset, sizeof(offset), "+0x%lx",
+           static_cast<unsigned long>(
+               static_cast<const char*>(address) -
+               static_cast<const char*>(info.dli_fbase)));
+  return std::string(module != NULL ? module + 1 : "?") + offset;
+}
+
+
+bool ProfileCpu(int seconds, int hz, std::string* folded)
+{
+  using namespace internal;
+
+  boost::unique_lock<boost::mutex> lock(profile_mutex, boost::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;
+  }
+
+  // A signal for each 1/hz of cpu used, by as many threads as can run at
+  // once.
+  size_t cpus = std::max(1u, boost::thread::hardware_concurrency());
+  size_t running = std::min(count_threads(), cpus);
+  capacity = std::min(MAX_SAMPLES,
+                      static_cast<size_t>(seconds) * hz * running + hz);
+  boost::scoped_array<stack_sample_t> buffer(new stack_sample_t[capacity]);
+  taken = 0;
+  samples.store(buffer.get(), boost::memory_order_seq_cst);
+
+  if (!installed) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &on_sigprof;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    installed = true;
+  }
+  set_timer(hz);
+
+  VARZ_LOGGER << "Profiling for " << seconds << " sec at " << hz << " hz.";
+  boost::this_thread::sleep(boost::posix_time::seconds(seconds));
+
+  set_timer(0);
+  samples.store(NULL, boost::memory_order_seq_cst);
+  while (in_handler.load(boost::memory_order_seq_cst) > 0) {
+    boost::this_thread::yield();
+  }
+
+  size_t count = std::min(taken.load(), capacity);
+  size_t dropped = taken.load() - count;
+  if (dropped > 0) {
+    LOG(WARNING) << "Dropped " << dropped << " samples.";
+  }
+
+  // Fold the stacks, naming each address once.
+  std::map<const void*, std::string> names;
+  std::map<std::string, int> stacks;
+  for (size_t i = 0; i < count; ++i) {
+    std::string stack;
+    for (int f = buffer[i].depth - 1; f >= 0; --f) {
+      const void* address = buffer[i].frames[f];
+      std::map<const void*, std::string>::iterator name = names.find(address);
+      if (name == names.end()) {
+        // Return addresses are past the call; name the call.
+        const void* call = static_cast<const char*>(address) - (f > 0 ? 1 : 0);
+        name = names.insert(std::make_pair(address, SymbolOf(call))).first;
+      }
+      if (!stack.empty()) {
+        stack += ';';
+      }
+      stack += name->second;
+    }
+    if (!stack.empty()) {
+      stacks[stack]++;
+    }
+  }
+  capacity = 0;
+  if (dropped > 0) {
+    // As a stack of its own, for the flame graph to show the share lost.
+    stacks["(dropped samples)"] += static_cast<int>(dropped);
+  }
+
+  for (std::map<std::string, int>::const_iterator stack = stacks.begin();
+       stack != stacks.end(); ++stack) {
+    char n[16];
+    snprintf(n, sizeof(n), " %d\n", stack->second);
+    *folded += stack->first;
+    *folded += n;
+  }
+  VARZ_LOGGER << "Profiled " << count << " samples, "
+              << stacks.size() << " stacks.";
+  return true;
+}
+
+
+} // namespace varz
+} // namespace atp
@@ -0,0 +1,56 @@
+#ifndef ATP_VARZ_PROFILER_H_
+#define ATP_VARZ_PROFILER_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+
+namespace atp {
+namespace varz {
+
+
+/// Samples the stacks of the threads of the process hz times per second
+/// of cpu time, for seconds, and sets folded to one line per distinct
+/// stack, outermost frame first, as taken by flamegraph.pl:
+///
+///   main;Firehose::run;MarketEventDispatcher::publish 42
+///
+/// Sampling is driven by SIGPROF from setitimer(ITIMER_PROF), so it
+/// cannot run with gprof (-pg) or another profiler using the signal; the
+/// handler stays installed after the first profile.  Stacks are walked by
+/// their frame pointers, so code built with -fomit-frame-pointer shows
+/// truncated stacks.  Samples past the buffer, sized for the threads that
+/// can run at once, are folded into a "(dropped samples)" line.
+/// Blocks the caller; returns false if a profile is already running.
+/// Functions of the executable have names only if it is linked with
+/// -rdynamic, else they show as module+offset.
+bool ProfileCpu(int seconds, int hz, std::string* folded);
+
+
+/// Allocations made from one call site, counted since the start of the
+/// process (see ATP_HEAP_PROFILE).
+struct HeapSite
+{
+  const void* address;
+  boost::uint64_t allocations;
+  boost::uint64_t bytes;
+};
+
+/// Whether the binary is built with the allocator hook, i.e. with
+/// -DATP_HEAP_PROFILE, which replaces operator new and delete to count
+/// allocations by the address of their caller.
+bool HeapProfileEnabled();
+
+/// The call sites that allocated, most bytes first.  Empty if not enabled.
+void HeapSites(std::vector<HeapSite>* sites);
+
+/// Name of the function at the address, demangled, or module+offset.
+std::string SymbolOf(const void* address);
+
+
+} // namespace varz
+} // namespace atp
+
+#endif //ATP_VARZ_PROFILER_H_
@@ -0,0 +1,157 @@
+#include <gflags/gflags.h>
+
+#include "utils.hpp"
+#include "varz/trace.hpp"
+
+
+DEFINE_int32(traceEvery, 0,
+             "Traces one in every so many published ticks, by seq; 0 for none.");
+DEFINE_int32(traceRingSize, 65536, "Trace records kept by the process.");
+
+
+namespace atp {
+namespace varz {
+
+
+static const char* STAGE_NAMES[TRACE_STAGES] = {
+  "callback",
+  "publish",
+  "send",
+  "forward",
+  "receive",
+  "parse",
+  "process",
+  "write",
+  "processed"
+};
+
+const char* TraceStageName(int stage)
+{
+  return (stage >= 0 && stage < TRACE_STAGES) ? STAGE_NAMES[stage] : "";
+}
+
+int TraceStageOf(const std::string& name)
+{
+  for (int stage = 0; stage < TRACE_STAGES; ++stage) {
+    if (name == STAGE_NAMES[stage]) {
+      return stage;
+    }
+  }
+  return -1;
+}
+
+
+TraceRing::TraceRing(size_t size) :
+    mask_(0),
+    next_(0)
+{
+  size_t slots = 1;
+  while (slots < size) {
+    slots <<= 1;
+  }
+  slots_.reset(new Slot[slots]);
+  mask_ = slots - 1;
+  for (size_t i = 0; i < slots; ++i) {
+    slots_[i].version.store(0, boost::memory_order_relaxed);
+  }
+}
+
+void TraceRing::Record(boost::uint64_t publisher, boost::uint64_t seq,
+                       int stage, boost::uint64_t micros)
+{
+  boost::uint64_t index = next_.fetch_add(1, boost::memory_order_relaxed);
+  Slot& slot = slots_[index & mask_];
+  slot.version.store(2 * index + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  slot.publisher_id.store(publisher, boost::memory_order_relaxed);
+  slot.seq.store(seq, boost::memory_order_relaxed);
+  slot.micros.store(micros, boost::memory_order_relaxed);
+  slot.stage.store(stage, boost::memory_order_relaxed);
+  slot.version.store(2 * index + 2, boost::memory_order_release);
+}
+
+void TraceRing::Dump(std::vector<TraceRecord>* out) const
+{
+  boost::uint64_t end = next_.load(boost::memory_order_acquire);
+  boost::uint64_t start = end > Size() ? end - Size() : 0;
+  for (boost::uint64_t index = start; index < end; ++index) {
+    const Slot& slot = slots_[index & mask_];
+    boost::uint64_t version = slot.version.load(boost::memory_order_acquire);
+    if (version != 2 * index + 2) {
+      continue;  // being written, or written over
+    }
+    TraceRecord record;
+    record.publisher_id = slot.publisher_id.load(boost::memory_order_relaxed);
+    record.seq = slot.seq.load(boost::memory_order_relaxed);
+    record.micros = slot.micros.load(boost::memory_order_relaxed);
+    record.stage = slot.stage.load(boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if (slot.version.load(boost::memory_order_relaxed) == version) {
+      out->push_back(record);
+    }
+  }
+}
+
+
+TraceRing& Traces()
+{
+  static TraceRing ring(FLAGS_traceRingSize > 0 ? FLAGS_traceRingSize : 1);
+  return ring;
+}
+
+bool TraceSampled(boost::uint64_t seq)
+{
+  return FLAGS_traceEvery > 0 &&
+      seq % static_cast<boost::uint64_t>(FLAGS_traceEvery) == 0;
+}
+
+void Trace(boost::uint64_t publisher, boost::uint64_t seq, int stage,
+           boost::uint64_t micros)
+{
+  Traces().Record(publisher, seq, stage, micros);
+}
+
+void Trace(boost::uint64_t publisher, boost::uint64_t seq, int stage)
+{
+  Traces().Record(publisher, seq, stage, now_micros());
+}
+
+
+// The traced tick handled by the thread.
+static __thread bool current_traced = false;
+static __thread boost::uint64_t current_publisher = 0;
+static __thread boost::uint64_t current_seq = 0;
+
+void TraceCurrent(int stage)
+{
+  if (current_traced) {
+    Trace(current_publisher, current_seq, stage);
+  }
+}
+
+bool TracingCurrent()
+{
+  return current_traced;
+}
+
+TraceScope::TraceScope(bool traced, boost::uint64_t publisher,
+                       boost::uint64_t seq) :
+    traced_(traced)
+{
+  if (traced_) {
+    current_traced = true;
+    current_publisher = publisher;
+    current_seq = seq;
+  }
+}
+
+TraceScope::~TraceScope()
+{
+  if (traced_) {
+    current_traced = false;
+  }
+}
+
+
+} // namespace varz
+} // namespace atp
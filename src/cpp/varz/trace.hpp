@@ -0,0 +1,126 @@
+#ifndef ATP_VARZ_TRACE_H_
+#define ATP_VARZ_TRACE_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
+
+
+namespace atp {
+namespace varz {
+
+
+/// Stages of a market data tick, in order, from the gateway to the db.
+/// A sampled tick (see TraceSampled) carries a trace header (see
+/// common/trace_header.hpp) and each stage it goes through records the
+/// time, keyed by the publisher id and seq of the tick, into the ring of
+/// its process.  The rings are served at /varz/traces and joined across
+/// processes by trace_join into a breakdown of the latency by stage.
+enum TraceStage {
+  TRACE_CALLBACK = 0,  // EWrapper callback, the timestamp of the tick
+  TRACE_PUBLISH,       // MarketEventDispatcher publishing
+  TRACE_SEND,          // sent to the Publisher
+  TRACE_FORWARD,       // forwarded by the Publisher
+  TRACE_RECEIVE,       // received by a MarketDataSubscriber
+  TRACE_PARSE,         // parsed
+  TRACE_PROCESS,       // handed to the subscriber's process()
+  TRACE_WRITE,         // written by historian::Db::Write
+  TRACE_PROCESSED,     // process() returned
+  TRACE_STAGES
+};
+
+const char* TraceStageName(int stage);
+
+/// The stage of the name, or -1.
+int TraceStageOf(const std::string& name);
+
+
+struct TraceRecord
+{
+  boost::uint64_t publisher_id;
+  boost::uint64_t seq;
+  boost::uint64_t micros;
+  int stage;
+};
+
+
+/// Fixed size ring of the last trace records of the process.  Recording
+/// takes a slot with one atomic increment and never blocks; readers skip
+/// the slots being written.
+class TraceRing
+{
+ public:
+
+  /// Size is rounded up to a power of 2.
+  explicit TraceRing(size_t size);
+
+  void Record(boost::uint64_t publisher, boost::uint64_t seq, int stage,
+              boost::uint64_t micros);
+
+  /// The records in the ring, oldest first.
+  void Dump(std::vector<TraceRecord>* out) const;
+
+  size_t Size() const
+  {
+    return mask_ + 1;
+  }
+
+ private:
+
+  // Version is odd while the slot is written, else 2 * (index + 1) of the
+  // record in it.
+  struct Slot
+  {
+    boost::atomic<boost::uint64_t> version;
+    boost::atomic<boost::uint64_t> publisher_id;
+    boost::atomic<boost::uint64_t> seq;
+    boost::atomic<boost::uint64_t> micros;
+    boost::atomic<int> stage;
+  };
+
+  boost::scoped_array<Slot> slots_;
+  size_t mask_;
+  boost::atomic<boost::uint64_t> next_;
+};
+
+
+/// The ring of the process, of --traceRingSize records.
+TraceRing& Traces();
+
+/// Whether the tick of this seq is traced: one in every --traceEvery,
+/// none if 0.  Decided where ticks are published.
+bool TraceSampled(boost::uint64_t seq);
+
+/// Records the stage of a traced tick at micros, or now.
+void Trace(boost::uint64_t publisher, boost::uint64_t seq, int stage,
+           boost::uint64_t micros);
+void Trace(boost::uint64_t publisher, boost::uint64_t seq, int stage);
+
+/// Records the stage, now, for the traced tick being handled by this
+/// thread (see TraceScope), if any.  For stages deep in the handling of a
+/// message that do not see the message itself, e.g. the db write.
+void TraceCurrent(int stage);
+
+/// True while this thread handles a traced tick (see TraceScope).
+bool TracingCurrent();
+
+/// Makes the tick, if traced, the tick being handled by this thread until
+/// the end of the scope.
+class TraceScope
+{
+ public:
+  TraceScope(bool traced, boost::uint64_t publisher, boost::uint64_t seq);
+  ~TraceScope();
+
+ private:
+  bool traced_;
+};
+
+
+} // namespace varz
+} // namespace atp
+
+#endif //ATP_VARZ_TRACE_H_
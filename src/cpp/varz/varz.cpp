@@ -56,7 +56,8 @@ class VarzValue {
   friend class VarzHolder;
   friend class VarzRegistry;     // checks value_buffer_ for varzs_by_ptr_ map
 
-  enum ValueType {FV_BOOL, FV_INT32, FV_INT64, FV_UINT64, FV_DOUBLE, FV_STRING};
+  enum ValueType {FV_BOOL, FV_INT32, FV_INT64, FV_UINT64, FV_DOUBLE, FV_STRING,
+                  FV_HISTOGRAM, FV_COUNTER, FV_GAUGE};
 
   const char* TypeName() const;
   bool Equal(const VarzValue& x) const;
@@ -84,6 +85,9 @@ VarzValue::VarzValue(void* valbuf, const char* type) : value_buffer_(valbuf) {
   else if (strcmp(type, "uint64") == 0)  type_ = FV_UINT64;
   else if (strcmp(type, "double") == 0)  type_ = FV_DOUBLE;
   else if (strcmp(type, "string") == 0)  type_ = FV_STRING;
+  else if (strcmp(type, "histogram") == 0)  type_ = FV_HISTOGRAM;
+  else if (strcmp(type, "counter") == 0)  type_ = FV_COUNTER;
+  else if (strcmp(type, "gauge") == 0)  type_ = FV_GAUGE;
   else assert(false); // Unknown typename
 }
 
@@ -95,6 +99,10 @@ VarzValue::~VarzValue() {
     case FV_UINT64: delete reinterpret_cast<uint64*>(value_buffer_); break;
     case FV_DOUBLE: delete reinterpret_cast<double*>(value_buffer_); break;
     case FV_STRING: delete reinterpret_cast<string*>(value_buffer_); break;
+    case FV_HISTOGRAM:
+      delete reinterpret_cast<Histogram*>(value_buffer_); break;
+    case FV_COUNTER: delete reinterpret_cast<Counter*>(value_buffer_); break;
+    case FV_GAUGE: delete reinterpret_cast<Gauge*>(value_buffer_); break;
   }
 }
 
@@ -106,6 +114,9 @@ const char* VarzValue::TypeName() const {
     case FV_UINT64: return "uint64";
     case FV_DOUBLE: return "double";
     case FV_STRING: return "string";
+    case FV_HISTOGRAM: return "histogram";
+    case FV_COUNTER: return "counter";
+    case FV_GAUGE: return "gauge";
     default: assert(false); return "";  // unknown type
   }
 }
@@ -120,6 +131,11 @@ bool VarzValue::Equal(const VarzValue& x) const {
     case FV_UINT64: return VALUE_AS(uint64) == OTHER_VALUE_AS(x, uint64);
     case FV_DOUBLE: return VALUE_AS(double) == OTHER_VALUE_AS(x, double);
     case FV_STRING: return VALUE_AS(string) == OTHER_VALUE_AS(x, string);
+    case FV_HISTOGRAM: return false;  // not worth comparing the buckets
+    case FV_COUNTER:
+      return (VALUE_AS(Counter)).Value() == (OTHER_VALUE_AS(x, Counter)).Value();
+    case FV_GAUGE:
+      return (VALUE_AS(Gauge)).Value() == (OTHER_VALUE_AS(x, Gauge)).Value();
     default: assert(false); return false;  // unknown type
   }
 }
@@ -132,6 +148,9 @@ VarzValue* VarzValue::New() const {
     case FV_UINT64: return new VarzValue(new uint64(0), "uint64");
     case FV_DOUBLE: return new VarzValue(new double(0.0), "double");
     case FV_STRING: return new VarzValue(new string, "string");
+    case FV_HISTOGRAM: return new VarzValue(new Histogram, "histogram");
+    case FV_COUNTER: return new VarzValue(new Counter, "counter");
+    case FV_GAUGE: return new VarzValue(new Gauge, "gauge");
     default: assert(false); return NULL;  // unknown type
   }
 }
@@ -145,6 +164,12 @@ void VarzValue::CopyFrom(const VarzValue& x) {
     case FV_UINT64: SET_VALUE_AS(uint64, OTHER_VALUE_AS(x, uint64));  break;
     case FV_DOUBLE: SET_VALUE_AS(double, OTHER_VALUE_AS(x, double));  break;
     case FV_STRING: SET_VALUE_AS(string, OTHER_VALUE_AS(x, string));  break;
+    case FV_HISTOGRAM:
+      SET_VALUE_AS(Histogram, OTHER_VALUE_AS(x, Histogram));
+      break;
+    case FV_COUNTER:  // counters cannot be set; only from the initial 0
+      break;
+    case FV_GAUGE: SET_VALUE_AS(Gauge, OTHER_VALUE_AS(x, Gauge)); break;
     default: assert(false);  // unknown type
   }
 }
@@ -168,6 +193,14 @@ string VarzValue::ToString() const {
       return intbuf;
     case FV_STRING:
       return VALUE_AS(string);
+    case FV_HISTOGRAM:
+      return (VALUE_AS(Histogram)).ToString();
+    case FV_COUNTER:
+      snprintf(intbuf, sizeof(intbuf), "%" PRId64, (VALUE_AS(Counter)).Value());
+      return intbuf;
+    case FV_GAUGE:
+      snprintf(intbuf, sizeof(intbuf), "%" PRId64, (VALUE_AS(Gauge)).Value());
+      return intbuf;
     default:
       assert(false);
       return "";  // unknown type
@@ -7,6 +7,9 @@
 #include <sys/types.h>          // the normal place u_int16_t is defined
 #include <boost/cstdint.hpp>
 
+#include "varz/counter.hpp"
+#include "varz/histogram.hpp"
+
 namespace atp {
 namespace varz {
 
@@ -126,6 +129,50 @@ bool IsBoolFlag(bool from);
 #define DECLARE_VARZ_double(name)          DECLARE_VARZ(double, D, name)
 #define DEFINE_VARZ_double(name, val, txt) DEFINE_VARZ(double, D, name, val, txt)
 
+// Counters and gauges are safe to update from any thread; see
+// varz/counter.hpp.  Counters start at 0.
+#define DECLARE_VARZ_counter(name) \
+  DECLARE_VARZ(atp::varz::Counter, C, name)
+
+#define DEFINE_VARZ_counter(name, txt)                           \
+  namespace vARZC {                                              \
+    atp::varz::Counter VARZ_##name;                              \
+    atp::varz::Counter VARZ_no##name;                            \
+    static atp::varz::VarzRegisterer o_##name(                   \
+        #name, "counter", txt, __FILE__,                         \
+        &VARZ_##name, &VARZ_no##name);                           \
+  }                                                              \
+  using vARZC::VARZ_##name
+
+#define DECLARE_VARZ_gauge(name) \
+  DECLARE_VARZ(atp::varz::Gauge, G, name)
+
+#define DEFINE_VARZ_gauge(name, val, txt)                        \
+  namespace vARZG {                                              \
+    atp::varz::Gauge VARZ_##name(val);                           \
+    atp::varz::Gauge VARZ_no##name(val);                         \
+    static atp::varz::VarzRegisterer o_##name(                   \
+        #name, "gauge", txt, __FILE__,                           \
+        &VARZ_##name, &VARZ_no##name);                           \
+  }                                                              \
+  using vARZG::VARZ_##name
+
+// Histograms have no initial value; values are added with
+// VARZ_name.Record(value) and shown as count, mean, percentiles and max.
+// VARZ_no##name is the empty histogram shown as the initial value.
+#define DECLARE_VARZ_histogram(name) \
+  DECLARE_VARZ(atp::varz::Histogram, H, name)
+
+#define DEFINE_VARZ_histogram(name, txt)                         \
+  namespace vARZH {                                              \
+    atp::varz::Histogram VARZ_##name;                            \
+    atp::varz::Histogram VARZ_no##name;                          \
+    static atp::varz::VarzRegisterer o_##name(                   \
+        #name, "histogram", txt, __FILE__,                       \
+        &VARZ_##name, &VARZ_no##name);                           \
+  }                                                              \
+  using vARZH::VARZ_##name
+
 // Strings are trickier, because they're not a POD, so we can't
 // construct them at static-initialization time (instead they get
 // constructed at global-constructor time, which is much later).  To
@@ -0,0 +1,75 @@
+
+#include <glog/logging.h>
+
+#include "zmq/BufferPool.hpp"
+
+
+namespace atp {
+namespace zmq {
+
+
+BufferPool::BufferPool(size_t bufferSize, size_t count) :
+    bufferSize_(bufferSize),
+    block_(bufferSize * count),
+    free_(count),
+    inUse_(0),
+    overflows_(0)
+{
+  for (size_t i = 0; i < count; ++i) {
+    free_.bounded_push(&block_[i * bufferSize_]);
+  }
+}
+
+BufferPool::~BufferPool()
+{
+  if (in_use() > 0) {
+    LOG(WARNING) << "Buffer pool destroyed with " << in_use()
+                 << " buffers in use.";
+  }
+}
+
+BufferPool& BufferPool::instance()
+{
+  // Leaked on purpose: zmq's I/O threads may still free buffers during
+  // static destruction.
+  static BufferPool* pool = new BufferPool(512, 8192);
+  return *pool;
+}
+
+char* BufferPool::acquire()
+{
+  char* buffer = NULL;
+  if (!free_.pop(buffer)) {
+    overflows_.fetch_add(1, boost::memory_order_relaxed);
+    buffer = new char[bufferSize_];
+  }
+  inUse_.fetch_add(1, boost::memory_order_relaxed);
+  return buffer;
+}
+
+void BufferPool::release(char* buffer)
+{
+  inUse_.fetch_sub(1, boost::memory_order_relaxed);
+  if (owns(buffer)) {
+    free_.bounded_push(buffer);
+  } else {
+    delete[] buffer;
+  }
+}
+
+void BufferPool::free_buffer(void* data, void* pool)
+{
+  static_cast<BufferPool*>(pool)->release(static_cast<char*>(data));
+}
+
+size_t BufferPool::send(::zmq::socket_t& socket, char* buffer, size_t size,
+                        bool sendMore)
+{
+  ::zmq::message_t frame(buffer, size, &BufferPool::free_buffer, this);
+  socket.send(frame, sendMore ? ZMQ_SNDMORE : 0);
+  return size;
+}
+
+
+} // namespace zmq
+} // namespace atp
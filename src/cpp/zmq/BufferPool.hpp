@@ -0,0 +1,84 @@
+#ifndef ATP_ZMQ_BUFFER_POOL_H_
+#define ATP_ZMQ_BUFFER_POOL_H_
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/stack.hpp>
+#include <zmq.hpp>
+
+#include "common.hpp"
+
+
+namespace atp {
+namespace zmq {
+
+
+/// Pool of fixed size buffers that are sent as zmq message data without
+/// copying.  zmq calls the free function of the message from its I/O thread
+/// once the frame is sent, which returns the buffer to the pool, so a
+/// steady stream of messages allocates nothing.
+///
+/// The buffers are carved out of one block.  When all are in flight,
+/// buffers are allocated on the heap and deleted when zmq is done with
+/// them.  Thread safe and lock free.
+class BufferPool : NoCopyAndAssign
+{
+ public:
+
+  BufferPool(size_t bufferSize, size_t count);
+
+  /// The pool may be referenced by messages still queued in zmq, so it
+  /// should live as long as the zmq context (see instance()).
+  ~BufferPool();
+
+  /// Shared pool of 512 byte buffers, never destroyed.
+  static BufferPool& instance();
+
+  size_t buffer_size() const
+  {
+    return bufferSize_;
+  }
+
+  char* acquire();
+
+  void release(char* buffer);
+
+  /// Sends the first size bytes of a buffer from acquire() as a frame.  The
+  /// buffer belongs to zmq from here on.  Returns size.
+  size_t send(::zmq::socket_t& socket, char* buffer, size_t size,
+              bool sendMore = false);
+
+  /// Buffers handed out and not yet released.
+  size_t in_use() const
+  {
+    return inUse_.load(boost::memory_order_relaxed);
+  }
+
+  /// Buffers allocated on the heap because the pool was empty.
+  size_t overflows() const
+  {
+    return overflows_.load(boost::memory_order_relaxed);
+  }
+
+ private:
+
+  static void free_buffer(void* data, void* pool);
+
+  bool owns(const char* buffer) const
+  {
+    return buffer >= &block_[0] && buffer < &block_[0] + block_.size();
+  }
+
+  size_t bufferSize_;
+  std::vector<char> block_;
+  boost::lockfree::stack<char*, boost::lockfree::fixed_sized<true> > free_;
+  boost::atomic<size_t> inUse_;
+  boost::atomic<size_t> overflows_;
+};
+
+
+} // namespace zmq
+} // namespace atp
+
+#endif //ATP_ZMQ_BUFFER_POOL_H_
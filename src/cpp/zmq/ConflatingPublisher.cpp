@@ -0,0 +1,302 @@
+
+#include <algorithm>
+#include <string.h>
+
+#include <boost/bind.hpp>
+#include <glog/logging.h>
+#include <zmq.hpp>
+
+#include "utils.hpp"
+#include "common.hpp"
+#include "common/tick_batch.hpp"
+#include "varz/varz.hpp"
+#include "zmq/ConflatingPublisher.hpp"
+
+
+DEFINE_VARZ_int64(conflating_publisher_messages_received, 0, "");
+DEFINE_VARZ_int64(conflating_publisher_messages_sent, 0, "");
+DEFINE_VARZ_int64(conflating_publisher_messages_conflated, 0, "");
+DEFINE_VARZ_int64(conflating_publisher_backlog, 0, "messages queued");
+DEFINE_VARZ_int64(conflating_publisher_backlog_max, 0, "");
+DEFINE_VARZ_int64(conflating_publisher_backlog_dropped, 0,
+                  "oldest messages dropped from a full backlog");
+DEFINE_VARZ_int64(conflating_publisher_fell_behind, 0,
+                  "times a backlog started: the rate was exceeded, or on zmq "
+                  "4 a subscriber's queue was full");
+DEFINE_VARZ_bool(conflating_publisher_event_loop_stopped, false, "");
+
+
+namespace atp {
+namespace zmq {
+
+// Messages read per wakeup before the backlog is flushed again.
+static const size_t MAX_RECEIVE_BATCH = 1024;
+
+// Wakeups to check for the destructor while idle.
+#ifdef ZMQ_3X
+static const long POLL_TIMEOUT = 100;  // msec
+#else
+static const long POLL_TIMEOUT = 100000;  // usec
+#endif
+
+void Conflater::add(const frames_t& message, const std::string& key)
+{
+  if (!key.empty()) {
+    boost::unordered_map<std::string, queue_t::iterator>::iterator found =
+        latest_.find(key);
+    if (found != latest_.end()) {
+      // The new value is sent after the messages that came before it.
+      queue_.erase(found->second);
+      latest_.erase(found);
+      conflated_++;
+    }
+  }
+  queue_.push_back(entry_t());
+  queue_.back().key = key;
+  queue_.back().message = message;
+  if (!key.empty()) {
+    latest_[key] = --queue_.end();
+  }
+  if (maxSize_ > 0 && queue_.size() > maxSize_) {
+    pop();
+    dropped_++;
+  }
+}
+
+void Conflater::add_classified(const frames_t& message,
+                               const Classifier& classifier)
+{
+  std::string key;
+  if (message.size() != 2 || !atp::common::is_tick_batch(message[1])) {
+    if (!classifier || !classifier(message, &key)) {
+      key.clear();
+    }
+    add(message, key);
+    return;
+  }
+  atp::common::tick_batch_reader batch(message[1]);
+  frames_t record(1, message[0]);
+  record.push_back(std::string());
+  while (batch.next(&record[1])) {
+    key.clear();
+    if (!classifier || !classifier(record, &key)) {
+      key.clear();
+    }
+    add(record, key);
+  }
+}
+
+void Conflater::pop()
+{
+  if (!queue_.front().key.empty()) {
+    latest_.erase(queue_.front().key);
+  }
+  queue_.pop_front();
+}
+
+
+/// Returns false if the socket does not take the message.  Only the first
+/// frame is sent without blocking: once it is taken the rest must follow.
+static bool send_frames(::zmq::socket_t& socket, const frames_t& frames)
+{
+  int noblock = FORWARD_NOBLOCK;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    ::zmq::message_t frame(frames[i].size());
+    memcpy(frame.data(), frames[i].data(), frames[i].size());
+    bool more = i + 1 < frames.size();
+    if (!socket.send(frame, (more ? ZMQ_SNDMORE : 0) | noblock)) {
+      return false;
+    }
+    noblock = 0;
+  }
+  return true;
+}
+
+
+ConflatingPublisher::ConflatingPublisher(const std::string& upstreamAddr,
+                                         const std::string& publishAddr,
+                                         Classifier classifier,
+                                         int maxRate,
+                                         size_t maxBacklog,
+                                         ::zmq::context_t* context) :
+    upstreamAddr_(upstreamAddr),
+    publishAddr_(publishAddr),
+    classifier_(classifier),
+    maxRate_(std::max(0, maxRate)),
+    maxBacklog_(maxBacklog),
+    stopping_(false),
+    context_(context),
+    localContext_(false),
+    ready_(false)
+{
+  thread_ = boost::shared_ptr<boost::thread>(new boost::thread(
+      boost::bind(&ConflatingPublisher::process, this)));
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (!ready_) {
+    isReady_.wait(lock);
+  }
+
+  LOG(INFO) << "Conflating publisher is ready: " << publishAddr_
+            << ", upstream " << upstreamAddr_ << ", max rate " << maxRate_
+            << ", max backlog " << maxBacklog_;
+}
+
+ConflatingPublisher::~ConflatingPublisher()
+{
+  stopping_ = true;
+  if (thread_->joinable()) {
+    thread_->join();
+  }
+  if (localContext_) {
+    ZMQ_PUBLISHER_LOGGER << "Deleting local context " << context_;
+    delete context_;
+  }
+}
+
+const std::string& ConflatingPublisher::publishAddr()
+{
+  return publishAddr_;
+}
+
+void ConflatingPublisher::block()
+{
+  thread_->join();
+}
+
+void ConflatingPublisher::process()
+{
+  if (context_ == NULL) {
+    context_ = new ::zmq::context_t(1);
+    localContext_ = true;
+    ZMQ_PUBLISHER_LOGGER << "Created local context.";
+  }
+
+  ::zmq::socket_t inbound(*context_, ZMQ_SUB);
+  inbound.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+  try {
+    inbound.connect(upstreamAddr_.c_str());
+  } catch (::zmq::error_t e) {
+    LOG(FATAL) << "Cannot connect to upstream at " << upstreamAddr_ << ":"
+               << e.what();
+  }
+
+#ifdef ZMQ_XPUB_NODROP
+  // Refuses messages instead of dropping them when a subscriber's queue
+  // is full, which is how the backlog starts.  Older zmq can only drop,
+  // so there only the rate limit applies.
+  ::zmq::socket_t publish(*context_, ZMQ_XPUB);
+  int nodrop = 1;
+  publish.setsockopt(ZMQ_XPUB_NODROP, &nodrop, sizeof(nodrop));
+#else
+  ::zmq::socket_t publish(*context_, ZMQ_PUB);
+#endif
+
+  try {
+    publish.bind(publishAddr_.c_str());
+  } catch (::zmq::error_t e) {
+    LOG(FATAL) << "Cannot bind publish at " << publishAddr_ << ":"
+               << e.what();
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    ready_ = true;
+  }
+  isReady_.notify_all();
+
+  // Token bucket of messages that can be sent, allowing bursts of 100 msec.
+  const double burst = std::max(1, maxRate_ / 10);
+  double tokens = burst;
+  boost::uint64_t lastRefill = now_micros();
+
+  Conflater backlog(maxBacklog_);
+  frames_t message;
+  size_t conflated = 0;
+  size_t dropped = 0;
+
+  ::zmq::pollitem_t items[] = {
+    { inbound, 0, ZMQ_POLLIN, 0 },
+    { publish, 0, ZMQ_POLLIN, 0 },
+  };
+
+  bool stop = false;
+  while (!stop && !stopping_) {
+    try {
+      // Wake up often while there is a backlog to flush.
+#ifdef ZMQ_3X
+      long timeout = backlog.empty() ? POLL_TIMEOUT : 1;  // msec
+#else
+      long timeout = backlog.empty() ? POLL_TIMEOUT : 1000;  // usec
+#endif
+      ::zmq::poll(items, 2, timeout);
+
+      if (items[1].revents & ZMQ_POLLIN) {
+        // Subscriptions of an XPUB socket; everything is published anyway.
+        ::zmq::message_t subscription;
+        while (publish.recv(&subscription, FORWARD_NOBLOCK)) {}
+      }
+
+      if (maxRate_ > 0) {
+        boost::uint64_t now = now_micros();
+        tokens = std::min(burst, tokens +
+                          (now - lastRefill) * maxRate_ / 1000000.);
+        lastRefill = now;
+      }
+
+      // Flush the backlog first to keep messages in order.
+      while (!backlog.empty() && (maxRate_ == 0 || tokens >= 1.)) {
+        if (!send_frames(publish, backlog.front())) {
+          break;
+        }
+        backlog.pop();
+        tokens -= 1.;
+        VARZ_conflating_publisher_messages_sent++;
+      }
+
+      for (size_t count = 0;
+           count < MAX_RECEIVE_BATCH &&
+               receive_frames(inbound, &message, FORWARD_NOBLOCK);
+           ++count) {
+        VARZ_conflating_publisher_messages_received++;
+
+        if (backlog.empty() && (maxRate_ == 0 || tokens >= 1.) &&
+            send_frames(publish, message)) {
+          tokens -= 1.;
+          VARZ_conflating_publisher_messages_sent++;
+          continue;
+        }
+
+        if (backlog.empty()) {
+          VARZ_conflating_publisher_fell_behind++;
+        }
+        backlog.add_classified(message, classifier_);
+      }
+
+      VARZ_conflating_publisher_messages_conflated +=
+          backlog.conflated() - conflated;
+      conflated = backlog.conflated();
+      VARZ_conflating_publisher_backlog_dropped += backlog.dropped() - dropped;
+      dropped = backlog.dropped();
+      VARZ_conflating_publisher_backlog = backlog.size();
+      if (VARZ_conflating_publisher_backlog >
+          VARZ_conflating_publisher_backlog_max) {
+        VARZ_conflating_publisher_backlog_max =
+            VARZ_conflating_publisher_backlog;
+      }
+
+    } catch (::zmq::error_t e) {
+      LOG(ERROR) << "Stopping on error "
+                 << e.num() << ", exception: " << e.what();
+      stop = true;
+    }
+  }
+
+  VARZ_conflating_publisher_event_loop_stopped = true;
+
+  LOG(ERROR) << "Conflating publisher thread stopped.";
+}
+
+
+} // namespace zmq
+} // namespace atp
@@ -0,0 +1,150 @@
+#ifndef ATP_ZMQ_CONFLATING_PUBLISHER_H_
+#define ATP_ZMQ_CONFLATING_PUBLISHER_H_
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <zmq.hpp>
+
+#include "common.hpp"
+#include "zmq/Forwarder.hpp"
+
+namespace atp {
+namespace zmq {
+
+
+/// Queue of messages waiting to be sent to a subscriber that is behind.
+/// A message added with a conflation key replaces the queued message with
+/// the same key and goes to the tail, so only the latest value per key is
+/// sent, and never ahead of messages that arrived before it.  Messages
+/// without a key are always queued.  Past maxSize messages the oldest are
+/// dropped.
+class Conflater : NoCopyAndAssign
+{
+ public:
+
+  /// Returns true and sets the key if the message can be conflated.
+  typedef boost::function<bool(const frames_t&, std::string*)> Classifier;
+
+  /// maxSize - messages queued at most; 0 for no limit.
+  explicit Conflater(size_t maxSize = 0) :
+      maxSize_(maxSize), conflated_(0), dropped_(0) {}
+
+  /// key - empty if the message must never be conflated.
+  void add(const frames_t& message, const std::string& key);
+
+  /// Adds the message with the key given by the classifier.  A tick batch
+  /// (topic and one frame of records, see common/tick_batch.hpp) is split
+  /// into a message per record, each conflated on its own, since a batch
+  /// as a whole has no key.
+  void add_classified(const frames_t& message, const Classifier& classifier);
+
+  bool empty() const
+  {
+    return queue_.empty();
+  }
+
+  size_t size() const
+  {
+    return queue_.size();
+  }
+
+  /// Messages replaced by a later one with the same key.
+  size_t conflated() const
+  {
+    return conflated_;
+  }
+
+  /// Messages dropped from the head of a full queue.
+  size_t dropped() const
+  {
+    return dropped_;
+  }
+
+  const frames_t& front() const
+  {
+    return queue_.front().message;
+  }
+
+  void pop();
+
+ private:
+
+  struct entry_t
+  {
+    std::string key;
+    frames_t message;
+  };
+
+  typedef std::list<entry_t> queue_t;
+  queue_t queue_;
+  boost::unordered_map<std::string, queue_t::iterator> latest_;
+  size_t maxSize_;
+  size_t conflated_;
+  size_t dropped_;
+};
+
+
+/// Publisher tier for a class of slow subscribers (e.g. the watcher or R
+/// sessions).  It subscribes to an upstream publisher and republishes every
+/// message at its own endpoint, up to maxRate messages per second.  When
+/// the subscribers cannot keep up -- the rate is exceeded or, with zmq 4's
+/// XPUB_NODROP, the socket refuses messages -- messages are queued and
+/// conflated by the key given by the classifier until the backlog is
+/// flushed.  Older zmq PUB sockets drop for a slow subscriber without
+/// telling, so there the tier is only a rate limiter that conflates what
+/// exceeds maxRate.
+///
+/// Upstream tick batches are sent as they are while the subscribers keep
+/// up; once queued, they are split and their ticks sent one per message.
+class ConflatingPublisher : NoCopyAndAssign
+{
+ public:
+
+  typedef Conflater::Classifier Classifier;
+
+  // upstreamAddr - endpoint of the publisher to subscribe to.
+  // publishAddr - endpoint for subscribers.
+  // maxRate - messages per second sent to subscribers; 0 for no limit.
+  // maxBacklog - messages queued at most; the oldest are dropped past it.
+  ConflatingPublisher(const std::string& upstreamAddr,
+                      const std::string& publishAddr,
+                      Classifier classifier,
+                      int maxRate,
+                      size_t maxBacklog,
+                      ::zmq::context_t* context = NULL);
+  ~ConflatingPublisher();
+
+  const std::string& publishAddr();
+
+  void block();
+
+ private:
+  void process();
+
+ private:
+  std::string upstreamAddr_;
+  std::string publishAddr_;
+  Classifier classifier_;
+  int maxRate_;
+  size_t maxBacklog_;
+  boost::atomic<bool> stopping_;
+  boost::shared_ptr<boost::thread> thread_;
+  ::zmq::context_t* context_;
+  bool localContext_;
+  bool ready_;
+  boost::mutex mutex_;
+  boost::condition_variable isReady_;
+};
+
+
+} // namespace zmq
+} // namespace atp
+
+#endif //ATP_ZMQ_CONFLATING_PUBLISHER_H_
@@ -0,0 +1,155 @@
+#ifndef ATP_ZMQ_FORWARDER_H_
+#define ATP_ZMQ_FORWARDER_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <zmq.hpp>
+
+#include "common/trace_header.hpp"
+#include "varz/trace.hpp"
+
+
+namespace atp {
+namespace zmq {
+
+
+#ifdef ZMQ_3X
+static const int FORWARD_NOBLOCK = ZMQ_DONTWAIT;
+#else
+static const int FORWARD_NOBLOCK = ZMQ_NOBLOCK;
+#endif
+
+
+/// Counts of a forwarder.  Kept by the caller and published to varz once
+/// per batch instead of once per frame.
+struct forward_stats_t
+{
+  forward_stats_t() :
+      messages(0), frames(0), bytes(0), dropped(0), batches(0) {}
+
+  boost::uint64_t messages;
+  boost::uint64_t frames;
+  boost::uint64_t bytes;
+  boost::uint64_t dropped;  // first frame refused by the outbound socket,
+                            // or too many frames for a shm ring.  Stays 0
+                            // on PUB sockets, which drop silently at the
+                            // high water mark instead.
+  boost::uint64_t batches;
+};
+
+
+inline bool has_more(::zmq::socket_t& socket)
+{
+#ifdef ZMQ_3X
+  int more = 0;
+#else
+  int64_t more = 0;
+#endif
+  size_t more_size = sizeof(more);
+  socket.getsockopt(ZMQ_RCVMORE, &more, &more_size);
+  return more != 0;
+}
+
+
+/// Records the forward stage of a traced message (see varz/trace.hpp).
+/// Costs a compare of the first byte for the others.
+inline void trace_forward(const void* data, size_t size)
+{
+  boost::uint64_t publisher, seq;
+  if (atp::common::read_trace_header(static_cast<const char*>(data), size,
+                                     &publisher, &seq)) {
+    atp::varz::Trace(publisher, seq, atp::varz::TRACE_FORWARD);
+  }
+}
+
+
+/// Frames of one multipart message.
+typedef std::vector<std::string> frames_t;
+
+
+/// Reads a multipart message into frames.  Returns false if flags has
+/// FORWARD_NOBLOCK and there is no message.
+inline bool receive_frames(::zmq::socket_t& socket, frames_t* frames,
+                           int flags = 0)
+{
+  ::zmq::message_t frame;
+  if (!socket.recv(&frame, flags)) {
+    return false;
+  }
+  frames->clear();
+  while (true) {
+    frames->push_back(std::string(static_cast<char*>(frame.data()),
+                                  frame.size()));
+    if (!has_more(socket)) {
+      break;
+    }
+    socket.recv(&frame);
+  }
+  return true;
+}
+
+
+/// Forwards the remaining frames of a multipart message.  The frame buffers
+/// are handed from socket to socket without copying: sending a message_t
+/// transfers its content, and the emptied message_t is reused for the next
+/// receive.  Only the first frame is sent without blocking: once a socket
+/// has taken it, the rest must follow or a partial message stays queued in
+/// front of the next one.  If the first frame is refused the rest of the
+/// message is still read and discarded, so the next message starts on a
+/// boundary.
+inline bool forward_frames(::zmq::socket_t& inbound, ::zmq::socket_t& outbound,
+                           ::zmq::message_t& frame, forward_stats_t* stats)
+{
+  bool sent = true;
+  int noblock = FORWARD_NOBLOCK;
+  while (true) {
+    bool more = has_more(inbound);
+    size_t size = frame.size();
+    trace_forward(frame.data(), size);
+    if (sent) {
+      sent = outbound.send(frame, (more ? ZMQ_SNDMORE : 0) | noblock);
+      noblock = 0;
+      if (sent) {
+        stats->bytes += size;
+      }
+    }
+    stats->frames++;
+    if (!more) {
+      break;
+    }
+    inbound.recv(&frame);
+  }
+  if (sent) {
+    stats->messages++;
+  } else {
+    stats->dropped++;
+  }
+  return sent;
+}
+
+
+/// Blocks until a message arrives, then forwards it along with all the
+/// messages already queued on the inbound socket, up to maxMessages, so
+/// that one wakeup moves a whole burst.  Returns the number of messages
+/// read.
+inline size_t forward_batch(::zmq::socket_t& inbound, ::zmq::socket_t& outbound,
+                            size_t maxMessages, forward_stats_t* stats)
+{
+  ::zmq::message_t frame;
+  inbound.recv(&frame);
+  size_t count = 0;
+  do {
+    forward_frames(inbound, outbound, frame, stats);
+    ++count;
+  } while (count < maxMessages && inbound.recv(&frame, FORWARD_NOBLOCK));
+  stats->batches++;
+  return count;
+}
+
+
+} // namespace zmq
+} // namespace atp
+
+#endif //ATP_ZMQ_FORWARDER_H_
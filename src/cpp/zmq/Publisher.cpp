@@ -1,5 +1,8 @@
 
+#include <algorithm>
+
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <gflags/gflags.h>
@@ -10,17 +13,33 @@
 #include "utils.hpp"
 #include "common.hpp"
 #include "varz/varz.hpp"
+#include "zmq/Forwarder.hpp"
 #include "zmq/Publisher.hpp"
+#include "zmq/ShmRing.hpp"
 
 
 DEFINE_bool(publisherIgnoreSignalInterrupt, true,
             "Ignores interrupt signal (zmq 2.0 default behavior).");
+DEFINE_int32(publisherMaxBatch, 1024,
+             "Max messages forwarded per wakeup of the publisher.");
+DEFINE_int32(publisherShmRingMegabytes, 64,
+             "Size of the ring of publishers at shm:// endpoints.");
 
 DEFINE_VARZ_bool(publisher_event_loop_stopped, false, "");
 DEFINE_VARZ_bool(publisher_ignores_sig_interrupt, true, "");
 DEFINE_VARZ_int32(publisher_sig_interrupts, 0, "");
 DEFINE_VARZ_int64(publisher_bytes_sent, 0, "");
-DEFINE_VARZ_int64(publisher_messages_sent, 0, "");
+DEFINE_VARZ_int64(publisher_messages_sent, 0, "frames sent");
+DEFINE_VARZ_int64(publisher_messages_dropped, 0,
+                  "refused by the outbound socket or ring; 0 on PUB, "
+                  "which drops at the high water mark uncounted");
+DEFINE_VARZ_int64(publisher_messages_per_sec, 0, "over the last second");
+DEFINE_VARZ_int64(publisher_batches, 0, "wakeups with messages forwarded");
+DEFINE_VARZ_int64(publisher_batch_size_max, 0, "");
+DEFINE_VARZ_int64(publisher_batch_size_1, 0, "batches of 1 message");
+DEFINE_VARZ_int64(publisher_batch_size_2_16, 0, "");
+DEFINE_VARZ_int64(publisher_batch_size_17_256, 0, "");
+DEFINE_VARZ_int64(publisher_batch_size_over_256, 0, "");
 
 
 namespace atp {
@@ -90,14 +109,22 @@ void Publisher::process()
     LOG(FATAL) << "Cannot bind inbound at " << addr_ << ":"
                << e.what();
   }
-  // start publish socket
-  ::zmq::socket_t publish(*context_, ZMQ_PUB);
-
-  try {
-    publish.bind(publishAddr_.c_str());
-  } catch (::zmq::error_t e) {
-    LOG(FATAL) << "Cannot bind publish at " << publishAddr_ << ":"
-               << e.what();
+  // start publish socket, or the shared memory ring for subscribers on
+  // this host.
+  boost::scoped_ptr< ::zmq::socket_t > publish;
+  boost::scoped_ptr<ShmRingWriter> ring;
+
+  if (ShmRing::is_shm(publishAddr_)) {
+    ring.reset(new ShmRingWriter(
+        publishAddr_, FLAGS_publisherShmRingMegabytes * 1024 * 1024));
+  } else {
+    publish.reset(new ::zmq::socket_t(*context_, ZMQ_PUB));
+    try {
+      publish->bind(publishAddr_.c_str());
+    } catch (::zmq::error_t e) {
+      LOG(FATAL) << "Cannot bind publish at " << publishAddr_ << ":"
+                 << e.what();
+    }
   }
 
   ZMQ_PUBLISHER_LOGGER
@@ -110,47 +137,61 @@ void Publisher::process()
   }
   isReady_.notify_all();
 
+  size_t maxBatch = std::max(1, FLAGS_publisherMaxBatch);
+  forward_stats_t stats;
+  boost::uint64_t second = now_micros() / 1000000;
+  boost::uint64_t messagesAtSecond = 0;
+
   bool stop = false;
   while (!stop) {
-    while (true) {
-      ::zmq::message_t message;
-#ifdef ZMQ_3X
-      int more(0);
-#else
-      int64_t more(0);
-#endif
-      size_t more_size = sizeof(more);
-      //  Process all parts of the message
-      try {
-
-        inbound.recv(&message);
-        inbound.getsockopt( ZMQ_RCVMORE, &more, &more_size);
-
-
-        VARZ_publisher_bytes_sent += publish.send(message,
-                                                  more? ZMQ_SNDMORE: 0);
-
-        VARZ_publisher_messages_sent++;
-      } catch (::zmq::error_t e) {
-        // Ignore signal 4 on linux which causes
-        // the publisher/ connector to hang.  Ignoring the interrupts is
-        // ZMQ 2.0 behavior which changed in 2.1.
-        if (e.num() == 4 && FLAGS_publisherIgnoreSignalInterrupt) {
-          VARZ_publisher_sig_interrupts++;
-          LOG(ERROR) << "Ignoring error "
-                     << e.num() << ", exception: " << e.what();
-          stop = false;
-        } else {
-          LOG(ERROR) << "Stopping on error "
-                     << e.num() << ", exception: " << e.what();
-          stop = true;
-          break;
-        }
+    size_t batch = 0;
+    try {
+
+      batch = ring ?
+          forward_batch(inbound, *ring, maxBatch, &stats) :
+          forward_batch(inbound, *publish, maxBatch, &stats);
+
+    } catch (::zmq::error_t e) {
+      // Ignore signal 4 on linux which causes
+      // the publisher/ connector to hang.  Ignoring the interrupts is
+      // ZMQ 2.0 behavior which changed in 2.1.
+      if (e.num() == 4 && FLAGS_publisherIgnoreSignalInterrupt) {
+        VARZ_publisher_sig_interrupts++;
+        LOG(ERROR) << "Ignoring error "
+                   << e.num() << ", exception: " << e.what();
+        stop = false;
+      } else {
+        LOG(ERROR) << "Stopping on error "
+                   << e.num() << ", exception: " << e.what();
+        stop = true;
       }
+    }
 
-      if (!more) {
-        break;      //  Last message part
+    // Varz are updated once per batch.
+    VARZ_publisher_bytes_sent = stats.bytes;
+    VARZ_publisher_messages_sent = stats.frames;
+    VARZ_publisher_messages_dropped = stats.dropped;
+    VARZ_publisher_batches = stats.batches;
+    if (batch > 0) {
+      if (static_cast<boost::int64_t>(batch) > VARZ_publisher_batch_size_max) {
+        VARZ_publisher_batch_size_max = batch;
       }
+      if (batch == 1) {
+        VARZ_publisher_batch_size_1++;
+      } else if (batch <= 16) {
+        VARZ_publisher_batch_size_2_16++;
+      } else if (batch <= 256) {
+        VARZ_publisher_batch_size_17_256++;
+      } else {
+        VARZ_publisher_batch_size_over_256++;
+      }
+    }
+    boost::uint64_t now = now_micros() / 1000000;
+    if (now != second) {
+      VARZ_publisher_messages_per_sec =
+          (stats.messages - messagesAtSecond) / (now - second);
+      messagesAtSecond = stats.messages;
+      second = now;
     }
   }
 
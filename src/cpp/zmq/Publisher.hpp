@@ -19,7 +19,8 @@ class Publisher
  public:
 
   // addr - endpoint to connect to send messages for publish
-  // publishAddr - endpoint for subscribers.
+  // publishAddr - endpoint for subscribers; a shm:// endpoint publishes
+  //   to a shared memory ring instead (see ShmRing.hpp).
   Publisher(const std::string& addr, const std::string& publishAddr,
             ::zmq::context_t* context = NULL);
   ~Publisher();
@@ -0,0 +1,281 @@
+
+#include <algorithm>
+#include <deque>
+#include <sstream>
+#include <string.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <glog/logging.h>
+#include <zmq.hpp>
+
+#include "utils.hpp"
+#include "common.hpp"
+#include "varz/varz.hpp"
+#include "zmq/Forwarder.hpp"
+#include "zmq/RouterReactor.hpp"
+#include "zmq/ZmqUtils.hpp"
+
+
+DEFINE_VARZ_int64(router_reactor_requests, 0, "");
+DEFINE_VARZ_int64(router_reactor_replies, 0, "");
+DEFINE_VARZ_string(router_reactor_worker_utilization, "",
+                   "percent of the last second busy, by worker");
+DEFINE_VARZ_string(router_reactor_worker_requests, "", "by worker");
+DEFINE_VARZ_bool(router_reactor_stopped, false, "");
+
+
+namespace atp {
+namespace zmq {
+
+// On the context of the workers, so the names need not be unique.
+static const std::string BACKEND_ADDR = "inproc://router-reactor-backend";
+static const std::string DONE_ADDR = "inproc://router-reactor-done";
+
+// Wakes up the router to check if a strategy stopped the reactor.
+#ifdef ZMQ_3X
+static const long POLL_TIMEOUT = 100;  // msec
+#else
+static const long POLL_TIMEOUT = 100000;  // usec
+#endif
+
+
+/// Sends the remaining frames of the message being read from inbound to
+/// outbound, without copying.
+static void forward_rest(::zmq::socket_t& inbound, ::zmq::socket_t& outbound)
+{
+  bool more = has_more(inbound);
+  while (more) {
+    ::zmq::message_t frame;
+    inbound.recv(&frame);
+    more = has_more(inbound);
+    outbound.send(frame, more ? ZMQ_SNDMORE : 0);
+  }
+}
+
+static std::string worker_identity(size_t worker)
+{
+  return boost::lexical_cast<std::string>(worker);
+}
+
+
+RouterReactor::RouterReactor(const std::string& addr,
+                             StrategyFactory factory,
+                             size_t workers,
+                             ::zmq::context_t* context) :
+    addr_(addr),
+    factory_(factory),
+    workers_(std::max<size_t>(1, workers)),
+    context_(context),
+    stopping_(false),
+    workersReady_(0),
+    ready_(false)
+{
+  for (size_t i = 0; i < workers_; ++i) {
+    strategies_.push_back(factory_());
+  }
+
+  thread_ = boost::shared_ptr<boost::thread>(new boost::thread(
+      boost::bind(&RouterReactor::route, this)));
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (!ready_) {
+    isReady_.wait(lock);
+  }
+
+  LOG(INFO) << "Router reactor with " << workers_ << " workers is ready: "
+            << addr_;
+}
+
+RouterReactor::~RouterReactor()
+{
+  stopping_ = true;
+  if (thread_->joinable()) {
+    thread_->join();
+  }
+}
+
+const std::string& RouterReactor::addr()
+{
+  return addr_;
+}
+
+void RouterReactor::block()
+{
+  thread_->join();
+}
+
+void RouterReactor::route()
+{
+  bool localContext = false;
+  if (context_ == NULL) {
+    context_ = new ::zmq::context_t(1);
+    localContext = true;
+    ZMQ_REACTOR_LOGGER << "Created local context.";
+  }
+
+  // Terminating this context is what stops workers waiting for requests.
+  ::zmq::context_t* workerContext = new ::zmq::context_t(1);
+
+  {
+    ::zmq::socket_t frontend(*context_, ZMQ_ROUTER);
+    ::zmq::socket_t backend(*workerContext, ZMQ_ROUTER);
+    ::zmq::socket_t done(*workerContext, ZMQ_PULL);
+    backend.bind(BACKEND_ADDR.c_str());
+    done.bind(DONE_ADDR.c_str());
+
+    for (size_t i = 0; i < workers_; ++i) {
+      workerThreads_.push_back(new boost::thread(
+          boost::bind(&RouterReactor::work, this, i, workerContext)));
+    }
+
+    // The backend drops requests for workers that are not connected yet.
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (workersReady_ < workers_) {
+        isReady_.wait(lock);
+      }
+    }
+
+    try {
+      frontend.bind(addr_.c_str());
+      ZMQ_REACTOR_LOGGER << "listening @ " << addr_;
+    } catch (::zmq::error_t e) {
+      LOG(FATAL) << "Cannot bind " << addr_ << ":" << e.what();
+    }
+
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      ready_ = true;
+    }
+    isReady_.notify_all();
+
+    // Idle workers, least recently used first.
+    std::deque<size_t> idle;
+    for (size_t i = 0; i < workers_; ++i) {
+      idle.push_back(i);
+    }
+    std::vector<boost::uint64_t> busySince(workers_, 0);
+    std::vector<boost::uint64_t> busyMicros(workers_, 0);
+    std::vector<boost::uint64_t> requests(workers_, 0);
+    boost::uint64_t windowStart = now_micros();
+
+    ::zmq::pollitem_t items[] = {
+      { backend, 0, ZMQ_POLLIN, 0 },
+      { done, 0, ZMQ_POLLIN, 0 },
+      { frontend, 0, ZMQ_POLLIN, 0 },
+    };
+
+    while (!stopping_) {
+      try {
+        // Requests wait in the frontend while all workers are busy.
+        ::zmq::poll(items, idle.empty() ? 2 : 3, POLL_TIMEOUT);
+
+        // Replies, in the order the workers send them.
+        ::zmq::message_t frame;
+        while (backend.recv(&frame, FORWARD_NOBLOCK)) {
+          // frame is the identity of the worker.
+          forward_rest(backend, frontend);
+          VARZ_router_reactor_replies++;
+        }
+
+        boost::uint64_t now = now_micros();
+        while (done.recv(&frame, FORWARD_NOBLOCK)) {
+          size_t worker = boost::lexical_cast<size_t>(std::string(
+              static_cast<const char*>(frame.data()), frame.size()));
+          busyMicros[worker] += now - std::max(busySince[worker], windowStart);
+          busySince[worker] = 0;
+          idle.push_back(worker);
+        }
+
+        while (!idle.empty() && frontend.recv(&frame, FORWARD_NOBLOCK)) {
+          // frame is the identity of the client.
+          size_t worker = idle.front();
+          idle.pop_front();
+
+          std::string identity = worker_identity(worker);
+          ::zmq::message_t to(identity.size());
+          memcpy(to.data(), identity.data(), identity.size());
+          backend.send(to, ZMQ_SNDMORE);
+          backend.send(frame, ZMQ_SNDMORE);
+          forward_rest(frontend, backend);
+
+          busySince[worker] = now;
+          requests[worker]++;
+          VARZ_router_reactor_requests++;
+        }
+
+        if (now - windowStart >= 1000000) {
+          std::ostringstream utilization, counts;
+          for (size_t i = 0; i < workers_; ++i) {
+            if (busySince[i] > 0) {
+              busyMicros[i] += now - std::max(busySince[i], windowStart);
+            }
+            const char* sep = i > 0 ? " " : "";
+            utilization << sep << busyMicros[i] * 100 / (now - windowStart);
+            counts << sep << requests[i];
+            busyMicros[i] = 0;
+          }
+          VARZ_router_reactor_worker_utilization = utilization.str();
+          VARZ_router_reactor_worker_requests = counts.str();
+          windowStart = now;
+        }
+
+      } catch (::zmq::error_t e) {
+        LOG(ERROR) << "Exception while routing messages: " << e.what()
+                   << ", stopping.";
+        stopping_ = true;
+      }
+    }
+  }
+
+  // Workers blocked on their sockets get ETERM and close them.
+  delete workerContext;
+  for (size_t i = 0; i < workerThreads_.size(); ++i) {
+    workerThreads_[i].join();
+  }
+
+  if (localContext) delete context_;
+  VARZ_router_reactor_stopped = true;
+  LOG(ERROR) << "Router reactor stopped.";
+}
+
+void RouterReactor::work(size_t worker, ::zmq::context_t* workerContext)
+{
+  Reactor::Strategy& strategy = strategies_[worker];
+  std::string identity = worker_identity(worker);
+  int linger = 0;
+
+  try {
+    ::zmq::socket_t socket(*workerContext, ZMQ_REP);
+    socket.setsockopt(ZMQ_IDENTITY, identity.data(), identity.size());
+    socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    socket.connect(BACKEND_ADDR.c_str());
+
+    ::zmq::socket_t done(*workerContext, ZMQ_PUSH);
+    done.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    done.connect(DONE_ADDR.c_str());
+
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      workersReady_++;
+    }
+    isReady_.notify_all();
+
+    while (!stopping_) {
+      if (!strategy.respond(socket)) {
+        stopping_ = true;
+      }
+      send_copy(done, identity, false);
+    }
+  } catch (::zmq::error_t e) {
+    if (e.num() != ETERM) {
+      LOG(ERROR) << "Worker " << worker << " stopped on error: " << e.what();
+      stopping_ = true;
+    }
+  }
+}
+
+
+} // namespace zmq
+} // namespace atp
@@ -0,0 +1,82 @@
+#ifndef ATP_ZMQ_ROUTER_REACTOR_H_
+#define ATP_ZMQ_ROUTER_REACTOR_H_
+
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <zmq.hpp>
+
+#include "common.hpp"
+#include "zmq/Reactor.hpp"
+
+namespace atp {
+namespace zmq {
+
+
+/// Reactor that serves many clients at once.  A ROUTER socket at the
+/// address takes the requests of REQ clients (or DEALER clients sending
+/// an empty delimiter frame first) and hands each to an idle worker of a
+/// pool.  Every worker runs its own Reactor::Strategy on a REP socket, so
+/// strategies written for a ZMQ_REP Reactor work unchanged, one request
+/// at a time per worker.  Replies go back to the clients as the workers
+/// finish, not in the order of the requests.
+///
+/// Worker utilization, the percent of the last second spent in respond,
+/// is published in the router_reactor_worker_utilization varz.
+class RouterReactor : NoCopyAndAssign
+{
+ public:
+
+  /// Called once per worker when the reactor is created.  The reactor
+  /// owns the strategies.
+  typedef boost::function<Reactor::Strategy*()> StrategyFactory;
+
+  RouterReactor(const std::string& addr,
+                StrategyFactory factory,
+                size_t workers,
+                ::zmq::context_t* context = NULL);
+
+  /// Stops routing and the workers.
+  ~RouterReactor();
+
+  const std::string& addr();
+
+  size_t workers() const
+  {
+    return workers_;
+  }
+
+  /// Returns when a strategy stops the reactor by returning false.
+  void block();
+
+ private:
+
+  /// Forwards requests and replies between the clients and the workers.
+  void route();
+
+  void work(size_t worker, ::zmq::context_t* workerContext);
+
+ private:
+  const std::string addr_;
+  StrategyFactory factory_;
+  const size_t workers_;
+  ::zmq::context_t* context_;
+  boost::shared_ptr<boost::thread> thread_;
+  boost::ptr_vector<boost::thread> workerThreads_;
+  boost::ptr_vector<Reactor::Strategy> strategies_;  // by worker
+  boost::atomic<bool> stopping_;
+  size_t workersReady_;
+  bool ready_;
+  boost::mutex mutex_;
+  boost::condition_variable isReady_;
+};
+
+
+} // namespace zmq
+} // namespace atp
+
+#endif //ATP_ZMQ_ROUTER_REACTOR_H_
@@ -0,0 +1,481 @@
+
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <new>
+
+#include <boost/atomic.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "utils.hpp"
+#include "zmq/ShmRing.hpp"
+
+
+namespace atp {
+namespace zmq {
+
+using boost::interprocess::interprocess_exception;
+using boost::interprocess::mapped_region;
+using boost::interprocess::shared_memory_object;
+
+static const std::string SHM_PREFIX = "shm://";
+static const boost::uint64_t RING_MAGIC = 0x61747072696e6731ULL;
+static const boost::uint32_t RECORD_WRAP = 0xffffffff;
+static const size_t RECORD_HEADER_SIZE = 8;  // size, frame count
+static const size_t MAX_FRAMES = 16;
+
+// Reader wait: yield this many times before blocking.
+static const int READER_SPINS = 100;
+// Longest block of a reader, to notice a writer that went away without
+// closing the ring.
+static const boost::int64_t READER_MAX_WAIT_MICROS = 100000;
+// Wait for the writer to create the segment.
+static const boost::int64_t READER_OPEN_WAIT_MICROS = 10000;
+
+
+/// Start of the segment.  Records follow at DATA_OFFSET; each is
+///
+///   uint32 size  -- of the record, padded to 8 bytes; RECORD_WRAP to
+///                   continue at the start of the ring
+///   uint32 count -- of frames
+///   count x (uint32 length, bytes)
+///
+/// The writer moves `reserved` past a record before writing it and `head`
+/// once it is written.  A reader's copy of a record is good if `reserved`
+/// has not passed the record's position + capacity after the copy.
+///
+/// Readers with nothing to read count themselves in `waiters` and block on
+/// `wakeups`, which the writer bumps and wakes after a write only while
+/// there are waiters.
+struct ring_header_t
+{
+  boost::uint64_t magic;
+  boost::uint64_t capacity;
+  boost::atomic<boost::uint64_t> head;
+  boost::atomic<boost::uint64_t> reserved;
+  boost::atomic<boost::uint32_t> closed;
+  boost::atomic<boost::uint32_t> waiters;
+  boost::atomic<boost::uint32_t> wakeups;
+};
+
+static const size_t DATA_OFFSET = 64;
+
+
+static inline ring_header_t* header_of(mapped_region* region)
+{
+  return static_cast<ring_header_t*>(region->get_address());
+}
+
+static inline char* data_of(mapped_region* region)
+{
+  return static_cast<char*>(region->get_address()) + DATA_OFFSET;
+}
+
+static inline void put32(char* at, boost::uint32_t value)
+{
+  memcpy(at, &value, sizeof(value));
+}
+
+static inline boost::uint32_t get32(const char* at)
+{
+  boost::uint32_t value;
+  memcpy(&value, at, sizeof(value));
+  return value;
+}
+
+
+/// Blocks while the word is value, up to timeoutMicros, or until woken.
+static void wait_word(boost::atomic<boost::uint32_t>* word,
+                      boost::uint32_t value, boost::int64_t timeoutMicros)
+{
+#ifdef __linux__
+  struct timespec timeout;
+  timeout.tv_sec = timeoutMicros / 1000000;
+  timeout.tv_nsec = (timeoutMicros % 1000000) * 1000;
+  // Not FUTEX_PRIVATE: the word is shared with the writer's process.
+  syscall(SYS_futex, reinterpret_cast<boost::uint32_t*>(word), FUTEX_WAIT,
+          value, &timeout, NULL, 0);
+#else
+  boost::this_thread::sleep(boost::posix_time::microseconds(
+      std::min<boost::int64_t>(timeoutMicros, 50)));
+#endif
+}
+
+/// Wakes all the readers blocked on the word.
+static void wake_word(boost::atomic<boost::uint32_t>* word)
+{
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<boost::uint32_t*>(word), FUTEX_WAKE,
+          INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/// Bumps the wakeups of the ring and wakes its readers, if any wait.
+static void wake_readers(ring_header_t* header)
+{
+  // Orders the store of head before the load of waiters; see wait().
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  if (header->waiters.load(boost::memory_order_relaxed) > 0) {
+    header->wakeups.fetch_add(1, boost::memory_order_release);
+    wake_word(&header->wakeups);
+  }
+}
+
+
+bool ShmRing::is_shm(const std::string& endpoint)
+{
+  return endpoint.compare(0, SHM_PREFIX.size(), SHM_PREFIX) == 0;
+}
+
+std::string ShmRing::segment(const std::string& endpoint)
+{
+  return is_shm(endpoint) ? endpoint.substr(SHM_PREFIX.size()) : endpoint;
+}
+
+
+ShmRingWriter::ShmRingWriter(const std::string& endpoint, size_t capacity) :
+    segment_(ShmRing::segment(endpoint)),
+    messages_(0)
+{
+  size_t size = 4096;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  try {
+    shared_memory_object::remove(segment_.c_str());
+    shared_memory_object shm(boost::interprocess::create_only,
+                             segment_.c_str(),
+                             boost::interprocess::read_write);
+    shm.truncate(DATA_OFFSET + size);
+    region_.reset(new mapped_region(shm, boost::interprocess::read_write));
+  } catch (interprocess_exception& e) {
+    LOG(FATAL) << "Cannot create shared memory ring " << segment_ << ": "
+               << e.what();
+  }
+
+  ring_header_t* header = new (region_->get_address()) ring_header_t();
+  header->capacity = size;
+  header->head.store(0, boost::memory_order_relaxed);
+  header->reserved.store(0, boost::memory_order_relaxed);
+  header->closed.store(0, boost::memory_order_relaxed);
+  header->waiters.store(0, boost::memory_order_relaxed);
+  header->wakeups.store(0, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  header->magic = RING_MAGIC;
+
+  LOG(INFO) << "Created shared memory ring " << segment_ << ", " << size
+            << " bytes";
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+  ring_header_t* header = header_of(region_.get());
+  header->closed.store(1, boost::memory_order_release);
+  wake_readers(header);
+  shared_memory_object::remove(segment_.c_str());
+}
+
+bool ShmRingWriter::write(const frames_t& frames)
+{
+  const char* data[MAX_FRAMES];
+  size_t sizes[MAX_FRAMES];
+  if (frames.size() > MAX_FRAMES) {
+    return false;
+  }
+  for (size_t i = 0; i < frames.size(); ++i) {
+    data[i] = frames[i].data();
+    sizes[i] = frames[i].size();
+  }
+  return write(data, sizes, frames.size());
+}
+
+bool ShmRingWriter::write(const char* const* frames, const size_t* sizes,
+                          size_t count)
+{
+  ring_header_t* header = header_of(region_.get());
+  char* data = data_of(region_.get());
+  const boost::uint64_t capacity = header->capacity;
+
+  size_t size = RECORD_HEADER_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    size += sizeof(boost::uint32_t) + sizes[i];
+  }
+  size = (size + 7) & ~static_cast<size_t>(7);
+  if (size > capacity / 2) {
+    return false;
+  }
+
+  boost::uint64_t head = header->head.load(boost::memory_order_relaxed);
+  size_t offset = head & (capacity - 1);
+  if (offset + size > capacity) {
+    header->reserved.store(head + (capacity - offset) + size,
+                           boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    put32(data + offset, RECORD_WRAP);
+    head += capacity - offset;
+    offset = 0;
+  } else {
+    header->reserved.store(head + size, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+  }
+
+  char* at = data + offset;
+  put32(at, static_cast<boost::uint32_t>(size));
+  put32(at + 4, static_cast<boost::uint32_t>(count));
+  at += RECORD_HEADER_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    put32(at, static_cast<boost::uint32_t>(sizes[i]));
+    memcpy(at + 4, frames[i], sizes[i]);
+    at += 4 + sizes[i];
+  }
+
+  header->head.store(head + size, boost::memory_order_release);
+  wake_readers(header);
+  messages_++;
+  return true;
+}
+
+
+ShmRingReader::ShmRingReader(const std::string& endpoint) :
+    segment_(ShmRing::segment(endpoint)),
+    position_(0),
+    overruns_(0),
+    topicsChanged_(false)
+{
+}
+
+ShmRingReader::~ShmRingReader()
+{
+}
+
+void ShmRingReader::subscribe(const std::string& topic)
+{
+  boost::lock_guard<boost::mutex> lock(topicsMutex_);
+  pendingTopics_.push_back(topic);
+  topicsChanged_.store(true, boost::memory_order_release);
+}
+
+void ShmRingReader::unsubscribe(const std::string& topic)
+{
+  boost::lock_guard<boost::mutex> lock(topicsMutex_);
+  std::vector<std::string>::iterator found =
+      std::find(pendingTopics_.begin(), pendingTopics_.end(), topic);
+  if (found != pendingTopics_.end()) {
+    pendingTopics_.erase(found);
+    topicsChanged_.store(true, boost::memory_order_release);
+  }
+}
+
+bool ShmRingReader::open()
+{
+  try {
+    // Writable for the count of waiters only.
+    shared_memory_object shm(boost::interprocess::open_only,
+                             segment_.c_str(),
+                             boost::interprocess::read_write);
+    region_.reset(new mapped_region(shm, boost::interprocess::read_write));
+  } catch (interprocess_exception& e) {
+    return false;
+  }
+
+  ring_header_t* header = header_of(region_.get());
+  if (region_->get_size() < DATA_OFFSET || header->magic != RING_MAGIC ||
+      region_->get_size() < DATA_OFFSET + header->capacity) {
+    // Not initialized by the writer yet.
+    region_.reset();
+    return false;
+  }
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  position_ = header->head.load(boost::memory_order_acquire);
+
+  LOG(INFO) << "Opened shared memory ring " << segment_;
+  return true;
+}
+
+bool ShmRingReader::subscribed(const frames_t& frames) const
+{
+  if (frames.empty()) {
+    return false;
+  }
+  for (size_t i = 0; i < topics_.size(); ++i) {
+    if (frames[0].compare(0, topics_[i].size(), topics_[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ShmRingReader::read_result_t ShmRingReader::read(frames_t* frames)
+{
+  ring_header_t* header = header_of(region_.get());
+  const char* data = data_of(region_.get());
+  const boost::uint64_t capacity = header->capacity;
+
+  boost::uint64_t head = header->head.load(boost::memory_order_acquire);
+  if (position_ == head) {
+    return NONE;
+  }
+  if (head - position_ > capacity) {
+    position_ = head;
+    overruns_++;
+    return OVERRUN;
+  }
+
+  // The record may be overwritten while it is copied; lengths are checked
+  // against the record before use and the copy is checked after.
+  size_t offset = position_ & (capacity - 1);
+  boost::uint32_t size = get32(data + offset);
+  size_t next = RECORD_WRAP == size ? capacity - offset : size;
+
+  bool valid = true;
+  if (size != RECORD_WRAP) {
+    valid = size >= RECORD_HEADER_SIZE && size % 8 == 0 &&
+        offset + size <= capacity && size <= head - position_;
+    if (valid) {
+      boost::uint32_t count = get32(data + offset + 4);
+      const char* at = data + offset + RECORD_HEADER_SIZE;
+      const char* end = data + offset + size;
+      valid = count <= size / 4;
+      frames->resize(valid ? count : 0);
+      for (size_t i = 0; valid && i < frames->size(); ++i) {
+        boost::uint32_t length = at + 4 <= end ? get32(at) : 0;
+        valid = at + 4 + length <= end;
+        if (valid) {
+          (*frames)[i].assign(at + 4, length);
+          at += 4 + length;
+        }
+      }
+    }
+  }
+
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  boost::uint64_t reserved =
+      header->reserved.load(boost::memory_order_relaxed);
+  if (reserved > position_ + capacity) {
+    position_ = header->head.load(boost::memory_order_acquire);
+    overruns_++;
+    return OVERRUN;
+  }
+  if (!valid) {
+    LOG(ERROR) << "Corrupt record in shared memory ring " << segment_
+               << " at " << position_;
+    position_ = head;
+    return OVERRUN;
+  }
+
+  position_ += next;
+  return size != RECORD_WRAP && subscribed(*frames) ? READ : SKIPPED;
+}
+
+void ShmRingReader::wait(boost::int64_t timeoutMicros)
+{
+  ring_header_t* header = header_of(region_.get());
+  // Counted before head is checked again, so that a writer that moved head
+  // after the check sees the waiter and wakes it.
+  header->waiters.fetch_add(1, boost::memory_order_seq_cst);
+  boost::uint32_t wakeups = header->wakeups.load(boost::memory_order_acquire);
+  if (header->head.load(boost::memory_order_seq_cst) == position_ &&
+      !header->closed.load(boost::memory_order_acquire)) {
+    wait_word(&header->wakeups, wakeups, timeoutMicros);
+  }
+  header->waiters.fetch_sub(1, boost::memory_order_relaxed);
+}
+
+bool ShmRingReader::receive(frames_t* frames, boost::int64_t timeoutMicros)
+{
+  if (topicsChanged_.load(boost::memory_order_acquire)) {
+    boost::lock_guard<boost::mutex> lock(topicsMutex_);
+    topics_ = pendingTopics_;
+    topicsChanged_.store(false, boost::memory_order_relaxed);
+  }
+
+  boost::int64_t start = now_micros();
+  int idle = 0;
+  while (true) {
+    if (region_ || open()) {
+      read_result_t result = read(frames);
+      if (result == READ) {
+        return true;
+      } else if (result != NONE) {
+        idle = 0;
+        continue;
+      }
+      if (header_of(region_.get())->closed.load(
+              boost::memory_order_acquire)) {
+        // The writer is gone; a new one creates a new segment.
+        LOG(INFO) << "Shared memory ring " << segment_ << " closed.";
+        region_.reset();
+      }
+    }
+    boost::int64_t remaining = READER_MAX_WAIT_MICROS;
+    if (timeoutMicros >= 0) {
+      remaining = timeoutMicros - (now_micros() - start);
+      if (remaining <= 0) {
+        return false;
+      }
+    }
+    if (++idle < READER_SPINS) {
+      boost::this_thread::yield();
+    } else if (region_) {
+      wait(std::min(remaining, READER_MAX_WAIT_MICROS));
+    } else {
+      boost::this_thread::sleep(boost::posix_time::microseconds(
+          std::min(remaining, READER_OPEN_WAIT_MICROS)));
+    }
+  }
+}
+
+
+size_t forward_batch(::zmq::socket_t& inbound, ShmRingWriter& ring,
+                     size_t maxMessages, forward_stats_t* stats)
+{
+  ::zmq::message_t frames[MAX_FRAMES];
+  const char* data[MAX_FRAMES];
+  size_t sizes[MAX_FRAMES];
+
+  inbound.recv(&frames[0]);
+  size_t count = 0;
+  do {
+    size_t n = 0;
+    size_t bytes = 0;
+    while (true) {
+      bool more = has_more(inbound);
+      if (n < MAX_FRAMES) {
+        data[n] = static_cast<const char*>(frames[n].data());
+        sizes[n] = frames[n].size();
+        bytes += sizes[n];
+        trace_forward(data[n], sizes[n]);
+      }
+      stats->frames++;
+      if (!more) {
+        break;
+      }
+      // Frames past MAX_FRAMES are read and dropped with the message.
+      inbound.recv(&frames[++n < MAX_FRAMES ? n : MAX_FRAMES - 1]);
+    }
+    if (n < MAX_FRAMES && ring.write(data, sizes, n + 1)) {
+      stats->messages++;
+      stats->bytes += bytes;
+    } else {
+      stats->dropped++;
+    }
+    ++count;
+  } while (count < maxMessages && inbound.recv(&frames[0], FORWARD_NOBLOCK));
+  stats->batches++;
+  return count;
+}
+
+
+} // namespace zmq
+} // namespace atp
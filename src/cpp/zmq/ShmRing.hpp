@@ -0,0 +1,141 @@
+#ifndef ATP_ZMQ_SHM_RING_H_
+#define ATP_ZMQ_SHM_RING_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <zmq.hpp>
+
+#include "common.hpp"
+#include "zmq/Forwarder.hpp"
+
+
+namespace boost {
+namespace interprocess {
+class mapped_region;
+}
+}
+
+
+namespace atp {
+namespace zmq {
+
+
+/// Shared memory ring of multipart messages for subscribers on the same
+/// host as the publisher (see EndPoint::shm).  There is one writer and
+/// any number of readers, each with its own cursor; the writer never
+/// waits for readers.  A reader that falls more than the capacity of the
+/// ring behind is overrun: it skips ahead to the latest message and counts
+/// the overrun instead of reading torn data.  Idle readers block on a futex
+/// in the segment, which the writer wakes only while some wait, so readers
+/// map the segment writable.
+///
+/// The segment is /dev/shm/<name>; endpoints are "shm://<name>".
+struct ShmRing
+{
+  static const size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+  static bool is_shm(const std::string& endpoint);
+
+  /// Name of the shared memory segment of the endpoint.
+  static std::string segment(const std::string& endpoint);
+};
+
+
+class ShmRingWriter : NoCopyAndAssign
+{
+ public:
+
+  /// Creates the segment, replacing any left by a previous writer.
+  /// Capacity is rounded up to a power of 2.
+  ShmRingWriter(const std::string& endpoint,
+                size_t capacity = ShmRing::DEFAULT_CAPACITY);
+
+  /// Removes the segment.  Readers that have it mapped keep reading it
+  /// but see no more messages.
+  ~ShmRingWriter();
+
+  /// Returns false if the message is larger than half the ring.
+  bool write(const frames_t& frames);
+
+  bool write(const char* const* frames, const size_t* sizes, size_t count);
+
+  boost::uint64_t messages() const
+  {
+    return messages_;
+  }
+
+ private:
+  std::string segment_;
+  boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+  boost::uint64_t messages_;
+};
+
+
+class ShmRingReader : NoCopyAndAssign
+{
+ public:
+
+  /// The segment is opened on the first receive after the writer has
+  /// created it, so readers can start before the publisher.  Reading
+  /// starts at the latest message.
+  explicit ShmRingReader(const std::string& endpoint);
+
+  ~ShmRingReader();
+
+  /// Messages are filtered by prefix of the first frame, like the topic
+  /// subscriptions of a zmq SUB socket.  Nothing is received until
+  /// subscribed.  Can be called from any thread; changes apply from the
+  /// next receive.
+  void subscribe(const std::string& topic);
+
+  void unsubscribe(const std::string& topic);
+
+  /// Waits up to timeoutMicros for a message.  Returns false on timeout.
+  bool receive(frames_t* frames, boost::int64_t timeoutMicros = -1);
+
+  /// Times the reader was overrun by the writer.
+  boost::uint64_t overruns() const
+  {
+    return overruns_;
+  }
+
+ private:
+
+  bool open();
+
+  /// Blocks up to timeoutMicros for the writer to move head.
+  void wait(boost::int64_t timeoutMicros);
+
+  enum read_result_t { NONE, READ, SKIPPED, OVERRUN };
+  read_result_t read(frames_t* frames);
+
+  bool subscribed(const frames_t& frames) const;
+
+  std::string segment_;
+  boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+  boost::uint64_t position_;
+  boost::uint64_t overruns_;
+  std::vector<std::string> topics_;  // of the reading thread
+
+  boost::mutex topicsMutex_;
+  std::vector<std::string> pendingTopics_;
+  boost::atomic<bool> topicsChanged_;
+};
+
+
+/// Blocks until a message arrives, then writes it and all the messages
+/// already queued on the inbound socket, up to maxMessages, to the ring.
+/// Messages with more frames than a record can hold are dropped.
+size_t forward_batch(::zmq::socket_t& inbound, ShmRingWriter& ring,
+                     size_t maxMessages, forward_stats_t* stats);
+
+
+} // namespace zmq
+} // namespace atp
+
+#endif //ATP_ZMQ_SHM_RING_H_
@@ -51,6 +51,12 @@ struct EndPoint {
     return "ipc://" + name;
   }
 
+  /// Shared memory ring on the same host (see ShmRing.hpp).
+  static std::string shm(const std::string& name)
+  {
+    return "shm://" + name;
+  }
+
   /// As of ZMQ 2.1.7, hostname must be resolvable (not '*')
   static std::string tcp(int port, const std::string& host="127.0.0.1")
   {
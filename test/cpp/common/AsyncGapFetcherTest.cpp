@@ -0,0 +1,156 @@
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "common/async_gap_fetcher.hpp"
+
+
+using std::string;
+using std::vector;
+using atp::common::async_gap_fetcher;
+using atp::common::fetched_gap_t;
+using atp::common::fetched_gaps;
+using atp::common::sequence_gap_t;
+
+
+/// Returns the seqs of the gap as the messages, with the thread it ran on;
+/// blocks while the gate is closed.
+struct fake_fetcher
+{
+  fake_fetcher() : open(true), calls(0) {}
+
+  bool operator()(const string& topic, const sequence_gap_t& gap,
+                  vector<string>* messages)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!open) {
+      changed.wait(lock);
+    }
+    calls++;
+    thread = boost::this_thread::get_id();
+    if (topic == "MISSING") {
+      return false;
+    }
+    for (boost::uint64_t seq = gap.first; seq <= gap.last; ++seq) {
+      messages->push_back(boost::lexical_cast<string>(seq));
+    }
+    return true;
+  }
+
+  void set_open(bool value)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    open = value;
+    changed.notify_all();
+  }
+
+  boost::mutex mutex;
+  boost::condition_variable changed;
+  bool open;
+  int calls;
+  boost::thread::id thread;
+};
+
+static sequence_gap_t gap(boost::uint64_t first, boost::uint64_t last)
+{
+  sequence_gap_t gap = sequence_gap_t();
+  gap.publisher = 7;
+  gap.first = first;
+  gap.last = last;
+  return gap;
+}
+
+static bool wait_for(fetched_gaps* inbox, vector<fetched_gap_t>* out)
+{
+  for (int i = 0; i < 1000; ++i) {
+    if (inbox->take(out)) {
+      return true;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+  }
+  return false;
+}
+
+
+TEST(AsyncGapFetcherTest, FetchTest)
+{
+  fake_fetcher fetcher;
+  async_gap_fetcher async(boost::bind<bool>(boost::ref(fetcher), _1, _2, _3),
+                          0);
+  fetched_gaps inbox;
+  vector<fetched_gap_t> fetched;
+  EXPECT_FALSE(inbox.take(&fetched));
+
+  // The request returns at once; the fetch runs on another thread.
+  fetcher.set_open(false);
+  ASSERT_TRUE(async.request("AAPL.STK", gap(3, 5), &inbox));
+  EXPECT_FALSE(inbox.take(&fetched));
+  fetcher.set_open(true);
+
+  ASSERT_TRUE(wait_for(&inbox, &fetched));
+  ASSERT_EQ(1u, fetched.size());
+  EXPECT_EQ("AAPL.STK", fetched[0].topic);
+  EXPECT_EQ(3u, fetched[0].gap.first);
+  ASSERT_EQ(3u, fetched[0].messages.size());
+  EXPECT_EQ("3", fetched[0].messages[0]);
+  EXPECT_EQ("5", fetched[0].messages[2]);
+  EXPECT_NE(boost::this_thread::get_id(), fetcher.thread);
+  EXPECT_FALSE(inbox.take(&fetched));
+
+  // Nothing found is not put in the inbox.
+  ASSERT_TRUE(async.request("MISSING", gap(1, 1), &inbox));
+  ASSERT_TRUE(async.request("GOOG.STK", gap(9, 9), &inbox));
+  ASSERT_TRUE(wait_for(&inbox, &fetched));
+  ASSERT_EQ(1u, fetched.size());
+  EXPECT_EQ("GOOG.STK", fetched[0].topic);
+  async.stop();
+  EXPECT_EQ(3u, async.requested());
+  EXPECT_EQ(2u, async.fetched());
+  EXPECT_EQ(1u, async.failed());
+  EXPECT_EQ(0u, async.dropped());
+
+  // Stopped, requests are dropped.
+  EXPECT_FALSE(async.request("AAPL.STK", gap(6, 6), &inbox));
+  EXPECT_EQ(1u, async.dropped());
+}
+
+TEST(AsyncGapFetcherTest, RateLimitTest)
+{
+  fake_fetcher fetcher;
+  fetched_gaps inbox;
+  {
+    // A burst of a second's worth, then drops.
+    async_gap_fetcher async(
+        boost::bind<bool>(boost::ref(fetcher), _1, _2, _3), 2);
+    EXPECT_TRUE(async.request("AAPL.STK", gap(1, 1), &inbox));
+    EXPECT_TRUE(async.request("AAPL.STK", gap(3, 3), &inbox));
+    EXPECT_FALSE(async.request("AAPL.STK", gap(5, 5), &inbox));
+    EXPECT_EQ(1u, async.dropped());
+
+    // and one every half second.
+    boost::this_thread::sleep(boost::posix_time::milliseconds(600));
+    EXPECT_TRUE(async.request("AAPL.STK", gap(7, 7), &inbox));
+    EXPECT_FALSE(async.request("AAPL.STK", gap(9, 9), &inbox));
+    EXPECT_EQ(2u, async.dropped());
+  }
+  {
+    // At most maxPending wait while the source is slow; the rest are
+    // dropped, also by the destructor.
+    fetcher.set_open(false);
+    async_gap_fetcher async(
+        boost::bind<bool>(boost::ref(fetcher), _1, _2, _3), 0, 2);
+    int accepted = 0;
+    for (int i = 0; i < 10; ++i) {
+      accepted += async.request("AAPL.STK", gap(i, i), &inbox) ? 1 : 0;
+    }
+    // One may be taken by the fetching thread, blocked in the fetcher.
+    EXPECT_LE(2, accepted);
+    EXPECT_GE(3, accepted);
+    fetcher.set_open(true);
+  }
+}
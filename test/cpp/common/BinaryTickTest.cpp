@@ -0,0 +1,181 @@
+
+#include <string>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "utils.hpp"
+#include "common/binary_tick.hpp"
+#include "common/intern_table.hpp"
+#include "common/trace_header.hpp"
+#include "proto/binary_tick.hpp"
+#include "proto/common.hpp"
+#include "proto/sequence.hpp"
+
+
+using std::string;
+using atp::common::binary_tick_t;
+using proto::ib::MarketData;
+
+
+static MarketData market_data(const string& event, double price)
+{
+  MarketData m;
+  m.set_timestamp(1368627780123456LL);
+  m.set_symbol("AAPL.STK");
+  m.set_event(event);
+  proto::common::set_as(price, m.mutable_value());
+  m.set_contract_id(265598);
+  m.set_symbol_id(atp::common::symbols().intern(m.symbol()));
+  m.set_event_id(atp::common::events().intern(m.event()));
+  m.set_intern_stamp(atp::common::intern_stamp());
+  m.set_publisher_id(1368600000000000LL);
+  m.set_seq(1234);
+  return m;
+}
+
+
+TEST(BinaryTickTest, RoundTripTest)
+{
+  binary_tick_t tick;
+  tick.symbol_id = 3;
+  tick.event_id = 7;
+  tick.contract_id = 265598;
+  tick.timestamp = 1368627780123456LL;
+  tick.publisher_id = 99;
+  tick.seq = 12;
+  tick.intern_stamp = 0x1234abcd;
+  tick.set(441.25);
+
+  string encoded;
+  atp::common::encode_binary_tick(tick, &encoded);
+  EXPECT_EQ(atp::common::BINARY_TICK_SIZE, encoded.size());
+  EXPECT_TRUE(atp::common::is_binary_tick(encoded));
+
+  binary_tick_t decoded;
+  ASSERT_TRUE(atp::common::decode_binary_tick(encoded, &decoded));
+  EXPECT_EQ(binary_tick_t::DOUBLE, decoded.type);
+  EXPECT_EQ(3u, decoded.symbol_id);
+  EXPECT_EQ(7u, decoded.event_id);
+  EXPECT_EQ(265598u, decoded.contract_id);
+  EXPECT_EQ(1368627780123456ULL, decoded.timestamp);
+  EXPECT_EQ(99u, decoded.publisher_id);
+  EXPECT_EQ(12u, decoded.seq);
+  EXPECT_EQ(0x1234abcdu, decoded.intern_stamp);
+  EXPECT_EQ(441.25, decoded.value.double_value);
+
+  tick.set(100);
+  atp::common::encode_binary_tick(tick, &encoded);
+  ASSERT_TRUE(atp::common::decode_binary_tick(encoded, &decoded));
+  EXPECT_EQ(binary_tick_t::INT, decoded.type);
+  EXPECT_EQ(100, decoded.value.int_value);
+
+  string time("1368627780");
+  tick.set(time);
+  atp::common::encode_binary_tick(tick, &encoded);
+  EXPECT_EQ(atp::common::BINARY_TICK_HEADER_SIZE + 4 + time.size(),
+            encoded.size());
+  ASSERT_TRUE(atp::common::decode_binary_tick(encoded, &decoded));
+  EXPECT_EQ(binary_tick_t::STRING, decoded.type);
+  EXPECT_EQ(time, decoded.string());
+
+  // Truncated or of another version.
+  EXPECT_FALSE(atp::common::decode_binary_tick(
+      encoded.data(), encoded.size() - 1, &decoded));
+  encoded[1] = 1;
+  EXPECT_FALSE(atp::common::decode_binary_tick(encoded, &decoded));
+}
+
+TEST(BinaryTickTest, ProtoTest)
+{
+  MarketData m = market_data("BID", 441.25);
+  string serialized;
+  ASSERT_TRUE(m.SerializeToString(&serialized));
+  EXPECT_FALSE(atp::common::is_binary_tick(serialized));
+
+  binary_tick_t tick;
+  ASSERT_TRUE(proto::ib::to_binary_tick(m, &tick));
+  string encoded;
+  atp::common::encode_binary_tick(tick, &encoded);
+
+  // Either encoding parses to the same message.
+  MarketData parsed;
+  ASSERT_TRUE(proto::ib::parse_market_data(encoded, &parsed));
+  EXPECT_EQ(m.SerializeAsString(), parsed.SerializeAsString());
+  ASSERT_TRUE(proto::ib::parse_market_data(serialized, &parsed));
+  EXPECT_EQ(m.SerializeAsString(), parsed.SerializeAsString());
+
+  boost::uint64_t publisher, seq;
+  ASSERT_TRUE(proto::ib::read_sequence(encoded, &publisher, &seq));
+  EXPECT_EQ(m.publisher_id(), publisher);
+  EXPECT_EQ(m.seq(), seq);
+
+  // Also behind a trace header.
+  string traced(atp::common::TRACE_HEADER_SIZE, '\0');
+  atp::common::encode_trace_header(m.publisher_id(), m.seq(), &traced[0]);
+  traced += encoded;
+  ASSERT_TRUE(proto::ib::parse_market_data(traced, &parsed));
+  EXPECT_EQ(m.SerializeAsString(), parsed.SerializeAsString());
+  ASSERT_TRUE(proto::ib::read_sequence(traced, &publisher, &seq));
+  EXPECT_EQ(m.seq(), seq);
+
+  // Ids of other tables are not resolved.
+  tick.intern_stamp = atp::common::intern_stamp() + 1;
+  atp::common::encode_binary_tick(tick, &encoded);
+  EXPECT_FALSE(proto::ib::parse_market_data(encoded, &parsed));
+
+  // Without interned ids there is no binary tick.
+  m.clear_event_id();
+  EXPECT_FALSE(proto::ib::to_binary_tick(m, &tick));
+}
+
+// Encoding and decoding cost and size per tick, binary vs proto.
+TEST(BinaryTickTest, BenchmarkTest)
+{
+  const int ticks = 200000;
+  MarketData m = market_data("ASK", 441.26);
+  string serialized = m.SerializeAsString();
+  binary_tick_t tick;
+  ASSERT_TRUE(proto::ib::to_binary_tick(m, &tick));
+  string encoded;
+  atp::common::encode_binary_tick(tick, &encoded);
+
+  char buffer[256];
+  boost::uint64_t start = now_micros();
+  for (int i = 0; i < ticks; ++i) {
+    m.set_seq(i);
+    m.SerializeToArray(buffer, sizeof(buffer));
+  }
+  boost::uint64_t protoEncode = now_micros() - start;
+
+  start = now_micros();
+  for (int i = 0; i < ticks; ++i) {
+    tick.seq = i;
+    atp::common::encode_binary_tick(tick, buffer);
+  }
+  boost::uint64_t binaryEncode = now_micros() - start;
+
+  MarketData parsed;
+  start = now_micros();
+  for (int i = 0; i < ticks; ++i) {
+    parsed.ParseFromString(serialized);
+  }
+  boost::uint64_t protoDecode = now_micros() - start;
+
+  binary_tick_t decoded;
+  start = now_micros();
+  for (int i = 0; i < ticks; ++i) {
+    atp::common::decode_binary_tick(encoded, &decoded);
+  }
+  boost::uint64_t binaryDecode = now_micros() - start;
+
+  LOG(INFO) << "Bytes / tick: proto = " << serialized.size()
+            << ", binary = " << encoded.size();
+  LOG(INFO) << "Encode nsec / tick: proto = " << protoEncode * 1000 / ticks
+            << ", binary = " << binaryEncode * 1000 / ticks;
+  LOG(INFO) << "Decode nsec / tick: proto = " << protoDecode * 1000 / ticks
+            << ", binary = " << binaryDecode * 1000 / ticks;
+
+  EXPECT_LT(encoded.size(), serialized.size());
+  EXPECT_EQ(m.timestamp(), decoded.timestamp);
+}
@@ -0,0 +1,148 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "common/intern_table.hpp"
+
+using std::string;
+using atp::common::intern_table;
+using atp::common::intern_id_t;
+using atp::common::NO_INTERN_ID;
+
+
+TEST(InternTableTest, InternTest)
+{
+  intern_table table("test");
+
+  intern_id_t aapl = table.intern("AAPL.STK");
+  intern_id_t goog = table.intern("GOOG.STK");
+
+  EXPECT_EQ(1u, aapl);
+  EXPECT_EQ(2u, goog);
+  EXPECT_EQ(aapl, table.intern("AAPL.STK"));
+  EXPECT_EQ(2u, table.size());
+
+  EXPECT_EQ("AAPL.STK", table.name(aapl));
+  EXPECT_EQ("GOOG.STK", table.name(goog));
+  EXPECT_EQ("", table.name(NO_INTERN_ID));
+  EXPECT_EQ("", table.name(100));
+
+  intern_id_t id;
+  EXPECT_TRUE(table.find("GOOG.STK", &id));
+  EXPECT_EQ(goog, id);
+  EXPECT_FALSE(table.find("MSFT.STK", &id));
+  EXPECT_FALSE(table.is_shared());
+}
+
+TEST(InternTableTest, ManyChunksTest)
+{
+  intern_table table("test");
+  size_t count = intern_table::CHUNK_SIZE * 3 + 7;
+  for (size_t i = 0; i < count; ++i) {
+    std::ostringstream s;
+    s << "S" << i;
+    EXPECT_EQ(i + 1, table.intern(s.str()));
+  }
+  EXPECT_EQ(count, table.size());
+  EXPECT_EQ("S5000", table.name(5001));
+}
+
+static void intern_all(intern_table* table, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    std::ostringstream s;
+    s << "S" << i;
+    intern_id_t id = table->intern(s.str());
+    EXPECT_EQ(s.str(), table->name(id));
+  }
+}
+
+TEST(InternTableTest, ConcurrentInternTest)
+{
+  intern_table table("test");
+  boost::thread_group threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.create_thread(boost::bind(&intern_all, &table, 5000));
+  }
+  threads.join_all();
+  EXPECT_EQ(5000u, table.size());
+}
+
+TEST(InternTableTest, SharedFileTest)
+{
+  const string path("_intern_table_test.intern");
+  std::remove(path.c_str());
+
+  intern_table first("first");
+  intern_table second("second");
+  ASSERT_TRUE(first.open(path));
+  ASSERT_TRUE(second.open(path));
+  EXPECT_TRUE(first.is_shared());
+
+  EXPECT_EQ(1u, first.intern("AAPL.STK"));
+  EXPECT_EQ(2u, second.intern("GOOG.STK"));  // catches up with first
+  EXPECT_EQ(2u, first.intern("GOOG.STK"));
+  EXPECT_EQ(3u, first.intern("MSFT.STK"));
+
+  // Ids appended by the other table are picked up on lookup.
+  EXPECT_EQ("MSFT.STK", second.name(3));
+
+  // Reloaded from file.
+  intern_table third("third");
+  ASSERT_TRUE(third.open(path));
+  EXPECT_EQ(3u, third.size());
+  EXPECT_EQ("GOOG.STK", third.name(2));
+
+  // Same file, same stamp; unshared tables have stamps of their own.
+  EXPECT_EQ(first.stamp(), second.stamp());
+  EXPECT_EQ(first.stamp(), third.stamp());
+  intern_table unshared("unshared");
+  EXPECT_NE(0u, unshared.stamp());
+  EXPECT_NE(first.stamp(), unshared.stamp());
+
+  // Cannot back a table that has handed out ids.
+  intern_table fourth("fourth");
+  fourth.intern("X");
+  EXPECT_FALSE(fourth.open(path));
+
+  std::remove(path.c_str());
+}
+
+TEST(InternTableTest, StampTest)
+{
+  const string path1("_intern_table_test1.intern");
+  const string path2("_intern_table_test2.intern");
+  std::remove(path1.c_str());
+  std::remove(path2.c_str());
+
+  // Files created apart have different stamps, so their ids do not mix.
+  intern_table first("first");
+  intern_table second("second");
+  ASSERT_TRUE(first.open(path1));
+  ASSERT_TRUE(second.open(path2));
+  EXPECT_NE(first.stamp(), second.stamp());
+  EXPECT_EQ(1u, first.intern("AAPL.STK"));
+
+  // A file without a stamp is not taken as shared.
+  const string legacy("_intern_table_test3.intern");
+  {
+    std::ofstream out(legacy.c_str());
+    out << "AAPL.STK\nGOOG.STK\n";
+  }
+  intern_table third("third");
+  ASSERT_TRUE(third.open(legacy));
+  EXPECT_FALSE(third.is_shared());
+  EXPECT_EQ(2u, third.size());
+
+  std::remove(path1.c_str());
+  std::remove(path2.c_str());
+  std::remove(legacy.c_str());
+}
@@ -0,0 +1,97 @@
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/sequence_tracker.hpp"
+#include "proto/common.hpp"
+#include "proto/sequence.hpp"
+
+
+using std::string;
+using atp::common::sequence_gap_t;
+using atp::common::sequence_tracker;
+
+
+TEST(SequenceTrackerTest, GapTest)
+{
+  sequence_tracker<> tracker;
+  sequence_gap_t gap;
+
+  // Joining in the middle of a sequence is not a gap.
+  EXPECT_EQ(sequence_tracker<>::FIRST, tracker.check("AAPL.STK", 7, 10, 100));
+  EXPECT_EQ(sequence_tracker<>::IN_ORDER,
+            tracker.check("AAPL.STK", 7, 11, 110));
+  EXPECT_EQ(sequence_tracker<>::FIRST, tracker.check("GOOG.STK", 7, 1, 115));
+
+  EXPECT_EQ(sequence_tracker<>::GAP,
+            tracker.check("AAPL.STK", 7, 15, 150, &gap));
+  EXPECT_EQ(7u, gap.publisher);
+  EXPECT_EQ(12u, gap.first);
+  EXPECT_EQ(14u, gap.last);
+  EXPECT_EQ(3u, gap.size());
+  EXPECT_EQ(110u, gap.after_ts);
+  EXPECT_EQ(150u, gap.before_ts);
+
+  EXPECT_EQ(sequence_tracker<>::STALE, tracker.check("AAPL.STK", 7, 13, 130));
+  EXPECT_EQ(sequence_tracker<>::STALE, tracker.check("AAPL.STK", 7, 15, 150));
+  EXPECT_EQ(sequence_tracker<>::IN_ORDER,
+            tracker.check("AAPL.STK", 7, 16, 160));
+  EXPECT_EQ(sequence_tracker<>::GAP, tracker.check("GOOG.STK", 7, 3, 170));
+
+  // Publisher restarted.
+  EXPECT_EQ(sequence_tracker<>::FIRST, tracker.check("AAPL.STK", 8, 1, 200));
+  EXPECT_EQ(sequence_tracker<>::IN_ORDER,
+            tracker.check("AAPL.STK", 8, 2, 210));
+
+  EXPECT_EQ(2u, tracker.channels());
+  EXPECT_EQ(2u, tracker.gaps());
+  EXPECT_EQ(4u, tracker.missed());
+  EXPECT_EQ(2u, tracker.stale());
+  EXPECT_EQ(1u, tracker.resets());
+}
+
+TEST(SequenceTrackerTest, ReadSequenceTest)
+{
+  proto::ib::MarketData marketData;
+  marketData.set_timestamp(1000);
+  marketData.set_symbol("AAPL.STK");
+  marketData.set_event("BID");
+  proto::common::set_as(500.5, marketData.mutable_value());
+  marketData.set_contract_id(265598);
+  marketData.set_symbol_id(3);
+
+  string serialized;
+  ASSERT_TRUE(marketData.SerializeToString(&serialized));
+
+  boost::uint64_t publisher, seq;
+  EXPECT_FALSE(proto::ib::read_sequence(serialized, &publisher, &seq));
+
+  marketData.set_publisher_id(1364312345678901ULL);
+  marketData.set_seq(123456789);
+  ASSERT_TRUE(marketData.SerializeToString(&serialized));
+  EXPECT_TRUE(proto::ib::read_sequence(serialized, &publisher, &seq));
+  EXPECT_EQ(1364312345678901ULL, publisher);
+  EXPECT_EQ(123456789u, seq);
+
+  proto::ib::MarketDepth marketDepth;
+  marketDepth.set_timestamp(1000);
+  marketDepth.set_symbol("AAPL.STK");
+  marketDepth.set_side(proto::ib::MarketDepth_Side_BID);
+  marketDepth.set_price(500.25);
+  marketDepth.set_size(100);
+  marketDepth.set_operation(proto::ib::MarketDepth_Operation_UPDATE);
+  marketDepth.set_level(2);
+  marketDepth.set_mm("ISLAND");
+  marketDepth.set_contract_id(265598);
+  marketDepth.set_publisher_id(9);
+  marketDepth.set_seq(42);
+  ASSERT_TRUE(marketDepth.SerializeToString(&serialized));
+  EXPECT_TRUE(proto::ib::read_sequence(serialized, &publisher, &seq));
+  EXPECT_EQ(9u, publisher);
+  EXPECT_EQ(42u, seq);
+
+  // Truncated
+  EXPECT_FALSE(proto::ib::read_sequence(serialized.substr(0, 10),
+                                        &publisher, &seq));
+}
@@ -0,0 +1,79 @@
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/tick_batch.hpp"
+
+
+using std::string;
+using atp::common::tick_batch;
+using atp::common::tick_batch_reader;
+
+
+static void add(tick_batch* batch, const string& record, boost::uint64_t now)
+{
+  char* at = batch->append(record.size(), now);
+  memcpy(at, record.data(), record.size());
+}
+
+
+TEST(TickBatchTest, RoundTripTest)
+{
+  tick_batch batch;
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(0u, batch.bytes());
+
+  add(&batch, "first", 100);
+  add(&batch, "", 110);
+  add(&batch, "third record", 120);
+  EXPECT_EQ(3u, batch.count());
+  EXPECT_EQ(100u, batch.start());
+  EXPECT_EQ(atp::common::TICK_BATCH_HEADER_SIZE + 3 * 4 + 5 + 12,
+            batch.bytes());
+  EXPECT_TRUE(atp::common::is_tick_batch(batch.data()));
+
+  tick_batch_reader reader(batch.data());
+  EXPECT_EQ(3u, reader.count());
+  string record;
+  ASSERT_TRUE(reader.next(&record));
+  EXPECT_EQ("first", record);
+  ASSERT_TRUE(reader.next(&record));
+  EXPECT_EQ("", record);
+  ASSERT_TRUE(reader.next(&record));
+  EXPECT_EQ("third record", record);
+  EXPECT_FALSE(reader.next(&record));
+
+  // Reused after clear, starting over.
+  batch.clear();
+  EXPECT_TRUE(batch.empty());
+  add(&batch, "again", 200);
+  EXPECT_EQ(1u, batch.count());
+  EXPECT_EQ(200u, batch.start());
+  tick_batch_reader again(batch.data());
+  ASSERT_TRUE(again.next(&record));
+  EXPECT_EQ("again", record);
+  EXPECT_FALSE(again.next(&record));
+}
+
+TEST(TickBatchTest, InvalidTest)
+{
+  tick_batch batch;
+  add(&batch, "first", 100);
+  add(&batch, "second", 110);
+
+  // A truncated record is not read.
+  string truncated = batch.data().substr(0, batch.bytes() - 1);
+  tick_batch_reader reader(truncated);
+  string record;
+  ASSERT_TRUE(reader.next(&record));
+  EXPECT_EQ("first", record);
+  EXPECT_FALSE(reader.next(&record));
+
+  // Nor anything that is not a batch, e.g. a proto.
+  string proto("\x08\x01\x12\x08" "AAPL.STK", 12);
+  EXPECT_FALSE(atp::common::is_tick_batch(proto));
+  tick_batch_reader none(proto);
+  EXPECT_EQ(0u, none.count());
+  EXPECT_FALSE(none.next(&record));
+}
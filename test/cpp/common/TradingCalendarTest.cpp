@@ -0,0 +1,127 @@
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "common/time_utils.hpp"
+#include "common/trading_calendar.hpp"
+
+using namespace boost::gregorian;
+using namespace boost::posix_time;
+using atp::time::TradingCalendar;
+
+
+// Eastern time string to UTC micros
+static boost::uint64_t est(const std::string& s)
+{
+  ptime t;
+  EXPECT_TRUE(atp::time::parse(s, &t));
+  return atp::time::as_micros(t);
+}
+
+
+TEST(TradingCalendarTest, HolidaysTest)
+{
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2012, Dec, 25)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2013, Jan, 1)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2013, Jan, 21)));  // MLK
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2013, Feb, 18)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2013, Mar, 29)));  // Good Fri
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2013, May, 27)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2015, Jul, 3)));  // observed
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2013, Sep, 2)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2012, Nov, 22)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2012, Oct, 29)));  // Sandy
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2023, Jun, 19)));
+  EXPECT_FALSE(TradingCalendar::is_trading_day(date(2012, Dec, 29)));  // Sat
+
+  // New Year's Day on Saturday is not observed on the Friday before.
+  EXPECT_TRUE(TradingCalendar::is_trading_day(date(2021, Dec, 31)));
+  EXPECT_TRUE(TradingCalendar::is_trading_day(date(2012, Dec, 31)));
+
+  EXPECT_TRUE(TradingCalendar::is_half_day(date(2012, Jul, 3)));
+  EXPECT_TRUE(TradingCalendar::is_half_day(date(2012, Nov, 23)));
+  EXPECT_TRUE(TradingCalendar::is_half_day(date(2012, Dec, 24)));
+  EXPECT_FALSE(TradingCalendar::is_half_day(date(2012, Dec, 31)));
+}
+
+TEST(TradingCalendarTest, SessionBoundariesTest)
+{
+  const TradingCalendar& cal = TradingCalendar::instance();
+
+  // Regular day
+  EXPECT_FALSE(cal.is_rth(est("2012-12-31 09:29:59.999999")));
+  EXPECT_TRUE(cal.is_rth(est("2012-12-31 09:30:00.00")));
+  EXPECT_TRUE(cal.is_rth(est("2012-12-31 15:59:59.999999")));
+  EXPECT_FALSE(cal.is_rth(est("2012-12-31 16:00:00.00")));
+  EXPECT_TRUE(cal.is_ext(est("2012-12-31 04:00:00.00")));
+  EXPECT_TRUE(cal.is_ext(est("2012-12-31 19:59:59.00")));
+  EXPECT_FALSE(cal.is_ext(est("2012-12-31 20:00:00.00")));
+  EXPECT_FALSE(cal.is_ext(est("2012-12-31 03:59:59.00")));
+
+  // Half day
+  EXPECT_TRUE(cal.is_rth(est("2012-12-24 12:59:59.00")));
+  EXPECT_FALSE(cal.is_rth(est("2012-12-24 13:00:00.00")));
+  EXPECT_TRUE(cal.is_ext(est("2012-12-24 16:59:59.00")));
+  EXPECT_FALSE(cal.is_ext(est("2012-12-24 17:00:00.00")));
+
+  // Holiday and weekend
+  EXPECT_FALSE(cal.is_ext(est("2012-12-25 10:00:00.00")));
+  EXPECT_FALSE(cal.is_ext(est("2012-12-29 10:00:00.00")));
+
+  // Friday evening is Saturday in UTC
+  EXPECT_TRUE(cal.is_ext(est("2012-12-28 19:30:00.00")));
+  EXPECT_TRUE(cal.check(est("2012-12-28 19:30:00.00"), false));
+  EXPECT_FALSE(cal.check(est("2012-12-28 19:30:00.00"), true));
+}
+
+TEST(TradingCalendarTest, DaylightSavingTest)
+{
+  const TradingCalendar& cal = TradingCalendar::instance();
+
+  // Before and after 2013-03-10
+  const atp::time::session_t* fri = cal.session(date(2013, Mar, 8));
+  const atp::time::session_t* mon = cal.session(date(2013, Mar, 11));
+  ASSERT_TRUE(fri != NULL);
+  ASSERT_TRUE(mon != NULL);
+
+  EXPECT_EQ(atp::time::as_micros(ptime(date(2013, Mar, 8), hours(14) +
+                                       minutes(30))), fri->rth_start);
+  EXPECT_EQ(atp::time::as_micros(ptime(date(2013, Mar, 11), hours(13) +
+                                       minutes(30))), mon->rth_start);
+
+  EXPECT_TRUE(cal.is_rth(est("2013-03-11 09:30:00.00")));
+  EXPECT_FALSE(cal.is_rth(est("2013-03-11 09:29:00.00")));
+}
+
+TEST(TradingCalendarTest, AgreesWithCheckRTHTest)
+{
+  const TradingCalendar& cal = TradingCalendar::instance();
+
+  // Every minute of a regular week, across the DST change.
+  boost::uint64_t start = est("2013-03-04 00:00:00.00");
+  boost::uint64_t end = est("2013-03-16 00:00:00.00");
+  for (boost::uint64_t ts = start; ts < end; ts += 60000000ULL) {
+    ptime t = atp::time::as_ptime(ts);
+    date d = atp::time::to_est(t).date();
+    if (!TradingCalendar::is_trading_day(d)) {
+      // A friday evening session can extend into the weekend.
+      if (d.day_of_week() != Saturday) {
+        EXPECT_FALSE(cal.is_ext(ts));
+      }
+      continue;
+    }
+    EXPECT_EQ(atp::time::checkRTH(t), cal.is_rth(ts)) << t;
+    EXPECT_EQ(atp::time::checkEXT(t), cal.is_ext(ts)) << t;
+  }
+}
+
+TEST(TradingCalendarTest, OutOfRangeTest)
+{
+  TradingCalendar cal(date(2013, Jan, 1), date(2013, Jan, 31));
+  EXPECT_TRUE(cal.is_rth(est("2012-12-31 10:00:00.00")));
+  EXPECT_TRUE(cal.is_rth(est("2013-02-01 10:00:00.00")));
+  EXPECT_FALSE(cal.is_rth(est("2013-01-01 10:00:00.00")));
+  EXPECT_TRUE(cal.is_rth(est("2013-01-02 10:00:00.00")));
+}
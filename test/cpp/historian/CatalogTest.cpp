@@ -0,0 +1,225 @@
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "common/intern_table.hpp"
+#include "historian/Catalog.hpp"
+
+
+using std::string;
+using std::vector;
+using historian::Catalog;
+using proto::historian::SessionLog;
+
+static const boost::uint64_t MINUTE = 60 * 1000000ULL;
+static const boost::uint64_t T0 = 1356965700000000ULL;  // 2012-12-31 09:55 EST
+
+
+static SessionLog sessionLog(const string& symbol, boost::uint64_t start,
+                             boost::uint64_t stop, const string& source)
+{
+  SessionLog l;
+  l.set_symbol(symbol);
+  l.set_start_timestamp(start);
+  l.set_stop_timestamp(stop);
+  l.set_source(source);
+  return l;
+}
+
+
+TEST(CatalogTest, FindTest)
+{
+  Catalog catalog;
+
+  // One long session, and short sessions every hour.
+  catalog.Add(sessionLog("AAPL.STK", T0, T0 + 600 * MINUTE, "long"));
+  for (int i = 0; i < 10; ++i) {
+    catalog.Add(sessionLog("AAPL.STK", T0 + i * 60 * MINUTE,
+                           T0 + i * 60 * MINUTE + 10 * MINUTE, "short"));
+  }
+  catalog.Add(sessionLog("GOOG.STK", T0, T0 + 10 * MINUTE, "goog"));
+
+  // Adding again is a no-op
+  catalog.Add(sessionLog("GOOG.STK", T0, T0 + 10 * MINUTE, "goog"));
+
+  EXPECT_EQ(2u, catalog.Symbols());
+  EXPECT_EQ(12u, catalog.Sessions());
+
+  vector<SessionLog> found;
+
+  // Overlaps the long session and the short one at hour 2
+  EXPECT_EQ(2u, catalog.Find("AAPL.STK", T0 + 125 * MINUTE,
+                             T0 + 130 * MINUTE, &found));
+  EXPECT_EQ("long", found[0].source());
+  EXPECT_EQ("short", found[1].source());
+  EXPECT_EQ(T0 + 120 * MINUTE, found[1].start_timestamp());
+
+  // Gap in the short sessions
+  found.clear();
+  EXPECT_EQ(1u, catalog.Find("AAPL.STK", T0 + 15 * MINUTE,
+                             T0 + 20 * MINUTE, &found));
+
+  // Before any data, and an unknown symbol
+  found.clear();
+  EXPECT_EQ(0u, catalog.Find("AAPL.STK", T0 - 20 * MINUTE, T0, &found));
+  EXPECT_EQ(0u, catalog.Find("IBM.STK", T0, T0 + 600 * MINUTE, &found));
+
+  // All symbols, ordered by symbol
+  found.clear();
+  EXPECT_EQ(3u, catalog.Find("", T0, T0 + 5 * MINUTE, &found));
+  EXPECT_EQ("GOOG.STK", found[2].symbol());
+}
+
+TEST(CatalogTest, UpdateTest)
+{
+  Catalog catalog(5 * MINUTE);
+
+  // Records written with a gap of more than 5 minutes.
+  for (int i = 0; i < 10; ++i) {
+    catalog.Update("AAPL.STK", T0 + i * MINUTE);
+  }
+  for (int i = 20; i < 30; ++i) {
+    catalog.Update("AAPL.STK", T0 + i * MINUTE);
+  }
+  EXPECT_EQ(2u, catalog.Sessions());
+
+  vector<SessionLog> found;
+  EXPECT_EQ(2u, catalog.Find("AAPL.STK", T0, T0 + 60 * MINUTE, &found));
+  EXPECT_EQ(T0 + 9 * MINUTE, found[0].stop_timestamp());
+  EXPECT_EQ(10u, found[0].records());
+  EXPECT_EQ(T0 + 20 * MINUTE, found[1].start_timestamp());
+
+  // Session log written for the first session replaces it.
+  catalog.Add(sessionLog("AAPL.STK", T0, T0 + 9 * MINUTE, "loader"));
+  EXPECT_EQ(2u, catalog.Sessions());
+
+  found.clear();
+  EXPECT_EQ(1u, catalog.Find("AAPL.STK", T0, T0 + 10 * MINUTE, &found));
+  EXPECT_EQ("loader", found[0].source());
+  EXPECT_EQ(10u, found[0].records());
+}
+
+TEST(CatalogTest, UpdateByIdTest)
+{
+  Catalog catalog(5 * MINUTE);
+  atp::common::intern_id_t id = atp::common::symbols().intern("IBM.STK");
+
+  // Updates by id and by name go to the same sessions.
+  for (int i = 0; i < 10; ++i) {
+    catalog.Update(id, T0 + i * MINUTE);
+  }
+  catalog.Update("IBM.STK", T0 + 10 * MINUTE);
+  EXPECT_EQ(1u, catalog.Symbols());
+  EXPECT_EQ(1u, catalog.Sessions());
+
+  vector<SessionLog> found;
+  EXPECT_EQ(1u, catalog.Find("IBM.STK", T0, T0 + 60 * MINUTE, &found));
+  EXPECT_EQ(11u, found[0].records());
+
+  // Ids not in the table are ignored.
+  catalog.Update(id + 1000, T0);
+  EXPECT_EQ(1u, catalog.Symbols());
+}
+
+TEST(CatalogTest, UpdateBatchTest)
+{
+  Catalog one(5 * MINUTE), batched(5 * MINUTE);
+  const string aapl("AAPL.STK");
+  atp::common::intern_id_t msft = atp::common::symbols().intern("MSFT.STK");
+
+  // In order, out of order within the gap, repeats, and a new session.
+  boost::uint64_t minutes[] = { 0, 1, 2, 4, 3, 3, 9, 20, 21, 2 };
+  vector<Catalog::written_t> written;
+  for (size_t i = 0; i < sizeof(minutes) / sizeof(minutes[0]); ++i) {
+    boost::uint64_t ts = T0 + minutes[i] * MINUTE;
+    one.Update(aapl, ts);
+    one.Update(msft, ts, true);
+    Catalog::written_t byName = { &aapl, atp::common::NO_INTERN_ID, ts, false };
+    Catalog::written_t byId = { NULL, msft, ts, true };
+    written.push_back(byName);
+    written.push_back(byId);
+  }
+  batched.Update(written);
+
+  EXPECT_EQ(4u, one.Sessions());
+  EXPECT_EQ(one.Sessions(), batched.Sessions());
+
+  vector<SessionLog> expected, found;
+  one.Find("", T0, T0 + 60 * MINUTE, &expected);
+  batched.Find("", T0, T0 + 60 * MINUTE, &found);
+  ASSERT_EQ(expected.size(), found.size());
+  for (size_t i = 0; i < found.size(); ++i) {
+    EXPECT_EQ(expected[i].symbol(), found[i].symbol());
+    EXPECT_EQ(expected[i].start_timestamp(), found[i].start_timestamp());
+    EXPECT_EQ(expected[i].stop_timestamp(), found[i].stop_timestamp());
+    EXPECT_EQ(expected[i].records(), found[i].records());
+  }
+  EXPECT_EQ(T0 + 9 * MINUTE, found[0].stop_timestamp());
+  EXPECT_EQ(5u, found[0].records());   // AAPL: repeats not counted
+  EXPECT_EQ(8u, found[2].records());   // MSFT: all new
+}
+
+TEST(CatalogTest, MergeTest)
+{
+  Catalog catalog(5 * MINUTE);
+
+  // Two sessions 10 minutes apart, the later written first.
+  for (int i = 10; i < 20; ++i) {
+    catalog.Update("AAPL.STK", T0 + i * MINUTE);
+  }
+  for (int i = 0; i < 5; ++i) {
+    catalog.Update("AAPL.STK", T0 + i * MINUTE);
+  }
+  EXPECT_EQ(2u, catalog.Sessions());
+
+  // Within the gap of both: one session.
+  catalog.Update("AAPL.STK", T0 + 7 * MINUTE);
+  EXPECT_EQ(1u, catalog.Sessions());
+
+  vector<SessionLog> found;
+  EXPECT_EQ(1u, catalog.Find("AAPL.STK", T0, T0 + 60 * MINUTE, &found));
+  EXPECT_EQ(T0, found[0].start_timestamp());
+  EXPECT_EQ(T0 + 19 * MINUTE, found[0].stop_timestamp());
+  EXPECT_EQ(16u, found[0].records());
+
+  // Writing the same records again does not count them again, unless
+  // known to be new.
+  for (int i = 0; i < 5; ++i) {
+    catalog.Update("AAPL.STK", T0 + i * MINUTE);
+  }
+  catalog.Update("AAPL.STK", T0 + 8 * MINUTE, true);
+  found.clear();
+  EXPECT_EQ(1u, catalog.Find("AAPL.STK", T0, T0 + 60 * MINUTE, &found));
+  EXPECT_EQ(17u, found[0].records());
+}
+
+TEST(CatalogTest, SessionLogCountTest)
+{
+  Catalog catalog(5 * MINUTE);
+
+  SessionLog log = sessionLog("AAPL.STK", T0, T0 + 60 * MINUTE, "loader");
+  log.set_records(100);
+  catalog.Add(log);
+
+  // Records of the logged session, e.g. loaded again, are counted by it.
+  for (int i = 0; i < 60; ++i) {
+    catalog.Update("AAPL.STK", T0 + i * MINUTE, i % 2 == 0);
+  }
+  EXPECT_EQ(1u, catalog.Sessions());
+
+  vector<SessionLog> found;
+  EXPECT_EQ(1u, catalog.Find("AAPL.STK", T0, T0 + 60 * MINUTE, &found));
+  EXPECT_EQ(100u, found[0].records());
+
+  // After it, a session of its own, not overlapping.
+  catalog.Update("AAPL.STK", T0 + 62 * MINUTE);
+  EXPECT_EQ(2u, catalog.Sessions());
+  found.clear();
+  EXPECT_EQ(1u, catalog.Find("AAPL.STK", T0 + 61 * MINUTE,
+                             T0 + 70 * MINUTE, &found));
+  EXPECT_EQ(T0 + 62 * MINUTE, found[0].start_timestamp());
+  EXPECT_EQ(1u, found[0].records());
+}
@@ -168,3 +168,56 @@ TEST(DbTest, DbReadWriteMarketDataTest)
 
 }
 
+TEST(DbTest, QueryBySymbolIdTest)
+{
+  Db db("/tmp/testdb-ids");
+  EXPECT_TRUE(db.Open());
+
+  atp::common::intern_id_t id = atp::common::symbols().intern("IBM.STK");
+  boost::uint32_t stamp = atp::common::intern_stamp();
+  boost::uint64_t t0 = 1356965700000000ULL;
+
+  MarketData d;
+  d.set_symbol("IBM.STK");
+  d.set_symbol_id(id);
+  d.set_intern_stamp(stamp);
+  d.set_event("BID");
+  proto::common::set_as(200., d.mutable_value());
+  d.set_contract_id(1);
+  for (int i = 0; i < 5; ++i) {
+    d.set_timestamp(t0 + i);
+    EXPECT_TRUE(db.Write(d));
+  }
+
+  struct : public historian::Visitor
+  {
+    int count;
+    bool operator()(const Record& record)
+    {
+      ++count;
+      return true;
+    }
+  } visitor;
+
+  visitor.count = 0;
+  db.Query(proto::historian::IB_MARKET_DATA, id, stamp, t0, t0 + 10,
+           &visitor);
+  EXPECT_EQ(5, visitor.count);
+
+  QueryBySymbol qbs;
+  qbs.set_type(proto::historian::IB_MARKET_DATA);
+  qbs.set_symbol("");
+  qbs.set_symbol_id(id);
+  qbs.set_intern_stamp(stamp);
+  qbs.set_utc_first_micros(t0 + 2);
+  qbs.set_utc_last_micros(t0 + 10);
+  visitor.count = 0;
+  db.Query(qbs, &visitor);
+  EXPECT_EQ(3, visitor.count);
+
+  // Ids of other tables find nothing.
+  qbs.set_intern_stamp(stamp + 1);
+  visitor.count = 0;
+  EXPECT_EQ(0, db.Query(qbs, &visitor));
+  EXPECT_EQ(0, visitor.count);
+}
@@ -0,0 +1,167 @@
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include <leveldb/db.h>
+
+#include "historian/DuplicateFilter.hpp"
+#include "varz/varz.hpp"
+
+
+DECLARE_VARZ_int64(historian_dedup_keys_probed);
+
+
+using std::string;
+using std::vector;
+using namespace leveldb;
+
+using historian::BloomFilter;
+using historian::DuplicateFilter;
+
+const static std::string DEDUP_DB_FILE("/tmp/testdb-dedup");
+
+
+static string key(const string& symbol, boost::uint64_t ts)
+{
+  std::ostringstream k;
+  k << "mkt:" << symbol << ':' << ts;
+  return k.str();
+}
+
+
+TEST(DuplicateFilterTest, BloomFilterTest)
+{
+  BloomFilter filter(1000);
+  for (int i = 0; i < 1000; ++i) {
+    filter.Add(key("AAPL.STK", 1356965700000000ULL + i));
+  }
+  EXPECT_EQ(1000, filter.Count());
+
+  // No false negatives
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(filter.MayContain(key("AAPL.STK", 1356965700000000ULL + i)));
+  }
+
+  // False positive rate at 10 bits per key should be about 1%
+  int positives = 0;
+  for (int i = 0; i < 10000; ++i) {
+    if (filter.MayContain(key("GOOG.STK", 1356965700000000ULL + i))) {
+      ++positives;
+    }
+  }
+  LOG(INFO) << "False positives = " << positives;
+  EXPECT_GT(500, positives);
+}
+
+TEST(DuplicateFilterTest, CheckBatchTest)
+{
+  DB* db;
+  Options options;
+  options.create_if_missing = true;
+  ASSERT_TRUE(DB::Open(options, DEDUP_DB_FILE, &db).ok());
+
+  boost::uint64_t t = 1356965700000000ULL;  // 2012-12-31 09:55 EST
+
+  // Clean up and write every other key
+  for (int i = 0; i < 100; ++i) {
+    db->Delete(WriteOptions(), key("AAPL.STK", t + i));
+    db->Delete(WriteOptions(), key("GOOG.STK", t + i));
+  }
+  for (int i = 0; i < 100; i += 2) {
+    ASSERT_TRUE(db->Put(WriteOptions(), key("AAPL.STK", t + i), "x").ok());
+  }
+
+  DuplicateFilter filter;
+
+  // Batch out of order, with two symbols and a repeated key
+  vector<string> keys;
+  for (int i = 99; i >= 0; --i) {
+    keys.push_back(key("AAPL.STK", t + i));
+    keys.push_back(key("GOOG.STK", t + i));
+  }
+  keys.push_back(key("GOOG.STK", t + 1));
+
+  vector<bool> duplicate;
+  EXPECT_EQ(51u, filter.Check(db, keys, &duplicate));
+  EXPECT_EQ(keys.size(), duplicate.size());
+  EXPECT_EQ(2u, filter.Sessions());
+
+  EXPECT_TRUE(duplicate[0] == false);  // AAPL t + 99
+  EXPECT_TRUE(duplicate[2] == true);   // AAPL t + 98
+  EXPECT_TRUE(duplicate[1] == false);  // GOOG t + 99
+  EXPECT_TRUE(duplicate[keys.size() - 1] == true);  // repeat of GOOG t + 1
+
+  // Write the new keys and check again: all duplicates now.
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!duplicate[i]) {
+      ASSERT_TRUE(db->Put(WriteOptions(), keys[i], "x").ok());
+      filter.Added(keys[i]);
+    }
+  }
+  EXPECT_EQ(keys.size(), filter.Check(db, keys, &duplicate));
+
+  // A key of a new day is a new session
+  vector<string> next(1, key("AAPL.STK", t + 24ULL * 60 * 60 * 1000000));
+  EXPECT_EQ(0u, filter.Check(db, next, &duplicate));
+  EXPECT_EQ(3u, filter.Sessions());
+
+  filter.Stop();
+  delete db;
+}
+
+TEST(DuplicateFilterTest, BackgroundLoadTest)
+{
+  DB* db;
+  Options options;
+  options.create_if_missing = true;
+  ASSERT_TRUE(DB::Open(options, DEDUP_DB_FILE, &db).ok());
+
+  boost::uint64_t t = 1357052100000000ULL;  // 2013-01-01 09:55 EST
+  for (int i = 0; i < 100; ++i) {
+    db->Delete(WriteOptions(), key("IBM.STK", t + i));
+  }
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_TRUE(db->Put(WriteOptions(), key("IBM.STK", t + i), "x").ok());
+  }
+
+  DuplicateFilter filter;
+  vector<string> keys;
+  for (int i = 0; i < 60; ++i) {
+    keys.push_back(key("IBM.STK", t + i));
+  }
+
+  // The session is loading: every key is read from the db.
+  vector<bool> duplicate;
+  boost::int64_t probed = VARZ_historian_dedup_keys_probed;
+  EXPECT_EQ(50u, filter.Check(db, keys, &duplicate));
+  EXPECT_EQ(60, VARZ_historian_dedup_keys_probed - probed);
+
+  // Written while loading
+  for (int i = 50; i < 60; ++i) {
+    ASSERT_TRUE(db->Put(WriteOptions(), keys[i], "x").ok());
+    filter.Added(keys[i]);
+  }
+
+  // Loaded: new keys miss the filter, bar false positives.
+  filter.WaitForLoads();
+  keys.clear();
+  for (int i = 60; i < 100; ++i) {
+    keys.push_back(key("IBM.STK", t + i));
+  }
+  probed = VARZ_historian_dedup_keys_probed;
+  EXPECT_EQ(0u, filter.Check(db, keys, &duplicate));
+  EXPECT_GT(5, VARZ_historian_dedup_keys_probed - probed);
+
+  keys.clear();
+  for (int i = 0; i < 60; ++i) {
+    keys.push_back(key("IBM.STK", t + i));
+  }
+  EXPECT_EQ(60u, filter.Check(db, keys, &duplicate));
+
+  filter.Stop();
+  delete db;
+}
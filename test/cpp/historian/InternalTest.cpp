@@ -238,3 +238,15 @@ TEST(InternalTest, SessionLogWriterTest)
   EXPECT_TRUE(read->IsInitialized());
   EXPECT_EQ("test", read->source());
 }
+
+TEST(InternalTest, KeyBuilderKeys)
+{
+  using namespace historian::internal;
+
+  KeyBuilder<MarketData> buildKey;
+  EXPECT_EQ("mkt:AAPL.STK:1000", buildKey(string("AAPL.STK"), 1000));
+
+  Writer<MarketData> writer;
+  EXPECT_EQ("x/event-value:AAPL.STK:BID:1000",
+            writer.buildIndexKey(string("AAPL.STK"), string("BID"), 1000));
+}
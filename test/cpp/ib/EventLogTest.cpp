@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <sstream>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "ib/event_log.hpp"
+
+using namespace std;
+using namespace ib::internal;
+
+
+static event_t tick_price(long tickerId, int field, double price)
+{
+  event_t event = event_t();
+  event.ts_utc = 1360000000000000ULL + tickerId;
+  event.connection_id = 1;
+  event.type = EVENT_TICK_PRICE;
+  event.field = field;
+  event.id = tickerId;
+  event.value = price;
+  return event;
+}
+
+static void log_ticks(EventLog* log, long tickerId, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    while (!log->log(tick_price(tickerId, 1, i))) {
+      boost::this_thread::yield();
+    }
+  }
+}
+
+static string text(const event_t& event)
+{
+  ostringstream out;
+  write_text(event, &out);
+  return out.str();
+}
+
+
+TEST(EventLogTest, RingTest)
+{
+  EventRing ring(3);
+  EXPECT_EQ(4u, ring.size());
+
+  event_t event;
+  EXPECT_FALSE(ring.pop(&event));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.push(tick_price(i, 1, 10. + i)));
+  }
+  EXPECT_FALSE(ring.push(tick_price(4, 1, 14.)));
+
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(ring.pop(&event));
+    EXPECT_EQ(i, event.id);
+    EXPECT_EQ(10. + i, event.value);
+  }
+  EXPECT_FALSE(ring.pop(&event));
+
+  // Wraps around.
+  EXPECT_TRUE(ring.push(tick_price(5, 1, 15.)));
+  ASSERT_TRUE(ring.pop(&event));
+  EXPECT_EQ(5, event.id);
+}
+
+TEST(EventLogTest, TextTest)
+{
+  // Same as the lines logged by LoggingEWrapper.
+  EXPECT_EQ("cid=1,ts_utc=1360000000000005,event=tickPrice,tickerId=5,"
+            "field=BID,price=10.25,canAutoExecute=0",
+            text(tick_price(5, 1, 10.25)));
+
+  event_t event = event_t();
+  event.ts_utc = 1360000000000000ULL;
+  event.connection_id = 2;
+  event.type = EVENT_TICK_STRING;
+  event.field = 45;  // LAST_TIMESTAMP
+  event.id = 7;
+  EXPECT_TRUE(event.set_text("1360000000"));
+  EXPECT_EQ("cid=2,ts_utc=1360000000000000,event=tickString,tickerId=7,"
+            "field=LAST_TIMESTAMP,value=1360000000", text(event));
+
+  event = event_t();
+  event.ts_utc = 1360000000000000ULL;
+  event.connection_id = 2;
+  event.type = EVENT_UPDATE_MKT_DEPTH_L2;
+  event.id = 7;
+  event.position = 3;
+  event.operation = 1;
+  event.side = 0;
+  event.value = 99.5;
+  event.size = 200;
+  EXPECT_TRUE(event.set_text("ARCA"));
+  EXPECT_EQ("cid=2,ts_utc=1360000000000000,event=updateMktDepthL2,id=7,"
+            "position=3,marketMaker=ARCA,operation=1,side=0,price=99.5,"
+            "size=200", text(event));
+
+  EXPECT_FALSE(event.set_text(string(EVENT_TEXT_SIZE + 1, 'x')));
+}
+
+TEST(EventLogTest, WriteReadTest)
+{
+  for (int compress = 0; compress < 2; ++compress) {
+    string path;
+    {
+      EventLog log(".", "_event_log_test", compress == 1, 256, 1);
+      ASSERT_TRUE(log.is_open());
+      path = log.current_file();
+
+      // Producers on several threads, more events than the ring holds.
+      boost::thread_group producers;
+      for (long tickerId = 0; tickerId < 4; ++tickerId) {
+        producers.create_thread(boost::bind(&log_ticks, &log, tickerId, 1000));
+      }
+      producers.join_all();
+      log.close();
+      EXPECT_EQ(4000u, log.written());
+      EXPECT_FALSE(log.is_open());
+    }
+
+    EventLogReader reader(path);
+    ASSERT_TRUE(reader.is_open());
+    event_t event;
+    int next[4] = { 0, 0, 0, 0 };
+    int count = 0;
+    while (reader.next(&event)) {
+      ASSERT_EQ(EVENT_TICK_PRICE, event.type);
+      ASSERT_LE(0, event.id);
+      ASSERT_GT(4, event.id);
+      // In order for each producer.
+      EXPECT_EQ(next[event.id]++, event.value);
+      count++;
+    }
+    EXPECT_EQ(4000, count);
+    remove(path.c_str());
+  }
+}
+
+TEST(EventLogTest, LongTextTest)
+{
+  EventRing ring(4);
+  event_t events[3] = { tick_price(1, 1, 1.), tick_price(2, 1, 2.),
+                        tick_price(3, 1, 3.) };
+  EXPECT_FALSE(ring.push(events, 5));
+  ASSERT_TRUE(ring.push(events, 3));
+  EXPECT_FALSE(ring.push(events, 2));
+  EXPECT_TRUE(ring.push(events, 1));
+
+  string path;
+  string value(EVENT_TEXT_SIZE * 2 + 5, 'x');
+  value[EVENT_TEXT_SIZE] = 'y';
+  {
+    EventLog log(".", "_event_log_test", false, 16, 1);
+    ASSERT_TRUE(log.is_open());
+    path = log.current_file();
+
+    event_t event = event_t();
+    event.connection_id = 2;
+    event.type = EVENT_TICK_STRING;
+    event.field = 45;
+    event.id = 7;
+    EXPECT_TRUE(log.log(event, value));
+    EXPECT_TRUE(log.log(tick_price(8, 1, 8.)));
+
+    // Waits for the writer rather than failing.
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_TRUE(log.log(tick_price(9, 1, i)));
+    }
+    log.close();
+    EXPECT_EQ(104u, log.written());
+
+    // Fails once closed.
+    EXPECT_FALSE(log.log(tick_price(10, 1, 10.)));
+    EXPECT_EQ(1u, log.dropped());
+  }
+
+  EventLogReader reader(path);
+  ASSERT_TRUE(reader.is_open());
+  event_t event;
+  ASSERT_TRUE(reader.next(&event));
+  EXPECT_EQ(EVENT_TICK_STRING, event.type);
+  EXPECT_EQ(value, reader.text());
+  ostringstream line;
+  write_text(event, &line, &reader.text());
+  EXPECT_EQ("cid=2,ts_utc=0,event=tickString,tickerId=7,"
+            "field=LAST_TIMESTAMP,value=" + value, line.str());
+  ASSERT_TRUE(reader.next(&event));
+  EXPECT_EQ(EVENT_TICK_PRICE, event.type);
+  EXPECT_EQ(8, event.id);
+  int count = 0;
+  while (reader.next(&event)) {
+    EXPECT_EQ(9, event.id);
+    EXPECT_EQ(count++, event.value);
+  }
+  EXPECT_EQ(100, count);
+  remove(path.c_str());
+}
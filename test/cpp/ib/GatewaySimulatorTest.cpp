@@ -0,0 +1,227 @@
+#include <set>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "ib/gateway_simulator.hpp"
+
+using namespace std;
+using namespace ib::internal;
+
+
+static vector<string> fields(const string& bytes)
+{
+  vector<string> out;
+  WireDecoder in(bytes.data(), bytes.data() + bytes.size());
+  string field;
+  while (in.read(&field)) {
+    out.push_back(field);
+  }
+  return out;
+}
+
+// reqMktData as EClientSocketBase sends it to server version 53.
+static string req_mkt_data(long tickerId, bool snapshot)
+{
+  string bytes;
+  WireEncoder(&bytes) << 1 << 9 << tickerId << 0 << "AAPL" << "STK"
+                      << "" << 0. << "" << "" << "SMART" << "" << "USD"
+                      << "" << 0 << "" << (snapshot ? 1 : 0);
+  return bytes;
+}
+
+// placeOrder of a limit order as EClientSocketBase sends it to server
+// version 53, with an algo if one is given.
+static string place_order(long orderId, int quantity, double limit,
+                          const string& algo = "")
+{
+  string bytes;
+  WireEncoder out(&bytes);
+  out << 3 << 35 << orderId << 0 << "AAPL" << "STK" << "" << 0. << ""
+      << "" << "SMART" << "" << "USD" << "" << "" << "";  // contract
+  out << "BUY" << quantity << "LMT" << limit << 0.;
+  out << "DAY" << "" << "" << "O" << 0 << "" << 1 << 0      // tif ...
+      << 0 << 0 << 0 << 0 << 0 << 0;                        // ... hidden
+  out << "" << 0. << "" << "" << "" << "" << "" << ""      // allocation
+      << 0 << "" << -1;                                     // short sale
+  out << 0 << "" << "" << 0 << "" << "" << 0 << 0 << "" << "" << ""
+      << "" << "" << "" << "" << 0 << "" << "";           // ... volatility
+  out << "" << "";                                          // delta neutral
+  out << 0 << "" << "" << "" << "" << "";                   // ... scale
+  out << "" << "" << 0 << 0;  // clearing, notHeld, underComp
+  out << algo;
+  if (!algo.empty()) {
+    out << 2 << "startTime" << "09:30:00" << "endTime" << "16:00:00";
+  }
+  out << 0;  // whatIf
+  return bytes;
+}
+
+
+TEST(GatewaySimulatorTest, SessionTest)
+{
+  SimulatedSession session(53, 100, true);
+  string out;
+
+  // Client version, then client id.
+  session.receive("59\0", 3, &out);
+  vector<string> reply = fields(out);
+  ASSERT_EQ(2u, reply.size());
+  EXPECT_EQ("53", reply[0]);
+  EXPECT_FALSE(session.connected());
+
+  out.clear();
+  session.receive("7\0", 2, &out);
+  EXPECT_TRUE(session.connected());
+  EXPECT_EQ(7, session.clientId());
+  reply = fields(out);
+  ASSERT_EQ(6u, reply.size());
+  EXPECT_EQ("9", reply[0]);  // nextValidId
+  EXPECT_EQ("100", reply[2]);
+  EXPECT_EQ("15", reply[3]);  // managedAccounts
+  EXPECT_EQ("DU000000", reply[5]);
+
+  // Subscriptions, the first split over two reads.
+  string request = req_mkt_data(5, false) + req_mkt_data(6, false);
+  out.clear();
+  session.receive(request.data(), 10, &out);
+  session.receive(request.data() + 10, request.size() - 10, &out);
+  EXPECT_TRUE(out.empty());
+
+  boost::uint64_t generation = 0;
+  set<long> marketData, marketDepth;
+  ASSERT_TRUE(session.subscriptions(&generation, &marketData, &marketDepth));
+  EXPECT_EQ(2u, marketData.size());
+  EXPECT_EQ(1u, marketData.count(5));
+  EXPECT_TRUE(marketDepth.empty());
+  EXPECT_FALSE(session.subscriptions(&generation, &marketData,
+                                     &marketDepth));
+
+  // A snapshot does not subscribe; a cancel does unsubscribe.
+  request = req_mkt_data(8, true);
+  WireEncoder(&request) << 2 << 1 << 5;
+  session.receive(request.data(), request.size(), &out);
+  reply = fields(out);
+  ASSERT_EQ(3u, reply.size());
+  EXPECT_EQ("57", reply[0]);
+  EXPECT_EQ("8", reply[2]);
+  ASSERT_TRUE(session.subscriptions(&generation, &marketData, &marketDepth));
+  EXPECT_EQ(1u, marketData.size());
+  EXPECT_EQ(1u, marketData.count(6));
+  EXPECT_EQ(0u, session.dropped());
+}
+
+TEST(GatewaySimulatorTest, EncodeTest)
+{
+  event_t event = event_t();
+  event.type = EVENT_TICK_PRICE;
+  event.id = 5;
+  event.field = 1;
+  event.value = 101.25;
+  string bytes;
+  encode_event(event, &bytes);
+
+  event.type = EVENT_UPDATE_MKT_DEPTH_L2;
+  event.position = 2;
+  event.operation = 1;
+  event.side = 0;
+  event.size = 300;
+  ASSERT_TRUE(event.set_text("ISLAND"));
+  encode_event(event, &bytes);
+
+  vector<string> out = fields(bytes);
+  ASSERT_EQ(14u, out.size());
+  EXPECT_EQ("1", out[0]);
+  EXPECT_EQ("5", out[2]);
+  EXPECT_EQ("101.25", out[4]);
+  EXPECT_EQ("13", out[5]);
+  EXPECT_EQ("ISLAND", out[9]);
+  EXPECT_EQ("300", out[13]);
+}
+
+TEST(GatewaySimulatorTest, ParseEventLineTest)
+{
+  event_t event = event_t();
+  event.ts_utc = 1360000000000000ULL;
+  event.connection_id = 3;
+  event.type = EVENT_TICK_STRING;
+  event.id = 9;
+  event.field = 45;  // LAST_TIMESTAMP
+  ASSERT_TRUE(event.set_text("1360000000,x"));
+
+  ostringstream line;
+  line << "I0204 10:00:00.000000  1234 LoggingEWrapper.cpp:10] ";
+  write_text(event, &line);
+
+  event_t parsed;
+  ASSERT_TRUE(parse_event_line(line.str(), &parsed));
+  EXPECT_EQ(event.ts_utc, parsed.ts_utc);
+  EXPECT_EQ(3u, parsed.connection_id);
+  EXPECT_EQ(EVENT_TICK_STRING, parsed.type);
+  EXPECT_EQ(9, parsed.id);
+  EXPECT_EQ(45, parsed.field);
+  EXPECT_EQ("1360000000,x", string(parsed.text, parsed.text_size));
+
+  EXPECT_FALSE(parse_event_line("cid=1,action=reqMktData", &parsed));
+}
+
+TEST(GatewaySimulatorTest, SyntheticTicksTest)
+{
+  SyntheticTicks ticks(0);
+  set<long> marketData, marketDepth;
+  event_t event;
+  EXPECT_FALSE(ticks.next(marketData, marketDepth, &event));
+
+  marketData.insert(1);
+  marketData.insert(2);
+  ASSERT_TRUE(ticks.next(marketData, marketDepth, &event));
+  EXPECT_EQ(EVENT_TICK_PRICE, event.type);
+  long id = static_cast<long>(event.id);
+  ASSERT_TRUE(ticks.next(marketData, marketDepth, &event));
+  EXPECT_EQ(EVENT_TICK_SIZE, event.type);
+  EXPECT_EQ(id, event.id);
+  ASSERT_TRUE(ticks.next(marketData, marketDepth, &event));
+  EXPECT_NE(id, event.id);
+}
+
+TEST(GatewaySimulatorTest, PlaceOrderTest)
+{
+  SimulatedSession session(53, 100, true);
+  string out;
+  session.receive("59\0" "7\0", 5, &out);
+  ASSERT_TRUE(session.connected());
+
+  // An order split at every byte, then one with an algo, each followed by
+  // reqIds pipelined behind it.
+  string request = place_order(100, 300, 25.5);
+  WireEncoder(&request) << 8 << 1 << 1;
+  request += place_order(101, 200, 26., "Vwap");
+  WireEncoder(&request) << 8 << 1 << 1;
+
+  out.clear();
+  size_t first = request.find(place_order(101, 200, 26., "Vwap"));
+  for (size_t i = 0; i < first; ++i) {
+    session.receive(request.data() + i, 1, &out);
+  }
+  session.receive(request.data() + first, request.size() - first, &out);
+  EXPECT_EQ(0u, session.dropped());
+
+  vector<string> reply = fields(out);
+  ASSERT_EQ(54u, reply.size());
+  // Submitted, Filled, then nextValidId, for each order.
+  EXPECT_EQ("3", reply[0]);
+  EXPECT_EQ("100", reply[2]);
+  EXPECT_EQ("Submitted", reply[3]);
+  EXPECT_EQ("300", reply[5]);
+  EXPECT_EQ("Filled", reply[15]);
+  EXPECT_EQ("25.5", reply[18]);
+  EXPECT_EQ("9", reply[24]);
+  EXPECT_EQ("101", reply[26]);
+  EXPECT_EQ("101", reply[29]);
+  EXPECT_EQ("Filled", reply[42]);
+  EXPECT_EQ("26", reply[45]);
+  EXPECT_EQ("9", reply[51]);
+  EXPECT_EQ("102", reply[53]);
+}
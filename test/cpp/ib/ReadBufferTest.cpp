@@ -0,0 +1,58 @@
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "ib/read_buffer.hpp"
+
+using namespace std;
+using namespace ib::internal;
+
+
+static string take(ReadBuffer* buffer, size_t sz)
+{
+  string out(sz, '\0');
+  out.resize(buffer->take(&out[0], sz));
+  return out;
+}
+
+
+TEST(ReadBufferTest, FillTakeTest)
+{
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  ReadBuffer buffer(10);
+  EXPECT_EQ(16u, buffer.size());
+  EXPECT_EQ(0u, buffer.buffered());
+
+  // Nothing to read.
+  EXPECT_EQ(-1, buffer.fill(fds[0]));
+  EXPECT_EQ(EAGAIN, errno);
+
+  ASSERT_EQ(12, write(fds[1], "0123456789ab", 12));
+  EXPECT_EQ(12, buffer.fill(fds[0]));
+  EXPECT_EQ(12u, buffer.buffered());
+  EXPECT_EQ("01234567", take(&buffer, 8));
+  EXPECT_EQ(4u, buffer.buffered());
+
+  // Wraps around: the free space is 4 bytes at the end and 8 at the start.
+  ASSERT_EQ(20, write(fds[1], "cdefghijklmnopqrstuv", 20));
+  EXPECT_EQ(12, buffer.fill(fds[0]));
+  EXPECT_EQ(0u, buffer.available());
+  EXPECT_EQ(-1, buffer.fill(fds[0]));
+  EXPECT_EQ("89abcdefghijklmn", take(&buffer, 100));
+
+  EXPECT_EQ(8, buffer.fill(fds[0]));
+  EXPECT_EQ("opqrstuv", take(&buffer, 100));
+  EXPECT_EQ("", take(&buffer, 100));
+
+  // End of the stream.
+  close(fds[1]);
+  EXPECT_EQ(0, buffer.fill(fds[0]));
+  close(fds[0]);
+}
@@ -0,0 +1,115 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "ib/subscription_balancer.hpp"
+
+using namespace std;
+using namespace ib::internal;
+
+typedef SubscriptionBalancer::Assignment Assignment;
+
+
+static SubscriptionBalancer::Request request(long id,
+                                             SubscriptionBalancer::Kind kind =
+                                             SubscriptionBalancer::MARKET_DATA)
+{
+  SubscriptionBalancer::Request r;
+  r.kind = kind;
+  r.id = id;
+  r.frames.push_back("key");
+  return r;
+}
+
+
+TEST(SubscriptionBalancerTest, BalanceTest)
+{
+  SubscriptionBalancer balancer(3, 2);
+  vector<Assignment> placed;
+  balancer.connect(0, &placed);
+  balancer.connect(1, &placed);
+  balancer.connect(2, &placed);
+  EXPECT_TRUE(placed.empty());
+  EXPECT_EQ(0u, balancer.primary());
+
+  // Round robin by load.
+  size_t member;
+  for (long id = 0; id < 6; ++id) {
+    ASSERT_TRUE(balancer.subscribe(request(id), &member));
+    EXPECT_EQ(static_cast<size_t>(id % 3), member);
+  }
+  EXPECT_EQ(2u, balancer.lines(0));
+  EXPECT_EQ(6u, balancer.subscriptions());
+
+  // Again: same member, no new line.
+  ASSERT_TRUE(balancer.subscribe(request(4), &member));
+  EXPECT_EQ(1u, member);
+  EXPECT_EQ(2u, balancer.lines(1));
+
+  // Depth is a line of its own.
+  EXPECT_FALSE(balancer.subscribe(
+      request(4, SubscriptionBalancer::MARKET_DEPTH), &member));
+
+  EXPECT_TRUE(balancer.unsubscribe(SubscriptionBalancer::MARKET_DATA, 4,
+                                   &member));
+  EXPECT_EQ(1u, member);
+  EXPECT_FALSE(balancer.unsubscribe(SubscriptionBalancer::MARKET_DATA, 4,
+                                    &member));
+  ASSERT_TRUE(balancer.subscribe(
+      request(4, SubscriptionBalancer::MARKET_DEPTH), &member));
+  EXPECT_EQ(1u, member);
+}
+
+TEST(SubscriptionBalancerTest, DisconnectTest)
+{
+  SubscriptionBalancer balancer(3, 3);
+  size_t member;
+
+  // Nothing is live yet: the subscriptions wait.
+  for (long id = 0; id < 4; ++id) {
+    ASSERT_TRUE(balancer.subscribe(request(id), &member));
+    EXPECT_EQ(3u, member);
+  }
+  EXPECT_EQ(3u, balancer.primary());
+  EXPECT_EQ(4u, balancer.waiting());
+
+  vector<Assignment> placed;
+  balancer.connect(1, &placed);
+  ASSERT_EQ(3u, placed.size());
+  EXPECT_EQ(1u, placed[0].member);
+  EXPECT_EQ(0, placed[0].request.id);
+  EXPECT_EQ("key", placed[0].request.frames[0]);
+  EXPECT_EQ(1u, balancer.waiting());
+
+  placed.clear();
+  balancer.connect(2, &placed);
+  ASSERT_EQ(1u, placed.size());
+  EXPECT_EQ(2u, placed[0].member);
+  EXPECT_EQ(3, placed[0].request.id);
+  EXPECT_EQ(0u, balancer.waiting());
+
+  // Member 1 goes down: two of its three fit on member 2.
+  vector<Assignment> moved;
+  EXPECT_EQ(1u, balancer.disconnect(1, &moved));
+  ASSERT_EQ(2u, moved.size());
+  EXPECT_EQ(2u, moved[0].member);
+  EXPECT_EQ(2u, moved[1].member);
+  EXPECT_EQ(0u, balancer.lines(1));
+  EXPECT_EQ(3u, balancer.lines(2));
+  EXPECT_EQ(1u, balancer.waiting());
+  EXPECT_EQ(2u, balancer.primary());
+
+  // Again: nothing to move.
+  moved.clear();
+  EXPECT_EQ(0u, balancer.disconnect(1, &moved));
+  EXPECT_TRUE(moved.empty());
+
+  // Member 0 comes up and takes the one waiting.
+  placed.clear();
+  balancer.connect(0, &placed);
+  ASSERT_EQ(1u, placed.size());
+  EXPECT_EQ(0u, placed[0].member);
+  EXPECT_EQ(4u, balancer.subscriptions());
+  EXPECT_EQ(0u, balancer.waiting());
+}
@@ -6,11 +6,14 @@
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "utils.hpp"
 #include "ib/TickerMap.hpp"
 
 using namespace std;
@@ -20,6 +23,56 @@ using namespace ib::internal;
 
 namespace {
 
+static Contract stock(long conId, const string& symbol)
+{
+  Contract c;
+  c.conId = conId;
+  c.symbol = symbol;
+  c.secType = "STK";
+  c.currency = "USD";
+  return c;
+}
+
+static string symbol_of(long conId)
+{
+  ostringstream s;
+  s << "S" << conId;
+  return s.str();
+}
+
+static void register_range(long first, long last)
+{
+  for (long conId = first; conId < last; ++conId) {
+    TickerMap::registerContract(stock(conId, symbol_of(conId)));
+  }
+}
+
+// Looks up the ids while they are registered; each must map to its own
+// entry once found, and stay found.
+static void lookup_range(long first, long last, bool* ok)
+{
+  long found = first;
+  while (found < last) {
+    const TickerMap::Entry* entry = TickerMap::getEntry(found);
+    if (entry == NULL) {
+      boost::this_thread::yield();
+      continue;
+    }
+    if (entry->tickerId != found ||
+        entry->topic != symbol_of(found) + ".STK") {
+      *ok = false;
+      return;
+    }
+    if (found > first && TickerMap::getEntry(found - 1) == NULL) {
+      *ok = false;
+      return;
+    }
+    found++;
+  }
+  *ok = true;
+}
+
+
 TEST(TickerMapTest, ConvertToContractTest)
 {
   using namespace std;
@@ -43,4 +96,98 @@ TEST(TickerMapTest, ConvertToContractTest)
   EXPECT_EQ("USD", c.currency);
 }
 
+TEST(TickerMapTest, RegisterTest)
+{
+  EXPECT_EQ(NULL, TickerMap::getEntry(100001));
+
+  long tickerId = TickerMap::registerContract(stock(100001, "AAPL"));
+  EXPECT_EQ(100001, tickerId);
+
+  const TickerMap::Entry* entry = TickerMap::getEntry(100001);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(100001, entry->tickerId);
+  EXPECT_EQ("AAPL.STK", entry->topic);
+  EXPECT_EQ("depth:AAPL.STK", entry->depthTopic);
+  EXPECT_EQ(atp::common::symbols().intern("AAPL.STK"), entry->symbolId);
+
+  // Registering again keeps the entry; another symbol is an error.
+  EXPECT_EQ(100001, TickerMap::registerContract(stock(100001, "AAPL")));
+  EXPECT_EQ(-1, TickerMap::registerContract(stock(100001, "MSFT")));
+  EXPECT_EQ(entry, TickerMap::getEntry(100001));
+
+  string topic;
+  EXPECT_TRUE(TickerMap::getSubscriptionKeyFromId(100001, &topic));
+  EXPECT_EQ("AAPL.STK", topic);
+  long id = 0;
+  EXPECT_TRUE(TickerMap::getTickerIdFromSubscriptionKey("AAPL.STK", &id));
+  EXPECT_EQ(100001, id);
+
+  // Entries do not move as the table grows.
+  size_t before = TickerMap::size();
+  register_range(200000, 205000);
+  EXPECT_EQ(before + 5000, TickerMap::size());
+  EXPECT_EQ(entry, TickerMap::getEntry(100001));
+  EXPECT_EQ("AAPL.STK", entry->topic);
+  for (long conId = 200000; conId < 205000; ++conId) {
+    entry = TickerMap::getEntry(conId);
+    ASSERT_TRUE(entry != NULL);
+    EXPECT_EQ(conId, entry->tickerId);
+  }
+}
+
+TEST(TickerMapTest, ConcurrentTest)
+{
+  bool ok[2] = { false, false };
+  boost::thread reader1(boost::bind(&lookup_range, 300000, 320000, &ok[0]));
+  boost::thread reader2(boost::bind(&lookup_range, 300000, 320000, &ok[1]));
+  register_range(300000, 320000);
+  reader1.join();
+  reader2.join();
+  EXPECT_TRUE(ok[0]);
+  EXPECT_TRUE(ok[1]);
+}
+
+TEST(TickerMapTest, BenchmarkTest)
+{
+  const long first = 400000;
+  const long count = 2000;
+  const int n = 10000000;
+  register_range(first, first + count);
+
+  // As before: a map read without the lock, and the topic copied.
+  map<long, string> symbols;
+  for (long conId = first; conId < first + count; ++conId) {
+    symbols[conId] = symbol_of(conId) + ".STK";
+  }
+
+  size_t bytes = 0;
+  boost::uint64_t start = now_micros();
+  for (int i = 0; i < n; ++i) {
+    bytes += TickerMap::getEntry(first + i % count)->topic.size();
+  }
+  boost::uint64_t entryMicros = now_micros() - start;
+
+  string topic;
+  start = now_micros();
+  for (int i = 0; i < n; ++i) {
+    TickerMap::getSubscriptionKeyFromId(first + i % count, &topic);
+    bytes += topic.size();
+  }
+  boost::uint64_t copyMicros = now_micros() - start;
+
+  start = now_micros();
+  for (int i = 0; i < n; ++i) {
+    map<long, string>::const_iterator found = symbols.find(first + i % count);
+    topic = found->second;
+    bytes += topic.size();
+  }
+  boost::uint64_t mapMicros = now_micros() - start;
+
+  LOG(INFO) << count << " tickers, nsec / lookup: entry = "
+            << entryMicros * 1000. / n
+            << ", entry + copy = " << copyMicros * 1000. / n
+            << ", map + copy = " << mapMicros * 1000. / n
+            << " (" << bytes << " bytes)";
+}
+
 } // Namespace
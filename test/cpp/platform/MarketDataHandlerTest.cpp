@@ -84,3 +84,35 @@ TEST(MarketDataHandlerTest, UsageSyntax)
   EXPECT_EQ(2, ask_count);
 
 }
+
+TEST(MarketDataHandlerTest, DispatchByEventId)
+{
+  typedef value_updater<MarketData>::typed_dispatcher<double> dispatcher;
+  dispatcher d;
+
+  int bid_count = 0;
+  dispatcher::callback cb = boost::bind(&aapl, _1, _2, "BID", &bid_count);
+  d.bind("BID", cb);
+
+  atp::common::intern_id_t bid = atp::common::events().intern("BID");
+  atp::common::intern_id_t ask = atp::common::events().intern("ASK");
+
+  EXPECT_EQ(atp::platform::marketdata::error_code::DISPATCHED,
+            d.dispatch(bid, "BID", now_micros(), 600.));
+  EXPECT_EQ(atp::platform::marketdata::error_code::NO_UPDATER_CONTINUE,
+            d.dispatch(ask, "ASK", now_micros(), 601.));
+
+  // No id: falls back to the event code.
+  EXPECT_EQ(atp::platform::marketdata::error_code::DISPATCHED,
+            d.dispatch(atp::common::NO_INTERN_ID, "BID", now_micros(), 600.));
+  EXPECT_EQ(2, bid_count);
+
+  // Ids are only taken from messages stamped with the local tables.
+  MarketData m;
+  m.set_event_id(bid);
+  EXPECT_EQ(atp::common::NO_INTERN_ID, get_event_id(m));
+  m.set_intern_stamp(atp::common::intern_stamp() + 1);
+  EXPECT_EQ(atp::common::NO_INTERN_ID, get_event_id(m));
+  m.set_intern_stamp(atp::common::intern_stamp());
+  EXPECT_EQ(bid, get_event_id(m));
+}
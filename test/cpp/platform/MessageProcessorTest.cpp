@@ -193,3 +193,85 @@ TEST(MessageProcessorTest, UsageSyntax)
 
   subscriber.block();
 }
+
+/// Checks that messages of a topic arrive in order.
+struct sequence_checker
+{
+  sequence_checker() : last(0), count(0), out_of_order(0) {}
+
+  bool process(const string& topic, const string& message)
+  {
+    size_t seq = boost::lexical_cast<size_t>(message);
+    if (seq <= last) {
+      out_of_order++;
+    }
+    last = seq;
+    count++;
+    return true;
+  }
+
+  size_t last;
+  size_t count;
+  size_t out_of_order;
+};
+
+TEST(MessageProcessorTest, WorkersTest)
+{
+  const string endpoint = "tcp://127.0.0.1:4445";
+
+  message_processor::protobuf_handlers_map handlers;
+  sequence_checker aapl, goog, nflx;
+  handlers.register_handler("AAPL.STK",
+                            boost::bind(&sequence_checker::process,
+                                        &aapl, _1, _2));
+  handlers.register_handler("GOOG.STK",
+                            boost::bind(&sequence_checker::process,
+                                        &goog, _1, _2));
+  handlers.register_handler("NFLX.STK",
+                            boost::bind(&sequence_checker::process,
+                                        &nflx, _1, _2));
+  handlers.register_handler("STOP",
+                            boost::bind(&stop_function, _1, _2, "workers"));
+
+  message_processor subscriber(endpoint, handlers, NULL, 2);
+
+  ::zmq::context_t ctx(1);
+  ::zmq::socket_t socket(ctx, ZMQ_PUB);
+#ifdef ZMQ_3X
+  // Queues instead of dropping, so that every message is handled.
+  int hwm = 0;
+  socket.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+#endif
+  socket.bind(endpoint.c_str());
+  usleep(200000);  // for the subscriber to connect
+
+  // Sent in bursts so the listener gets batches of several messages.
+  size_t sent = 0;
+  for (size_t seq = 1; seq <= 3000; ++seq) {
+    string message = boost::lexical_cast<string>(seq);
+    atp::zmq::send_copy(socket, "AAPL.STK", true);
+    atp::zmq::send_copy(socket, message, false);
+    atp::zmq::send_copy(socket, "GOOG.STK", true);
+    atp::zmq::send_copy(socket, message, false);
+    atp::zmq::send_copy(socket, "NFLX.STK", true);
+    atp::zmq::send_copy(socket, message, false);
+    sent++;
+    if (seq % 100 == 0) {
+      usleep(1000);
+    }
+  }
+  usleep(200000);
+
+  atp::zmq::send_copy(socket, "STOP", true);
+  atp::zmq::send_copy(socket, "STOP", false);
+  subscriber.block();
+
+  LOG(INFO) << "aapl got " << aapl.count << ", goog got " << goog.count
+            << ", nflx got " << nflx.count << ", sent " << sent;
+  EXPECT_EQ(sent, aapl.count);
+  EXPECT_EQ(sent, goog.count);
+  EXPECT_EQ(sent, nflx.count);
+  EXPECT_EQ(0u, aapl.out_of_order);
+  EXPECT_EQ(0u, goog.out_of_order);
+  EXPECT_EQ(0u, nflx.out_of_order);
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <string>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "utils.hpp"
+#include "common/tick_capture.hpp"
+#include "common/time_utils.hpp"
+#include "proto/ib.pb.h"
+#include "service/CaptureReader.hpp"
+
+
+using namespace std;
+using namespace atp::log_reader;
+using proto::ib::MarketData;
+using proto::ib::MarketDepth;
+
+
+struct counter
+{
+  counter() : count(0), last(0) {}
+  size_t count;
+  boost::uint64_t last;
+};
+
+struct count_marketdata
+{
+  count_marketdata(counter* c, size_t stop = 0) : c(c), stop(stop) {}
+  bool operator()(const MarketData& m)
+  {
+    EXPECT_EQ("AAPL.STK", m.symbol());
+    EXPECT_GE(m.timestamp(), c->last);
+    c->last = m.timestamp();
+    c->count++;
+    return stop == 0 || c->count < stop;
+  }
+  counter* c;
+  size_t stop;
+};
+
+struct count_marketdepth
+{
+  count_marketdepth(counter* c) : c(c) {}
+  bool operator()(const MarketDepth& m)
+  {
+    c->count++;
+    return true;
+  }
+  counter* c;
+};
+
+
+// Writes n ticks, alternating market data and depth, 10 msec apart.
+static string write_capture(const ptime& start, int n)
+{
+  atp::capture::Writer writer(".", "_capture_test", 100);
+
+  boost::uint64_t ts = atp::time::as_micros(start);
+  for (int i = 0; i < n; ++i, ts += 10000) {
+    string proto;
+    if (i % 2 == 0) {
+      MarketData m;
+      m.set_symbol("AAPL.STK");
+      m.set_timestamp(ts);
+      m.set_event("BID");
+      m.mutable_value()->set_type(proto::common::Value_Type_DOUBLE);
+      m.mutable_value()->set_double_value(500. + i);
+      m.set_contract_id(1);
+      EXPECT_TRUE(m.SerializeToString(&proto));
+      EXPECT_TRUE(writer.append(atp::capture::MARKET_DATA, ts, proto));
+    } else {
+      MarketDepth m;
+      m.set_symbol("AAPL.STK");
+      m.set_timestamp(ts);
+      m.set_side(proto::ib::MarketDepth_Side_BID);
+      m.set_price(500. + i);
+      m.set_size(100);
+      m.set_operation(proto::ib::MarketDepth_Operation_UPDATE);
+      m.set_level(0);
+      m.set_contract_id(1);
+      EXPECT_TRUE(m.SerializeToString(&proto));
+      EXPECT_TRUE(writer.append(atp::capture::MARKET_DEPTH, ts, proto));
+    }
+  }
+  writer.flush();
+  EXPECT_EQ(static_cast<size_t>(n), writer.records_written());
+  string path = writer.current_file();
+  writer.close();
+
+  // No longer accepting records after close.
+  EXPECT_FALSE(writer.append(atp::capture::MARKET_DATA, ts, ""));
+  return path;
+}
+
+
+TEST(CaptureReaderTest, WriteAndReadTest)
+{
+  ptime start;
+  ASSERT_TRUE(atp::time::parse("2012-12-31 09:35:00.00", &start));
+
+  string path = write_capture(start, 2000);
+  LOG(INFO) << "Wrote " << path;
+
+  atp::capture::File file(path);
+  ASSERT_TRUE(file.is_open());
+  ASSERT_TRUE(file.has_index());
+  EXPECT_EQ(20u, file.index().size());
+
+  counter md, depth;
+  count_marketdata p1(&md);
+  count_marketdepth p2(&depth);
+  CaptureReader::marketdata_visitor_t m1 = p1;
+  CaptureReader::marketdepth_visitor_t m2 = p2;
+
+  CaptureReader reader(path);
+  EXPECT_EQ(2000u, reader.Process(m1, m2));
+  EXPECT_EQ(1000u, md.count);
+  EXPECT_EQ(1000u, depth.count);
+  remove(path.c_str());
+}
+
+TEST(CaptureReaderTest, SeekAndDurationTest)
+{
+  ptime start;
+  ASSERT_TRUE(atp::time::parse("2012-12-31 09:35:00.00", &start));
+
+  string path = write_capture(start, 2000);
+
+  counter md, depth;
+  count_marketdata p1(&md);
+  count_marketdepth p2(&depth);
+  CaptureReader::marketdata_visitor_t m1 = p1;
+  CaptureReader::marketdepth_visitor_t m2 = p2;
+
+  CaptureReader reader(path);
+
+  // Start 10 seconds in and read 5 seconds worth: 501 ticks inclusive.
+  size_t processed = reader.Process(m1, m2, seconds(5), start + seconds(10));
+  EXPECT_EQ(501u, processed);
+  EXPECT_EQ(501u, md.count + depth.count);
+  EXPECT_EQ(atp::time::as_micros(start + seconds(15)), md.last);
+  remove(path.c_str());
+}
+
+TEST(CaptureReaderTest, VisitorStopTest)
+{
+  ptime start;
+  ASSERT_TRUE(atp::time::parse("2012-12-31 09:35:00.00", &start));
+
+  string path = write_capture(start, 2000);
+
+  counter md, depth;
+  count_marketdata p1(&md, 10);
+  count_marketdepth p2(&depth);
+  CaptureReader::marketdata_visitor_t m1 = p1;
+  CaptureReader::marketdepth_visitor_t m2 = p2;
+
+  // The tenth market data, i.e. the 19th record, stops the scan.
+  CaptureReader reader(path);
+  EXPECT_EQ(19u, reader.Process(m1, m2));
+  EXPECT_EQ(10u, md.count);
+  EXPECT_EQ(9u, depth.count);
+  remove(path.c_str());
+}
+
+TEST(CaptureReaderTest, SessionRotationTest)
+{
+  ptime t;
+  ASSERT_TRUE(atp::time::parse("2012-12-31 19:59:00.00", &t));
+  boost::uint64_t ts = atp::time::as_micros(t);
+
+  ptime midnight;
+  ASSERT_TRUE(atp::time::parse("2013-01-01 00:00:00.00", &midnight));
+  boost::uint64_t next = atp::time::as_micros(midnight);
+  EXPECT_EQ(next, atp::capture::session_end(ts));
+
+  atp::capture::Writer writer(".", "_capture_test", 100);
+  EXPECT_TRUE(writer.append(atp::capture::MARKET_DATA, ts, "first"));
+  EXPECT_TRUE(writer.append(atp::capture::MARKET_DATA, ts + 1, "second"));
+  writer.flush();
+  string first = writer.current_file();
+  EXPECT_EQ(2u, writer.records_written());
+
+  // The first record of the next session opens a new file.
+  EXPECT_TRUE(writer.append(atp::capture::MARKET_DATA, next, "third"));
+  writer.flush();
+  string second = writer.current_file();
+  EXPECT_NE(first, second);
+  EXPECT_EQ(1u, writer.records_written());
+  writer.close();
+
+  atp::capture::File f1(first);
+  ASSERT_TRUE(f1.is_open());
+  EXPECT_TRUE(f1.has_index());
+  atp::capture::record_t record;
+  ASSERT_TRUE(f1.next(&record));
+  EXPECT_EQ("first", string(record.payload, record.size));
+  ASSERT_TRUE(f1.next(&record));
+  EXPECT_FALSE(f1.next(&record));
+
+  atp::capture::File f2(second);
+  ASSERT_TRUE(f2.is_open());
+  ASSERT_TRUE(f2.next(&record));
+  EXPECT_EQ("third", string(record.payload, record.size));
+  EXPECT_EQ(next, record.timestamp);
+  EXPECT_FALSE(f2.next(&record));
+
+  remove(first.c_str());
+  remove(second.c_str());
+}
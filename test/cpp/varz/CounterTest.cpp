@@ -0,0 +1,135 @@
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "utils.hpp"
+#include "varz/counter.hpp"
+
+using atp::varz::Counter;
+using atp::varz::Gauge;
+
+
+static void count_counter(Counter* counter, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    ++(*counter);
+  }
+}
+
+static void count_atomic(boost::atomic<boost::int64_t>* counter, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    counter->fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
+static void count_plain(volatile boost::int64_t* counter, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    *counter = *counter + 1;
+  }
+}
+
+static void add_gauge(Gauge* gauge, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    *gauge += 2;
+    *gauge -= 2;
+  }
+}
+
+template <typename F>
+static boost::uint64_t run_threads(int threads, F f)
+{
+  boost::uint64_t start = now_micros();
+  std::vector<boost::thread*> pool;
+  for (int i = 0; i < threads; ++i) {
+    pool.push_back(new boost::thread(f));
+  }
+  for (int i = 0; i < threads; ++i) {
+    pool[i]->join();
+    delete pool[i];
+  }
+  return now_micros() - start;
+}
+
+
+TEST(CounterTest, CountTest)
+{
+  Counter counter;
+  EXPECT_EQ(0, counter.Value());
+  ++counter;
+  counter++;
+  counter += 10;
+  EXPECT_EQ(12, counter.Value());
+
+  // No counts are lost, with more threads than slots too.
+  const int threads = Counter::SLOTS + 8;
+  run_threads(threads, boost::bind(&count_counter, &counter, 10000));
+  EXPECT_EQ(12 + threads * 10000, static_cast<boost::int64_t>(counter));
+}
+
+TEST(CounterTest, HeapAlignmentTest)
+{
+  // Counters on the heap, like the values of varz, are cache line aligned.
+  std::vector<Counter*> counters;
+  for (int i = 0; i < 16; ++i) {
+    counters.push_back(new Counter);
+    EXPECT_EQ(0u, reinterpret_cast<size_t>(counters.back()) % 64);
+    EXPECT_EQ(0, counters.back()->Value());
+  }
+  for (size_t i = 0; i < counters.size(); ++i) {
+    delete counters[i];
+  }
+}
+
+TEST(CounterTest, GaugeTest)
+{
+  Gauge gauge(5);
+  EXPECT_EQ(5, gauge.Value());
+  gauge = 100;
+  EXPECT_EQ(100, gauge.Value());
+  gauge.Max(50);
+  EXPECT_EQ(100, gauge.Value());
+  gauge.Max(150);
+  EXPECT_EQ(150, gauge.Value());
+
+  gauge = 0;
+  run_threads(4, boost::bind(&add_gauge, &gauge, 100000));
+  EXPECT_EQ(0, gauge.Value());
+}
+
+// Cost per increment with several threads counting at once: a Counter,
+// one shared atomic, and one shared int64 as the varz were (which loses
+// counts).
+TEST(CounterTest, BenchmarkTest)
+{
+  const int threads = 4;
+  const int n = 5000000;
+
+  Counter counter;
+  boost::uint64_t counterMicros =
+      run_threads(threads, boost::bind(&count_counter, &counter, n));
+
+  boost::atomic<boost::int64_t> atomic(0);
+  boost::uint64_t atomicMicros =
+      run_threads(threads, boost::bind(&count_atomic, &atomic, n));
+
+  volatile boost::int64_t plain = 0;
+  boost::uint64_t plainMicros =
+      run_threads(threads, boost::bind(&count_plain, &plain, n));
+
+  LOG(INFO) << threads << " threads, nsec / increment: counter = "
+            << counterMicros * 1000. / n
+            << ", atomic = " << atomicMicros * 1000. / n
+            << ", plain = " << plainMicros * 1000. / n
+            << " (lost " << threads * n - plain << ")";
+
+  EXPECT_EQ(threads * n, counter.Value());
+  EXPECT_EQ(threads * n, atomic.load());
+}
@@ -0,0 +1,68 @@
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "varz/histogram.hpp"
+
+using atp::varz::Histogram;
+
+
+TEST(HistogramTest, BucketTest)
+{
+  // Exact below 2 * SUB_BUCKETS, then within 1 / SUB_BUCKETS.
+  for (boost::uint64_t v = 0; v < 2 * Histogram::SUB_BUCKETS; ++v) {
+    EXPECT_EQ(v, Histogram::BucketMax(Histogram::BucketOf(v)));
+  }
+  boost::uint64_t values[] = { 64, 65, 100, 1000, 12345, 999999, 1ULL << 39 };
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    boost::uint64_t max = Histogram::BucketMax(Histogram::BucketOf(values[i]));
+    EXPECT_LE(values[i], max);
+    EXPECT_GE(values[i] + values[i] / Histogram::SUB_BUCKETS, max);
+  }
+
+  // Buckets are in order of the values.
+  size_t last = 0;
+  for (boost::uint64_t v = 1; v < (1ULL << 40); v = v * 3 / 2 + 1) {
+    size_t bucket = Histogram::BucketOf(v);
+    EXPECT_LE(last, bucket);
+    EXPECT_GT(Histogram::BUCKETS, bucket);
+    last = bucket;
+  }
+  EXPECT_EQ(Histogram::BUCKETS - 1, Histogram::BucketOf(1ULL << 50));
+}
+
+TEST(HistogramTest, PercentileTest)
+{
+  Histogram h;
+  EXPECT_EQ(0u, h.Percentile(0.99));
+
+  // 1..10000
+  for (boost::uint64_t v = 1; v <= 10000; ++v) {
+    h.Record(v);
+  }
+  EXPECT_EQ(10000u, h.Count());
+  EXPECT_EQ(10000u, h.Last());
+  EXPECT_EQ(10000u, h.Max());
+  EXPECT_DOUBLE_EQ(5000.5, h.Mean());
+  EXPECT_NEAR(5000, h.Percentile(0.5), 5000 / Histogram::SUB_BUCKETS);
+  EXPECT_NEAR(9000, h.Percentile(0.9), 9000 / Histogram::SUB_BUCKETS);
+  EXPECT_NEAR(9900, h.Percentile(0.99), 9900 / Histogram::SUB_BUCKETS);
+  EXPECT_EQ(10000u, h.Percentile(1.));
+
+  // A tail of slow ones shows in the high percentiles only.
+  h.Clear();
+  for (int i = 0; i < 990; ++i) {
+    h.Record(static_cast<boost::uint64_t>(10));
+  }
+  for (int i = 0; i < 10; ++i) {
+    h.Record(static_cast<boost::uint64_t>(50000));
+  }
+  EXPECT_EQ(10u, h.Percentile(0.5));
+  EXPECT_EQ(10u, h.Percentile(0.99));
+  EXPECT_NEAR(50000, h.Percentile(0.999), 50000 / Histogram::SUB_BUCKETS);
+
+  std::string json = h.ToString();
+  EXPECT_NE(std::string::npos, json.find("\"count\" : 1000"));
+  EXPECT_NE(std::string::npos, json.find("\"p50\" : 10,"));
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+
+#include "varz/profiler.hpp"
+
+
+static void burn(volatile bool* done)
+{
+  volatile double x = 1.;
+  while (!*done) {
+    for (int i = 0; i < 10000; ++i) {
+      x = x * 1.0000001 + 1e-9;
+    }
+  }
+}
+
+static void profile(bool* ok, std::string* folded)
+{
+  *ok = atp::varz::ProfileCpu(1, 200, folded);
+}
+
+
+TEST(ProfilerTest, CpuTest)
+{
+  volatile bool done = false;
+  boost::thread burner(boost::bind(&burn, &done));
+
+  std::string folded;
+  EXPECT_TRUE(atp::varz::ProfileCpu(1, 200, &folded));
+  done = true;
+  burner.join();
+
+  LOG(INFO) << "Profile:\n" << folded;
+
+  // Every line is a stack and a count of samples.
+  std::istringstream lines(folded);
+  std::string line;
+  int samples = 0;
+  while (std::getline(lines, line)) {
+    size_t space = line.rfind(' ');
+    ASSERT_NE(std::string::npos, space);
+    EXPECT_LT(0u, space);
+    int count = atoi(line.substr(space + 1).c_str());
+    EXPECT_LT(0, count);
+    samples += count;
+  }
+  // A second of cpu at 200 hz, give or take the scheduler.
+  EXPECT_LT(50, samples);
+}
+
+TEST(ProfilerTest, BusyTest)
+{
+  bool ok = false;
+  std::string folded;
+  boost::thread first(boost::bind(&profile, &ok, &folded));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+  std::string other;
+  EXPECT_FALSE(atp::varz::ProfileCpu(1, 200, &other));
+  EXPECT_TRUE(other.empty());
+
+  first.join();
+  EXPECT_TRUE(ok);
+}
+
+TEST(ProfilerTest, SymbolTest)
+{
+  std::string name = atp::varz::SymbolOf(
+      reinterpret_cast<const void*>(&std::terminate));
+  LOG(INFO) << "std::terminate = " << name;
+  EXPECT_NE(std::string::npos, name.find("terminate"));
+
+  EXPECT_EQ("0x10", atp::varz::SymbolOf(reinterpret_cast<const void*>(0x10)));
+}
+
+TEST(ProfilerTest, HeapTest)
+{
+  std::vector<atp::varz::HeapSite> sites;
+  atp::varz::HeapSites(&sites);
+
+#ifdef ATP_HEAP_PROFILE
+  EXPECT_TRUE(atp::varz::HeapProfileEnabled());
+  EXPECT_FALSE(sites.empty());
+  for (size_t i = 1; i < sites.size(); ++i) {
+    EXPECT_GE(sites[i - 1].bytes, sites[i].bytes);
+  }
+#else
+  EXPECT_FALSE(atp::varz::HeapProfileEnabled());
+  EXPECT_TRUE(sites.empty());
+#endif
+}
@@ -0,0 +1,122 @@
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "common/trace_header.hpp"
+#include "varz/trace.hpp"
+
+using std::string;
+using std::vector;
+using atp::varz::TraceRecord;
+using atp::varz::TraceRing;
+
+
+static void record(TraceRing* ring, boost::uint64_t publisher, int n)
+{
+  for (int i = 1; i <= n; ++i) {
+    ring->Record(publisher, i, atp::varz::TRACE_SEND, i * 10);
+  }
+}
+
+
+TEST(TraceTest, RingTest)
+{
+  TraceRing ring(5);
+  EXPECT_EQ(8u, ring.Size());
+
+  vector<TraceRecord> records;
+  ring.Dump(&records);
+  EXPECT_TRUE(records.empty());
+
+  // Only the last 8 are kept, oldest first.
+  record(&ring, 7, 12);
+  ring.Dump(&records);
+  ASSERT_EQ(8u, records.size());
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(7u, records[i].publisher_id);
+    EXPECT_EQ(i + 5, records[i].seq);
+    EXPECT_EQ((i + 5) * 10, records[i].micros);
+    EXPECT_EQ(atp::varz::TRACE_SEND, records[i].stage);
+  }
+}
+
+TEST(TraceTest, ConcurrentTest)
+{
+  TraceRing ring(1 << 16);
+  boost::thread_group threads;
+  for (int t = 1; t <= 4; ++t) {
+    threads.create_thread(boost::bind(&record, &ring, t, 10000));
+  }
+  threads.join_all();
+
+  // Every record is whole: its micros match its seq.
+  vector<TraceRecord> records;
+  ring.Dump(&records);
+  ASSERT_EQ(40000u, records.size());
+  vector<int> counts(5, 0);
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(records[i].seq * 10, records[i].micros);
+    counts[records[i].publisher_id]++;
+  }
+  for (int t = 1; t <= 4; ++t) {
+    EXPECT_EQ(10000, counts[t]);
+  }
+}
+
+TEST(TraceTest, StageTest)
+{
+  for (int stage = 0; stage < atp::varz::TRACE_STAGES; ++stage) {
+    EXPECT_EQ(stage,
+              atp::varz::TraceStageOf(atp::varz::TraceStageName(stage)));
+  }
+  EXPECT_EQ(-1, atp::varz::TraceStageOf("unknown"));
+}
+
+TEST(TraceTest, ScopeTest)
+{
+  vector<TraceRecord> before;
+  atp::varz::Traces().Dump(&before);
+
+  atp::varz::TraceCurrent(atp::varz::TRACE_WRITE);  // none traced
+  {
+    atp::varz::TraceScope scope(true, 3, 42);
+    atp::varz::TraceCurrent(atp::varz::TRACE_WRITE);
+  }
+  {
+    atp::varz::TraceScope scope(false, 3, 43);
+    atp::varz::TraceCurrent(atp::varz::TRACE_WRITE);
+  }
+
+  vector<TraceRecord> after;
+  atp::varz::Traces().Dump(&after);
+  ASSERT_EQ(before.size() + 1, after.size());
+  EXPECT_EQ(3u, after.back().publisher_id);
+  EXPECT_EQ(42u, after.back().seq);
+  EXPECT_EQ(atp::varz::TRACE_WRITE, after.back().stage);
+}
+
+TEST(TraceTest, HeaderTest)
+{
+  string message("\x08\x01\x12\x08" "AAPL.STK", 12);
+  EXPECT_FALSE(atp::common::is_traced(message));
+
+  string traced(atp::common::TRACE_HEADER_SIZE, '\0');
+  atp::common::encode_trace_header(1368600000000000ULL, 1234, &traced[0]);
+  traced += message;
+  EXPECT_TRUE(atp::common::is_traced(traced));
+
+  boost::uint64_t publisher, seq;
+  ASSERT_TRUE(atp::common::read_trace_header(traced.data(), traced.size(),
+                                             &publisher, &seq));
+  EXPECT_EQ(1368600000000000ULL, publisher);
+  EXPECT_EQ(1234u, seq);
+
+  const char* data = traced.data();
+  size_t size = traced.size();
+  atp::common::skip_trace_header(&data, &size);
+  EXPECT_EQ(message, string(data, size));
+}
@@ -0,0 +1,69 @@
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "varz/varz.hpp"
+#include "varz/VarzSampler.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+using atp::varz::VarzSampler;
+
+
+DEFINE_VARZ_counter(sampler_test_requests, "");
+DEFINE_VARZ_string(sampler_test_label, "", "");
+
+
+TEST(VarzSamplerTest, RatesTest)
+{
+  VarzSampler sampler(1000, 100);
+  map<string, double> rates;
+  sampler.rates(1, &rates);
+  EXPECT_TRUE(rates.empty());
+
+  // 10 per second for 30 seconds, then 100 per second for 10 seconds.
+  boost::uint64_t now = 1000000;
+  for (int i = 0; i <= 40; ++i) {
+    sampler.sample(now + i * 1000000);
+    VARZ_sampler_test_requests += (i < 30) ? 10 : 100;
+  }
+
+  sampler.rates(1, &rates);
+  EXPECT_DOUBLE_EQ(100., rates["sampler_test_requests"]);
+  EXPECT_EQ(0u, rates.count("sampler_test_label"));  // not numeric
+
+  rates.clear();
+  sampler.rates(20, &rates);
+  EXPECT_DOUBLE_EQ(55., rates["sampler_test_requests"]);
+
+  // Over all there is, when the window is longer.
+  rates.clear();
+  sampler.rates(60, &rates);
+  EXPECT_DOUBLE_EQ(32.5, rates["sampler_test_requests"]);
+}
+
+TEST(VarzSamplerTest, HistoryTest)
+{
+  VarzSampler sampler(1000, 5);
+  vector<VarzSampler::point_t> points;
+  EXPECT_FALSE(sampler.history("sampler_test_requests", &points));
+
+  boost::int64_t start = VARZ_sampler_test_requests;
+  for (int i = 0; i < 8; ++i) {
+    sampler.sample(i * 1000000);
+    ++VARZ_sampler_test_requests;
+  }
+
+  // Only the last 5, oldest first.
+  ASSERT_TRUE(sampler.history("sampler_test_requests", &points));
+  ASSERT_EQ(5u, points.size());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(static_cast<boost::uint64_t>(i + 3) * 1000000, points[i].first);
+    EXPECT_EQ(start + i + 3, points[i].second);
+  }
+  EXPECT_FALSE(sampler.history("sampler_test_label", &points));
+}
@@ -25,6 +25,9 @@ DEFINE_VARZ_int64(start_ts, 0, "Start timestamp");
 DEFINE_VARZ_string(name, "", "Name");
 DEFINE_VARZ_int32(count, 0, "count");
 DEFINE_VARZ_bool(flag, false, "flag");
+DEFINE_VARZ_histogram(latency, "latency");
+DEFINE_VARZ_counter(messages, "messages");
+DEFINE_VARZ_gauge(depth, 0, "depth");
 
 TEST(VarzTest, VarzServerStartStopTest)
 {
@@ -128,6 +131,31 @@ TEST(VarzTest, CurlTest)
   int32 count2 = json_spirit::find_value(value2.get_obj(), "count").get_int();
   EXPECT_EQ(1, count2);
 
+  VARZ_latency.Record(static_cast<uint64>(100));
+  success = curl(url, &result);
+  EXPECT_TRUE(success);
+
+  json_spirit::Value value3;
+  EXPECT_TRUE(json_spirit::read(result, value3));
+  try {
+    const json_spirit::Object& latency =
+        json_spirit::find_value(value3.get_obj(), "latency").get_obj();
+    EXPECT_EQ(1, json_spirit::find_value(latency, "count").get_int());
+    EXPECT_EQ(100, json_spirit::find_value(latency, "p99").get_int());
+  } catch (...) { FAIL(); }
+
+  VARZ_messages += 3;
+  VARZ_depth = 7;
+  success = curl(url, &result);
+  EXPECT_TRUE(success);
+
+  json_spirit::Value value4;
+  EXPECT_TRUE(json_spirit::read(result, value4));
+  try {
+    EXPECT_EQ(3, json_spirit::find_value(value4.get_obj(), "messages").get_int());
+    EXPECT_EQ(7, json_spirit::find_value(value4.get_obj(), "depth").get_int());
+  } catch (...) { FAIL(); }
+
   LOG(INFO) << "Stopping server when server out of scope.";
 }
 
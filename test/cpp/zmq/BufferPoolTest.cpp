@@ -0,0 +1,73 @@
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include "zmq/BufferPool.hpp"
+#include "zmq/ZmqUtils.hpp"
+
+
+using namespace atp::zmq;
+
+
+TEST(BufferPoolTest, AcquireReleaseTest)
+{
+  BufferPool pool(64, 4);
+
+  std::vector<char*> buffers;
+  for (int i = 0; i < 4; ++i) {
+    buffers.push_back(pool.acquire());
+  }
+  EXPECT_EQ(4u, pool.in_use());
+  EXPECT_EQ(0u, pool.overflows());
+
+  // Pool is empty; this one comes from the heap.
+  char* extra = pool.acquire();
+  EXPECT_EQ(1u, pool.overflows());
+  pool.release(extra);
+
+  for (int i = 0; i < 4; ++i) {
+    pool.release(buffers[i]);
+  }
+  EXPECT_EQ(0u, pool.in_use());
+
+  // Buffers are recycled.
+  char* again = pool.acquire();
+  EXPECT_EQ(1u, pool.overflows());
+  EXPECT_TRUE(std::find(buffers.begin(), buffers.end(), again) !=
+              buffers.end());
+  pool.release(again);
+}
+
+TEST(BufferPoolTest, SendTest)
+{
+  ::zmq::context_t context(1);
+  const std::string addr = EndPoint::inproc("buffer-pool-test");
+
+  ::zmq::socket_t pull(context, ZMQ_PULL);
+  pull.bind(addr.c_str());
+  ::zmq::socket_t push(context, ZMQ_PUSH);
+  push.connect(addr.c_str());
+
+  BufferPool pool(64, 4);
+  for (int i = 0; i < 100; ++i) {
+    char* buffer = pool.acquire();
+    std::string payload = "message";
+    payload.copy(buffer, payload.size());
+    EXPECT_EQ(payload.size(), pool.send(push, buffer, payload.size()));
+
+    std::string received;
+    receive(pull, &received);
+    EXPECT_EQ(payload, received);
+  }
+
+  // zmq frees the buffers from its own thread once sent.
+  for (int i = 0; i < 100 && pool.in_use() > 0; ++i) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  }
+  EXPECT_EQ(0u, pool.in_use());
+}
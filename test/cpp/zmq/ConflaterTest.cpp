@@ -0,0 +1,118 @@
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/tick_batch.hpp"
+#include "zmq/ConflatingPublisher.hpp"
+
+
+using namespace atp::zmq;
+
+
+static frames_t message(const std::string& topic, const std::string& value)
+{
+  frames_t frames;
+  frames.push_back(topic);
+  frames.push_back(value);
+  return frames;
+}
+
+
+TEST(ConflaterTest, ConflateTest)
+{
+  Conflater backlog;
+
+  backlog.add(message("AAPL.STK", "bid 1"), "AAPL.STK:BID");
+  backlog.add(message("AAPL.STK", "last 1"), "");
+  backlog.add(message("AAPL.STK", "bid 2"), "AAPL.STK:BID");
+  backlog.add(message("AAPL.STK", "last 2"), "");
+  backlog.add(message("GOOG.STK", "bid 1"), "GOOG.STK:BID");
+  backlog.add(message("AAPL.STK", "bid 3"), "AAPL.STK:BID");
+
+  // Latest bid at the tail, behind the trades; trades are all kept.
+  EXPECT_EQ(4u, backlog.size());
+  EXPECT_EQ(2u, backlog.conflated());
+
+  EXPECT_EQ("last 1", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_EQ("last 2", backlog.front()[1]);
+  backlog.pop();
+
+  // Once sent, a new bid is queued behind the rest.
+  EXPECT_EQ("GOOG.STK", backlog.front()[0]);
+  backlog.pop();
+  EXPECT_EQ("bid 3", backlog.front()[1]);
+  backlog.pop();
+  backlog.add(message("AAPL.STK", "bid 4"), "AAPL.STK:BID");
+  backlog.add(message("AAPL.STK", "last 3"), "");
+  EXPECT_EQ(2u, backlog.size());
+  EXPECT_EQ(2u, backlog.conflated());
+
+  EXPECT_EQ("bid 4", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_EQ("last 3", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_TRUE(backlog.empty());
+}
+
+TEST(ConflaterTest, MaxSizeTest)
+{
+  Conflater backlog(3);
+
+  backlog.add(message("AAPL.STK", "bid 1"), "AAPL.STK:BID");
+  backlog.add(message("AAPL.STK", "last 1"), "");
+  backlog.add(message("AAPL.STK", "last 2"), "");
+  EXPECT_EQ(0u, backlog.dropped());
+
+  // The oldest goes, and its key with it.
+  backlog.add(message("AAPL.STK", "last 3"), "");
+  EXPECT_EQ(3u, backlog.size());
+  EXPECT_EQ(1u, backlog.dropped());
+  backlog.add(message("AAPL.STK", "bid 2"), "AAPL.STK:BID");
+  EXPECT_EQ(0u, backlog.conflated());
+  EXPECT_EQ(2u, backlog.dropped());
+
+  EXPECT_EQ("last 2", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_EQ("last 3", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_EQ("bid 2", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_TRUE(backlog.empty());
+}
+
+/// Bids conflated by topic.
+static bool classify(const frames_t& message, std::string* key)
+{
+  if (message[1].compare(0, 3, "bid") != 0) {
+    return false;
+  }
+  *key = message[0] + ":BID";
+  return true;
+}
+
+TEST(ConflaterTest, TickBatchTest)
+{
+  Conflater backlog;
+
+  const char* records[] = { "bid 1", "last 1", "bid 2" };
+  atp::common::tick_batch batch;
+  for (int i = 0; i < 3; ++i) {
+    size_t size = strlen(records[i]);
+    memcpy(batch.append(size, 0), records[i], size);
+  }
+
+  // Ticks of the batch are queued and conflated one by one.
+  backlog.add_classified(message("AAPL.STK", batch.data()), classify);
+  backlog.add_classified(message("AAPL.STK", "bid 3"), classify);
+  EXPECT_EQ(2u, backlog.size());
+  EXPECT_EQ(2u, backlog.conflated());
+
+  EXPECT_EQ("last 1", backlog.front()[1]);
+  backlog.pop();
+  EXPECT_EQ("bid 3", backlog.front()[1]);
+  EXPECT_EQ("AAPL.STK", backlog.front()[0]);
+  backlog.pop();
+  EXPECT_TRUE(backlog.empty());
+}
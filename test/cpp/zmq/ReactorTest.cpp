@@ -6,11 +6,13 @@
 #include <gtest/gtest.h>
 
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include "common.hpp"
 #include "zmq/Reactor.hpp"
+#include "zmq/RouterReactor.hpp"
 #include "zmq/ZmqUtils.hpp"
 
 
@@ -285,3 +287,56 @@ TEST(ReactorTest, InProcMultiSendReceiveTest)
 
 }
 
+
+
+/// Replies with the request, after a second if the request is "slow".
+struct EchoStrategy : Reactor::Strategy
+{
+  bool respond(zmq::socket_t& socket)
+  {
+    std::string request;
+    atp::zmq::receive(socket, &request);
+    if (request == "slow") {
+      sleep(1);
+    }
+    atp::zmq::send_copy(socket, request, false);
+    return true;
+  }
+};
+
+static Reactor::Strategy* NewEchoStrategy()
+{
+  return new EchoStrategy();
+}
+
+TEST(ReactorTest, RouterReactorTest)
+{
+  zmq::context_t context(1);
+
+  const std::string& addr = atp::zmq::EndPoint::inproc("test.router");
+  RouterReactor reactor(addr, &NewEchoStrategy, 2, &context);
+  ASSERT_EQ(2u, reactor.workers());
+
+  zmq::socket_t slowClient(context, ZMQ_REQ);
+  slowClient.connect(addr.c_str());
+  zmq::socket_t client(context, ZMQ_REQ);
+  client.connect(addr.c_str());
+
+  atp::zmq::send_copy(slowClient, "slow", false);
+  usleep(100000);
+
+  // Handled by the other worker while the slow request is in progress.
+  boost::uint64_t start = now_micros();
+  for (int i = 0; i < 10; ++i) {
+    std::string message = "fast-" + boost::lexical_cast<std::string>(i);
+    atp::zmq::send_copy(client, message, false);
+    std::string reply;
+    atp::zmq::receive(client, &reply);
+    EXPECT_EQ(message, reply);
+  }
+  EXPECT_LT(now_micros() - start, 500000u);
+
+  std::string reply;
+  atp::zmq::receive(slowClient, &reply);
+  EXPECT_EQ("slow", reply);
+}
@@ -0,0 +1,123 @@
+
+#include <string>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "zmq/ShmRing.hpp"
+#include "zmq/ZmqUtils.hpp"
+
+
+using namespace atp::zmq;
+
+
+static frames_t message(const std::string& topic, int i)
+{
+  std::ostringstream payload;
+  payload << "payload-" << i;
+  frames_t frames;
+  frames.push_back(topic);
+  frames.push_back(payload.str());
+  return frames;
+}
+
+
+TEST(ShmRingTest, ReadWriteTest)
+{
+  const std::string endpoint = EndPoint::shm("atp-shm-ring-test");
+  EXPECT_TRUE(ShmRing::is_shm(endpoint));
+  EXPECT_FALSE(ShmRing::is_shm(EndPoint::ipc("atp-shm-ring-test")));
+
+  ShmRingWriter writer(endpoint, 4096);
+
+  ShmRingReader aapl(endpoint);
+  aapl.subscribe("AAPL.");
+  ShmRingReader all(endpoint);
+  all.subscribe("");
+
+  frames_t frames;
+  EXPECT_FALSE(aapl.receive(&frames, 0));  // opens at the latest message
+  EXPECT_FALSE(all.receive(&frames, 0));
+
+  // Wraps around the ring several times; readers keep up.
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(writer.write(message(i % 2 ? "AAPL.STK" : "GOOG.STK", i)));
+
+    if (i % 2) {
+      ASSERT_TRUE(aapl.receive(&frames, 0));
+      EXPECT_EQ(message("AAPL.STK", i), frames);
+    }
+    ASSERT_TRUE(all.receive(&frames, 0));
+    EXPECT_EQ(2u, frames.size());
+    EXPECT_EQ(message(i % 2 ? "AAPL.STK" : "GOOG.STK", i)[1], frames[1]);
+  }
+  EXPECT_FALSE(aapl.receive(&frames, 0));
+  EXPECT_EQ(0u, aapl.overruns());
+  EXPECT_EQ(0u, all.overruns());
+
+  // Larger than half the ring.
+  frames_t big(1, std::string(4096, 'x'));
+  EXPECT_FALSE(writer.write(big));
+}
+
+TEST(ShmRingTest, OverrunTest)
+{
+  const std::string endpoint = EndPoint::shm("atp-shm-ring-test-overrun");
+  ShmRingWriter writer(endpoint, 4096);
+
+  ShmRingReader reader(endpoint);
+  reader.subscribe("");
+  frames_t frames;
+  EXPECT_FALSE(reader.receive(&frames, 0));
+
+  // A slow reader is lapped by the writer.
+  for (int i = 0; i < 1000; ++i) {
+    writer.write(message("AAPL.STK", i));
+  }
+  EXPECT_FALSE(reader.receive(&frames, 0));
+  EXPECT_EQ(1u, reader.overruns());
+
+  // and picks up from the latest message.
+  writer.write(message("AAPL.STK", 1000));
+  ASSERT_TRUE(reader.receive(&frames, 0));
+  EXPECT_EQ(message("AAPL.STK", 1000), frames);
+}
+
+static void write_later(ShmRingWriter* writer, const frames_t& frames)
+{
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  writer->write(frames);
+}
+
+TEST(ShmRingTest, WaitTest)
+{
+  const std::string endpoint = EndPoint::shm("atp-shm-ring-test-wait");
+  ShmRingWriter writer(endpoint, 4096);
+
+  ShmRingReader reader(endpoint);
+  reader.subscribe("");
+  frames_t frames;
+  EXPECT_FALSE(reader.receive(&frames, 0));
+
+  // A blocked reader is woken by the write, well before its timeout.
+  boost::thread later(boost::bind(&write_later, &writer,
+                                  message("AAPL.STK", 1)));
+  boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+  ASSERT_TRUE(reader.receive(&frames, 5000000));
+  EXPECT_GT(boost::posix_time::seconds(2),
+            boost::posix_time::microsec_clock::universal_time() - start);
+  EXPECT_EQ(message("AAPL.STK", 1), frames);
+  later.join();
+
+  // Subscriptions changed from another thread apply on the next receive.
+  boost::thread(boost::bind(&ShmRingReader::unsubscribe, &reader,
+                            std::string(""))).join();
+  reader.subscribe("GOOG.");
+  writer.write(message("AAPL.STK", 2));
+  writer.write(message("GOOG.STK", 3));
+  ASSERT_TRUE(reader.receive(&frames, 0));
+  EXPECT_EQ(message("GOOG.STK", 3), frames);
+}